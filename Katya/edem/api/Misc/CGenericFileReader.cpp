@@ -35,14 +35,15 @@ bool from_string(T& toValue,
  *
  * @param toTrim Reference to string to trim
  */
-void trim(std::string& toTrim)
+template <class String>
+void trim(String& toTrim)
 {
     // List of characters to remove
-    static const std::string WHITESPACE = " \t\r\n\v\f";
+    static const char WHITESPACE[] = " \t\r\n\v\f";
 
     // Find first character that is not whitespace
     size_t pos = toTrim.find_first_not_of(WHITESPACE);
-    if (string::npos == pos)
+    if (String::npos == pos)
     {
         // Whole string is whitespace
         toTrim.clear();
@@ -56,14 +57,15 @@ void trim(std::string& toTrim)
 
     // Find last character that is not whitespace
     pos = toTrim.find_last_not_of(WHITESPACE);
-    if (pos != string::npos &&
+    if (pos != String::npos &&
         (pos + 1) < toTrim.length())
     {
         toTrim.erase(pos+1);
     }
 }
 
-CGenericFileReader::CGenericFileReader()
+CGenericFileReader::CGenericFileReader(std::pmr::memory_resource* resource)
+    : m_data(resource)
 {
     // Nothing to do
 }
@@ -73,9 +75,10 @@ CGenericFileReader::~CGenericFileReader()
     // Nothing to do, map clears itself
 }
 
-CGenericFileReader* CGenericFileReader::getReader(const std::string& file)
+CGenericFileReader* CGenericFileReader::getReader(const std::string& file,
+                                                 std::pmr::memory_resource* resource)
 {
-    CGenericFileReader* tmp = new CGenericFileReader();
+    CGenericFileReader* tmp = new CGenericFileReader(resource);
 
     if (0 != tmp)
     {
@@ -109,7 +112,7 @@ bool CGenericFileReader::getString(const std::string& key,
     // Check to see if the key exists in the map
     if (m_data.end() != idx)
     {
-        valueToSet = idx->second;
+        valueToSet.assign(idx->second.data(), idx->second.size());
         return true;
     }
     else
@@ -195,7 +198,9 @@ bool CGenericFileReader::init(const std::string& file)
     //    the end of the file.  We dont stop on eofbit being set
     //    as it may be set when we read the last line of the file
     //    and we need to parse that
-    string line;
+    // The line and its parts live in the map's resource, as the map does
+    std::pmr::memory_resource* resource = m_data.get_allocator().resource();
+    std::pmr::string line(resource);
     while (false == getline(fileStream, line).fail())
     {
         // First remove all leading/trailing white space
@@ -214,7 +219,7 @@ bool CGenericFileReader::init(const std::string& file)
                 0 != pos)
             {
                 //extract the key
-                string key = line.substr(0, pos);
+                std::pmr::string key(line, 0, pos, resource);
 
                 // Move position past the '='
                 pos++;
@@ -222,10 +227,10 @@ bool CGenericFileReader::init(const std::string& file)
                 // Extract the value
                 // If '=' is the last character then we have
                 // an empty value, this is allowed
-                string value;
+                std::pmr::string value(resource);
                 if (pos < line.length())
                 {
-                    value = line.substr(pos);
+                    value.assign(line, pos);
                 }
 
                 // Trim the key and value again incase there was space
@@ -234,7 +239,7 @@ bool CGenericFileReader::init(const std::string& file)
                 trim(value);
 
                 // Store value
-                if (false == m_data.insert(std::make_pair(key,value)).second)
+                if (false == m_data.emplace(std::move(key), std::move(value)).second)
                 {
                     // could not insert due to duplicate key
                     // the file is malformed
@@ -3,7 +3,9 @@
 
 #include <ostream>
 #include <string>
+#include <string_view>
 #include <map>
+#include <memory_resource>
 
 /**
  * This simple class (which acts as its own factory) provides
@@ -88,10 +90,16 @@ public:
      * initialised reader.  This is the only way to
      * create an instance of this class
      *
-     * @param file The full path to the file
+     * The keys and values are stored in the supplied memory
+     * resource, which must outlive the reader; pass an arena
+     * that is released after setup to keep the parse off the heap.
+     *
+     * @param file     The full path to the file
+     * @param resource Where the key->value data is allocated
      * @return The fully initialised file reader.
      */
-    static CGenericFileReader* getReader(const std::string& file);
+    static CGenericFileReader* getReader(const std::string& file,
+                                         std::pmr::memory_resource* resource = std::pmr::get_default_resource());
 
     /**
      * Destructor, deletes and cleans up internal storage.
@@ -171,7 +179,12 @@ private:
     /**
      * Typedef for holding data read from file
      */
-    typedef std::map<std::string, std::string> tStringStringMap;
+    struct SKeyLess
+    {
+        using is_transparent = void;
+        bool operator()(std::string_view a, std::string_view b) const { return a < b; }
+    };
+    typedef std::pmr::map<std::pmr::string, std::pmr::string, SKeyLess> tStringStringMap;
 
     /**
      * Constructor, does nothing.
@@ -179,7 +192,7 @@ private:
      * The constructor is private to stop it being directly
      * called.  Instead use the getReader() static method.
      */
-    CGenericFileReader();
+    explicit CGenericFileReader(std::pmr::memory_resource* resource);
 
     /**
      * Initialise to the file and read whole file.
@@ -0,0 +1,346 @@
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <random>
+#include <vector>
+
+#include "bodyforce.h"
+#include "particlesnapshot.h"
+
+using NApiHelpersV3_0_0::CSimple3DVector;
+using namespace NExternalForceTypesV3_0_0;
+
+/** Host particle store; particle ids are indices */
+class CHostParticles : public NApiCore::IParticleManagerApi_1_3
+{
+public:
+    std::vector<SParticle> particles;
+
+    const SParticle getParticleData( int particleId ) const override { return particles[particleId]; }
+    const double *getCustomPropertyValue( int, unsigned int ) const override { return nullptr; }
+    void markParticleOfInterest( int ) override {}
+    bool resetCustomProperty( const char[], unsigned int, double ) override { return false; }
+    bool resetCustomProperty( const char[], unsigned int, int, double ) override { return false; }
+    int getTotalNumberParticlesPerType( const char[] ) override { return int(particles.size()); }
+    bool markForRemoval( int ) override { return false; }
+    bool setScale( int, double ) override { return false; }
+    double getScale( int ) const override { return 1; }
+    int getTotalNumberParticles() const override { return int(particles.size()); }
+    bool getSurfacePositions( int, double * ) override { return false; }
+    bool resetCustomProperty( const char[], const char[], double ) override { return false; }
+    bool resetCustomProperty( const char[], const char[], int, double ) override { return false; }
+
+    void getApiVersion( NApi::tApiMajorVersion &major, NApi::tApiMinorVersion &minor ) override
+    {
+        major = 1;
+        minor = 3;
+    }
+    NApiCore::EApiId getApiId() const override { return NApiCore::eParticleManager; }
+    bool readOnly() const override { return true; }
+};
+
+/** Smooth analytic vector field; counts the queries it answers */
+class CAnalyticField : public NApiCore::IFieldApi_1_0
+{
+public:
+    mutable size_t queries = 0;
+
+    static void value( double x, double y, double z, double e[3] )
+    {
+        e[0] = std::sin(3 * x);
+        e[1] = std::cos(3 * y);
+        e[2] = x * z + 1;
+    }
+
+    bool fieldIsScalar() override { return false; }
+    bool queryVectorField( double x, double y, double z, unsigned int, NApi::EInterpolationType,
+                           double &rx, double &ry, double &rz ) override
+    {
+        double e[3];
+        value(x, y, z, e);
+        rx = e[0];
+        ry = e[1];
+        rz = e[2];
+        queries++;
+        return true;
+    }
+    bool queryScalarField( double, double, double, unsigned int, NApi::EInterpolationType, double & ) override
+    {
+        return false;
+    }
+
+    void getApiVersion( NApi::tApiMajorVersion &major, NApi::tApiMinorVersion &minor ) override
+    {
+        major = 1;
+        minor = 0;
+    }
+    NApiCore::EApiId getApiId() const override { return NApiCore::eField; }
+    bool readOnly() const override { return true; }
+};
+
+class CFieldManager : public NApiCore::IFieldManagerApi_1_0
+{
+public:
+    CAnalyticField field;
+    /** The named field is not there */
+    bool missing = false;
+
+    IApi *getApi( NApiCore::EApiId, NApi::tApiMajorVersion, NApi::tApiMinorVersion, unsigned int ) override
+    {
+        return &field;
+    }
+    IApi *getApi( NApiCore::EApiId, NApi::tApiMajorVersion, NApi::tApiMinorVersion,
+                  char[NApi::API_BASIC_STRING_LENGTH] ) override
+    {
+        return missing ? nullptr : &field;
+    }
+
+    void getApiVersion( NApi::tApiMajorVersion &major, NApi::tApiMinorVersion &minor ) override
+    {
+        major = 1;
+        minor = 0;
+    }
+    NApiCore::EApiId getApiId() const override { return NApiCore::eFieldManager; }
+    bool readOnly() const override { return true; }
+};
+
+class ApiMgr : public NApiCore::IApiManager_1_0
+{
+public:
+    CFieldManager fields;
+    int released = 0;
+
+    IApi* getApi( NApiCore::EApiId apiId,
+                  NApi::tApiMajorVersion major,
+                  NApi::tApiMinorVersion minor ) override
+    {
+        return apiId == NApiCore::eFieldManager ? &fields : nullptr;
+    }
+
+    void release( IApi* apiInstance ) override
+    {
+        if (apiInstance != nullptr)
+            released++;
+    }
+
+    void getApiVersion( NApi::tApiMajorVersion& major,
+                        NApi::tApiMinorVersion& minor ) override
+    {
+        major = minor = 0;
+    }
+
+    NApiCore::EApiId getApiId() const override
+    {
+        return NApiCore::EApiId::eApiManager;
+    }
+
+    bool readOnly() const override
+    {
+        return false;
+    }
+};
+
+/** Drag written directly against the host structs */
+static CSimple3DVector scalarDrag( const SDragLaw &law, const SParticle &p )
+{
+    const double r = std::cbrt(3 * p.volume / (4 * M_PI));
+    CSimple3DVector w = CSimple3DVector(law.ux, law.uy, law.uz) - p.velocity;
+    return w * (0.5 * law.fluidDensity * law.dragCoefficient * M_PI * r * r * w.length());
+}
+
+/** Field force from the exact field value */
+static CSimple3DVector exactField( const SSampledFieldLaw &law, const SParticle &p )
+{
+    double e[3];
+    CAnalyticField::value(p.position.getX(), p.position.getY(), p.position.getZ(), e);
+    return CSimple3DVector(e[0], e[1], e[2]) * (law.coupling * p.volume);
+}
+
+/**
+ * Runs `steps` host steps of per-particle calls and returns calls per
+ * second; maxRelDiff collects the difference to reference(law, particle).
+ */
+template <class Force, class Reference>
+static double runSteps( Force &force, CHostParticles &host, int steps, Reference reference, double &maxRelDiff )
+{
+    std::mt19937 rng(7);
+    std::uniform_real_distribution<double> jitter(-1e-3, 1e-3);
+    const double dt = 1e-5;
+    double seconds = 0;
+    std::vector<SResults> results(host.particles.size());
+
+    for (int s = 0; s < steps; s++)
+    {
+        for (SParticle &p : host.particles)
+        {
+            p.velocity += CSimple3DVector(jitter(rng), jitter(rng), jitter(rng));
+            p.position += p.velocity * dt;
+        }
+
+        const STimeStepData step = {s * dt, dt};
+        auto start = std::chrono::steady_clock::now();
+        for (size_t i = 0; i < host.particles.size(); i++)
+        {
+            results[i].force = CSimple3DVector();
+            force.externalForce(0, step, host.particles[i], nullptr, nullptr, results[i]);
+        }
+        seconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+        for (size_t i = 0; i < host.particles.size(); i++)
+        {
+            const CSimple3DVector ref = reference(force.getLaw(), host.particles[i]);
+            const double diff = (results[i].force - ref).length() / (ref.length() + 1e-300);
+            maxRelDiff = std::max(maxRelDiff, diff);
+        }
+    }
+    return steps * host.particles.size() / seconds;
+}
+
+int main( int argc, char *argv[] )
+{
+    const size_t n = argc > 1 ? size_t(atol(argv[1])) : 200000;
+    const int steps = 20;
+
+    CHostParticles host;
+    std::mt19937 rng(1);
+    std::uniform_real_distribution<double> u(-1, 1), rad(1e-4, 1e-3);
+    host.particles.resize(n);
+    for (size_t i = 0; i < n; i++)
+    {
+        SParticle &p = host.particles[i];
+        p.ID = int(i);
+        p.type = "Katya";
+        const double r = rad(rng);
+        p.volume = 4.0 / 3.0 * M_PI * r * r * r;
+        p.density = 2650;
+        p.mass = p.volume * p.density;
+        p.NumOfSpheres = 1;
+        p.position = CSimple3DVector(u(rng), u(rng), u(rng));
+        p.velocity = CSimple3DVector(u(rng), u(rng), u(rng));
+    }
+
+    ApiMgr mgr;
+    double diff = 0;
+
+    // the plugin against the same drag written by hand on the host structs
+    CDragForce drag;
+    drag.getLaw().ux = 2;
+    drag.starting(mgr, 1);
+    const double dragRate = runSteps(drag, host, steps, scalarDrag, diff);
+    drag.stopping(mgr);
+
+    std::vector<CSimple3DVector> forces(n);
+    auto start = std::chrono::steady_clock::now();
+    for (int s = 0; s < steps; s++)
+        for (size_t i = 0; i < n; i++)
+            forces[i] = scalarDrag(drag.getLaw(), host.particles[i]);
+    const double handRate = steps * n / std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    printf("particles %zu steps %d\n", n, steps);
+    printf("drag calls      %.3g /s, by hand %.3g /s (x%.2f)\n", dragRate, handRate, dragRate / handRate);
+    printf("max relative difference %.3g\n", diff);
+    if (diff > 1e-12)
+        return 1;
+
+    // field force: one direct query per particle against the cached field
+    std::vector<double> ex(n), ey(n), ez(n);
+    CAnalyticField &field = mgr.fields.field;
+    start = std::chrono::steady_clock::now();
+    for (int s = 0; s < steps; s++)
+        for (size_t i = 0; i < n; i++)
+        {
+            const CSimple3DVector &p = host.particles[i].position;
+            field.queryVectorField(p.getX(), p.getY(), p.getZ(), 8, NApi::eIdw, ex[i], ey[i], ez[i]);
+        }
+    const double directRate = steps * n / std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    printf("\nfield queries   %.3g /s\n", directRate);
+    int status = 0;
+    for (auto kind : {CFieldSampler::EInterpolation::eNearest, CFieldSampler::EInterpolation::eTrilinear})
+    {
+        CSampledFieldForce sampled;
+        SSampledFieldLaw &law = sampled.getLaw();
+        for (int a = 0; a < 3; a++)
+        {
+            law.boxLo[a] = -1.5;
+            law.boxHi[a] = 1.5;
+            law.nodes[a] = 64;
+        }
+        law.refreshInterval = 5e-5;
+        law.interpolation = kind;
+        law.reportError = true;
+        if (!sampled.starting(mgr, 1))
+            return 1;
+
+        field.queries = 0;
+        double fieldDiff = 0;
+        const double rate = runSteps(sampled, host, steps, exactField, fieldDiff);
+        const SFieldSamplerError error = law.getErrorReport();
+
+        // the sampler on its own over the whole particle array
+        std::vector<double> px(n), py(n), pz(n);
+        for (size_t i = 0; i < n; i++)
+        {
+            px[i] = host.particles[i].position.getX();
+            py[i] = host.particles[i].position.getY();
+            pz[i] = host.particles[i].position.getZ();
+        }
+        const SFieldSamplerError whole = law.getSampler().measureError(n, px.data(), py.data(), pz.data(), kind);
+        sampled.stopping(mgr);
+
+        printf("%s calls %.3g /s (x%.2f), snapshots %zu, host queries %zu\n",
+               kind == CFieldSampler::EInterpolation::eNearest ? "nearest  " : "trilinear", rate, rate / directRate,
+               law.getSampler().snapshots(), field.queries);
+        printf("    cache error: max rel %.3g, reported max abs %.3g rms %.3g over %zu points\n",
+               fieldDiff, error.maxAbs, error.rms, error.points);
+        printf("    batched interpolation %.3g points/s, direct queries %.3g points/s\n",
+               n / whole.cachedSeconds, n / whole.directSeconds);
+
+        // a 64^3 snapshot of this field is good to about a percent
+        if (kind == CFieldSampler::EInterpolation::eTrilinear && (fieldDiff > 1e-2 || error.points != SSampledFieldLaw::ERROR_SAMPLES))
+            status = 1;
+    }
+
+    // a law that fails to start hands back the field manager and the field
+    {
+        CSampledFieldForce sampled;
+        SSampledFieldLaw &law = sampled.getLaw();
+        mgr.released = 0;
+        mgr.fields.missing = true;
+        const bool noField = !sampled.starting(mgr, 1) && mgr.released == 1;
+        mgr.fields.missing = false;
+        law.nodes[0] = 1;
+        const bool badBox = !sampled.starting(mgr, 1) && mgr.released == 3;
+        printf("\nfailed starts: %s\n", noField && badBox ? "released" : "LEAKED");
+        if (!noField || !badBox)
+            status = 1;
+    }
+
+    // snapshots on their own: full gathers and a 1% incremental update
+    CParticleSnapshot snapshot;
+    const std::vector<int> ids = CParticleSnapshot::allIds(host, 0);
+    std::vector<int> changed;
+    for (size_t i = 0; i < n; i += 100)
+    {
+        host.particles[i].position += CSimple3DVector(1, 0, 0);
+        changed.push_back(int(i));
+    }
+    printf("\n");
+    for (size_t threads : {size_t(1), size_t(0)})
+    {
+        snapshot.setThreads(threads);
+        snapshot.gather(host, ids);
+        const SSnapshotStats full = snapshot.lastStats();
+        for (size_t i = 0; i < n; i += 100)
+            host.particles[i].position += CSimple3DVector(1, 0, 0);
+        snapshot.update(host, changed);
+        const SSnapshotStats part = snapshot.lastStats();
+        printf("snapshot %2zu threads: full %.3g particles/s, update of %zu in %.3g s (x%.0f cheaper)\n",
+               full.threads, full.fetched / full.seconds, part.fetched, part.seconds, full.seconds / part.seconds);
+    }
+    for (size_t i = 0; i < n; i++)
+        if (snapshot.laneOf(int(i)) != int64_t(i) || snapshot.px[i] != host.particles[i].position.getX())
+            status = 1;
+
+    return status;
+}
@@ -0,0 +1,78 @@
+#include <cmath>
+#include <cstring>
+
+#include "arena.h"
+#include "bodyforce.h"
+
+template <class Law>
+void CBodyForce<Law>::getPreferenceFileName( char prefFileName[] )
+{
+    strncpy(prefFileName, Law::preferenceFile(), NApi::FILE_PATH_MAX_LENGTH);
+}
+
+template <class Law>
+bool CBodyForce<Law>::isThreadSafe()
+{
+    return true;
+}
+
+template <class Law>
+bool CBodyForce<Law>::usesCustomProperties()
+{
+    return false;
+}
+
+template <class Law>
+bool CBodyForce<Law>::setup( NApiCore::IApiManager_1_0 &apiManager, const char prefFile[], char customMsg[] )
+{
+    CArena setupArena;
+    CGenericFileReader *reader = CGenericFileReader::getReader(prefFile, &setupArena);
+    if (reader == nullptr)
+    {
+        strncpy(customMsg, "Cannot read body force config", NApi::ERROR_MSG_MAX_LENGTH);
+        return false;
+    }
+
+    law.configure(*reader);
+    delete reader;
+    return true;
+}
+
+template <class Law>
+bool CBodyForce<Law>::starting( NApiCore::IApiManager_1_0 &apiManager, int numThreads )
+{
+    return law.starting(apiManager);
+}
+
+template <class Law>
+void CBodyForce<Law>::stopping( NApiCore::IApiManager_1_0 &apiManager )
+{
+    law.stopping(apiManager);
+}
+
+template <class Law>
+NApi::ECalculateResult CBodyForce<Law>::externalForce(
+        int threadId,
+        const NExternalForceTypesV3_0_0::STimeStepData &timeStepData,
+        const NExternalForceTypesV3_0_0::SParticle &particle,
+        NApiCore::ICustomPropertyDataApi_1_0 *particleCustomProperties,
+        NApiCore::ICustomPropertyDataApi_1_0 *simulationCustomProperties,
+        NExternalForceTypesV3_0_0::SResults &results )
+{
+    law.beginStep(timeStepData.time);
+
+    // the law takes columns, here of one particle each
+    const double px = particle.position.getX(), py = particle.position.getY(), pz = particle.position.getZ();
+    const double vx = particle.velocity.getX(), vy = particle.velocity.getY(), vz = particle.velocity.getZ();
+    const double radius = std::cbrt(3 * particle.volume / (4 * M_PI));
+    double fx, fy, fz;
+    law.evaluate(1, timeStepData.time, &px, &py, &pz, &vx, &vy, &vz, &particle.mass, &particle.volume, &radius,
+                 &fx, &fy, &fz);
+    results.force += NApiHelpersV3_0_0::CSimple3DVector(fx, fy, fz);
+    return NApi::eSuccess;
+}
+
+template class CBodyForce<SDragLaw>;
+template class CBodyForce<SConfiningPressureLaw>;
+template class CBodyForce<SUniformFieldLaw>;
+template class CBodyForce<SSampledFieldLaw>;
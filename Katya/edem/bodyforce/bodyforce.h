@@ -0,0 +1,56 @@
+#pragma once
+
+#include <Api/Core/ApiTypes.h>
+#include <Api/Core/IApiManager_1_0.h>
+#include <Api/Core/ICustomPropertyDataApi_1_0.h>
+#include <Api/Core/NExternalForceTypesV3_0_0.h>
+
+#include "fieldlaw.h"
+#include "laws.h"
+
+/**
+ * Particle body force plugin evaluating a compile time force Law.
+ *
+ * The host asks for the force of one particle per externalForce() call,
+ * and the call is answered from the particle it passes: the law runs
+ * over that one particle with no dispatch and no copies into batch
+ * columns. Gathering the particles of a step from the particle manager
+ * to evaluate them together costs more than the closed form laws below,
+ * so the plugin does not batch; callers that hold columns already (a
+ * CParticleSnapshot, for instance) can run a law's evaluate() over them.
+ *
+ * The particle body force plugin interface header is not part of the
+ * vendored API, so the class mirrors the V3.0.0 method set rather than
+ * deriving from it.
+ */
+template <class Law>
+class CBodyForce
+{
+public:
+    void getPreferenceFileName( char prefFileName[NApi::FILE_PATH_MAX_LENGTH] );
+    bool isThreadSafe();
+    bool usesCustomProperties();
+    bool setup( NApiCore::IApiManager_1_0& apiManager,
+                const char prefFile[],
+                char customMsg[NApi::ERROR_MSG_MAX_LENGTH] );
+    bool starting( NApiCore::IApiManager_1_0& apiManager, int numThreads );
+    void stopping( NApiCore::IApiManager_1_0& apiManager );
+
+    NApi::ECalculateResult externalForce(
+            int threadId,
+            const NExternalForceTypesV3_0_0::STimeStepData& timeStepData,
+            const NExternalForceTypesV3_0_0::SParticle& particle,
+            NApiCore::ICustomPropertyDataApi_1_0* particleCustomProperties,
+            NApiCore::ICustomPropertyDataApi_1_0* simulationCustomProperties,
+            NExternalForceTypesV3_0_0::SResults& results );
+
+    Law &getLaw() { return law; }
+
+private:
+    Law law;
+};
+
+using CDragForce = CBodyForce<SDragLaw>;
+using CConfiningPressureForce = CBodyForce<SConfiningPressureLaw>;
+using CFieldForce = CBodyForce<SUniformFieldLaw>;
+using CSampledFieldForce = CBodyForce<SSampledFieldLaw>;
@@ -0,0 +1,172 @@
+#include <algorithm>
+#include <cstring>
+#include <vector>
+
+#include "fieldlaw.h"
+
+void SSampledFieldLaw::configure( CGenericFileReader &reader )
+{
+    const char *axes = "xyz";
+    for (int a = 0; a < 3; a++)
+    {
+        const std::string suffix(1, axes[a]);
+        reader.getDouble("box_min_" + suffix, boxLo[a]);
+        reader.getDouble("box_max_" + suffix, boxHi[a]);
+        reader.getInt("nodes_" + suffix, nodes[a]);
+        reader.getDouble("direction_" + suffix, direction[a]);
+    }
+
+    std::string kind;
+    int report = reportError ? 1 : 0;
+    reader.getString("field_name", fieldName);
+    reader.getDouble("refresh_interval", refreshInterval);
+    reader.getString("interpolation", kind);
+    reader.getInt("number_of_points", numberOfPoints);
+    reader.getDouble("coupling", coupling);
+    reader.getInt("report_error", report);
+
+    if (kind == "nearest")
+        interpolation = CFieldSampler::EInterpolation::eNearest;
+    else if (kind == "trilinear")
+        interpolation = CFieldSampler::EInterpolation::eTrilinear;
+    reportError = report != 0;
+}
+
+bool SSampledFieldLaw::starting( NApiCore::IApiManager_1_0 &apiManager )
+{
+    fieldManager = dynamic_cast<NApiCore::IFieldManagerApi_1_0 *>(
+                apiManager.getApi(NApiCore::eFieldManager, 1, 0));
+    if (fieldManager == nullptr)
+        return false;
+
+    char name[NApi::API_BASIC_STRING_LENGTH] = "";
+    strncpy(name, fieldName.c_str(), NApi::API_BASIC_STRING_LENGTH - 1);
+    field = dynamic_cast<NApiCore::IFieldApi_1_0 *>(fieldManager->getApi(NApiCore::eField, 1, 0, name));
+
+    checkedSnapshot = 0;
+    errorSnapshot = 0;
+    errorX.clear();
+    errorY.clear();
+    errorZ.clear();
+    worstError = SFieldSamplerError();
+    if (!sampler.bind(field, boxLo, boxHi, nodes, refreshInterval, unsigned(std::max(numberOfPoints, 1))))
+    {
+        // a missing field or a bad box: hand back what was acquired
+        stopping(apiManager);
+        return false;
+    }
+    return true;
+}
+
+void SSampledFieldLaw::stopping( NApiCore::IApiManager_1_0 &apiManager )
+{
+    {
+        std::lock_guard<std::mutex> lock(errorMutex);
+        if (field != nullptr)
+            measureErrorSamples();
+    }
+    if (field != nullptr)
+        apiManager.release(field);
+    if (fieldManager != nullptr)
+        apiManager.release(fieldManager);
+    field = nullptr;
+    fieldManager = nullptr;
+}
+
+void SSampledFieldLaw::beginStep( double time )
+{
+    sampler.refresh(time);
+}
+
+void SSampledFieldLaw::evaluate( size_t n, double time,
+                                 const double *__restrict px, const double *__restrict py, const double *__restrict pz,
+                                 const double *__restrict vx, const double *__restrict vy, const double *__restrict vz,
+                                 const double *__restrict mass, const double *__restrict volume,
+                                 const double *__restrict radius,
+                                 double *__restrict fx, double *__restrict fy, double *__restrict fz ) const
+{
+    if (!sampler.isBound())
+    {
+        std::fill(fx, fx + n, 0.0);
+        std::fill(fy, fy + n, 0.0);
+        std::fill(fz, fz + n, 0.0);
+        return;
+    }
+
+    if (sampler.components() == 3)
+    {
+        sampler.sample(n, px, py, pz, fx, fy, fz, interpolation);
+        for (size_t i = 0; i < n; i++)
+        {
+            const double c = coupling * volume[i];
+            fx[i] *= c;
+            fy[i] *= c;
+            fz[i] *= c;
+        }
+    }
+    else
+    {
+        // the scalar goes through fz, which is overwritten last
+        sampler.sample(n, px, py, pz, fz, nullptr, nullptr, interpolation);
+        const double dx = direction[0], dy = direction[1], dz = direction[2];
+        for (size_t i = 0; i < n; i++)
+        {
+            const double c = coupling * volume[i] * fz[i];
+            fx[i] = c * dx;
+            fy[i] = c * dy;
+            fz[i] = c * dz;
+        }
+    }
+
+    if (reportError && checkedSnapshot != sampler.snapshots())
+        collectErrorSamples(n, px, py, pz);
+}
+
+void SSampledFieldLaw::collectErrorSamples( size_t n, const double *px, const double *py, const double *pz ) const
+{
+    std::lock_guard<std::mutex> lock(errorMutex);
+    const size_t snapshot = sampler.snapshots();
+    if (checkedSnapshot == snapshot)
+        return;
+    if (errorSnapshot != snapshot)
+    {
+        // points still collected for an earlier snapshot are compared
+        // as they are, the cache error does not depend on the snapshot
+        measureErrorSamples();
+        errorSnapshot = snapshot;
+    }
+
+    const size_t stride = std::max<size_t>(n / ERROR_SAMPLES, 1);
+    for (size_t i = 0; i < n && errorX.size() < ERROR_SAMPLES; i += stride)
+    {
+        errorX.push_back(px[i]);
+        errorY.push_back(py[i]);
+        errorZ.push_back(pz[i]);
+    }
+    if (errorX.size() == ERROR_SAMPLES)
+    {
+        measureErrorSamples();
+        checkedSnapshot = snapshot;
+    }
+}
+
+void SSampledFieldLaw::measureErrorSamples() const
+{
+    if (errorX.empty())
+        return;
+    const SFieldSamplerError error = sampler.measureError(errorX.size(), errorX.data(), errorY.data(),
+                                                          errorZ.data(), interpolation);
+    if (error.maxRel >= worstError.maxRel)
+        worstError = error;
+    errorX.clear();
+    errorY.clear();
+    errorZ.clear();
+}
+
+SFieldSamplerError SSampledFieldLaw::getErrorReport() const
+{
+    std::lock_guard<std::mutex> lock(errorMutex);
+    if (field != nullptr)
+        measureErrorSamples();
+    return worstError;
+}
@@ -0,0 +1,83 @@
+#pragma once
+
+#include <atomic>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include <Api/Core/IFieldApi_1_0.h>
+#include <Api/Core/IFieldManagerApi_1_0.h>
+
+#include "fieldsampler.h"
+#include "laws.h"
+
+/**
+ * Force from a host field, F = coupling * volume * E(position).
+ *
+ * The field named by field_name is snapshotted by a CFieldSampler on a
+ * regular grid over the box and interpolated at the evaluated positions.
+ * A scalar field s acts along `direction`: E = s * direction.
+ *
+ * With report_error = 1 the positions evaluated after each snapshot are
+ * collected, up to ERROR_SAMPLES strided over one evaluation and across
+ * host calls, and compared with direct field queries; the
+ * worst result is kept in getErrorReport().
+ *
+ * The law is a snapshot, not a shortcut: every particle of a step sees
+ * the field of the same instant, the host answers a number of queries
+ * set by the grid rather than the particles, and the error report tells
+ * what the grid costs in accuracy. It is not faster than querying a
+ * cheap field per particle.
+ *
+ * Config keys: field_name, box_min_x/y/z, box_max_x/y/z, nodes_x/y/z,
+ * refresh_interval, interpolation (nearest | trilinear), number_of_points,
+ * coupling, direction_x/y/z, report_error.
+ */
+struct SSampledFieldLaw : SLawBase
+{
+    static const char *preferenceFile() { return "sampledfield.txt"; }
+    /** Points of each error comparison */
+    static constexpr size_t ERROR_SAMPLES = 256;
+
+    void configure( CGenericFileReader &reader );
+    bool starting( NApiCore::IApiManager_1_0 &apiManager );
+    void stopping( NApiCore::IApiManager_1_0 &apiManager );
+    void beginStep( double time );
+
+    void evaluate( size_t n, double time,
+                   const double *__restrict px, const double *__restrict py, const double *__restrict pz,
+                   const double *__restrict vx, const double *__restrict vy, const double *__restrict vz,
+                   const double *__restrict mass, const double *__restrict volume,
+                   const double *__restrict radius,
+                   double *__restrict fx, double *__restrict fy, double *__restrict fz ) const;
+
+    /** Worst comparison so far, points still collected are compared first */
+    SFieldSamplerError getErrorReport() const;
+    CFieldSampler &getSampler() { return sampler; }
+
+    std::string fieldName;
+    double boxLo[3] = {-0.05, -0.05, -0.05};
+    double boxHi[3] = {0.05, 0.05, 0.05};
+    int nodes[3] = {32, 32, 32};
+    double refreshInterval = 0;
+    CFieldSampler::EInterpolation interpolation = CFieldSampler::EInterpolation::eTrilinear;
+    int numberOfPoints = 8;
+    double coupling = 1;
+    double direction[3] = {0, 0, 1};
+    bool reportError = false;
+
+private:
+    void collectErrorSamples( size_t n, const double *px, const double *py, const double *pz ) const;
+    /** Compares the collected points, worstError and the points under errorMutex */
+    void measureErrorSamples() const;
+
+    CFieldSampler sampler;
+    NApiCore::IFieldManagerApi_1_0 *fieldManager = nullptr;
+    NApiCore::IFieldApi_1_0 *field = nullptr;
+
+    mutable std::mutex errorMutex;
+    mutable std::atomic<size_t> checkedSnapshot{0};
+    mutable size_t errorSnapshot = 0;
+    mutable std::vector<double> errorX, errorY, errorZ;
+    mutable SFieldSamplerError worstError;
+};
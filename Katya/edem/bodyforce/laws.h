@@ -0,0 +1,141 @@
+#pragma once
+
+#include <cmath>
+#include <cstddef>
+
+#include <Api/Core/IApiManager_1_0.h>
+#include <CGenericFileReader.h>
+
+/**
+ * Body force laws used as compile time policies of CBodyForce.
+ *
+ * A law reads its parameters in configure() and evaluates n particles
+ * given as columns in evaluate(); CBodyForce passes one particle per
+ * host call. The columns are separate restrict pointers so the loops
+ * vectorise when a caller has many particles at hand. Every law writes
+ * (not adds) fx, fy, fz.
+ *
+ * Laws that need host APIs or per step preparation override the hooks
+ * of SLawBase; beginStep() is called before every evaluation and may be
+ * called from several threads at once.
+ */
+struct SLawBase
+{
+    bool starting( NApiCore::IApiManager_1_0 &apiManager ) { return true; }
+    void stopping( NApiCore::IApiManager_1_0 &apiManager ) {}
+    void beginStep( double time ) {}
+};
+
+/** Quadratic drag in a uniform fluid stream: F = 1/2 rho Cd pi r^2 |u - v| (u - v) */
+struct SDragLaw : SLawBase
+{
+    static const char *preferenceFile() { return "drag.txt"; }
+
+    void configure( CGenericFileReader &reader )
+    {
+        reader.getDouble("fluid_density", fluidDensity);
+        reader.getDouble("drag_coefficient", dragCoefficient);
+        reader.getDouble("fluid_velocity_x", ux);
+        reader.getDouble("fluid_velocity_y", uy);
+        reader.getDouble("fluid_velocity_z", uz);
+    }
+
+    void evaluate( size_t n, double time,
+                   const double *__restrict px, const double *__restrict py, const double *__restrict pz,
+                   const double *__restrict vx, const double *__restrict vy, const double *__restrict vz,
+                   const double *__restrict mass, const double *__restrict volume,
+                   const double *__restrict radius,
+                   double *__restrict fx, double *__restrict fy, double *__restrict fz ) const
+    {
+        const double k = 0.5 * fluidDensity * dragCoefficient * M_PI;
+        for (size_t i = 0; i < n; i++)
+        {
+            const double wx = ux - vx[i], wy = uy - vy[i], wz = uz - vz[i];
+            const double c = k * radius[i] * radius[i] * std::sqrt(wx * wx + wy * wy + wz * wz);
+            fx[i] = c * wx;
+            fy[i] = c * wy;
+            fz[i] = c * wz;
+        }
+    }
+
+    double fluidDensity = 1.2;
+    double dragCoefficient = 0.47;
+    double ux = 0, uy = 0, uz = 0;
+};
+
+/**
+ * Confining pressure of a cylindrical membrane around the z axis through
+ * (cx, cy): particles within `shell` of the boundary radius are pushed
+ * inwards by pressure times their cross section.
+ */
+struct SConfiningPressureLaw : SLawBase
+{
+    static const char *preferenceFile() { return "confining.txt"; }
+
+    void configure( CGenericFileReader &reader )
+    {
+        reader.getDouble("pressure", pressure);
+        reader.getDouble("axis_x", cx);
+        reader.getDouble("axis_y", cy);
+        reader.getDouble("boundary_radius", boundaryRadius);
+        reader.getDouble("shell", shell);
+    }
+
+    void evaluate( size_t n, double time,
+                   const double *__restrict px, const double *__restrict py, const double *__restrict pz,
+                   const double *__restrict vx, const double *__restrict vy, const double *__restrict vz,
+                   const double *__restrict mass, const double *__restrict volume,
+                   const double *__restrict radius,
+                   double *__restrict fx, double *__restrict fy, double *__restrict fz ) const
+    {
+        const double inner = boundaryRadius - shell;
+        for (size_t i = 0; i < n; i++)
+        {
+            const double dx = px[i] - cx, dy = py[i] - cy;
+            const double rho = std::sqrt(dx * dx + dy * dy);
+            const double c = -pressure * M_PI * radius[i] * radius[i] / (rho + 1e-300);
+            const double active = rho > inner ? c : 0.0;
+            fx[i] = active * dx;
+            fy[i] = active * dy;
+            fz[i] = 0;
+        }
+    }
+
+    double pressure = 1e6;
+    double cx = 0, cy = 0;
+    double boundaryRadius = 0.025;
+    double shell = 0.001;
+};
+
+/** Uniform field acting on the particle volume: F = coupling * volume * E */
+struct SUniformFieldLaw : SLawBase
+{
+    static const char *preferenceFile() { return "field.txt"; }
+
+    void configure( CGenericFileReader &reader )
+    {
+        reader.getDouble("coupling", coupling);
+        reader.getDouble("field_x", ex);
+        reader.getDouble("field_y", ey);
+        reader.getDouble("field_z", ez);
+    }
+
+    void evaluate( size_t n, double time,
+                   const double *__restrict px, const double *__restrict py, const double *__restrict pz,
+                   const double *__restrict vx, const double *__restrict vy, const double *__restrict vz,
+                   const double *__restrict mass, const double *__restrict volume,
+                   const double *__restrict radius,
+                   double *__restrict fx, double *__restrict fy, double *__restrict fz ) const
+    {
+        for (size_t i = 0; i < n; i++)
+        {
+            const double c = coupling * volume[i];
+            fx[i] = c * ex;
+            fy[i] = c * ey;
+            fz[i] = c * ez;
+        }
+    }
+
+    double coupling = 1;
+    double ex = 0, ey = 0, ez = 0;
+};
@@ -0,0 +1,131 @@
+#include <cstring>
+
+#include <CGenericFileReader.h>
+
+#include "arena.h"
+#include "bondmodel.h"
+#include "packingsidecar.h"
+
+using NApiHelpersV3_0_0::CSimple3DVector;
+
+void CBondedParticles::getPreferenceFileName( char prefFileName[] )
+{
+    strncpy(prefFileName, "bonds.txt", NApi::FILE_PATH_MAX_LENGTH);
+}
+
+bool CBondedParticles::isThreadSafe()
+{
+    // each bond belongs to exactly one contact
+    return true;
+}
+
+bool CBondedParticles::setup( NApiCore::IApiManager_1_0 &apiManager, const char prefFile[], char customMsg[] )
+{
+    CArena setupArena;
+    CGenericFileReader *reader = CGenericFileReader::getReader(prefFile, &setupArena);
+    if (reader == nullptr)
+    {
+        strncpy(customMsg, "Cannot read bond model config", NApi::ERROR_MSG_MAX_LENGTH);
+        return false;
+    }
+
+    SPackingSource source;
+    SBondParameters params;
+    bool ok = reader->getString("positions", source.centers) && reader->getString("radii", source.radii);
+    reader->getInt("id_offset", idOffset);
+    reader->getDouble("bond_tolerance", params.tolerance);
+    reader->getDouble("bond_radius_multiplier", params.radiusMultiplier);
+    reader->getDouble("normal_stiffness", params.normalStiffness);
+    reader->getDouble("shear_stiffness", params.shearStiffness);
+    reader->getDouble("tensile_strength", params.tensileStrength);
+    reader->getDouble("shear_strength", params.shearStrength);
+    std::string format;
+    reader->getString("ae_output", aeOutput);
+    reader->getString("ae_format", format);
+    reader->getInt("ae_axis", aeAxis);
+    reader->getDouble("ae_length_scale", aeLengthScale);
+    delete reader;
+    aeFormat = format == "binary" ? CAERecorder::EFormat::eBinary : CAERecorder::EFormat::eTsv;
+
+    if (!ok || CPackingSidecar::load(packing, source) == CPackingSidecar::EStatus::eFailed)
+    {
+        strncpy(customMsg, "Cannot read packing for bond model", NApi::ERROR_MSG_MAX_LENGTH);
+        return false;
+    }
+
+    grid.build(packing.x.data(), packing.y.data(), packing.z.data(), packing.size(),
+               2 * packing.maxRadius() * params.tolerance);
+    network.build(packing, grid, params, &setupArena);
+    return true;
+}
+
+bool CBondedParticles::starting( NApiCore::IApiManager_1_0 &apiManager, int numThreads )
+{
+    if (aeOutput.empty())
+        return true;
+    if (!recorder.open(aeOutput, aeFormat, aeAxis, aeLengthScale))
+        return false;
+    network.setRecorder(&recorder);
+    return true;
+}
+
+void CBondedParticles::stopping( NApiCore::IApiManager_1_0 &apiManager )
+{
+    network.setRecorder(nullptr);
+    recorder.close();
+}
+
+NApi::EPluginModelType CBondedParticles::getModelType()
+{
+    return NApi::EPluginModelType::eOptional;
+}
+
+NApi::EPluginExecutionChainPosition CBondedParticles::getExecutionChainPosition()
+{
+    return NApi::EPluginExecutionChainPosition::eAfterBasePos;
+}
+
+NApi::ECalculateResult CBondedParticles::calculateForce(
+        const NCalcForceTypesV3_0_0::STimeStepData &timeStepData,
+        const NCalcForceTypesV3_0_0::SDiscreteElement &element1,
+        NApiCore::ICustomPropertyDataApi_1_0 *element1CustomProperties,
+        const NCalcForceTypesV3_0_0::SDiscreteElement &element2,
+        NApiCore::ICustomPropertyDataApi_1_0 *element2CustomProperties,
+        const NCalcForceTypesV3_0_0::SInteraction &interaction,
+        const NCalcForceTypesV3_0_0::SContact &contact,
+        NApiCore::ICustomPropertyDataApi_1_0 *contactCustomProperties,
+        NApiCore::ICustomPropertyDataApi_1_0 *simulationCustomProperties,
+        NCalcForceTypesV3_0_0::SContactResult &contactResults )
+{
+    if (!element1.isSphere || !element2.isSphere)
+        return NApi::eSuccess;
+
+    const int64_t i = int64_t(element1.ID) - idOffset, j = int64_t(element2.ID) - idOffset;
+    if (i < 0 || j < 0 || size_t(i) >= packing.size() || size_t(j) >= packing.size())
+        return NApi::eSuccess;
+
+    const int64_t b = network.findBond(uint32_t(i), uint32_t(j));
+    if (b < 0)
+        return NApi::eSuccess;
+
+    // the bond state is stored from its first end's point of view
+    const bool swapped = network.first[b] != uint32_t(i);
+    const NCalcForceTypesV3_0_0::SDiscreteElement &e1 = swapped ? element2 : element1;
+    const NCalcForceTypesV3_0_0::SDiscreteElement &e2 = swapped ? element1 : element2;
+
+    const double p1[3] = {e1.position.getX(), e1.position.getY(), e1.position.getZ()};
+    const double p2[3] = {e2.position.getX(), e2.position.getY(), e2.position.getZ()};
+    const double v1[3] = {e1.velocity.getX(), e1.velocity.getY(), e1.velocity.getZ()};
+    const double v2[3] = {e2.velocity.getX(), e2.velocity.getY(), e2.velocity.getZ()};
+    double force[3];
+    if (!network.updateBond(size_t(b), p1, p2, v1, v2, timeStepData.time, timeStepData.timeStep, force))
+        return NApi::eSuccess;
+
+    const double sign = swapped ? -1 : 1;
+    CSimple3DVector shear(network.shearX[b], network.shearY[b], network.shearZ[b]);
+    CSimple3DVector normal = CSimple3DVector(force[0], force[1], force[2]) - shear;
+    contactResults.normalForce += normal * sign;
+    contactResults.tangentialForce += shear * sign;
+
+    return NApi::eSuccess;
+}
@@ -0,0 +1,79 @@
+#pragma once
+
+#include <string>
+
+#include <Api/Core/ApiTypes.h>
+#include <Api/Core/IApiManager_1_0.h>
+#include <Api/Core/ICustomPropertyDataApi_1_0.h>
+#include <Api/Core/NCalcForceTypesV3_0_0.h>
+
+#include "bondnetwork.h"
+
+/**
+ * Bonded-particle contact model.
+ *
+ * setup() loads the same packing the factory emits, indexes it with a
+ * CSpatialGrid and builds the CBondNetwork once. Per contact the bond is
+ * found by scanning the CSR row of element 1, so the lookup costs the
+ * degree of the particle. Particle ids are mapped to packing rows as
+ * `ID - id_offset`, which holds for particles emitted in file order.
+ *
+ * The model chains after the base model; the contact radius of the
+ * particles has to cover the bond length so the host reports bonded
+ * pairs as contacts.
+ *
+ * Config keys (key = value):
+ *     positions, radii        packing files
+ *     id_offset               host id of the first packing row
+ *     bond_tolerance, bond_radius_multiplier,
+ *     normal_stiffness, shear_stiffness,
+ *     tensile_strength, shear_strength
+ *     ae_output               acoustic emission file, no events are recorded if empty
+ *     ae_format               tsv (default) or binary
+ *     ae_axis                 0, 1 or 2: coordinate reported as X-Loc
+ *     ae_length_scale         model length to output length, 1000 for m -> mm
+ *
+ * The event file is opened in starting() and completed in stopping().
+ */
+class CBondedParticles
+{
+public:
+    void getPreferenceFileName( char prefFileName[NApi::FILE_PATH_MAX_LENGTH] );
+    bool isThreadSafe();
+    bool setup( NApiCore::IApiManager_1_0& apiManager,
+                const char prefFile[],
+                char customMsg[NApi::ERROR_MSG_MAX_LENGTH] );
+    bool starting( NApiCore::IApiManager_1_0& apiManager, int numThreads );
+    void stopping( NApiCore::IApiManager_1_0& apiManager );
+
+    NApi::EPluginModelType getModelType();
+    NApi::EPluginExecutionChainPosition getExecutionChainPosition();
+
+    NApi::ECalculateResult calculateForce(
+            const NCalcForceTypesV3_0_0::STimeStepData& timeStepData,
+            const NCalcForceTypesV3_0_0::SDiscreteElement& element1,
+            NApiCore::ICustomPropertyDataApi_1_0* element1CustomProperties,
+            const NCalcForceTypesV3_0_0::SDiscreteElement& element2,
+            NApiCore::ICustomPropertyDataApi_1_0* element2CustomProperties,
+            const NCalcForceTypesV3_0_0::SInteraction& interaction,
+            const NCalcForceTypesV3_0_0::SContact& contact,
+            NApiCore::ICustomPropertyDataApi_1_0* contactCustomProperties,
+            NApiCore::ICustomPropertyDataApi_1_0* simulationCustomProperties,
+            NCalcForceTypesV3_0_0::SContactResult& contactResults );
+
+    const CPacking &getPacking() const { return packing; }
+    CBondNetwork &getNetwork() { return network; }
+    CAERecorder &getRecorder() { return recorder; }
+
+private:
+    CPacking packing;
+    CSpatialGrid grid;
+    CBondNetwork network;
+    int idOffset = 1;
+
+    CAERecorder recorder;
+    std::string aeOutput;
+    CAERecorder::EFormat aeFormat = CAERecorder::EFormat::eTsv;
+    int aeAxis = 0;
+    double aeLengthScale = 1000;
+};
@@ -0,0 +1,171 @@
+#include <algorithm>
+#include <cmath>
+
+#include "bondnetwork.h"
+
+void CBondNetwork::build( const CPacking &packing, const CSpatialGrid &grid, const SBondParameters &parameters,
+                          std::pmr::memory_resource *temporaries )
+{
+    params = parameters;
+    const size_t n = packing.size();
+    const double reach = packing.maxRadius() * params.tolerance;
+
+    first.clear();
+    second.clear();
+    length0.clear();
+
+    std::pmr::vector<uint32_t> candidates(temporaries);
+    for (uint32_t i = 0; i < n; i++)
+    {
+        candidates.clear();
+        grid.forEachCandidate(packing.x[i], packing.y[i], packing.z[i], packing.r[i] * params.tolerance + reach,
+                              [&]( uint32_t j ) { if (j > i) candidates.push_back(j); });
+        std::sort(candidates.begin(), candidates.end());
+
+        for (uint32_t j : candidates)
+        {
+            const double dx = packing.x[i] - packing.x[j];
+            const double dy = packing.y[i] - packing.y[j];
+            const double dz = packing.z[i] - packing.z[j];
+            const double dist = std::sqrt(dx * dx + dy * dy + dz * dz);
+            if (dist <= params.tolerance * (packing.r[i] + packing.r[j]))
+            {
+                first.push_back(i);
+                second.push_back(j);
+                length0.push_back(dist);
+            }
+        }
+    }
+
+    const size_t nb = first.size();
+    area.resize(nb);
+    for (size_t b = 0; b < nb; b++)
+    {
+        const double rb = params.radiusMultiplier * std::min(packing.r[first[b]], packing.r[second[b]]);
+        area[b] = M_PI * rb * rb;
+    }
+    normalForce.assign(nb, 0);
+    shearX.assign(nb, 0);
+    shearY.assign(nb, 0);
+    shearZ.assign(nb, 0);
+    broken.assign(nb, 0);
+    breakTime.assign(nb, 0);
+
+    // both directions of every bond go into the rows
+    rowStart.assign(n + 1, 0);
+    for (size_t b = 0; b < nb; b++)
+    {
+        rowStart[first[b] + 1]++;
+        rowStart[second[b] + 1]++;
+    }
+    for (size_t i = 1; i <= n; i++)
+        rowStart[i] += rowStart[i - 1];
+
+    neighbour.resize(2 * nb);
+    bondOf.resize(2 * nb);
+    std::pmr::vector<uint32_t> fill(rowStart.begin(), rowStart.end() - 1, temporaries);
+    for (size_t b = 0; b < nb; b++)
+    {
+        uint32_t k = fill[first[b]]++;
+        neighbour[k] = second[b];
+        bondOf[k] = uint32_t(b);
+        k = fill[second[b]]++;
+        neighbour[k] = first[b];
+        bondOf[k] = uint32_t(b);
+    }
+}
+
+size_t CBondNetwork::brokenCount() const
+{
+    return size_t(std::count(broken.begin(), broken.end(), 1));
+}
+
+int64_t CBondNetwork::findBond( uint32_t i, uint32_t j ) const
+{
+    if (i + 1 >= rowStart.size())
+        return -1;
+
+    for (uint32_t k = rowStart[i]; k < rowStart[i + 1]; k++)
+        if (neighbour[k] == j)
+            return bondOf[k];
+    return -1;
+}
+
+bool CBondNetwork::updateBond( size_t b, const double p1[3], const double p2[3],
+                               const double v1[3], const double v2[3],
+                               double time, double timeStep, double force[3] )
+{
+    force[0] = force[1] = force[2] = 0;
+    if (broken[b])
+        return false;
+
+    double n[3] = {p1[0] - p2[0], p1[1] - p2[1], p1[2] - p2[2]};
+    const double length = std::sqrt(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]);
+    if (length <= 0)
+        return true;
+    for (double &c : n)
+        c /= length;
+
+    const double a = area[b];
+    // compression positive
+    const double fn = params.normalStiffness * a * (length0[b] - length);
+
+    const double rv[3] = {v1[0] - v2[0], v1[1] - v2[1], v1[2] - v2[2]};
+    const double vn = rv[0] * n[0] + rv[1] * n[1] + rv[2] * n[2];
+    const double ks = params.shearStiffness * a * timeStep;
+    double s[3] = {shearX[b] - ks * (rv[0] - vn * n[0]),
+                   shearY[b] - ks * (rv[1] - vn * n[1]),
+                   shearZ[b] - ks * (rv[2] - vn * n[2])};
+    // keep the shear force in the current bond plane
+    const double sn = s[0] * n[0] + s[1] * n[1] + s[2] * n[2];
+    for (int c = 0; c < 3; c++)
+        s[c] -= sn * n[c];
+
+    const double shearMag = std::sqrt(s[0] * s[0] + s[1] * s[1] + s[2] * s[2]);
+    if (-fn / a > params.tensileStrength || shearMag / a > params.shearStrength)
+    {
+        broken[b] = 1;
+        breakTime[b] = time;
+        if (recorder != nullptr)
+        {
+            // elastic energy of the normal and shear springs at the break
+            const double energy = fn * fn / (2 * params.normalStiffness * a) +
+                                  shearMag * shearMag / (2 * params.shearStiffness * a);
+            const double mid[3] = {(p1[0] + p2[0]) / 2, (p1[1] + p2[1]) / 2, (p1[2] + p2[2]) / 2};
+            recorder->record(time, mid, energy);
+        }
+        return false;
+    }
+
+    normalForce[b] = fn;
+    shearX[b] = s[0];
+    shearY[b] = s[1];
+    shearZ[b] = s[2];
+    for (int c = 0; c < 3; c++)
+        force[c] = fn * n[c] + s[c];
+    return true;
+}
+
+void CBondNetwork::evaluate( const double *px, const double *py, const double *pz,
+                             const double *vx, const double *vy, const double *vz,
+                             double time, double timeStep,
+                             double *fx, double *fy, double *fz )
+{
+    // bonds are ordered by their first end, so this walks the particle
+    // columns front to back
+    for (size_t b = 0; b < first.size(); b++)
+    {
+        if (broken[b])
+            continue;
+
+        const uint32_t i = first[b], j = second[b];
+        const double p1[3] = {px[i], py[i], pz[i]}, p2[3] = {px[j], py[j], pz[j]};
+        const double v1[3] = {vx[i], vy[i], vz[i]}, v2[3] = {vx[j], vy[j], vz[j]};
+        double f[3];
+        if (!updateBond(b, p1, p2, v1, v2, time, timeStep, f))
+            continue;
+
+        fx[i] += f[0]; fy[i] += f[1]; fz[i] += f[2];
+        fx[j] -= f[0]; fy[j] -= f[1]; fz[j] -= f[2];
+    }
+}
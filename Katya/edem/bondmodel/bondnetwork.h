@@ -0,0 +1,84 @@
+#pragma once
+
+#include <cstdint>
+#include <memory_resource>
+#include <vector>
+
+#include "aerecorder.h"
+#include "packing.h"
+#include "spatialgrid.h"
+
+/** Material parameters of the parallel bonds */
+struct SBondParameters
+{
+    double tolerance = 1.0;        /**< pair is bonded if distance <= tolerance * (r1 + r2) */
+    double radiusMultiplier = 1.0; /**< bond radius = multiplier * min(r1, r2) */
+    double normalStiffness = 1e10; /**< normal stiffness per unit area, N/m3 */
+    double shearStiffness = 1e10;  /**< shear stiffness per unit area, N/m3 */
+    double tensileStrength = 1e6;  /**< Pa */
+    double shearStrength = 1e6;    /**< Pa */
+};
+
+/**
+ * Bond network of a packing in compressed sparse row form.
+ *
+ * Row i lists the neighbours of particle i in neighbour[rowStart[i] ..
+ * rowStart[i + 1]), every bond appears in the rows of both of its ends
+ * and bondOf maps a CSR entry to the bond id. Per-bond state is kept in
+ * columns indexed by bond id, bonds are numbered in row order of their
+ * lower end so a sweep over the bonds walks the particles in order.
+ */
+class CBondNetwork
+{
+public:
+    /** Finds all bonded pairs of the packing with the help of the grid, the lists of the search in `temporaries` */
+    void build( const CPacking &packing, const CSpatialGrid &grid, const SBondParameters &params,
+                std::pmr::memory_resource *temporaries = std::pmr::get_default_resource() );
+
+    size_t particleCount() const { return rowStart.empty() ? 0 : rowStart.size() - 1; }
+    size_t bondCount() const { return first.size(); }
+    size_t brokenCount() const;
+
+    /** Bond id between particles i and j or -1, O(degree of i) */
+    int64_t findBond( uint32_t i, uint32_t j ) const;
+
+    /**
+     * Updates the state of bond b from the current positions and
+     * velocities of its ends and returns the force on the first end.
+     * Returns false if the bond is (or just got) broken. A bond that
+     * breaks is reported to the recorder, if any, at its midpoint with
+     * the strain energy stored in it.
+     */
+    bool updateBond( size_t b, const double p1[3], const double p2[3],
+                     const double v1[3], const double v2[3],
+                     double time, double timeStep, double force[3] );
+
+    /**
+     * Evaluates every intact bond and adds the bond forces to the
+     * per-particle force columns.
+     */
+    void evaluate( const double *px, const double *py, const double *pz,
+                   const double *vx, const double *vy, const double *vz,
+                   double time, double timeStep,
+                   double *fx, double *fy, double *fz );
+
+    const SBondParameters &getParameters() const { return params; }
+    void setRecorder( CAERecorder *aeRecorder ) { recorder = aeRecorder; }
+
+    // CSR adjacency
+    tLargeVector<uint32_t> rowStart;
+    tLargeVector<uint32_t> neighbour;
+    tLargeVector<uint32_t> bondOf;
+
+    // per-bond state
+    tLargeVector<uint32_t> first, second;
+    tLargeVector<double> area, length0;
+    tLargeVector<double> normalForce;
+    tLargeVector<double> shearX, shearY, shearZ;
+    tLargeVector<uint8_t> broken;
+    tLargeVector<double> breakTime;
+
+private:
+    SBondParameters params;
+    CAERecorder *recorder = nullptr;
+};
@@ -0,0 +1,264 @@
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <optional>
+#include <thread>
+#include <vector>
+
+#include "bondmodel.h"
+
+class ApiMgr : public NApiCore::IApiManager_1_0
+{
+public:
+    IApi* getApi(NApiCore::EApiId apiId,
+                 NApi::tApiMajorVersion major,
+                 NApi::tApiMinorVersion minor ) override
+    {
+        return nullptr;
+    }
+
+    void release( IApi* apiInstance ) override
+    {
+    }
+
+    void getApiVersion(NApi::tApiMajorVersion& major,
+                       NApi::tApiMinorVersion& minor) override
+    {
+        major = minor = 0;
+    }
+
+    NApiCore::EApiId getApiId() const override
+    {
+        return NApiCore::EApiId::eApiManager;
+    }
+
+    bool readOnly() const override
+    {
+        return false;
+    }
+};
+
+static bool near( double a, double b, double tolerance )
+{
+    return std::fabs(a - b) <= tolerance * std::max(std::fabs(b), 1e-300);
+}
+
+/**
+ * One bond between two touching particles of radius 1 mm along x, its
+ * network built afresh for every check.
+ */
+static bool bondMechanicsOk()
+{
+    CPacking pair;
+    for (int k = 0; k < 2; k++)
+    {
+        pair.x.push_back(2e-3 * k);
+        pair.y.push_back(0);
+        pair.z.push_back(0);
+        pair.r.push_back(1e-3);
+    }
+    CSpatialGrid grid;
+    grid.build(pair.x.data(), pair.y.data(), pair.z.data(), pair.size(), 4e-3);
+    SBondParameters params;
+    params.tolerance = 1.01;
+    params.normalStiffness = 1e10;
+    params.shearStiffness = 5e9;
+    params.tensileStrength = 1e6;
+    params.shearStrength = 2e6;
+    const double area = M_PI * 1e-6;
+    const double p1[3] = {0, 0, 0}, still[3] = {0, 0, 0};
+    const double timeStep = 1e-6;
+    double force[3];
+
+    // stretched by 50 nm: the normal spring pulls the first end towards the second
+    CBondNetwork network;
+    network.build(pair, grid, params);
+    bool ok = network.bondCount() == 1 && network.brokenCount() == 0;
+    const double stretch = 5e-8;
+    const double stretched[3] = {2e-3 + stretch, 0, 0};
+    ok = ok && network.updateBond(0, p1, stretched, still, still, 0, timeStep, force) &&
+         near(force[0], params.normalStiffness * area * stretch, 1e-6) && force[1] == 0 && force[2] == 0 &&
+         near(network.normalForce[0], -params.normalStiffness * area * stretch, 1e-6);
+
+    // sheared at 1 mm/s for one step: an incremental shear force against the motion
+    network.build(pair, grid, params);
+    const double p2[3] = {2e-3, 0, 0};
+    const double sliding[3] = {0, 1e-3, 0};
+    const double shear = params.shearStiffness * area * timeStep * 1e-3;
+    ok = ok && network.updateBond(0, p1, p2, sliding, still, 0, timeStep, force) && near(force[1], -shear, 1e-9) &&
+         std::fabs(force[0]) <= 1e-12 * shear && near(network.shearY[0], -shear, 1e-9);
+    // and it accumulates over the steps
+    ok = ok && network.updateBond(0, p1, p2, sliding, still, 0, timeStep, force) && near(force[1], -2 * shear, 1e-9);
+
+    // past the tensile strength the bond breaks once, records the time and stops pulling;
+    // the recorder gets exactly one event
+    const std::string aeFile = "ae_break_test.txt";
+    CAERecorder recorder;
+    ok = ok && recorder.open(aeFile, CAERecorder::EFormat::eTsv);
+    network.build(pair, grid, params);
+    network.setRecorder(&recorder);
+    const double tensile = 1.5 * params.tensileStrength / params.normalStiffness;
+    const double torn[3] = {2e-3 + tensile, 0, 0};
+    ok = ok && !network.updateBond(0, p1, torn, still, still, 0.25, timeStep, force) &&
+         force[0] == 0 && network.broken[0] == 1 && network.breakTime[0] == 0.25 && network.brokenCount() == 1;
+    ok = ok && !network.updateBond(0, p1, stretched, still, still, 0.5, timeStep, force) && force[0] == 0 &&
+         network.breakTime[0] == 0.25;
+    double fx[2] = {0, 0}, fy[2] = {0, 0}, fz[2] = {0, 0};
+    const double px[2] = {0, 2e-3 + stretch}, zero[2] = {0, 0};
+    network.evaluate(px, zero, zero, zero, zero, zero, 0.75, timeStep, fx, fy, fz);
+    ok = ok && fx[0] == 0 && fx[1] == 0;
+    network.setRecorder(nullptr);
+    recorder.close();
+    ok = ok && recorder.written() == 1 && recorder.dropped() == 0;
+    remove(aeFile.c_str());
+
+    // past the shear strength it breaks too; evaluate applies the force to both ends until then
+    network.build(pair, grid, params);
+    const double speed = 1;
+    const double shearStep = params.shearStiffness * area * timeStep * speed;
+    const double vx[2] = {0, 0}, vy[2] = {speed, 0};
+    const double pxAtRest[2] = {0, 2e-3};
+    const size_t steps = size_t(params.shearStrength * area / shearStep) + 2;
+    size_t brokeAt = 0;
+    for (size_t k = 1; k <= steps && brokeAt == 0; k++)
+    {
+        fx[0] = fx[1] = fy[0] = fy[1] = 0;
+        network.evaluate(pxAtRest, zero, zero, vx, vy, zero, double(k), timeStep, fx, fy, fz);
+        if (network.broken[0])
+            brokeAt = k;
+        else
+            ok = ok && near(fy[0], -double(k) * shearStep, 1e-9) && near(fy[1], double(k) * shearStep, 1e-9);
+    }
+    ok = ok && brokeAt > 0 && brokeAt + 2 >= steps && network.breakTime[0] == double(brokeAt) && fy[0] == 0 &&
+         network.brokenCount() == 1;
+    return ok;
+}
+
+/** A stretched bond of the loaded packing through the contact model, split into normal and shear */
+static bool contactForceOk( CBondedParticles &model )
+{
+    CBondNetwork &network = model.getNetwork();
+    const CPacking &packing = model.getPacking();
+    if (network.bondCount() == 0)
+        return false;
+    const uint32_t i = network.first[0], j = network.second[0];
+
+    NCalcForceTypesV3_0_0::SDiscreteElement e1 = {}, e2 = {};
+    e1.isSphere = e2.isSphere = true;
+    // reported with the ends swapped, so the model has to flip the force
+    e1.ID = int(j) + 1;
+    e2.ID = int(i) + 1;
+    const double dx = packing.x[j] - packing.x[i], dy = packing.y[j] - packing.y[i], dz = packing.z[j] - packing.z[i];
+    const double length = std::sqrt(dx * dx + dy * dy + dz * dz);
+    const double stretch = 1e-4 * network.length0[0];
+    const double scale = (length + stretch) / length;
+    e1.position = NApiHelpersV3_0_0::CSimple3DVector(packing.x[i] + dx * scale, packing.y[i] + dy * scale,
+                                                     packing.z[i] + dz * scale);
+    e2.position = NApiHelpersV3_0_0::CSimple3DVector(packing.x[i], packing.y[i], packing.z[i]);
+    e1.velocity = NApiHelpersV3_0_0::CSimple3DVector(0, 0, 1e-4);
+
+    NCalcForceTypesV3_0_0::STimeStepData step = {0, 1e-6};
+    NCalcForceTypesV3_0_0::SInteraction interaction = {};
+    NCalcForceTypesV3_0_0::SContact contact = {};
+    NCalcForceTypesV3_0_0::SContactResult result;
+    model.calculateForce(step, e1, nullptr, e2, nullptr, interaction, contact, nullptr, nullptr, result);
+
+    // element 1 (the second end) is pulled back towards the first
+    const SBondParameters &params = network.getParameters();
+    const double expected = params.normalStiffness * network.area[0] * stretch;
+    const NApiHelpersV3_0_0::CSimple3DVector &fn = result.normalForce;
+    const double along = -(fn.getX() * dx + fn.getY() * dy + fn.getZ() * dz) / length;
+    const NApiHelpersV3_0_0::CSimple3DVector &ft = result.tangentialForce;
+    const double shearAlong = (ft.getX() * dx + ft.getY() * dy + ft.getZ() * dz) / length;
+    return !network.broken[0] && near(along, expected, 1e-6) && std::fabs(shearAlong) <= 1e-9 * expected &&
+           ft.length() > 0 && ft.getZ() < 0;
+}
+
+int main( int argc, char *argv[] )
+{
+    CBondedParticles model;
+    ApiMgr mgr;
+    char msg[NApi::ERROR_MSG_MAX_LENGTH] = "";
+    if (!model.setup(mgr, argc > 1 ? argv[1] : "bonds.txt", msg))
+    {
+        printf("%s\n", msg);
+        return 1;
+    }
+
+    CBondNetwork &network = model.getNetwork();
+    size_t maxDegree = 0;
+    for (size_t i = 0; i < network.particleCount(); i++)
+        maxDegree = std::max<size_t>(maxDegree, network.rowStart[i + 1] - network.rowStart[i]);
+
+    printf("particles %zu bonds %zu mean degree %.2f max degree %zu\n",
+           network.particleCount(), network.bondCount(),
+           2.0 * network.bondCount() / std::max<size_t>(network.particleCount(), 1), maxDegree);
+
+    // every bond must be found from both of its ends
+    for (size_t b = 0; b < network.bondCount(); b++)
+        if (network.findBond(network.first[b], network.second[b]) != int64_t(b) ||
+            network.findBond(network.second[b], network.first[b]) != int64_t(b))
+            return 1;
+
+    const bool mechanicsOk = bondMechanicsOk();
+    const bool contactOk = contactForceOk(model);
+    printf("bond forces and breakage: %s, contact model: %s\n", mechanicsOk ? "ok" : "FAILED",
+           contactOk ? "ok" : "FAILED");
+    if (!mechanicsOk || !contactOk)
+        return 1;
+
+    // stream breakage events from several threads in 1 ms bursts of 100,
+    // about 4 * 10^5 breaks per second; nothing may be dropped at this rate
+    CAERecorder recorder;
+    if (!recorder.open("ae_test.txt", CAERecorder::EFormat::eTsv))
+        return 1;
+    const int threads = 4, perThread = 100000;
+    auto start = std::chrono::steady_clock::now();
+    std::vector<std::thread> workers;
+    for (int t = 0; t < threads; t++)
+        workers.emplace_back([&, t]()
+        {
+            for (int k = 0; k < perThread; k++)
+            {
+                const double p[3] = {1e-3 * k, 0, 0};
+                recorder.record(1e-6 * k, p, t + 1);
+                if (k % 100 == 99)
+                    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+            }
+        });
+    for (auto &w : workers)
+        w.join();
+    const double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    const size_t dropped = recorder.dropped();
+    recorder.close();
+    remove("ae_test.txt");
+
+    printf("ae events %d recorded in %.3f s (%.3g/s), written %zu dropped %zu\n",
+           threads * perThread, seconds, threads * perThread / seconds, recorder.written(), dropped);
+    if (dropped != 0 || recorder.written() != size_t(threads) * perThread)
+        return 1;
+
+    // a recorder built where a closed one was must not get its thread
+    // rings, and a one-slot ring keeps its losses counted after close
+    std::optional<CAERecorder> slot;
+    const double origin[3] = {0, 0, 0};
+    bool reuseOk = true;
+    for (int round = 0; round < 2; round++)
+    {
+        slot.emplace();
+        reuseOk = reuseOk && slot->open("ae_reuse_test.txt", CAERecorder::EFormat::eTsv, 0, 1000, 1);
+        const int events = round == 0 ? 1 : 1000;
+        for (int k = 0; k < events; k++)
+            slot->record(1e-6 * k, origin, 1);
+        slot->close();
+        reuseOk = reuseOk && slot->written() + slot->dropped() == size_t(events) && slot->written() > 0;
+        slot.reset();
+    }
+    remove("ae_reuse_test.txt");
+    printf("recorder at a reused address: %s\n", reuseOk ? "ok" : "FAILED");
+    if (!reuseOk)
+        return 1;
+
+    return 0;
+}
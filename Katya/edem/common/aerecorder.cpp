@@ -0,0 +1,164 @@
+#include <algorithm>
+#include <chrono>
+
+#include "aerecorder.h"
+
+namespace
+{
+    /** Process-wide, so a thread local cache never mistakes a new recorder at a freed address for a dead one */
+    uint64_t newGeneration()
+    {
+        static std::atomic<uint64_t> last{0};
+        return ++last;
+    }
+}
+
+CEventRing::CEventRing( size_t capacityPow2 )
+    : events(capacityPow2), mask(capacityPow2 - 1)
+{
+}
+
+bool CEventRing::push( const SBreakEvent &event )
+{
+    const size_t h = head.load(std::memory_order_relaxed);
+    if (h - tail.load(std::memory_order_acquire) > mask)
+    {
+        dropped.fetch_add(1, std::memory_order_relaxed);
+        return false;
+    }
+    events[h & mask] = event;
+    head.store(h + 1, std::memory_order_release);
+    return true;
+}
+
+CAERecorder::~CAERecorder()
+{
+    close();
+}
+
+bool CAERecorder::open( const std::string &path, EFormat fmt, int ax, double scale, size_t capacity )
+{
+    close();
+
+    file = fopen(path.c_str(), fmt == EFormat::eBinary ? "wb" : "w");
+    if (file == nullptr)
+        return false;
+
+    format = fmt;
+    axis = std::min(std::max(ax, 0), 2);
+    lengthScale = scale;
+    ringCapacity = 1;
+    while (ringCapacity < capacity)
+        ringCapacity <<= 1;
+    writtenCount = 0;
+    droppedCount = 0;
+    generation = newGeneration();
+
+    if (format == EFormat::eBinary)
+        fwrite("AEB1", 1, 4, file);
+    else
+        fprintf(file, "\"Time [s]\"\t\"X-Loc. [mm]\"\t\"Energy [eu]\"\n");
+
+    running = true;
+    writer = std::thread(&CAERecorder::writerLoop, this);
+    return true;
+}
+
+void CAERecorder::close()
+{
+    if (writer.joinable())
+    {
+        running = false;
+        writer.join();
+    }
+    if (file != nullptr)
+    {
+        fclose(file);
+        file = nullptr;
+    }
+
+    std::lock_guard<std::mutex> lock(ringsMutex);
+    for (auto &ring : rings)
+        droppedCount += ring.second->dropped.load(std::memory_order_relaxed);
+    rings.clear();
+}
+
+size_t CAERecorder::dropped() const
+{
+    std::lock_guard<std::mutex> lock(ringsMutex);
+    size_t total = droppedCount;
+    for (auto &ring : rings)
+        total += ring.second->dropped.load(std::memory_order_relaxed);
+    return total;
+}
+
+CEventRing &CAERecorder::threadRing()
+{
+    struct SCache
+    {
+        const CAERecorder *owner = nullptr;
+        uint64_t generation = 0;
+        CEventRing *ring = nullptr;
+    };
+    thread_local SCache cache;
+
+    if (cache.owner == this && cache.generation == generation)
+        return *cache.ring;
+
+    std::lock_guard<std::mutex> lock(ringsMutex);
+    const std::thread::id self = std::this_thread::get_id();
+    auto it = std::find_if(rings.begin(), rings.end(), [&]( auto &ring ) { return ring.first == self; });
+    if (it == rings.end())
+    {
+        rings.emplace_back(self, std::make_unique<CEventRing>(ringCapacity));
+        it = rings.end() - 1;
+    }
+    cache = {this, generation, it->second.get()};
+    return *cache.ring;
+}
+
+void CAERecorder::record( double time, const double position[3], double energy )
+{
+    if (!isOpen())
+        return;
+    threadRing().push({time, position[axis] * lengthScale, energy});
+}
+
+size_t CAERecorder::drainAll()
+{
+    pending.clear();
+    {
+        std::lock_guard<std::mutex> lock(ringsMutex);
+        for (auto &ring : rings)
+            ring.second->drain([&]( const SBreakEvent &e ) { pending.push_back(e); });
+    }
+    if (pending.empty())
+        return 0;
+
+    std::sort(pending.begin(), pending.end(),
+              []( const SBreakEvent &a, const SBreakEvent &b ) { return a.time < b.time; });
+
+    if (format == EFormat::eBinary)
+        for (const SBreakEvent &e : pending)
+        {
+            const double row[3] = {e.time, e.location, e.energy};
+            fwrite(row, sizeof(double), 3, file);
+        }
+    else
+        for (const SBreakEvent &e : pending)
+            fprintf(file, "%.9g\t%.9g\t%.9g\n", e.time, e.location, e.energy);
+
+    writtenCount += pending.size();
+    return pending.size();
+}
+
+void CAERecorder::writerLoop()
+{
+    while (running.load(std::memory_order_relaxed))
+    {
+        if (drainAll() == 0)
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    drainAll();
+    fflush(file);
+}
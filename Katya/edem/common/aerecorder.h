@@ -0,0 +1,115 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <cstdio>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+/** One acoustic emission event: a bond that broke */
+struct SBreakEvent
+{
+    double time;
+    double location;
+    double energy;
+};
+
+/**
+ * Single producer / single consumer ring of events. The producing
+ * thread only writes head, the writer thread only writes tail, so
+ * neither side ever blocks the other.
+ */
+class CEventRing
+{
+public:
+    explicit CEventRing( size_t capacityPow2 );
+
+    bool push( const SBreakEvent &event );
+    template <class F> size_t drain( F &&consume );
+
+    std::atomic<size_t> dropped{0};
+
+private:
+    std::vector<SBreakEvent> events;
+    size_t mask;
+    alignas(64) std::atomic<size_t> head{0};
+    alignas(64) std::atomic<size_t> tail{0};
+};
+
+/**
+ * Records bond breakage events from the force loop threads and streams
+ * them to disk in the `Time / X-Loc / Energy` layout of the AE series
+ * analysed in distr/.
+ *
+ * record() is wait free: every thread owns a CEventRing that is found
+ * through a thread local cache and only registered (under a mutex) the
+ * first time the thread records. A background thread drains the rings
+ * about every millisecond and writes the events sorted by time within
+ * each drain. If a ring is full the event is counted as dropped instead
+ * of stalling the caller.
+ *
+ * Formats: TSV with the same header as the experimental series, or a
+ * binary file of "AEB1" followed by (time, location, energy) doubles.
+ */
+class CAERecorder
+{
+public:
+    enum class EFormat { eTsv, eBinary };
+
+    ~CAERecorder();
+
+    /**
+     * Opens the output and starts the writer thread.
+     * @param axis Coordinate (0, 1, 2) reported as the event location
+     * @param lengthScale Multiplier from model units to output units (m -> mm by default)
+     */
+    bool open( const std::string &path, EFormat format, int axis = 0,
+               double lengthScale = 1000, size_t ringCapacity = 1 << 16 );
+    /** Stops the writer after draining everything recorded so far */
+    void close();
+    bool isOpen() const { return running.load(std::memory_order_relaxed); }
+
+    void record( double time, const double position[3], double energy );
+
+    size_t written() const { return writtenCount; }
+    /** Events lost to full rings since open(), still valid after close() */
+    size_t dropped() const;
+
+private:
+    CEventRing &threadRing();
+    void writerLoop();
+    size_t drainAll();
+
+    FILE *file = nullptr;
+    EFormat format = EFormat::eTsv;
+    int axis = 0;
+    double lengthScale = 1;
+    size_t ringCapacity = 1 << 16;
+    /** Drawn process-wide by every open(), see threadRing() */
+    uint64_t generation = 0;
+
+    mutable std::mutex ringsMutex;
+    std::vector<std::pair<std::thread::id, std::unique_ptr<CEventRing>>> rings;
+    /** Dropped by the rings close() let go of */
+    size_t droppedCount = 0;
+
+    std::vector<SBreakEvent> pending;
+    size_t writtenCount = 0;
+
+    std::atomic<bool> running{false};
+    std::thread writer;
+};
+
+template <class F>
+size_t CEventRing::drain( F &&consume )
+{
+    const size_t t = tail.load(std::memory_order_relaxed);
+    const size_t h = head.load(std::memory_order_acquire);
+    for (size_t k = t; k != h; k++)
+        consume(events[k & mask]);
+    tail.store(h, std::memory_order_release);
+    return h - t;
+}
@@ -0,0 +1,81 @@
+#include <algorithm>
+#include <cstdint>
+
+#include "arena.h"
+
+CArena::CArena( size_t firstChunk, std::pmr::memory_resource *upstreamResource )
+    : upstream(upstreamResource), firstSize(std::max<size_t>(firstChunk, 256))
+{
+}
+
+CArena::~CArena()
+{
+    release();
+}
+
+void CArena::rewind( SMark position )
+{
+    current = position.chunk;
+    offset = position.offset;
+}
+
+void CArena::release()
+{
+    for (const SChunk &chunk : chunks)
+        upstream->deallocate(chunk.data, chunk.size, alignof(std::max_align_t));
+    chunks.clear();
+    current = offset = 0;
+}
+
+size_t CArena::used() const
+{
+    size_t total = offset;
+    for (size_t c = 0; c < current && c < chunks.size(); c++)
+        total += chunks[c].size;
+    return total;
+}
+
+size_t CArena::reserved() const
+{
+    size_t total = 0;
+    for (const SChunk &chunk : chunks)
+        total += chunk.size;
+    return total;
+}
+
+void *CArena::do_allocate( size_t bytes, size_t alignment )
+{
+    auto fit = [bytes, alignment]( const SChunk &chunk, size_t from ) -> char *
+    {
+        const uintptr_t base = uintptr_t(chunk.data);
+        const uintptr_t aligned = (base + from + alignment - 1) / alignment * alignment;
+        return aligned - base + bytes <= chunk.size ? chunk.data + (aligned - base) : nullptr;
+    };
+
+    // the current chunk, then the kept ones after it; a chunk too small
+    // for this request stays unused until the next rewind
+    for (size_t c = current; c < chunks.size(); c++)
+    {
+        char *block = fit(chunks[c], c == current ? offset : 0);
+        if (block != nullptr)
+        {
+            current = c;
+            offset = size_t(block - chunks[c].data) + bytes;
+            return block;
+        }
+    }
+
+    const size_t size = std::max(chunks.empty() ? firstSize : 2 * chunks.back().size, bytes + alignment);
+    chunks.push_back({static_cast<char *>(upstream->allocate(size, alignof(std::max_align_t))), size});
+    allocations++;
+    current = chunks.size() - 1;
+    char *block = fit(chunks.back(), 0);
+    offset = size_t(block - chunks.back().data) + bytes;
+    return block;
+}
+
+CArena &CArena::scratch()
+{
+    thread_local CArena arena;
+    return arena;
+}
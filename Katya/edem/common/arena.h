@@ -0,0 +1,90 @@
+#pragma once
+
+#include <cstddef>
+#include <memory_resource>
+#include <vector>
+
+/**
+ * Bump allocator over a chain of chunks, for std::pmr containers of
+ * short-lived objects.
+ *
+ * deallocate() does nothing: memory comes back all at once through
+ * reset(), which rewinds to the first chunk in O(1) and keeps every
+ * chunk for the next round, or through rewind() to a mark(), which
+ * gives back only what was allocated after it. After a warm-up round
+ * the arena asks nothing of its upstream resource; release() returns
+ * the chunks to it. Chunks double in size, so a round of any size needs
+ * few of them.
+ *
+ * Not thread safe: one arena per thread, see scratch().
+ */
+class CArena : public std::pmr::memory_resource
+{
+public:
+    /** Position to rewind() to */
+    struct SMark
+    {
+        size_t chunk = 0;
+        size_t offset = 0;
+    };
+
+    explicit CArena( size_t firstChunk = size_t(64) << 10,
+                     std::pmr::memory_resource *upstream = std::pmr::new_delete_resource() );
+    ~CArena() override;
+    CArena( const CArena & ) = delete;
+    CArena &operator=( const CArena & ) = delete;
+
+    SMark mark() const { return {current, offset}; }
+    void rewind( SMark position );
+    void reset() { rewind(SMark()); }
+    /** Returns every chunk upstream */
+    void release();
+
+    /** Bytes handed out since the last reset, alignment included */
+    size_t used() const;
+    /** Bytes of the chunks kept */
+    size_t reserved() const;
+    /** Chunks taken from upstream since construction */
+    size_t upstreamAllocations() const { return allocations; }
+
+    /**
+     * Scratch arena of the calling thread, for temporaries of one call
+     * (a timestep, a batch); take it through CArenaScope so the call
+     * leaves it as it found it.
+     */
+    static CArena &scratch();
+
+private:
+    void *do_allocate( size_t bytes, size_t alignment ) override;
+    void do_deallocate( void *, size_t, size_t ) override {}
+    bool do_is_equal( const std::pmr::memory_resource &other ) const noexcept override { return this == &other; }
+
+    struct SChunk
+    {
+        char *data;
+        size_t size;
+    };
+
+    std::pmr::memory_resource *upstream;
+    std::vector<SChunk> chunks;
+    size_t firstSize;
+    size_t current = 0;
+    size_t offset = 0;
+    size_t allocations = 0;
+};
+
+/** Gives back on destruction what was taken from an arena during its life */
+class CArenaScope
+{
+public:
+    explicit CArenaScope( CArena &scopeArena ) : arena(scopeArena), start(scopeArena.mark()) {}
+    ~CArenaScope() { arena.rewind(start); }
+    CArenaScope( const CArenaScope & ) = delete;
+    CArenaScope &operator=( const CArenaScope & ) = delete;
+
+    CArena &resource() { return arena; }
+
+private:
+    CArena &arena;
+    CArena::SMark start;
+};
@@ -0,0 +1,392 @@
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstdio>
+#include <fstream>
+#include <sstream>
+
+#include "clump.h"
+#include "parallel.h"
+
+bool CClumpTemplate::read( const std::string &path )
+{
+    std::ifstream file(path);
+    if (!file)
+        return false;
+
+    std::string name;
+    std::vector<SClumpSphere> list;
+    std::string line;
+    while (std::getline(file, line))
+    {
+        line = line.substr(0, line.find('#'));
+        std::istringstream fields(line);
+        if (name.empty())
+        {
+            fields >> name;
+            continue;
+        }
+        SClumpSphere sphere;
+        if (!(fields >> sphere.x))
+            continue;
+        if (!(fields >> sphere.y >> sphere.z >> sphere.r) || !(sphere.r > 0))
+            return false;
+        list.push_back(sphere);
+    }
+    if (name.empty() || list.empty())
+        return false;
+    assign(name, list);
+    return true;
+}
+
+void CClumpTemplate::assign( const std::string &type, const std::vector<SClumpSphere> &list )
+{
+    typeName = type;
+    spheres = list;
+    massProperties = SClumpMass();
+}
+
+double CClumpTemplate::boundingRadius() const
+{
+    double radius = 0;
+    for (const SClumpSphere &s : spheres)
+        radius = std::max(radius, std::sqrt(s.x * s.x + s.y * s.y + s.z * s.z) + s.r);
+    return radius;
+}
+
+double CClumpTemplate::minRadius() const
+{
+    double radius = spheres.empty() ? 0 : spheres[0].r;
+    for (const SClumpSphere &s : spheres)
+        radius = std::min(radius, s.r);
+    return radius;
+}
+
+void CClumpTemplate::integrate( int n, size_t threads, double sums[10] ) const
+{
+    double lo[3] = {spheres[0].x, spheres[0].y, spheres[0].z}, hi[3] = {lo[0], lo[1], lo[2]};
+    for (const SClumpSphere &s : spheres)
+    {
+        const double c[3] = {s.x, s.y, s.z};
+        for (int a = 0; a < 3; a++)
+        {
+            lo[a] = std::min(lo[a], c[a] - s.r);
+            hi[a] = std::max(hi[a], c[a] + s.r);
+        }
+    }
+    // moments are taken about the box centre, the caller shifts them back
+    double mid[3];
+    for (int a = 0; a < 3; a++)
+        mid[a] = 0.5 * (lo[a] + hi[a]);
+    const double hy = (hi[1] - lo[1]) / n, hz = (hi[2] - lo[2]) / n, w = hy * hz;
+
+    std::vector<std::array<double, 10>> layers(static_cast<size_t>(n));
+    parallelFor(0, size_t(n), threads, [&]( size_t k0, size_t k1 )
+    {
+        std::vector<double> sx, sy, rho2, reach;
+        std::vector<std::pair<double, double>> intervals;
+        for (size_t k = k0; k < k1; k++)
+        {
+            std::array<double, 10> &sum = layers[k];
+            sum.fill(0);
+            const double z = lo[2] + (double(k) + 0.5) * hz - mid[2];
+
+            // sections of the spheres crossing this layer, as structure of arrays
+            sx.clear();
+            sy.clear();
+            rho2.clear();
+            for (const SClumpSphere &s : spheres)
+            {
+                const double dz = z - (s.z - mid[2]), r2 = s.r * s.r - dz * dz;
+                if (r2 <= 0)
+                    continue;
+                sx.push_back(s.x - mid[0]);
+                sy.push_back(s.y - mid[1]);
+                rho2.push_back(r2);
+            }
+            if (sx.empty())
+                continue;
+            reach.resize(sx.size());
+
+            for (int j = 0; j < n; j++)
+            {
+                const double y = lo[1] + (j + 0.5) * hy - mid[1];
+                const size_t m = sx.size();
+                for (size_t s = 0; s < m; s++)
+                    reach[s] = rho2[s] - (y - sy[s]) * (y - sy[s]);
+
+                intervals.clear();
+                for (size_t s = 0; s < m; s++)
+                    if (reach[s] > 0)
+                    {
+                        const double half = std::sqrt(reach[s]);
+                        intervals.emplace_back(sx[s] - half, sx[s] + half);
+                    }
+                if (intervals.empty())
+                    continue;
+                std::sort(intervals.begin(), intervals.end());
+
+                // x moments of the merged intervals, exact
+                double length = 0, first = 0, second = 0;
+                double a = intervals[0].first, b = intervals[0].second;
+                auto close = [&]()
+                {
+                    length += b - a;
+                    first += 0.5 * (b * b - a * a);
+                    second += (b * b * b - a * a * a) / 3;
+                };
+                for (size_t i = 1; i < intervals.size(); i++)
+                {
+                    if (intervals[i].first > b)
+                    {
+                        close();
+                        a = intervals[i].first;
+                    }
+                    b = std::max(b, intervals[i].second);
+                }
+                close();
+
+                sum[0] += w * length;
+                sum[1] += w * first;
+                sum[2] += w * y * length;
+                sum[3] += w * z * length;
+                sum[4] += w * second;
+                sum[5] += w * y * y * length;
+                sum[6] += w * z * z * length;
+                sum[7] += w * y * first;
+                sum[8] += w * z * first;
+                sum[9] += w * y * z * length;
+            }
+        }
+    }, 4);
+
+    // layers are added in order, so the result does not depend on the threads
+    std::fill(sums, sums + 10, 0.0);
+    for (const std::array<double, 10> &layer : layers)
+        for (int m = 0; m < 10; m++)
+            sums[m] += layer[m];
+    // back to the template origin
+    const double v = sums[0], sx = sums[1], sy = sums[2], sz = sums[3];
+    sums[4] += 2 * mid[0] * sx + mid[0] * mid[0] * v;
+    sums[5] += 2 * mid[1] * sy + mid[1] * mid[1] * v;
+    sums[6] += 2 * mid[2] * sz + mid[2] * mid[2] * v;
+    sums[7] += mid[0] * sy + mid[1] * sx + mid[0] * mid[1] * v;
+    sums[8] += mid[0] * sz + mid[2] * sx + mid[0] * mid[2] * v;
+    sums[9] += mid[1] * sz + mid[2] * sy + mid[1] * mid[2] * v;
+    sums[1] += mid[0] * v;
+    sums[2] += mid[1] * v;
+    sums[3] += mid[2] * v;
+}
+
+namespace
+{
+    /** Volume, centre and central inertia from the raw moments */
+    SClumpMass massOf( const double sums[10] )
+    {
+        SClumpMass mass;
+        const double v = sums[0];
+        mass.volume = v;
+        if (v <= 0)
+            return mass;
+        for (int a = 0; a < 3; a++)
+            mass.centre[a] = sums[1 + a] / v;
+        const double *c = mass.centre;
+        const double xx = sums[4] - v * c[0] * c[0], yy = sums[5] - v * c[1] * c[1], zz = sums[6] - v * c[2] * c[2];
+        const double xy = sums[7] - v * c[0] * c[1], xz = sums[8] - v * c[0] * c[2], yz = sums[9] - v * c[1] * c[2];
+        const double inertia[9] = {yy + zz, -xy, -xz,
+                                   -xy, xx + zz, -yz,
+                                   -xz, -yz, xx + yy};
+        std::copy(inertia, inertia + 9, mass.inertia);
+        return mass;
+    }
+}
+
+bool CClumpTemplate::compute( double tolerance, size_t threads )
+{
+    massProperties = SClumpMass();
+    if (spheres.empty())
+        return false;
+
+    const int MAX_RESOLUTION = 8192;
+    const double bound = boundingRadius();
+    double sums[10];
+    int n = 32;
+    integrate(n, threads, sums);
+    SClumpMass coarse = massOf(sums);
+    for (;;)
+    {
+        n *= 2;
+        integrate(n, threads, sums);
+        SClumpMass fine = massOf(sums);
+        if (fine.volume <= 0)
+            return false;
+
+        double largest = 0;
+        for (int i = 0; i < 9; i++)
+            largest = std::max(largest, std::fabs(fine.inertia[i]));
+        double error = std::fabs(fine.volume - coarse.volume) / fine.volume;
+        for (int a = 0; a < 3; a++)
+            error = std::max(error, std::fabs(fine.centre[a] - coarse.centre[a]) / bound);
+        for (int i = 0; i < 9; i++)
+            error = std::max(error, std::fabs(fine.inertia[i] - coarse.inertia[i]) / largest);
+        fine.error = error;
+        fine.resolution = n;
+        coarse = fine;
+        if (error <= tolerance || n >= MAX_RESOLUTION)
+            break;
+    }
+
+    principalAxes(coarse.inertia, coarse.moments, coarse.axes);
+    massProperties = coarse;
+    return massProperties.error <= tolerance;
+}
+
+void CClumpTemplate::principalAxes( const double matrix[9], double values[3], double vectors[9] )
+{
+    double a[3][3], v[3][3] = {{1, 0, 0}, {0, 1, 0}, {0, 0, 1}};
+    for (int i = 0; i < 3; i++)
+        for (int j = 0; j < 3; j++)
+            a[i][j] = 0.5 * (matrix[3 * i + j] + matrix[3 * j + i]);
+
+    // cyclic Jacobi: zero each off-diagonal element in turn
+    for (int sweep = 0; sweep < 50; sweep++)
+    {
+        const double off = a[0][1] * a[0][1] + a[0][2] * a[0][2] + a[1][2] * a[1][2];
+        const double diag = a[0][0] * a[0][0] + a[1][1] * a[1][1] + a[2][2] * a[2][2];
+        if (off <= 1e-30 * diag || off == 0)
+            break;
+        for (int p = 0; p < 2; p++)
+            for (int q = p + 1; q < 3; q++)
+            {
+                if (a[p][q] == 0)
+                    continue;
+                const double theta = (a[q][q] - a[p][p]) / (2 * a[p][q]);
+                const double t = (theta >= 0 ? 1 : -1) / (std::fabs(theta) + std::sqrt(theta * theta + 1));
+                const double c = 1 / std::sqrt(t * t + 1), s = t * c;
+                for (int k = 0; k < 3; k++)
+                {
+                    const double kp = a[k][p], kq = a[k][q];
+                    a[k][p] = c * kp - s * kq;
+                    a[k][q] = s * kp + c * kq;
+                }
+                for (int k = 0; k < 3; k++)
+                {
+                    const double pk = a[p][k], qk = a[q][k];
+                    a[p][k] = c * pk - s * qk;
+                    a[q][k] = s * pk + c * qk;
+                }
+                for (int k = 0; k < 3; k++)
+                {
+                    const double kp = v[k][p], kq = v[k][q];
+                    v[k][p] = c * kp - s * kq;
+                    v[k][q] = s * kp + c * kq;
+                }
+            }
+    }
+
+    int order[3] = {0, 1, 2};
+    std::sort(order, order + 3, [&a]( int i, int j ) { return a[i][i] < a[j][j]; });
+    for (int c = 0; c < 3; c++)
+    {
+        values[c] = a[order[c]][order[c]];
+        for (int r = 0; r < 3; r++)
+            vectors[3 * r + c] = v[r][order[c]];
+    }
+    // a proper rotation: the third axis is the cross product of the first two
+    const double *m = vectors;
+    const double det = m[0] * (m[4] * m[8] - m[5] * m[7]) - m[1] * (m[3] * m[8] - m[5] * m[6]) +
+                       m[2] * (m[3] * m[7] - m[4] * m[6]);
+    if (det < 0)
+        for (int r = 0; r < 3; r++)
+            vectors[3 * r + 2] = -vectors[3 * r + 2];
+}
+
+std::vector<SClumpSphere> CClumpTemplate::principalSpheres() const
+{
+    const double *c = massProperties.centre, *axes = massProperties.axes;
+    std::vector<SClumpSphere> list;
+    for (const SClumpSphere &s : spheres)
+    {
+        const double d[3] = {s.x - c[0], s.y - c[1], s.z - c[2]};
+        SClumpSphere local;
+        local.x = axes[0] * d[0] + axes[3] * d[1] + axes[6] * d[2];
+        local.y = axes[1] * d[0] + axes[4] * d[1] + axes[7] * d[2];
+        local.z = axes[2] * d[0] + axes[5] * d[1] + axes[8] * d[2];
+        local.r = s.r;
+        list.push_back(local);
+    }
+    return list;
+}
+
+void CClumpTemplate::placement( const double origin[3], const double rotation[9], double scale,
+                                double position[3], double orientation[9] ) const
+{
+    const double *c = massProperties.centre, *axes = massProperties.axes;
+    for (int r = 0; r < 3; r++)
+    {
+        position[r] = origin[r] + scale * (rotation[3 * r] * c[0] + rotation[3 * r + 1] * c[1] +
+                                           rotation[3 * r + 2] * c[2]);
+        for (int col = 0; col < 3; col++)
+            orientation[3 * r + col] = rotation[3 * r] * axes[col] + rotation[3 * r + 1] * axes[3 + col] +
+                                       rotation[3 * r + 2] * axes[6 + col];
+    }
+}
+
+CClumpLibrary &CClumpLibrary::instance()
+{
+    static CClumpLibrary library;
+    return library;
+}
+
+std::shared_ptr<const CClumpTemplate> CClumpLibrary::acquire( const std::string &path, double tolerance,
+                                                              size_t threads )
+{
+    auto clump = std::make_shared<CClumpTemplate>();
+    if (!clump->read(path))
+        return nullptr;
+
+    char number[32];
+    snprintf(number, sizeof(number), "%.17g", tolerance);
+    std::string key = clump->type() + '|' + number;
+    for (const SClumpSphere &s : clump->getSpheres())
+    {
+        snprintf(number, sizeof(number), "|%a %a %a %a", s.x, s.y, s.z, s.r);
+        key += number;
+    }
+
+    std::lock_guard<std::mutex> lock(mutex);
+    auto entry = entries.find(key);
+    if (entry != entries.end())
+    {
+        std::shared_ptr<const CClumpTemplate> known = entry->second.lock();
+        if (known != nullptr)
+            return known;
+    }
+
+    // a template that does not reach the tolerance is still usable, compute() reports its error
+    clump->compute(tolerance, threads);
+    computeCount++;
+    for (auto it = entries.begin(); it != entries.end();)
+        it = it->second.expired() ? entries.erase(it) : std::next(it);
+    entries[key] = clump;
+    return clump;
+}
+
+void randomRotation( uint64_t key, double rotation[9] )
+{
+    // splitmix64 for three uniforms, then Shoemake's uniform quaternion
+    auto next = [&key]()
+    {
+        uint64_t z = (key += 0x9e3779b97f4a7c15ull);
+        z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ull;
+        z = (z ^ (z >> 27)) * 0x94d049bb133111ebull;
+        return double((z ^ (z >> 31)) >> 11) * 0x1.0p-53;
+    };
+    const double u1 = next(), u2 = 2 * M_PI * next(), u3 = 2 * M_PI * next();
+    const double a = std::sqrt(1 - u1), b = std::sqrt(u1);
+    const double w = a * std::sin(u2), x = a * std::cos(u2), y = b * std::sin(u3), z = b * std::cos(u3);
+    const double m[9] = {1 - 2 * (y * y + z * z), 2 * (x * y - w * z), 2 * (x * z + w * y),
+                         2 * (x * y + w * z), 1 - 2 * (x * x + z * z), 2 * (y * z - w * x),
+                         2 * (x * z - w * y), 2 * (y * z + w * x), 1 - 2 * (x * x + y * y)};
+    std::copy(m, m + 9, rotation);
+}
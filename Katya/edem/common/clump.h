@@ -0,0 +1,120 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+/** One sphere of a clump template, in the template frame */
+struct SClumpSphere
+{
+    double x = 0, y = 0, z = 0;
+    double r = 0;
+};
+
+/** Mass properties of a clump per unit density, at scale 1 */
+struct SClumpMass
+{
+    double volume = 0;
+    /** Centre of mass in the template frame */
+    double centre[3] = {0, 0, 0};
+    /** Inertia tensor about the centre of mass, row major */
+    double inertia[9] = {0, 0, 0, 0, 0, 0, 0, 0, 0};
+    /** Principal moments, ascending */
+    double moments[3] = {0, 0, 0};
+    /** Principal axes as the columns of a proper rotation, row major */
+    double axes[9] = {1, 0, 0, 0, 1, 0, 0, 0, 1};
+    /** Estimated relative error of the volume, centre and inertia */
+    double error = 0;
+    /** Rows per axis of the finest integration grid */
+    int resolution = 0;
+};
+
+/**
+ * Rigid clump of overlapping spheres.
+ *
+ * Overlaps are counted once: the mass properties are integrated over
+ * the union of the spheres. The template box is cut into a grid of rows
+ * along x; each row meets every sphere in an interval, the intervals
+ * are merged and the moments 1, x, x^2 integrated exactly along them,
+ * so only the y-z directions are sampled (midpoint rule). The grid is
+ * doubled until two successive results agree to `tolerance`, relative
+ * to the volume, the bounding radius and the largest moment; rows of
+ * a z layer are only tested against the spheres crossing the layer,
+ * and the layers are spread over a parallelFor.
+ *
+ * Template file: the EDEM particle type on the first line, then one
+ * sphere per line as `x y z r`; `#` starts a comment.
+ */
+class CClumpTemplate
+{
+public:
+    bool read( const std::string &path );
+    /** Replaces the spheres, mass properties are reset */
+    void assign( const std::string &typeName, const std::vector<SClumpSphere> &list );
+
+    /** Integrates the mass properties to the relative tolerance */
+    bool compute( double tolerance = 1e-4, size_t threads = 0 );
+
+    const std::string &type() const { return typeName; }
+    const std::vector<SClumpSphere> &getSpheres() const { return spheres; }
+    const SClumpMass &mass() const { return massProperties; }
+    /** Radius of the sphere about the template origin enclosing every sphere */
+    double boundingRadius() const;
+    double minRadius() const;
+
+    /**
+     * The spheres in the principal frame (origin at the centre of mass,
+     * axes along the principal axes), in which the EDEM particle type
+     * should be defined for the orientations placement() gives.
+     */
+    std::vector<SClumpSphere> principalSpheres() const;
+
+    /**
+     * Where to put a clump whose template origin is at `origin`, turned
+     * by `rotation` (row major) and scaled by `scale`: the position of
+     * its centre of mass and the orientation of its principal frame.
+     */
+    void placement( const double origin[3], const double rotation[9], double scale,
+                    double position[3], double orientation[9] ) const;
+
+    /** Jacobi eigen decomposition of a symmetric 3x3 matrix: ascending values, vectors as columns */
+    static void principalAxes( const double matrix[9], double values[3], double vectors[9] );
+
+private:
+    /** Moments of the union on an n x n grid of rows */
+    void integrate( int n, size_t threads, double sums[10] ) const;
+
+    std::string typeName;
+    std::vector<SClumpSphere> spheres;
+    SClumpMass massProperties;
+};
+
+/**
+ * Process-wide cache of clump templates with their mass properties.
+ *
+ * Templates are identified by their type and spheres (not the file
+ * path) and the tolerance, and shared through shared_ptr while anyone
+ * holds them, so several factories of one template integrate it once.
+ */
+class CClumpLibrary
+{
+public:
+    static CClumpLibrary &instance();
+
+    /** Template of the file with its mass properties, nullptr if it cannot be read */
+    std::shared_ptr<const CClumpTemplate> acquire( const std::string &path, double tolerance, size_t threads = 0 );
+
+    size_t computed() const { return computeCount; }
+
+private:
+    std::mutex mutex;
+    std::map<std::string, std::weak_ptr<const CClumpTemplate>> entries;
+    size_t computeCount = 0;
+};
+
+/** Uniformly distributed rotation (row major) drawn from a 64-bit key */
+void randomRotation( uint64_t key, double rotation[9] );
@@ -0,0 +1,175 @@
+#include <algorithm>
+#include <cmath>
+#include <map>
+#include <tuple>
+
+#include "culling.h"
+#include "spatialgrid.h"
+
+namespace
+{
+    double sphereVolume( double r )
+    {
+        return 4.0 / 3.0 * M_PI * r * r * r;
+    }
+
+    /** Copies row i of every property column of from onto the end of to */
+    void appendProperties( const CPacking &from, size_t i, CPacking &to )
+    {
+        for (size_t k = 0; k < from.properties.size(); k++)
+        {
+            const double *row = from.properties[k].row(i);
+            to.properties[k].values.insert(to.properties[k].values.end(), row, row + from.properties[k].elements);
+        }
+    }
+}
+
+double rayleighTimestep( double radius, double density, double shearModulus, double poisson )
+{
+    return M_PI * radius * std::sqrt(density / shearModulus) / (0.1631 * poisson + 0.8766);
+}
+
+bool cullFineParticles( const CPacking &packing, const SCullParams &params, CPacking &culled, SCullReport &report,
+                        std::pmr::memory_resource *temporaries )
+{
+    report = SCullReport();
+    const size_t n = packing.size();
+    if (n == 0 || params.mode == ECullMode::eNone || params.cutoff <= 0)
+        return false;
+
+    culled.x.clear();
+    culled.y.clear();
+    culled.z.clear();
+    culled.r.clear();
+    culled.properties.resize(packing.properties.size());
+    for (size_t k = 0; k < packing.properties.size(); k++)
+    {
+        culled.properties[k].name = packing.properties[k].name;
+        culled.properties[k].elements = packing.properties[k].elements;
+        culled.properties[k].values.clear();
+    }
+
+    report.before = n;
+    report.minRadiusBefore = packing.minRadius();
+    std::pmr::vector<size_t> fine(temporaries);
+    for (size_t i = 0; i < n; i++)
+    {
+        report.volumeBefore += sphereVolume(packing.r[i]);
+        if (packing.r[i] < params.cutoff)
+        {
+            fine.push_back(i);
+            continue;
+        }
+        culled.x.push_back(packing.x[i]);
+        culled.y.push_back(packing.y[i]);
+        culled.z.push_back(packing.z[i]);
+        culled.r.push_back(packing.r[i]);
+        appendProperties(packing, i, culled);
+    }
+    const size_t coarse = culled.size();
+    if (coarse == 0)
+        return false;
+
+    // fine volume waiting to be merged into each coarse particle
+    std::pmr::vector<double> added(coarse, 0, temporaries);
+    CSpatialGrid grid;
+    const double maxRadius = culled.maxRadius();
+    if (params.mode != ECullMode::eDrop)
+        grid.build(culled.x.data(), culled.y.data(), culled.z.data(), coarse, 2 * maxRadius);
+
+    auto mergeOrDrop = [&]( const double p[3], double r, size_t count )
+    {
+        // nearest coarse surface within reach
+        int64_t best = -1;
+        double bestGap = 0;
+        grid.forEachCandidate(p[0], p[1], p[2], r + maxRadius, [&]( uint32_t j )
+        {
+            const double dx = culled.x[j] - p[0], dy = culled.y[j] - p[1], dz = culled.z[j] - p[2];
+            const double gap = std::sqrt(dx * dx + dy * dy + dz * dz) - culled.r[j] - r;
+            if (gap <= maxRadius && (best < 0 || gap < bestGap))
+            {
+                best = j;
+                bestGap = gap;
+            }
+        });
+        if (best < 0)
+        {
+            report.dropped += count;
+            report.volumeLost += sphereVolume(r);
+            return;
+        }
+        added[size_t(best)] += sphereVolume(r);
+        report.merged += count;
+    };
+
+    if (params.mode == ECullMode::eDrop)
+        for (size_t i : fine)
+        {
+            report.dropped++;
+            report.volumeLost += sphereVolume(packing.r[i]);
+        }
+    else if (params.mode == ECullMode::eMerge)
+        for (size_t i : fine)
+        {
+            const double p[3] = {packing.x[i], packing.y[i], packing.z[i]};
+            mergeOrDrop(p, packing.r[i], 1);
+        }
+    else
+    {
+        struct SParcel
+        {
+            double volume = 0;
+            double moment[3] = {0, 0, 0};
+            size_t members = 0;
+            size_t largest = 0;
+        };
+        const double size = params.parcelSize > 0 ? params.parcelSize : 4 * params.cutoff;
+        std::pmr::map<std::tuple<int64_t, int64_t, int64_t>, SParcel> cells(temporaries);
+        for (size_t i : fine)
+        {
+            const auto key = std::make_tuple(int64_t(std::floor(packing.x[i] / size)),
+                                             int64_t(std::floor(packing.y[i] / size)),
+                                             int64_t(std::floor(packing.z[i] / size)));
+            SParcel &parcel = cells[key];
+            const double v = sphereVolume(packing.r[i]);
+            parcel.volume += v;
+            parcel.moment[0] += v * packing.x[i];
+            parcel.moment[1] += v * packing.y[i];
+            parcel.moment[2] += v * packing.z[i];
+            if (parcel.members == 0 || packing.r[i] > packing.r[parcel.largest])
+                parcel.largest = i;
+            parcel.members++;
+        }
+
+        for (auto const& cell : cells)
+        {
+            const SParcel &parcel = cell.second;
+            const double p[3] = {parcel.moment[0] / parcel.volume, parcel.moment[1] / parcel.volume,
+                                 parcel.moment[2] / parcel.volume};
+            const double r = std::cbrt(parcel.volume * 3 / (4 * M_PI));
+            if (r < params.cutoff)
+            {
+                mergeOrDrop(p, r, parcel.members);
+                continue;
+            }
+            culled.x.push_back(p[0]);
+            culled.y.push_back(p[1]);
+            culled.z.push_back(p[2]);
+            culled.r.push_back(r);
+            appendProperties(packing, parcel.largest, culled);
+            report.parcelled += parcel.members;
+            report.parcels++;
+        }
+    }
+
+    for (size_t j = 0; j < coarse; j++)
+        if (added[j] > 0)
+            culled.r[j] = std::cbrt(culled.r[j] * culled.r[j] * culled.r[j] + added[j] * 3 / (4 * M_PI));
+
+    report.after = culled.size();
+    report.massLost = report.volumeLost * params.density;
+    report.minRadiusAfter = culled.minRadius();
+    report.timestepBefore = rayleighTimestep(report.minRadiusBefore, params.density, params.shearModulus, params.poisson);
+    report.timestepAfter = rayleighTimestep(report.minRadiusAfter, params.density, params.shearModulus, params.poisson);
+    return true;
+}
@@ -0,0 +1,73 @@
+#pragma once
+
+#include <cstddef>
+#include <memory_resource>
+
+#include "packing.h"
+
+/** How particles below the cutoff radius are treated */
+enum class ECullMode { eNone, eDrop, eMerge, eParcel };
+
+struct SCullParams
+{
+    ECullMode mode = ECullMode::eNone;
+    /** Particles with a smaller radius are culled */
+    double cutoff = 0;
+    /** Edge of the cells fine particles are gathered in by eParcel, 0 for 4 * cutoff */
+    double parcelSize = 0;
+
+    // material for the reported mass and Rayleigh timestep
+    double density = 2500;
+    double shearModulus = 1e9;
+    double poisson = 0.25;
+};
+
+struct SCullReport
+{
+    size_t before = 0;
+    size_t after = 0;
+    size_t dropped = 0;  /**< removed without a trace */
+    size_t merged = 0;   /**< volume added to the nearest coarse particle */
+    size_t parcelled = 0; /**< gathered into parcels */
+    size_t parcels = 0;  /**< parcels created */
+
+    double volumeBefore = 0;
+    double volumeLost = 0;
+    double massLost = 0;
+
+    double minRadiusBefore = 0;
+    double minRadiusAfter = 0;
+    /** Rayleigh critical timestep of the smallest particle, before and after */
+    double timestepBefore = 0;
+    double timestepAfter = 0;
+
+    double timestepGain() const { return timestepBefore > 0 ? timestepAfter / timestepBefore : 0; }
+};
+
+/** Rayleigh critical timestep pi R sqrt(rho / G) / (0.1631 nu + 0.8766) */
+double rayleighTimestep( double radius, double density, double shearModulus, double poisson );
+
+/**
+ * Removes the particles below the cutoff radius from a packing.
+ *
+ *  - eDrop   drops them;
+ *  - eMerge  adds the volume of each to the nearest coarse particle it
+ *            touches or is within its reach, growing that particle's
+ *            radius (mass is kept, particles with no neighbour in reach
+ *            are dropped);
+ *  - eParcel coarse-grains them: the fine particles of each cell of
+ *            size parcelSize become one parcel of their total volume at
+ *            their volume-weighted centre; parcels still below the cutoff
+ *            are merged as above.
+ *
+ * Neighbours are found through a CSpatialGrid of the coarse particles.
+ * Property columns follow their particle; a parcel takes the properties
+ * of its largest member. The report gives the volume and mass lost and
+ * the estimated gain in the Rayleigh timestep, which scales with the
+ * smallest radius.
+ *
+ * The lists and the parcel map of the call are allocated from
+ * `temporaries`, a setup arena say.
+ */
+bool cullFineParticles( const CPacking &packing, const SCullParams &params, CPacking &culled, SCullReport &report,
+                        std::pmr::memory_resource *temporaries = std::pmr::get_default_resource() );
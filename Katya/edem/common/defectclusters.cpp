@@ -0,0 +1,268 @@
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+#include "defectclusters.h"
+#include "parallel.h"
+#include "spatialgrid.h"
+
+size_t CDefectClusters::find( size_t i ) const
+{
+    // path halving: a compare-and-swap that loses to a concurrent link
+    // only skips this shortcut
+    for (;;)
+    {
+        uint32_t p = parent[i].load();
+        if (p == i)
+            return i;
+        const uint32_t grandparent = parent[p].load();
+        if (grandparent != p)
+            parent[i].compare_exchange_weak(p, grandparent);
+        i = p;
+    }
+}
+
+void CDefectClusters::unite( size_t a, size_t b )
+{
+    // the larger root goes under the smaller, so a root is the earliest
+    // defect of its cluster whatever order the threads link in
+    for (;;)
+    {
+        a = find(a);
+        b = find(b);
+        if (a == b)
+            return;
+        if (a < b)
+            std::swap(a, b);
+        uint32_t expected = uint32_t(a);
+        if (parent[a].compare_exchange_strong(expected, uint32_t(b)))
+            return;
+    }
+}
+
+size_t CDefectClusters::clusterOf( size_t i ) const
+{
+    return order[find(position[i])];
+}
+
+void CDefectClusters::principalAxes( const double covariance[6], double values[3], double axes[3][3] )
+{
+    double a[3][3] = {{covariance[0], covariance[3], covariance[4]},
+                      {covariance[3], covariance[1], covariance[5]},
+                      {covariance[4], covariance[5], covariance[2]}};
+    double v[3][3] = {{1, 0, 0}, {0, 1, 0}, {0, 0, 1}};
+
+    // cyclic Jacobi rotations
+    for (int sweep = 0; sweep < 50; sweep++)
+    {
+        const double off = a[0][1] * a[0][1] + a[0][2] * a[0][2] + a[1][2] * a[1][2];
+        const double diagonal = a[0][0] * a[0][0] + a[1][1] * a[1][1] + a[2][2] * a[2][2];
+        if (off <= 1e-30 * diagonal || off == 0)
+            break;
+        for (int p = 0; p < 2; p++)
+            for (int q = p + 1; q < 3; q++)
+            {
+                if (a[p][q] == 0)
+                    continue;
+                const double theta = (a[q][q] - a[p][p]) / (2 * a[p][q]);
+                const double t = (theta >= 0 ? 1 : -1) / (std::fabs(theta) + std::sqrt(theta * theta + 1));
+                const double c = 1 / std::sqrt(t * t + 1), s = t * c;
+                for (int k = 0; k < 3; k++)
+                {
+                    const double kp = a[k][p], kq = a[k][q];
+                    a[k][p] = c * kp - s * kq;
+                    a[k][q] = s * kp + c * kq;
+                }
+                for (int k = 0; k < 3; k++)
+                {
+                    const double pk = a[p][k], qk = a[q][k];
+                    a[p][k] = c * pk - s * qk;
+                    a[q][k] = s * pk + c * qk;
+                }
+                for (int k = 0; k < 3; k++)
+                {
+                    const double kp = v[k][p], kq = v[k][q];
+                    v[k][p] = c * kp - s * kq;
+                    v[k][q] = s * kp + c * kq;
+                }
+            }
+    }
+
+    int rank[3] = {0, 1, 2};
+    std::sort(rank, rank + 3, [&a]( int i, int j ) { return a[i][i] > a[j][j]; });
+    for (int k = 0; k < 3; k++)
+    {
+        values[k] = a[rank[k]][rank[k]];
+        // the largest component positive, so equal clusters get equal axes
+        int largest = 0;
+        for (int d = 1; d < 3; d++)
+            if (std::fabs(v[d][rank[k]]) > std::fabs(v[largest][rank[k]]))
+                largest = d;
+        const double sign = v[largest][rank[k]] < 0 ? -1 : 1;
+        for (int d = 0; d < 3; d++)
+            axes[k][d] = sign * v[d][rank[k]];
+    }
+}
+
+bool CDefectClusters::cluster( const double *x, const double *y, const double *z, const double *t, size_t n,
+                               const SParams &params, const tWindowCallback &callback )
+{
+    const std::vector<double> &ends = params.windowEnds;
+    if (n >= std::numeric_limits<uint32_t>::max() || params.distance <= 0 || (!ends.empty() && t == nullptr) ||
+        !std::is_sorted(ends.begin(), ends.end()))
+        return false;
+    const size_t windows = std::max<size_t>(1, ends.size());
+
+    // counting sort into window order, input order within a window
+    std::vector<uint32_t> windowOf(n, 0);
+    std::vector<size_t> windowStart(windows + 1, 0);
+    for (size_t i = 0; i < n; i++)
+    {
+        if (!ends.empty())
+            windowOf[i] = uint32_t(std::min<size_t>(std::lower_bound(ends.begin(), ends.end(), t[i]) - ends.begin(),
+                                                    windows - 1));
+        windowStart[windowOf[i] + 1]++;
+    }
+    for (size_t w = 0; w < windows; w++)
+        windowStart[w + 1] += windowStart[w];
+
+    order.resize(n);
+    position.resize(n);
+    {
+        std::vector<size_t> fill(windowStart.begin(), windowStart.end() - 1);
+        for (size_t i = 0; i < n; i++)
+            order[fill[windowOf[i]]++] = uint32_t(i);
+    }
+    std::vector<double> xs(n), ys(n), zs(n);
+    for (size_t k = 0; k < n; k++)
+    {
+        position[order[k]] = uint32_t(k);
+        xs[k] = x[order[k]];
+        ys[k] = y[order[k]];
+        zs[k] = z[order[k]];
+    }
+    windowOf = std::vector<uint32_t>();
+
+    // moments are taken about the middle of the bounds, to keep the
+    // variance of a small cluster far from the origin accurate
+    double origin[3] = {0, 0, 0};
+    if (n > 0)
+    {
+        const auto [xLo, xHi] = std::minmax_element(xs.begin(), xs.end());
+        const auto [yLo, yHi] = std::minmax_element(ys.begin(), ys.end());
+        const auto [zLo, zHi] = std::minmax_element(zs.begin(), zs.end());
+        origin[0] = 0.5 * (*xLo + *xHi);
+        origin[1] = 0.5 * (*yLo + *yHi);
+        origin[2] = 0.5 * (*zLo + *zHi);
+    }
+
+    CSpatialGrid grid;
+    grid.build(xs.data(), ys.data(), zs.data(), n, params.distance);
+    parent.reset(new std::atomic<uint32_t>[n]);
+    for (size_t k = 0; k < n; k++)
+        parent[k].store(uint32_t(k), std::memory_order_relaxed);
+    moments.resize(n);
+
+    const double distance2 = params.distance * params.distance;
+    std::vector<uint32_t> live, kept;
+    std::vector<SDefectCluster> clusters;
+    for (size_t w = 0; w < windows; w++)
+    {
+        const size_t lo = windowStart[w], hi = windowStart[w + 1];
+        // earlier windows are all below lo; pairs within the window are
+        // merged once, from the later defect
+        const size_t from = params.cumulative ? 0 : lo;
+        parallelFor(lo, hi, params.threads, [&]( size_t begin, size_t end )
+        {
+            for (size_t i = begin; i < end; i++)
+                grid.forEachCandidate(xs[i], ys[i], zs[i], params.distance, [&]( uint32_t j )
+                {
+                    if (j >= from && j < i)
+                    {
+                        const double dx = xs[i] - xs[j], dy = ys[i] - ys[j], dz = zs[i] - zs[j];
+                        if (dx * dx + dy * dy + dz * dz < distance2)
+                            unite(i, j);
+                    }
+                });
+        });
+
+        // fold the moments of merged clusters into their new roots, then
+        // add the new defects; a new defect never becomes the root of an
+        // older one, so its slot is only read if it is a root itself
+        if (!params.cumulative)
+            live.clear();
+        for (size_t i = lo; i < hi; i++)
+            moments[i] = SMoments{0, {0, 0, 0}, {0, 0, 0, 0, 0, 0}};
+        kept.clear();
+        for (uint32_t r : live)
+        {
+            const size_t root = find(r);
+            if (root == r)
+            {
+                kept.push_back(r);
+                continue;
+            }
+            SMoments &into = moments[root];
+            into.count += moments[r].count;
+            for (int a = 0; a < 3; a++)
+                into.sum[a] += moments[r].sum[a];
+            for (int a = 0; a < 6; a++)
+                into.square[a] += moments[r].square[a];
+        }
+        for (size_t i = lo; i < hi; i++)
+        {
+            const size_t root = find(i);
+            if (root == i)
+                kept.push_back(uint32_t(i));
+            const double p[3] = {xs[i] - origin[0], ys[i] - origin[1], zs[i] - origin[2]};
+            SMoments &into = moments[root];
+            into.count++;
+            for (int a = 0; a < 3; a++)
+                into.sum[a] += p[a];
+            into.square[0] += p[0] * p[0];
+            into.square[1] += p[1] * p[1];
+            into.square[2] += p[2] * p[2];
+            into.square[3] += p[0] * p[1];
+            into.square[4] += p[0] * p[2];
+            into.square[5] += p[1] * p[2];
+        }
+        live.swap(kept);
+
+        SWindowStats stats;
+        stats.window = w;
+        stats.end = ends.empty() ? 0 : ends[w];
+        stats.defects = hi - from;
+        stats.clusters = live.size();
+        clusters.clear();
+        for (uint32_t r : live)
+        {
+            const SMoments &m = moments[r];
+            stats.largest = std::max(stats.largest, m.count);
+            if (m.count < params.minSize)
+                continue;
+
+            SDefectCluster cluster;
+            cluster.first = order[r];
+            cluster.size = m.count;
+            double mean[3], covariance[6], values[3];
+            for (int a = 0; a < 3; a++)
+            {
+                mean[a] = m.sum[a] / double(m.count);
+                cluster.centroid[a] = origin[a] + mean[a];
+            }
+            const int pairs[6][2] = {{0, 0}, {1, 1}, {2, 2}, {0, 1}, {0, 2}, {1, 2}};
+            for (int c = 0; c < 6; c++)
+                covariance[c] = m.square[c] / double(m.count) - mean[pairs[c][0]] * mean[pairs[c][1]];
+            principalAxes(covariance, values, cluster.axes);
+            for (int k = 0; k < 3; k++)
+                cluster.extent[k] = std::sqrt(std::max(0.0, values[k]));
+            clusters.push_back(cluster);
+        }
+        std::sort(clusters.begin(), clusters.end(), []( const SDefectCluster &a, const SDefectCluster &b )
+        {
+            return a.size != b.size ? a.size > b.size : a.first < b.first;
+        });
+        callback(stats, clusters);
+    }
+    return true;
+}
@@ -0,0 +1,101 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <vector>
+
+/** One cluster of defects at the end of a time window */
+struct SDefectCluster
+{
+    /** Input index of the earliest defect, kept while the cluster grows and merges */
+    size_t first = 0;
+    size_t size = 0;
+    double centroid[3] = {0, 0, 0};
+    /** Standard deviations along the principal axes, largest first */
+    double extent[3] = {0, 0, 0};
+    /** Unit principal axes, axes[k] goes with extent[k] */
+    double axes[3][3] = {{1, 0, 0}, {0, 1, 0}, {0, 0, 1}};
+};
+
+/**
+ * Single-linkage clustering of defects (broken bonds) with a distance
+ * threshold, as defect_cluster.py does with AgglomerativeClustering:
+ * two defects closer than the distance are in one cluster, and so is
+ * every chain of such pairs.
+ *
+ * Defects are bucketed into CSpatialGrid cells of the distance, so each
+ * one is compared only with its neighbourhood, and the pairs are merged
+ * by a parallelFor into a lock-free union-find (compare-and-swap links,
+ * path halving). Time and memory are O(n) for a bounded density.
+ *
+ * With time windows the defects are added window by window: in the
+ * cumulative mode a window holds every defect that broke up to its end
+ * and only the new defects are compared, so following a crack through
+ * all windows costs one clustering. The moments of each cluster are
+ * merged along with it, so a window's statistics cost O(new defects +
+ * clusters). In the partial mode a window holds only its own defects.
+ */
+class CDefectClusters
+{
+public:
+    struct SParams
+    {
+        double distance = 0.2;
+        /**
+         * Ends of the time windows, ascending. A defect goes to the first
+         * window ending at or after its time, the last window if none;
+         * without ends all defects form one window.
+         */
+        std::vector<double> windowEnds;
+        /** Windows hold every earlier defect too (defect_cluster.py's default) */
+        bool cumulative = true;
+        size_t threads = 0;
+        /** Smaller clusters are merged and counted but not reported */
+        size_t minSize = 1;
+    };
+
+    struct SWindowStats
+    {
+        size_t window = 0;
+        double end = 0;
+        size_t defects = 0;
+        size_t clusters = 0;
+        size_t largest = 0;
+    };
+
+    using tWindowCallback = std::function<void( const SWindowStats &, const std::vector<SDefectCluster> & )>;
+
+    /**
+     * Clusters n defects at (x, y, z) that broke at times t (may be null
+     * without windows) and calls back once per window with its clusters,
+     * largest first.
+     */
+    bool cluster( const double *x, const double *y, const double *z, const double *t, size_t n,
+                  const SParams &params, const tWindowCallback &callback );
+
+    /** Input index of the earliest defect of the cluster of defect i in the last window */
+    size_t clusterOf( size_t i ) const;
+
+    /** Eigen decomposition of a symmetric 3x3 matrix (xx, yy, zz, xy, xz, yz), values descending */
+    static void principalAxes( const double covariance[6], double values[3], double axes[3][3] );
+
+private:
+    struct SMoments
+    {
+        size_t count;
+        double sum[3];
+        double square[6];  /**< xx, yy, zz, xy, xz, yz */
+    };
+
+    size_t find( size_t i ) const;
+    void unite( size_t a, size_t b );
+
+    /** Defects in window order; sorted position -> input index and back */
+    std::vector<uint32_t> order;
+    std::vector<uint32_t> position;
+    std::unique_ptr<std::atomic<uint32_t>[]> parent;
+    std::vector<SMoments> moments;
+};
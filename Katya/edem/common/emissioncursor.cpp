@@ -0,0 +1,101 @@
+#include <algorithm>
+
+#include "emissioncursor.h"
+
+namespace
+{
+    /** Process-wide, so a thread local cache never mistakes a new cursor for a dead one */
+    uint64_t newGeneration()
+    {
+        static std::atomic<uint64_t> last{0};
+        return ++last;
+    }
+}
+
+CEmissionCursor::CEmissionCursor( size_t blockSize )
+    : block(std::max<size_t>(blockSize, 1)), generation(newGeneration())
+{
+}
+
+size_t CEmissionCursor::next()
+{
+    SBlock &own = threadBlock();
+    if (own.next == own.end)
+    {
+        bool reused = false;
+        if (hasLeftovers.load(std::memory_order_acquire))
+        {
+            std::lock_guard<std::mutex> lock(blocksMutex);
+            if (!leftovers.empty())
+            {
+                own.next = leftovers.back().first;
+                own.end = leftovers.back().second;
+                leftovers.pop_back();
+                reused = true;
+            }
+            hasLeftovers = !leftovers.empty();
+        }
+        if (!reused)
+        {
+            own.next = counter.fetch_add(block, std::memory_order_relaxed);
+            own.end = own.next + block;
+        }
+    }
+    return own.next++;
+}
+
+void CEmissionCursor::reset()
+{
+    std::lock_guard<std::mutex> lock(blocksMutex);
+    counter = 0;
+    blocks.clear();
+    leftovers.clear();
+    hasLeftovers = false;
+    generation = newGeneration();
+}
+
+std::vector<std::pair<size_t, size_t>> CEmissionCursor::pending()
+{
+    std::lock_guard<std::mutex> lock(blocksMutex);
+    std::vector<std::pair<size_t, size_t>> ranges(leftovers.begin(), leftovers.end());
+    for (auto const& b : blocks)
+        if (b.second->next < b.second->end)
+            ranges.emplace_back(b.second->next, b.second->end);
+    std::sort(ranges.begin(), ranges.end());
+    return ranges;
+}
+
+void CEmissionCursor::resume( size_t claimedCount, const std::vector<std::pair<size_t, size_t>> &ranges )
+{
+    reset();
+    std::lock_guard<std::mutex> lock(blocksMutex);
+    counter = claimedCount;
+    // kept descending, so a single caller gets the indices in order
+    leftovers.assign(ranges.rbegin(), ranges.rend());
+    hasLeftovers = !leftovers.empty();
+}
+
+CEmissionCursor::SBlock &CEmissionCursor::threadBlock()
+{
+    struct SCache
+    {
+        const CEmissionCursor *owner = nullptr;
+        uint64_t generation = 0;
+        SBlock *block = nullptr;
+    };
+    thread_local SCache cache;
+
+    if (cache.owner == this && cache.generation == generation)
+        return *cache.block;
+
+    std::lock_guard<std::mutex> lock(blocksMutex);
+    const std::thread::id self = std::this_thread::get_id();
+    auto it = std::find_if(blocks.begin(), blocks.end(), [&]( auto &b ) { return b.first == self; });
+    if (it == blocks.end())
+    {
+        blocks.emplace_back(self, std::make_unique<SBlock>());
+        it = blocks.end() - 1;
+    }
+    cache = {this, generation, it->second.get()};
+    return *cache.block;
+}
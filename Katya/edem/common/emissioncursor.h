@@ -0,0 +1,66 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/**
+ * Hands out the indices 0, 1, 2, ... to concurrent callers, every index
+ * exactly once.
+ *
+ * A thread claims a block of indices with one fetch_add on the shared
+ * counter and then serves its next() calls from that block, so threads
+ * only meet on the counter once per block instead of once per particle.
+ * As in CAERecorder, each thread's block is found through a thread
+ * local cache and registered under a mutex the first time the thread
+ * asks; a thread that alternates between cursors keeps its unfinished
+ * blocks. With a single caller the indices come in order.
+ *
+ * The cursor knows no end: callers drop indices past the number of
+ * particles they have.
+ *
+ * For a checkpoint, claimed() and pending() describe exactly which
+ * indices were handed out: all below claimed() except the pending
+ * ranges, the unserved rest of the threads' blocks. resume() restores
+ * that, serving the pending ranges before claiming new blocks.
+ */
+class CEmissionCursor
+{
+public:
+    explicit CEmissionCursor( size_t blockSize = 64 );
+
+    /** Next index for the calling thread */
+    size_t next();
+    /** Starts over from 0 and forgets the blocks of all threads; not concurrently with next() */
+    void reset();
+
+    /** Indices claimed by all threads so far, a multiple of the block size */
+    size_t claimed() const { return counter.load(std::memory_order_relaxed); }
+
+    /** Ranges [first, last) below claimed() not handed out yet, ascending; not concurrently with next() */
+    std::vector<std::pair<size_t, size_t>> pending();
+    /** Continues where claimed() and pending() were taken; not concurrently with next() */
+    void resume( size_t claimedCount, const std::vector<std::pair<size_t, size_t>> &ranges );
+
+private:
+    struct alignas(64) SBlock
+    {
+        size_t next = 0;
+        size_t end = 0;
+    };
+
+    SBlock &threadBlock();
+
+    const size_t block;
+    alignas(64) std::atomic<size_t> counter{0};
+    uint64_t generation = 0;
+
+    std::mutex blocksMutex;
+    std::vector<std::pair<std::thread::id, std::unique_ptr<SBlock>>> blocks;
+    /** Ranges left over by resume(), served last first */
+    std::vector<std::pair<size_t, size_t>> leftovers;
+    std::atomic<bool> hasLeftovers{false};
+};
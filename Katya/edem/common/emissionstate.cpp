@@ -0,0 +1,91 @@
+#include <cstdio>
+#include <cstring>
+
+#include "emissionstate.h"
+#include "packingsidecar.h"
+
+namespace
+{
+    const char MAGIC[4] = {'P', 'K', 'S', '1'};
+
+    struct SHeader
+    {
+        char magic[4];
+        uint32_t version;
+        uint64_t sourceHash;
+        uint64_t configHash;
+        uint64_t slots;
+        uint64_t claimed;
+        double time;
+        uint64_t ranges;
+    };
+}
+
+size_t SEmissionState::emitted() const
+{
+    size_t left = 0;
+    for (auto const& range : pending)
+        left += range.second - range.first;
+    return size_t(claimed) - left;
+}
+
+bool SEmissionState::write( const std::string &path ) const
+{
+    SHeader header;
+    memcpy(header.magic, MAGIC, sizeof(MAGIC));
+    header.version = VERSION;
+    header.sourceHash = sourceHash;
+    header.configHash = configHash;
+    header.slots = slots;
+    header.claimed = claimed;
+    header.time = time;
+    header.ranges = pending.size();
+
+    std::vector<uint64_t> ranges;
+    for (auto const& range : pending)
+        ranges.insert(ranges.end(), {uint64_t(range.first), uint64_t(range.second)});
+
+    const std::string temporary = CPackingSidecar::temporaryPath(path);
+    FILE *file = fopen(temporary.c_str(), "wb");
+    if (file == nullptr)
+        return false;
+    bool ok = fwrite(&header, sizeof(header), 1, file) == 1 &&
+              (ranges.empty() || fwrite(ranges.data(), sizeof(uint64_t), ranges.size(), file) == ranges.size());
+    ok = fclose(file) == 0 && ok;
+    if (!ok || !CPackingSidecar::replaceFile(temporary, path))
+    {
+        remove(temporary.c_str());
+        return false;
+    }
+    return true;
+}
+
+bool SEmissionState::read( const std::string &path )
+{
+    FILE *file = fopen(path.c_str(), "rb");
+    if (file == nullptr)
+        return false;
+
+    SHeader header;
+    bool ok = fread(&header, sizeof(header), 1, file) == 1 && memcmp(header.magic, MAGIC, sizeof(MAGIC)) == 0 &&
+              header.version == VERSION && header.ranges <= header.claimed;
+    std::vector<uint64_t> ranges(ok ? 2 * header.ranges : 0);
+    ok = ok && (ranges.empty() || fread(ranges.data(), sizeof(uint64_t), ranges.size(), file) == ranges.size());
+    fclose(file);
+    if (!ok)
+        return false;
+
+    pending.clear();
+    for (size_t k = 0; k < ranges.size(); k += 2)
+    {
+        if (ranges[k] >= ranges[k + 1] || ranges[k + 1] > header.claimed)
+            return false;
+        pending.emplace_back(size_t(ranges[k]), size_t(ranges[k + 1]));
+    }
+    sourceHash = header.sourceHash;
+    configHash = header.configHash;
+    slots = header.slots;
+    claimed = header.claimed;
+    time = header.time;
+    return true;
+}
@@ -0,0 +1,51 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <utility>
+#include <vector>
+
+/**
+ * Emission state of a factory, saved when the simulation stops and
+ * restored when it starts again.
+ *
+ * The state only holds what cannot be recomputed: the identity of the
+ * inputs and the emission cursor. The packing comes back through the
+ * sidecar, tiles and regions are rebuilt from the config, and the
+ * random choices (tile symmetries, clump rotations) are drawn from
+ * seeds and positions rather than a running generator, so resuming
+ * costs the same as starting and the particles already emitted are
+ * never visited again.
+ *
+ * The simulation time the state was saved at tells a restart from a
+ * host checkpoint (resume) from a rerun of the deck (start over).
+ *
+ * File (native byte order): "PKS1", version, source and config hashes,
+ * the number of emission slots, the cursor's claimed count, the time and
+ * the cursor's pending ranges. It is written through a temporary file and a rename,
+ * so a crash while saving leaves the previous state.
+ */
+struct SEmissionState
+{
+    static constexpr uint32_t VERSION = 2;
+
+    /** CPackingSidecar::sourceHash of the packing */
+    uint64_t sourceHash = 0;
+    /** Hash of the factory config */
+    uint64_t configHash = 0;
+    /** Slots emission goes over, 0 when unknown (streaming emission) */
+    uint64_t slots = 0;
+    /** See CEmissionCursor */
+    uint64_t claimed = 0;
+    /** Simulation time the emitted slots were created by, in s */
+    double time = 0;
+    std::vector<std::pair<size_t, size_t>> pending;
+
+    /** Slots handed out */
+    size_t emitted() const;
+
+    bool write( const std::string &path ) const;
+    /** False if the file is missing, damaged or of another version */
+    bool read( const std::string &path );
+};
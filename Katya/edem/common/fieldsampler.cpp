@@ -0,0 +1,215 @@
+#include <chrono>
+#include <cmath>
+#include <limits>
+
+#include "fieldsampler.h"
+
+/**
+ * Interpolates C interleaved components stored on an n0 x n1 x n2 node
+ * grid. The clamped node coordinate is never negative, so the int
+ * conversion is the floor and the loop has no branches. out1 and out2
+ * are only written for C == 3, scalar fields pass null for them.
+ */
+template <bool Trilinear, int C>
+static void interpolate( size_t n,
+                         const double *__restrict x, const double *__restrict y, const double *__restrict z,
+                         const double *__restrict node,
+                         double lo0, double lo1, double lo2,
+                         double inv0, double inv1, double inv2,
+                         int n0, int n1, int n2,
+                         double *__restrict out0, double *__restrict out1, double *__restrict out2 )
+{
+    const double max0 = n0 - 1, max1 = n1 - 1, max2 = n2 - 1;
+    const int s0 = C, s1 = C * n0, s2 = C * n0 * n1;
+    for (size_t i = 0; i < n; i++)
+    {
+        double t0 = (x[i] - lo0) * inv0, t1 = (y[i] - lo1) * inv1, t2 = (z[i] - lo2) * inv2;
+        t0 = t0 < 0 ? 0 : (t0 > max0 ? max0 : t0);
+        t1 = t1 < 0 ? 0 : (t1 > max1 ? max1 : t1);
+        t2 = t2 < 0 ? 0 : (t2 > max2 ? max2 : t2);
+
+        double result[C];
+        if (!Trilinear)
+        {
+            const int k = int(t0 + 0.5) * s0 + int(t1 + 0.5) * s1 + int(t2 + 0.5) * s2;
+            for (int c = 0; c < C; c++)
+                result[c] = node[k + c];
+        }
+        else
+        {
+            // the last cell also serves points on the upper face
+            int i0 = int(t0), i1 = int(t1), i2 = int(t2);
+            i0 = i0 > n0 - 2 ? n0 - 2 : i0;
+            i1 = i1 > n1 - 2 ? n1 - 2 : i1;
+            i2 = i2 > n2 - 2 ? n2 - 2 : i2;
+            const double f0 = t0 - i0, f1 = t1 - i1, f2 = t2 - i2;
+
+            const int k = i0 * s0 + i1 * s1 + i2 * s2;
+            for (int c = 0; c < C; c++)
+            {
+                const double *v = node + k + c;
+                const double c00 = v[0] + f0 * (v[s0] - v[0]);
+                const double c10 = v[s1] + f0 * (v[s1 + s0] - v[s1]);
+                const double c01 = v[s2] + f0 * (v[s2 + s0] - v[s2]);
+                const double c11 = v[s1 + s2] + f0 * (v[s1 + s2 + s0] - v[s1 + s2]);
+                const double e0 = c00 + f1 * (c10 - c00);
+                const double e1 = c01 + f1 * (c11 - c01);
+                result[c] = e0 + f2 * (e1 - e0);
+            }
+        }
+
+        out0[i] = result[0];
+        if constexpr (C == 3)
+        {
+            out1[i] = result[1];
+            out2[i] = result[2];
+        }
+    }
+}
+
+template <bool Trilinear>
+static void interpolate( int components, size_t n, const double *x, const double *y, const double *z,
+                         const double *node, const double lo[3], const double step[3], const int dims[3],
+                         double *out0, double *out1, double *out2 )
+{
+    if (components == 3)
+        interpolate<Trilinear, 3>(n, x, y, z, node, lo[0], lo[1], lo[2], 1 / step[0], 1 / step[1], 1 / step[2],
+                                  dims[0], dims[1], dims[2], out0, out1, out2);
+    else
+        interpolate<Trilinear, 1>(n, x, y, z, node, lo[0], lo[1], lo[2], 1 / step[0], 1 / step[1], 1 / step[2],
+                                  dims[0], dims[1], dims[2], out0, nullptr, nullptr);
+}
+
+bool CFieldSampler::bind( NApiCore::IFieldApi_1_0 *fieldApi, const double boxLo[3], const double boxHi[3],
+                          const int nodes[3], double refreshInterval, unsigned int points )
+{
+    field = nullptr;
+    if (fieldApi == nullptr)
+        return false;
+
+    size_t total = 1;
+    for (int a = 0; a < 3; a++)
+    {
+        if (nodes[a] < 2 || !(boxHi[a] > boxLo[a]))
+            return false;
+        lo[a] = boxLo[a];
+        dims[a] = nodes[a];
+        step[a] = (boxHi[a] - boxLo[a]) / (nodes[a] - 1);
+        total *= size_t(nodes[a]);
+    }
+    // node offsets are computed in int
+    if (3 * total > size_t(std::numeric_limits<int>::max()))
+        return false;
+
+    field = fieldApi;
+    scalar = field->fieldIsScalar();
+    numberOfPoints = points;
+    interval = refreshInterval;
+    nextRefresh = std::numeric_limits<double>::lowest();
+    snapshotCount = failedCount = 0;
+
+    values.assign(total * components(), 0);
+    return true;
+}
+
+bool CFieldSampler::query( double x, double y, double z, double value[3] ) const
+{
+    value[0] = value[1] = value[2] = 0;
+    if (scalar)
+        return field->queryScalarField(x, y, z, numberOfPoints, NApi::eIdw, value[0]);
+    return field->queryVectorField(x, y, z, numberOfPoints, NApi::eIdw, value[0], value[1], value[2]);
+}
+
+void CFieldSampler::snapshot()
+{
+    size_t k = 0;
+    for (int iz = 0; iz < dims[2]; iz++)
+        for (int iy = 0; iy < dims[1]; iy++)
+            for (int ix = 0; ix < dims[0]; ix++, k++)
+            {
+                double value[3];
+                if (!query(lo[0] + ix * step[0], lo[1] + iy * step[1], lo[2] + iz * step[2], value))
+                    failedCount++;
+                for (int c = 0; c < components(); c++)
+                    values[k * components() + c] = value[c];
+            }
+    snapshotCount++;
+}
+
+bool CFieldSampler::refresh( double time )
+{
+    if (field == nullptr || time < nextRefresh.load(std::memory_order_acquire))
+        return false;
+
+    std::lock_guard<std::mutex> lock(refreshMutex);
+    if (time < nextRefresh.load(std::memory_order_relaxed))
+        return false;
+
+    snapshot();
+    // a zero interval refreshes once per distinct time
+    const double next = interval > 0 ? time + interval
+                                     : std::nextafter(time, std::numeric_limits<double>::infinity());
+    nextRefresh.store(next, std::memory_order_release);
+    return true;
+}
+
+void CFieldSampler::sample( size_t n, const double *x, const double *y, const double *z,
+                            double *out0, double *out1, double *out2, EInterpolation interpolation ) const
+{
+    if (interpolation == EInterpolation::eTrilinear)
+        interpolate<true>(components(), n, x, y, z, values.data(), lo, step, dims, out0, out1, out2);
+    else
+        interpolate<false>(components(), n, x, y, z, values.data(), lo, step, dims, out0, out1, out2);
+}
+
+SFieldSamplerError CFieldSampler::measureError( size_t n, const double *x, const double *y, const double *z,
+                                                EInterpolation interpolation, size_t stride ) const
+{
+    SFieldSamplerError error;
+    if (field == nullptr || n == 0)
+        return error;
+
+    stride = stride == 0 ? 1 : stride;
+    std::vector<double> px, py, pz;
+    for (size_t i = 0; i < n; i += stride)
+    {
+        px.push_back(x[i]);
+        py.push_back(y[i]);
+        pz.push_back(z[i]);
+    }
+    const size_t m = px.size();
+
+    std::vector<double> cached[3];
+    for (auto &column : cached)
+        column.resize(m);
+    auto start = std::chrono::steady_clock::now();
+    sample(m, px.data(), py.data(), pz.data(), cached[0].data(), cached[1].data(), cached[2].data(), interpolation);
+    auto mid = std::chrono::steady_clock::now();
+
+    std::vector<double> direct(3 * m);
+    for (size_t i = 0; i < m; i++)
+        query(px[i], py[i], pz[i], &direct[3 * i]);
+    auto end = std::chrono::steady_clock::now();
+
+    double sumSq = 0;
+    for (size_t i = 0; i < m; i++)
+    {
+        double diffSq = 0, magSq = 0;
+        for (int c = 0; c < components(); c++)
+        {
+            const double d = cached[c][i] - direct[3 * i + c];
+            error.maxAbs = std::max(error.maxAbs, std::abs(d));
+            diffSq += d * d;
+            magSq += direct[3 * i + c] * direct[3 * i + c];
+        }
+        sumSq += diffSq;
+        if (magSq > 0)
+            error.maxRel = std::max(error.maxRel, std::sqrt(diffSq / magSq));
+    }
+
+    error.points = m;
+    error.rms = std::sqrt(sumSq / (m * components()));
+    error.cachedSeconds = std::chrono::duration<double>(mid - start).count();
+    error.directSeconds = std::chrono::duration<double>(end - mid).count();
+    return error;
+}
@@ -0,0 +1,91 @@
+#pragma once
+
+#include <atomic>
+#include <mutex>
+#include <vector>
+
+#include <Api/Core/IFieldApi_1_0.h>
+
+/** Cost of the cached field compared with direct queries */
+struct SFieldSamplerError
+{
+    size_t points = 0;        /**< points compared */
+    double maxAbs = 0;        /**< largest absolute difference of a component */
+    double rms = 0;           /**< root mean square difference over all components */
+    double maxRel = 0;        /**< largest difference relative to the field magnitude */
+    double cachedSeconds = 0; /**< time of the batched interpolation of the points */
+    double directSeconds = 0; /**< time of the direct queries of the same points */
+};
+
+/**
+ * Snapshot of an IFieldApi_1_0 field on a local regular grid.
+ *
+ * refresh() queries the field once per grid node whenever the refresh
+ * interval has elapsed; sample() then interpolates whole particle arrays
+ * from the snapshot without touching the host. The components of a node
+ * are stored together, so a trilinear lookup touches as few cache lines
+ * as possible, and the interpolation loops vectorise.
+ *
+ * The sampler is for consistency and a bounded number of host queries
+ * per refresh; measureError() tells how close the snapshot is to the
+ * field. It does not make a query cheaper than a cheap field answers it.
+ *
+ * Points outside the box are clamped to its faces. Nodes the field
+ * cannot answer for hold zero and are counted in failedQueries().
+ *
+ * refresh() may be called from several threads at the first call of a
+ * step: one of them rebuilds the snapshot while the others wait, so no
+ * thread samples a half built snapshot as long as every thread calls
+ * refresh() before sample() in a step.
+ */
+class CFieldSampler
+{
+public:
+    enum class EInterpolation { eNearest, eTrilinear };
+
+    /**
+     * Binds the sampler to a field. Every dimension needs at least two
+     * nodes. A refresh interval of zero snapshots every time step.
+     */
+    bool bind( NApiCore::IFieldApi_1_0 *field, const double lo[3], const double hi[3], const int dims[3],
+               double refreshInterval, unsigned int numberOfPoints = 8 );
+
+    bool isBound() const { return field != nullptr; }
+    int components() const { return scalar ? 1 : 3; }
+
+    /** Takes a new snapshot if the interval has elapsed, returns true if it did */
+    bool refresh( double time );
+
+    /**
+     * Interpolates the field at n points. out1 and out2 are only written
+     * for vector fields.
+     */
+    void sample( size_t n, const double *x, const double *y, const double *z,
+                 double *out0, double *out1, double *out2, EInterpolation interpolation ) const;
+
+    /** Compares sample() with direct field queries at every stride-th point */
+    SFieldSamplerError measureError( size_t n, const double *x, const double *y, const double *z,
+                                     EInterpolation interpolation, size_t stride = 1 ) const;
+
+    size_t snapshots() const { return snapshotCount; }
+    size_t failedQueries() const { return failedCount; }
+
+private:
+    bool query( double x, double y, double z, double value[3] ) const;
+    void snapshot();
+
+    NApiCore::IFieldApi_1_0 *field = nullptr;
+    bool scalar = true;
+    unsigned int numberOfPoints = 8;
+
+    double lo[3] = {0, 0, 0};
+    double step[3] = {1, 1, 1};
+    int dims[3] = {0, 0, 0};
+    std::vector<double> values; /**< node values, components interleaved */
+
+    double interval = 0;
+    std::atomic<double> nextRefresh{0};
+    std::mutex refreshMutex;
+    size_t snapshotCount = 0;
+    size_t failedCount = 0;
+};
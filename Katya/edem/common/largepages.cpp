@@ -0,0 +1,284 @@
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+
+#ifndef _WIN32
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+#include "largepages.h"
+#include "parallel.h"
+
+namespace
+{
+    const uint64_t BLOCK_MAGIC = 0x4c41524745504147ull;
+    const size_t HUGE_PAGE = size_t(2) << 20;
+    const size_t PAGE = 4096;
+
+    enum EKind : uint64_t { eHeap, eMapped, eExplicit };
+}
+
+bool SLargePageConfig::readOption( std::string const& key, std::string const& value )
+{
+    std::istringstream values(value);
+    if (key == "pages")
+    {
+        const char *names[] = {"default", "transparent", "explicit"};
+        for (int m = 0; m < 3; m++)
+            if (value == names[m])
+            {
+                pages = EPageMode(m);
+                return true;
+            }
+        return false;
+    }
+    if (key == "first_touch" && (value == "on" || value == "off"))
+    {
+        firstTouch = value == "on";
+        return true;
+    }
+    if (key == "first_touch_threads")
+        return bool(values >> threads);
+    if (key == "large_threshold")
+        return bool(values >> threshold);
+    return false;
+}
+
+void SLargePageConfig::readEnvironment()
+{
+    const char *variables[][2] = {{"EDEM_PAGES", "pages"}, {"EDEM_FIRST_TOUCH", "first_touch"},
+                                  {"EDEM_LARGE_THRESHOLD", "large_threshold"}};
+    for (auto const& variable : variables)
+    {
+        const char *value = getenv(variable[0]);
+        if (value != nullptr && !readOption(variable[1], value))
+            fprintf(stderr, "ignoring %s=%s\n", variable[0], value);
+    }
+}
+
+CLargePages::CLargePages()
+{
+    settings.readEnvironment();
+    tlb.start();
+}
+
+CLargePages &CLargePages::instance()
+{
+    static CLargePages pages;
+    return pages;
+}
+
+void CLargePages::configure( const SLargePageConfig &newConfig )
+{
+    std::lock_guard<std::mutex> guard(mutex);
+    settings = newConfig;
+}
+
+SLargePageConfig CLargePages::config() const
+{
+    std::lock_guard<std::mutex> guard(mutex);
+    return settings;
+}
+
+void *CLargePages::allocate( size_t bytes )
+{
+    static_assert(sizeof(SBlockHeader) == 64, "blocks keep a cache line of alignment");
+    const SLargePageConfig current = config();
+    const size_t total = bytes + sizeof(SBlockHeader);
+
+    SBlockHeader *header = nullptr;
+    uint64_t kind = eHeap, length = total;
+#ifndef _WIN32
+    if (current.pages != EPageMode::eDefault && total >= current.threshold)
+    {
+        length = (total + HUGE_PAGE - 1) / HUGE_PAGE * HUGE_PAGE;
+        void *mapped = MAP_FAILED;
+        if (current.pages == EPageMode::eExplicit)
+        {
+            mapped = mmap(nullptr, length, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+            kind = eExplicit;
+            if (mapped == MAP_FAILED)
+                fallbacks++;
+        }
+        if (mapped == MAP_FAILED)
+        {
+            // over-map by a huge page and trim, so the block starts on a huge page boundary
+            kind = eMapped;
+            void *raw = mmap(nullptr, length + HUGE_PAGE, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+            if (raw != MAP_FAILED)
+            {
+                const uintptr_t start = (uintptr_t(raw) + HUGE_PAGE - 1) / HUGE_PAGE * HUGE_PAGE;
+                if (start > uintptr_t(raw))
+                    munmap(raw, start - uintptr_t(raw));
+                const uintptr_t end = start + length, rawEnd = uintptr_t(raw) + length + HUGE_PAGE;
+                if (rawEnd > end)
+                    munmap(reinterpret_cast<void *>(end), rawEnd - end);
+                mapped = reinterpret_cast<void *>(start);
+#ifdef MADV_HUGEPAGE
+                madvise(mapped, length, MADV_HUGEPAGE);
+#endif
+            }
+        }
+        if (mapped != MAP_FAILED)
+        {
+            if (current.firstTouch)
+            {
+                // the same contiguous split parallelFor gives the array's users; the
+                // workers are not pinned, so the placement is a likely one only
+                char *pages = static_cast<char *>(mapped);
+                parallelFor(0, length / PAGE, current.threads, [pages]( size_t lo, size_t hi )
+                {
+                    for (size_t p = lo; p < hi; p++)
+                        static_cast<volatile char *>(pages)[p * PAGE] = 0;
+                }, 1);
+                touchedBytes += length;
+            }
+            header = static_cast<SBlockHeader *>(mapped);
+            mappings++;
+            mappedBytes += length;
+            if (kind == eExplicit)
+                explicitBytes += length;
+        }
+    }
+#endif
+    if (header == nullptr)
+    {
+        kind = eHeap;
+        length = total;
+        header = static_cast<SBlockHeader *>(::operator new(total));
+        heapBytes += length;
+    }
+    header->magic = BLOCK_MAGIC;
+    header->length = length;
+    header->kind = kind;
+    return header + 1;
+}
+
+void CLargePages::deallocate( void *block, size_t )
+{
+    if (block == nullptr)
+        return;
+    SBlockHeader *header = static_cast<SBlockHeader *>(block) - 1;
+    const uint64_t length = header->length, kind = header->kind;
+    header->magic = 0;
+    if (kind == eHeap)
+    {
+        heapBytes -= length;
+        ::operator delete(header);
+        return;
+    }
+#ifndef _WIN32
+    munmap(header, length);
+#endif
+    mappings--;
+    mappedBytes -= length;
+    if (kind == eExplicit)
+        explicitBytes -= length;
+}
+
+CLargePages::SStats CLargePages::stats() const
+{
+    SStats s;
+    s.mappings = mappings;
+    s.mappedBytes = mappedBytes;
+    s.explicitBytes = explicitBytes;
+    s.fallbacks = fallbacks;
+    s.touchedBytes = touchedBytes;
+    s.heapBytes = heapBytes;
+    return s;
+}
+
+long long CLargePages::transparentHugeBytes()
+{
+    for (const char *path : {"/proc/self/smaps_rollup", "/proc/self/smaps"})
+    {
+        std::ifstream smaps(path);
+        if (!smaps)
+            continue;
+        long long total = 0;
+        std::string line;
+        while (std::getline(smaps, line))
+            if (line.compare(0, 14, "AnonHugePages:") == 0)
+                total += atoll(line.c_str() + 14) * 1024;
+        return total;
+    }
+    return -1;
+}
+
+std::string CLargePages::report() const
+{
+    const SLargePageConfig current = config();
+    const SStats s = stats();
+    const char *names[] = {"default", "transparent", "explicit"};
+    const long long transparent = transparentHugeBytes();
+    char misses[64] = "unknown";
+    if (tlb.available())
+        snprintf(misses, sizeof(misses), "%llu", (unsigned long long)tlb.read());
+    char line[512];
+    snprintf(line, sizeof(line),
+             "pages %s, first touch %s: %zu mappings of %.1f MB (%.1f MB explicit, %zu fallbacks), "
+             "%.1f MB on transparent huge pages, %.1f MB first touched, %.1f MB from the heap, dTLB misses %s",
+             names[int(current.pages)], current.firstTouch ? "on" : "off", s.mappings, s.mappedBytes / 1048576.0,
+             s.explicitBytes / 1048576.0, s.fallbacks, transparent < 0 ? 0.0 : transparent / 1048576.0,
+             s.touchedBytes / 1048576.0, s.heapBytes / 1048576.0, misses);
+    return line;
+}
+
+CTlbCounter::CTlbCounter( bool inherit )
+{
+#ifndef _WIN32
+    perf_event_attr attr;
+    memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = PERF_TYPE_HW_CACHE;
+    attr.config = PERF_COUNT_HW_CACHE_DTLB | PERF_COUNT_HW_CACHE_OP_READ << 8 | PERF_COUNT_HW_CACHE_RESULT_MISS << 16;
+    attr.disabled = 1;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    attr.inherit = inherit ? 1 : 0;
+    descriptor = int(syscall(__NR_perf_event_open, &attr, 0, -1, -1, 0));
+#endif
+}
+
+CTlbCounter::~CTlbCounter()
+{
+#ifndef _WIN32
+    if (descriptor >= 0)
+        close(descriptor);
+#endif
+}
+
+void CTlbCounter::start()
+{
+#ifndef _WIN32
+    if (descriptor < 0)
+        return;
+    ioctl(descriptor, PERF_EVENT_IOC_RESET, 0);
+    ioctl(descriptor, PERF_EVENT_IOC_ENABLE, 0);
+#endif
+}
+
+uint64_t CTlbCounter::stop()
+{
+#ifndef _WIN32
+    if (descriptor >= 0)
+        ioctl(descriptor, PERF_EVENT_IOC_DISABLE, 0);
+#endif
+    return read();
+}
+
+uint64_t CTlbCounter::read() const
+{
+    uint64_t count = 0;
+#ifndef _WIN32
+    if (descriptor >= 0 && ::read(descriptor, &count, sizeof(count)) != ssize_t(sizeof(count)))
+        count = 0;
+#endif
+    return count;
+}
@@ -0,0 +1,161 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <new>
+#include <string>
+#include <vector>
+
+/** How large arrays are backed */
+enum class EPageMode { eDefault, eTransparent, eExplicit };
+
+struct SLargePageConfig
+{
+    /**
+     *  - eDefault      operator new, as any vector;
+     *  - eTransparent  an anonymous mapping advised for transparent huge pages;
+     *  - eExplicit     a MAP_HUGETLB mapping from the reserved 2 MB pages,
+     *                  falling back to eTransparent when none are left.
+     */
+    EPageMode pages = EPageMode::eDefault;
+    /**
+     * Touch a new mapping from parallelFor workers, page range by page
+     * range as parallelFor splits the array, so on a NUMA machine each
+     * part lands on the node the touching thread ran on. Best effort:
+     * parallelFor does not pin its workers, so a later worker on the same
+     * range is only likely, not certain, to run on that node.
+     */
+    bool firstTouch = false;
+    /** Threads of the first touch, 0 for one per hardware thread */
+    size_t threads = 0;
+    /** Smaller arrays always come from operator new */
+    size_t threshold = size_t(1) << 21;
+
+    /**
+     * Reads a config line:
+     *
+     *     pages = default | transparent | explicit
+     *     first_touch = on | off
+     *     first_touch_threads = <n>
+     *     large_threshold = <bytes>
+     *
+     * false for other keys or bad values.
+     */
+    bool readOption( std::string const& key, std::string const& value );
+    /** The same from EDEM_PAGES, EDEM_FIRST_TOUCH and EDEM_LARGE_THRESHOLD */
+    void readEnvironment();
+};
+
+/**
+ * Data TLB load misses of the calling thread through perf_event_open;
+ * unavailable (and counting nothing) where perf events are not allowed.
+ * With inherit the threads the calling thread starts afterwards count
+ * too, each once it has ended.
+ */
+class CTlbCounter
+{
+public:
+    explicit CTlbCounter( bool inherit = false );
+    ~CTlbCounter();
+    CTlbCounter( const CTlbCounter & ) = delete;
+    CTlbCounter &operator=( const CTlbCounter & ) = delete;
+
+    bool available() const { return descriptor >= 0; }
+    void start();
+    /** Misses since start() */
+    uint64_t stop();
+    /** Misses since start(), counting on */
+    uint64_t read() const;
+
+private:
+    int descriptor = -1;
+};
+
+/**
+ * Process-wide source of large arrays, behind CLargeAllocator.
+ *
+ * The configuration starts from the environment and may be replaced by
+ * configure() (a factory config, say) before the arrays are built; it
+ * applies to allocations made after it. Every block remembers how it
+ * was allocated, so a block is released correctly whatever the
+ * configuration is by then. Windows builds always use operator new.
+ *
+ * The data TLB misses in report() are counted from the first use of
+ * the large pages, by the thread that made it and, once they end, the
+ * threads it started later (see CTlbCounter).
+ */
+class CLargePages
+{
+public:
+    struct SStats
+    {
+        size_t mappings = 0;         /**< live mapped blocks */
+        size_t mappedBytes = 0;      /**< their size, rounded to pages */
+        size_t explicitBytes = 0;    /**< of which MAP_HUGETLB */
+        size_t fallbacks = 0;        /**< explicit requests that got transparent pages */
+        size_t touchedBytes = 0;     /**< first touched by workers, since start */
+        size_t heapBytes = 0;        /**< live blocks from operator new */
+    };
+
+    static CLargePages &instance();
+
+    void configure( const SLargePageConfig &newConfig );
+    SLargePageConfig config() const;
+
+    void *allocate( size_t bytes );
+    void deallocate( void *block, size_t bytes );
+
+    SStats stats() const;
+    /** Transparent huge pages backing the process (AnonHugePages of /proc/self/smaps), -1 if unknown */
+    static long long transparentHugeBytes();
+    /** One line of the configuration and statistics */
+    std::string report() const;
+
+private:
+    CLargePages();
+
+    /** What precedes every block, one cache line */
+    struct SBlockHeader
+    {
+        uint64_t magic;
+        uint64_t length;   /**< of the whole mapping */
+        uint64_t kind;     /**< 0 heap, 1 mapping, 2 explicit huge pages */
+        uint64_t pad[5];
+    };
+
+    mutable std::mutex mutex;
+    SLargePageConfig settings;
+
+    std::atomic<size_t> mappings{0}, mappedBytes{0}, explicitBytes{0}, fallbacks{0}, touchedBytes{0}, heapBytes{0};
+    CTlbCounter tlb{true};
+};
+
+/** std allocator over CLargePages */
+template <class T>
+struct CLargeAllocator
+{
+    using value_type = T;
+
+    CLargeAllocator() = default;
+    template <class U>
+    CLargeAllocator( const CLargeAllocator<U> & ) {}
+
+    T *allocate( size_t n )
+    {
+        if (n > size_t(-1) / sizeof(T))
+            throw std::bad_array_new_length();
+        return static_cast<T *>(CLargePages::instance().allocate(n * sizeof(T)));
+    }
+    void deallocate( T *block, size_t n ) { CLargePages::instance().deallocate(block, n * sizeof(T)); }
+
+    template <class U>
+    bool operator==( const CLargeAllocator<U> & ) const { return true; }
+    template <class U>
+    bool operator!=( const CLargeAllocator<U> & ) const { return false; }
+};
+
+/** Vector for arrays that may grow to gigabytes: particle columns, grids, bond tables */
+template <class T>
+using tLargeVector = std::vector<T, CLargeAllocator<T>>;
@@ -0,0 +1,528 @@
+#include <algorithm>
+#include <charconv>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <limits>
+#include <mutex>
+#include <string_view>
+#include <thread>
+#include <unordered_map>
+
+#include "largepages.h"
+#include "musenstore.h"
+#include "parallel.h"
+
+namespace
+{
+    const char MAGIC[4] = {'M', 'C', 'S', '1'};
+
+    size_t aligned( size_t offset )
+    {
+        return (offset + 7) & ~size_t(7);
+    }
+
+    bool seek( FILE *file, uint64_t offset )
+    {
+#ifdef _WIN32
+        return _fseeki64(file, int64_t(offset), SEEK_SET) == 0;
+#else
+        return fseeko(file, off_t(offset), SEEK_SET) == 0;
+#endif
+    }
+
+    bool writeAt( FILE *file, uint64_t offset, const void *data, size_t bytes )
+    {
+        return bytes == 0 || (seek(file, offset) && fwrite(data, 1, bytes, file) == bytes);
+    }
+
+    /** Static fields of one export line */
+    struct SEntity
+    {
+        int64_t id = 0;
+        double radius = -1;
+        int64_t begin = -1;
+        int64_t end = -1;
+        double birth = 0;
+        double death = -1;
+        bool hasLifetime = false;
+        std::string_view material;
+    };
+
+    /** Tokens of a line, split on blanks, as views into the mapping */
+    class CTokens
+    {
+    public:
+        CTokens( const char *from, const char *to ) : p(from), end(to) {}
+
+        bool next( std::string_view &token )
+        {
+            while (p < end && (*p == ' ' || *p == '\t' || *p == '\r'))
+                p++;
+            if (p == end)
+                return false;
+            const char *start = p;
+            while (p < end && *p != ' ' && *p != '\t' && *p != '\r')
+                p++;
+            token = std::string_view(start, size_t(p - start));
+            return true;
+        }
+
+        template <class T>
+        bool number( T &value )
+        {
+            std::string_view token;
+            if (!next(token))
+                return false;
+            const char *first = token.data();
+            if (*first == '+')
+                first++;
+            const std::from_chars_result result = std::from_chars(first, token.data() + token.size(), value);
+            return result.ec == std::errc() && result.ptr == token.data() + token.size();
+        }
+
+    private:
+        const char *p;
+        const char *end;
+    };
+
+    /**
+     * Parses one line as defect_processor.py does. Coordinates of time
+     * point k go to coords[(3k + a) * stride], the time points to times
+     * if not null; with coords null only the time points are counted.
+     * @return null, or what is wrong with the line
+     */
+    const char *parseLine( const char *from, const char *to, EMusenKind kind, SEntity &entity,
+                           double *coords, size_t stride, size_t timePoints, double *times,
+                           size_t &timeCount, bool &hasCoordinates )
+    {
+        CTokens tokens(from, to);
+        std::string_view token;
+        if (!tokens.next(token) || token != "0")
+            return "the first column is expected to be 0";
+        if (!tokens.number(entity.id))
+            return "no entity id";
+
+        timeCount = 0;
+        while (tokens.next(token))
+        {
+            if (token == "2")
+            {
+                double t;
+                if (!tokens.number(t))
+                    return "bad time point";
+                if (coords != nullptr && timeCount >= timePoints)
+                    return "more time points than the first entity";
+                if (times != nullptr)
+                    times[timeCount] = t;
+                timeCount++;
+                if (kind == EMusenKind::eParticles && (!tokens.next(token) || token != "12"))
+                    return "12 is expected after <2 time>";
+            }
+            if (token == "12")
+            {
+                if (timeCount == 0)
+                    return "coordinates before any time point";
+                double xyz[3];
+                if (!tokens.number(xyz[0]) || !tokens.number(xyz[1]) || !tokens.number(xyz[2]))
+                    return "bad coordinates";
+                if (coords != nullptr)
+                    for (int a = 0; a < 3; a++)
+                        coords[(3 * (timeCount - 1) + a) * stride] = xyz[a];
+                hasCoordinates = true;
+            }
+            else if (token == "5" && kind == EMusenKind::eParticles)
+            {
+                if (!tokens.number(entity.radius))
+                    return "bad radius";
+            }
+            else if (token == "5")
+            {
+                if (!tokens.number(entity.begin) || !tokens.number(entity.end))
+                    return "bad bond ends";
+            }
+            else if (token == "24" && kind == EMusenKind::eBonds)
+            {
+                if (!tokens.number(entity.birth) || !tokens.number(entity.death))
+                    return "bad bond lifetime";
+                entity.hasLifetime = true;
+            }
+            else if (token == "23" && kind == EMusenKind::eBonds)
+            {
+                if (!tokens.next(entity.material))
+                    return "no material after 23";
+            }
+        }
+
+        if (coords != nullptr && timeCount != timePoints)
+            return "fewer time points than the first entity";
+        if (kind == EMusenKind::eParticles && entity.radius < 0)
+            return "radius was not mentioned";
+        if (kind == EMusenKind::eBonds && (entity.begin < 0 || entity.end < 0 || !entity.hasLifetime))
+            return "expected bond ends and lifetime";
+        return nullptr;
+    }
+
+    bool isBlank( const char *from, const char *to )
+    {
+        for (; from < to; from++)
+            if (*from != ' ' && *from != '\t' && *from != '\r')
+                return false;
+        return true;
+    }
+
+    /** Starts of the non-blank lines of the text, found by the threads piece by piece */
+    std::vector<size_t> lineStarts( const char *text, size_t size, size_t threads )
+    {
+        const size_t pieces = std::max<size_t>(1, std::min<size_t>(4 * threads, size >> 16));
+        const size_t step = (size + pieces - 1) / pieces;
+        auto eachLine = [text, size, step]( size_t piece, auto &&f )
+        {
+            const size_t hi = std::min(size, (piece + 1) * step);
+            for (size_t p = piece * step; p < hi; p++)
+                if (p == 0 || text[p - 1] == '\n')
+                {
+                    const char *eol = static_cast<const char *>(memchr(text + p, '\n', size - p));
+                    if (!isBlank(text + p, eol != nullptr ? eol : text + size))
+                        f(p);
+                }
+        };
+
+        std::vector<size_t> counts(pieces + 1, 0);
+        parallelFor(0, pieces, threads, [&]( size_t lo, size_t hi )
+        {
+            for (size_t piece = lo; piece < hi; piece++)
+                eachLine(piece, [&]( size_t ) { counts[piece + 1]++; });
+        }, 1);
+        for (size_t piece = 0; piece < pieces; piece++)
+            counts[piece + 1] += counts[piece];
+
+        std::vector<size_t> starts(counts[pieces]);
+        parallelFor(0, pieces, threads, [&]( size_t lo, size_t hi )
+        {
+            for (size_t piece = lo; piece < hi; piece++)
+            {
+                size_t at = counts[piece];
+                eachLine(piece, [&]( size_t p ) { starts[at++] = p; });
+            }
+        }, 1);
+        return starts;
+    }
+}
+
+bool CMusenStore::open( const std::string &path )
+{
+    close();
+    if (!file.open(path) || file.size() < sizeof(SHeader))
+        return false;
+
+    SHeader header;
+    memcpy(&header, file.data(), sizeof(header));
+    const uint64_t n = header.count;
+    const uint64_t staticBytes = header.kind == uint32_t(EMusenKind::eParticles) ? 8 * n : aligned(36 * n);
+    const uint64_t frameBytes = 24 * n * header.timePoints;
+    bool ok = memcmp(header.magic, MAGIC, sizeof(MAGIC)) == 0 && header.version == VERSION &&
+              header.kind <= uint32_t(EMusenKind::eBonds) && header.fileSize == file.size() &&
+              header.timesOffset + 8 * header.timePoints <= header.idsOffset &&
+              header.idsOffset + 8 * n <= header.indexOffset &&
+              header.indexOffset + sizeof(SIndexEntry) * n <= header.staticOffset &&
+              header.staticOffset + staticBytes <= header.materialsOffset &&
+              header.materialsOffset <= header.fileSize;
+    if (ok && header.framesOffset != 0)
+        ok = header.staticOffset + staticBytes <= header.framesOffset &&
+             header.framesOffset + frameBytes <= header.materialsOffset;
+    if (!ok)
+    {
+        close();
+        return false;
+    }
+
+    const uint8_t *base = file.data();
+    entityKind = EMusenKind(header.kind);
+    count = size_t(n);
+    frames = size_t(header.timePoints);
+    timeColumn = reinterpret_cast<const double *>(base + header.timesOffset);
+    idColumn = reinterpret_cast<const int64_t *>(base + header.idsOffset);
+    index = reinterpret_cast<const SIndexEntry *>(base + header.indexOffset);
+    staticData = reinterpret_cast<const double *>(base + header.staticOffset);
+    frameData = header.framesOffset != 0 ? reinterpret_cast<const double *>(base + header.framesOffset) : nullptr;
+
+    const char *name = reinterpret_cast<const char *>(base + header.materialsOffset);
+    const char *tableEnd = reinterpret_cast<const char *>(base + header.fileSize);
+    for (uint32_t k = 0; k < header.materialCount; k++)
+    {
+        const char *nul = static_cast<const char *>(memchr(name, 0, size_t(tableEnd - name)));
+        if (nul == nullptr)
+        {
+            close();
+            return false;
+        }
+        materialNames.push_back(name);
+        name = nul + 1;
+    }
+    return true;
+}
+
+void CMusenStore::close()
+{
+    file.close();
+    count = frames = 0;
+    timeColumn = nullptr;
+    idColumn = nullptr;
+    index = nullptr;
+    staticData = frameData = nullptr;
+    materialNames.clear();
+}
+
+size_t CMusenStore::timeIndex( double t ) const
+{
+    return size_t(std::lower_bound(timeColumn, timeColumn + frames, t) - timeColumn);
+}
+
+int64_t CMusenStore::row( int64_t id ) const
+{
+    const SIndexEntry *found = std::lower_bound(index, index + count, id,
+                                                []( const SIndexEntry &e, int64_t v ) { return e.id < v; });
+    return found != index + count && found->id == id ? int64_t(found->row) : -1;
+}
+
+bool CMusenConverter::convert( const std::string &input, EMusenKind kind, const std::string &output,
+                               const SParams &params, SReport &report, std::string &error )
+{
+    const auto start = std::chrono::steady_clock::now();
+    report = SReport();
+    const size_t threads = params.threads != 0 ? params.threads : std::max(1u, std::thread::hardware_concurrency());
+
+    CMappedFile source;
+    if (!source.open(input))
+    {
+        error = "cannot map " + input;
+        return false;
+    }
+    const char *text = reinterpret_cast<const char *>(source.data());
+    const size_t textSize = source.size();
+    report.inputBytes = textSize;
+
+    const std::vector<size_t> lines = lineStarts(text, textSize, threads);
+    auto lineEnd = [text, textSize]( size_t p )
+    {
+        const char *eol = static_cast<const char *>(memchr(text + p, '\n', textSize - p));
+        return eol != nullptr ? eol : text + textSize;
+    };
+    auto fail = [&]( size_t row, const char *what )
+    {
+        const size_t line = 1 + size_t(std::count(text, text + lines[row], '\n'));
+        error = input + ":" + std::to_string(line) + ": " + what;
+        return false;
+    };
+    if (lines.empty())
+    {
+        error = input + " has no entities";
+        return false;
+    }
+
+    // the first entity fixes the time points
+    const size_t n = lines.size();
+    size_t timePoints = 0;
+    bool hasCoordinates = false;
+    {
+        SEntity entity;
+        if (const char *what = parseLine(text + lines[0], lineEnd(lines[0]), kind, entity, nullptr, 0, 0,
+                                         nullptr, timePoints, hasCoordinates))
+            return fail(0, what);
+    }
+    std::vector<double> times(timePoints);
+
+    CMusenStore::SHeader header = {};
+    memcpy(header.magic, MAGIC, sizeof(MAGIC));
+    header.version = CMusenStore::VERSION;
+    header.kind = uint32_t(kind);
+    header.count = n;
+    header.timePoints = timePoints;
+    header.timesOffset = aligned(sizeof(header));
+    header.idsOffset = aligned(header.timesOffset + 8 * timePoints);
+    header.indexOffset = header.idsOffset + 8 * n;
+    header.staticOffset = header.indexOffset + sizeof(CMusenStore::SIndexEntry) * n;
+    const uint64_t framesOffset = header.staticOffset + (kind == EMusenKind::eParticles ? 8 * n : aligned(36 * n));
+    const uint64_t frameBytes = 24 * uint64_t(n) * timePoints;
+
+    // static columns of every entity; the frames go batch by batch
+    std::vector<int64_t> ids(n);
+    std::vector<double> radius(kind == EMusenKind::eParticles ? n : 0);
+    std::vector<int64_t> begins(kind == EMusenKind::eBonds ? n : 0), ends(begins.size());
+    std::vector<double> births(begins.size()), deaths(begins.size());
+    std::vector<std::string_view> materialOf(begins.size());
+
+    const size_t rowBytes = std::max<size_t>(24 * timePoints, 1);
+    const size_t batch = std::min(n, std::max<size_t>(1, params.batchBytes / rowBytes));
+    tLargeVector<double> buffer(batch * 3 * timePoints);
+
+    const std::string temporary = CPackingSidecar::temporaryPath(output);
+    FILE *out = fopen(temporary.c_str(), "wb");
+    if (out == nullptr)
+    {
+        error = "cannot write " + temporary;
+        return false;
+    }
+    auto abandon = [&]( const std::string &message )
+    {
+        fclose(out);
+        remove(temporary.c_str());
+        if (!message.empty())
+            error = message;
+        return false;
+    };
+
+    // frames of bonds are only stored once some bond has coordinates;
+    // rows before the first such batch are then filled with NaN
+    size_t framesFrom = kind == EMusenKind::eParticles ? 0 : n;
+    auto writeFrames = [&]( size_t rowBegin, size_t rows, const double *columns, size_t stride )
+    {
+        bool ok = true;
+        for (size_t c = 0; ok && c < 3 * timePoints; c++)
+            ok = writeAt(out, framesOffset + 8 * (uint64_t(c) * n + rowBegin), columns + c * stride, 8 * rows);
+        return ok;
+    };
+
+    std::mutex failure;
+    size_t failedRow = n;
+    const char *failedWhat = nullptr;
+    for (size_t rowBegin = 0; rowBegin < n; rowBegin += batch)
+    {
+        const size_t rows = std::min(batch, n - rowBegin);
+        if (kind == EMusenKind::eBonds)
+            std::fill(buffer.begin(), buffer.end(), std::numeric_limits<double>::quiet_NaN());
+
+        bool batchCoordinates = false;
+        parallelFor(rowBegin, rowBegin + rows, threads, [&]( size_t lo, size_t hi )
+        {
+            bool seen = false;
+            for (size_t r = lo; r < hi; r++)
+            {
+                SEntity entity;
+                size_t timeCount;
+                const char *what = parseLine(text + lines[r], lineEnd(lines[r]), kind, entity,
+                                             buffer.data() + (r - rowBegin), batch, timePoints,
+                                             r == 0 ? times.data() : nullptr, timeCount, seen);
+                if (what != nullptr)
+                {
+                    std::lock_guard<std::mutex> lock(failure);
+                    if (r < failedRow)
+                    {
+                        failedRow = r;
+                        failedWhat = what;
+                    }
+                    return;
+                }
+                ids[r] = entity.id;
+                if (kind == EMusenKind::eParticles)
+                    radius[r] = entity.radius;
+                else
+                {
+                    begins[r] = entity.begin;
+                    ends[r] = entity.end;
+                    births[r] = entity.birth;
+                    deaths[r] = entity.death;
+                    materialOf[r] = entity.material;
+                }
+            }
+            if (seen)
+            {
+                std::lock_guard<std::mutex> lock(failure);
+                batchCoordinates = true;
+            }
+        }, 256);
+        if (failedWhat != nullptr)
+        {
+            abandon(std::string());
+            return fail(failedRow, failedWhat);
+        }
+
+        if (batchCoordinates && framesFrom == n)
+        {
+            // the first bonds with coordinates: NaN for the rows before
+            std::vector<double> nan(std::min(rowBegin, batch), std::numeric_limits<double>::quiet_NaN());
+            for (size_t r = 0; r < rowBegin; r += nan.size())
+                if (!writeFrames(r, std::min(nan.size(), rowBegin - r), nan.data(), 0))
+                    return abandon("cannot write " + temporary);
+            framesFrom = 0;
+        }
+        if (framesFrom == 0 && !writeFrames(rowBegin, rows, buffer.data(), batch))
+            return abandon("cannot write " + temporary);
+        report.batches++;
+    }
+    hasCoordinates = framesFrom == 0;
+
+    // index, materials and the static columns
+    std::vector<CMusenStore::SIndexEntry> index(n);
+    for (size_t r = 0; r < n; r++)
+        index[r] = {ids[r], uint64_t(r)};
+    std::sort(index.begin(), index.end(),
+              []( const CMusenStore::SIndexEntry &a, const CMusenStore::SIndexEntry &b ) { return a.id < b.id; });
+    for (size_t r = 1; r < n; r++)
+        if (index[r].id == index[r - 1].id)
+        {
+            abandon(std::string());
+            return fail(size_t(index[r].row), "duplicate id");
+        }
+
+    std::vector<uint32_t> materials(begins.size());
+    std::unordered_map<std::string_view, uint32_t> materialIndex;
+    std::string materialTable;
+    for (size_t r = 0; r < materials.size(); r++)
+    {
+        if (materialOf[r].empty())
+        {
+            materials[r] = ~0u;
+            continue;
+        }
+        const auto found = materialIndex.emplace(materialOf[r], uint32_t(materialIndex.size()));
+        if (found.second)
+        {
+            materialTable += materialOf[r];
+            materialTable += '\0';
+        }
+        materials[r] = found.first->second;
+    }
+
+    header.framesOffset = hasCoordinates ? framesOffset : 0;
+    header.materialsOffset = hasCoordinates ? framesOffset + frameBytes : framesOffset;
+    header.materialCount = uint32_t(materialIndex.size());
+    header.fileSize = header.materialsOffset + materialTable.size();
+
+    bool ok = writeAt(out, 0, &header, sizeof(header)) &&
+              writeAt(out, header.timesOffset, times.data(), 8 * times.size()) &&
+              writeAt(out, header.idsOffset, ids.data(), 8 * n) &&
+              writeAt(out, header.indexOffset, index.data(), sizeof(CMusenStore::SIndexEntry) * n);
+    if (kind == EMusenKind::eParticles)
+        ok = ok && writeAt(out, header.staticOffset, radius.data(), 8 * n);
+    else
+    {
+        uint64_t at = header.staticOffset;
+        for (const void *column : {(const void *)begins.data(), (const void *)ends.data(),
+                                   (const void *)births.data(), (const void *)deaths.data()})
+        {
+            ok = ok && writeAt(out, at, column, 8 * n);
+            at += 8 * n;
+        }
+        ok = ok && writeAt(out, at, materials.data(), 4 * n);
+        // pad the material column up to the frames
+        const uint64_t padding = framesOffset - (at + 4 * n);
+        ok = ok && writeAt(out, at + 4 * n, "\0\0\0\0\0\0\0", size_t(padding));
+    }
+    ok = ok && writeAt(out, header.materialsOffset, materialTable.data(), materialTable.size());
+    ok = fclose(out) == 0 && ok;
+    if (!ok || !CPackingSidecar::replaceFile(temporary, output))
+    {
+        remove(temporary.c_str());
+        error = "cannot write " + output;
+        return false;
+    }
+
+    report.entities = n;
+    report.timePoints = timePoints;
+    report.outputBytes = size_t(header.fileSize);
+    report.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    return true;
+}
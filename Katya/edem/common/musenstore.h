@@ -0,0 +1,155 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "packingsidecar.h"
+
+/**
+ * Columnar store of a MUSEN text export of particles or bonds, written
+ * by CMusenConverter and mapped by CMusenStore.
+ *
+ * The export has one entity per line, `0 <id>` then marker-tagged
+ * fields, separated by spaces:
+ *
+ *     2 <t>               a time point, the k-th one of the line
+ *     12 <x> <y> <z>      coordinates at the last time point
+ *     5 <radius>          particles: the radius
+ *     5 <begin> <end>     bonds: ids of the bonded particles
+ *     24 <birth> <death>  bonds: lifetime
+ *     23 <material>       bonds: material name
+ *
+ * Every entity has the same number of time points; unknown tokens are
+ * skipped one at a time, as defect_processor.py does. Particles give
+ * coordinates at every time point, bonds may give none.
+ *
+ * Layout (native byte order, every block 8 byte aligned):
+ *
+ *     header     "MCS1", version, kind, material count, entity count,
+ *                time point count, block offsets
+ *     times      the time points
+ *     ids        entity ids in export order; a row is an index into it
+ *     index      (id, row) pairs sorted by id
+ *     static     particles: radius; bonds: begin and end ids, birth,
+ *                death, material index (uint32, ~0u for none)
+ *     frames     for each time point the x, y and z columns, NaN where
+ *                a bond has no coordinates
+ *     materials  material names, NUL terminated
+ *
+ * A frame is contiguous, so reading one time point of a mapped store
+ * touches only that time point's pages; a row is found by id through
+ * the index in O(log n).
+ */
+enum class EMusenKind : uint32_t { eParticles, eBonds };
+
+class CMusenStore
+{
+public:
+    static constexpr uint32_t VERSION = 1;
+
+    bool open( const std::string &path );
+    void close();
+
+    EMusenKind kind() const { return entityKind; }
+    size_t size() const { return count; }
+    size_t timePoints() const { return frames; }
+    const double *times() const { return timeColumn; }
+    /** First time point at or after t (timePoints() if none), as defect_processor.py picks frames */
+    size_t timeIndex( double t ) const;
+
+    const int64_t *ids() const { return idColumn; }
+    /** Row of an entity, -1 if there is none */
+    int64_t row( int64_t id ) const;
+
+    /** Particles */
+    const double *radius() const { return staticColumn(0); }
+    /** Bonds */
+    const int64_t *begin() const { return reinterpret_cast<const int64_t *>(staticColumn(0)); }
+    const int64_t *end() const { return reinterpret_cast<const int64_t *>(staticColumn(1)); }
+    const double *birth() const { return staticColumn(2); }
+    const double *death() const { return staticColumn(3); }
+    const uint32_t *material() const { return reinterpret_cast<const uint32_t *>(staticColumn(4)); }
+    size_t materials() const { return materialNames.size(); }
+    const char *materialName( size_t k ) const { return materialNames[k]; }
+
+    /** Whether any frame holds coordinates */
+    bool hasCoordinates() const { return frameData != nullptr; }
+    /** Column of axis a at time point t */
+    const double *frame( size_t t, int a ) const { return frameData + (3 * t + a) * count; }
+
+private:
+    struct SHeader
+    {
+        char magic[4];
+        uint32_t version;
+        uint32_t kind;
+        uint32_t materialCount;
+        uint64_t count;
+        uint64_t timePoints;
+        uint64_t timesOffset;
+        uint64_t idsOffset;
+        uint64_t indexOffset;
+        uint64_t staticOffset;
+        uint64_t framesOffset;   /**< 0 without coordinates */
+        uint64_t materialsOffset;
+        uint64_t fileSize;
+    };
+
+    struct SIndexEntry
+    {
+        int64_t id;
+        uint64_t row;
+    };
+
+    const double *staticColumn( size_t c ) const { return staticData + c * count; }
+
+    friend class CMusenConverter;
+
+    CMappedFile file;
+    EMusenKind entityKind = EMusenKind::eParticles;
+    size_t count = 0;
+    size_t frames = 0;
+    const double *timeColumn = nullptr;
+    const int64_t *idColumn = nullptr;
+    const SIndexEntry *index = nullptr;
+    const double *staticData = nullptr;
+    const double *frameData = nullptr;
+    std::vector<const char *> materialNames;
+};
+
+/**
+ * Converts a MUSEN export into a CMusenStore file.
+ *
+ * The export is mapped and tokenised in place (std::from_chars over the
+ * mapping, no allocation per token): a parallelFor finds the lines,
+ * then batches of lines are parsed by a parallelFor into reused frame
+ * buffers and each batch is written into its place in every frame, so
+ * memory stays within `batchBytes` plus the per-entity static columns
+ * whatever the number of time points. The store is written to a
+ * temporary file and renamed over the output.
+ */
+class CMusenConverter
+{
+public:
+    struct SParams
+    {
+        size_t threads = 0;
+        /** Budget of the frame buffers of a batch */
+        size_t batchBytes = size_t(256) << 20;
+    };
+
+    struct SReport
+    {
+        size_t entities = 0;
+        size_t timePoints = 0;
+        size_t batches = 0;
+        size_t inputBytes = 0;
+        size_t outputBytes = 0;
+        double seconds = 0;
+    };
+
+    static bool convert( const std::string &input, EMusenKind kind, const std::string &output,
+                         const SParams &params, SReport &report, std::string &error );
+};
@@ -0,0 +1,178 @@
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+
+#include "packing.h"
+
+namespace
+{
+    bool blank( std::string const& line )
+    {
+        return line.find_first_not_of(" \t\r") == std::string::npos;
+    }
+}
+
+bool CPacking::read( std::string const& centersFile, std::string const& radiiFile )
+{
+    x.clear();
+    y.clear();
+    z.clear();
+    r.clear();
+    properties.clear();
+
+    if (!readCenters(centersFile) || !readRadiuses(radiiFile))
+        return false;
+
+    return r.size() == x.size();
+}
+
+bool CPacking::read( SPackingSource const& source )
+{
+    if (!read(source.centers, source.radii))
+        return false;
+
+    for (auto const& property : source.properties)
+        if (!readProperty(property.first, property.second))
+            return false;
+    return true;
+}
+
+bool CPacking::readProperty( std::string const& name, std::string const& fileName )
+{
+    std::ifstream ifs(fileName);
+
+    if (!ifs)
+        return false;
+
+    SPackingProperty property;
+    property.name = name;
+    property.values.reserve(size());
+
+    std::string line;
+    size_t rows = 0;
+
+    while (std::getline(ifs, line, '\n'))
+    {
+        if (blank(line))
+            continue;
+
+        if (rows == 0)
+            property.elements = unsigned(std::max(parseRow(line, nullptr, 0), 0));
+        const size_t at = property.values.size();
+        property.values.resize(at + property.elements);
+        const int elements = parseRow(line, property.values.data() + at, property.elements);
+        if (elements <= 0 || unsigned(elements) != property.elements)
+            return false;
+        rows++;
+    }
+
+    if (rows != size())
+        return false;
+
+    properties.push_back(std::move(property));
+    return true;
+}
+
+bool CPacking::write( std::string const& centersFile, std::string const& radiiFile ) const
+{
+    std::ofstream centers(centersFile), radii(radiiFile);
+    if (!centers || !radii)
+        return false;
+
+    centers.precision(12);
+    radii.precision(12);
+    for (size_t i = 0; i < size(); i++)
+    {
+        centers << i + 1 << ',' << x[i] << ',' << y[i] << ',' << z[i] << '\n';
+        radii << i + 1 << ',' << r[i] << '\n';
+    }
+    return bool(centers) && bool(radii);
+}
+
+int CPacking::parseRow( std::string const& line, double *values, unsigned int maxValues )
+{
+    int count = 0;
+    for (const char *comma = strchr(line.c_str(), ','); comma != nullptr; count++)
+    {
+        char *end;
+        const double value = strtod(comma + 1, &end);
+        if (end == comma + 1)
+            return -1;
+        if (unsigned(count) < maxValues)
+            values[count] = value;
+        comma = strchr(end, ',');
+    }
+    return count;
+}
+
+unsigned int CPacking::propertyElements( std::string const& fileName )
+{
+    std::ifstream ifs(fileName);
+    std::string line;
+    while (std::getline(ifs, line, '\n'))
+    {
+        if (line.empty())
+            continue;
+        const size_t first = line.find(',');
+        return first == std::string::npos ? 0 : unsigned(std::count(line.begin() + first, line.end(), ','));
+    }
+    return 0;
+}
+
+double CPacking::maxRadius() const
+{
+    return r.empty() ? 0 : *std::max_element(r.begin(), r.end());
+}
+
+double CPacking::minRadius() const
+{
+    return r.empty() ? 0 : *std::min_element(r.begin(), r.end());
+}
+
+bool CPacking::readCenters( std::string const& fileName )
+{
+    std::ifstream ifs(fileName);
+
+    if (!ifs)
+        return false;
+
+    std::string line;
+
+    while (std::getline(ifs, line, '\n'))
+    {
+        if (blank(line))
+            continue;
+
+        double p[3];
+        if (parseRow(line, p, 3) < 3)
+            return false;
+        x.push_back(p[0]);
+        y.push_back(p[1]);
+        z.push_back(p[2]);
+    }
+    return true;
+}
+
+bool CPacking::readRadiuses( std::string const& fileName )
+{
+    std::ifstream ifs(fileName);
+
+    if (!ifs)
+        return false;
+
+    std::string line;
+
+    while (std::getline(ifs, line, '\n'))
+    {
+        if (blank(line))
+            continue;
+
+        double rad = 0;
+        if (parseRow(line, &rad, 1) < 1)
+            return false;
+        r.push_back(rad);
+    }
+
+    return true;
+}
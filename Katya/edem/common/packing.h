@@ -0,0 +1,68 @@
+#pragma once
+
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "largepages.h"
+
+/** Extra per-particle column: values of one custom property, elements interleaved */
+struct SPackingProperty
+{
+    std::string name;
+    unsigned int elements = 1;
+    tLargeVector<double> values;
+
+    const double *row( size_t i ) const { return values.data() + i * elements; }
+};
+
+/** Files a packing is loaded from */
+struct SPackingSource
+{
+    std::string centers;
+    std::string radii;
+    /** (custom property name, file) of each extra column */
+    std::vector<std::pair<std::string, std::string>> properties;
+    /** Load through the binary sidecar, see CPackingSidecar */
+    bool sidecar = true;
+};
+
+/**
+ * Particle packing kept as structure of arrays: one column per
+ * coordinate plus the radius. Loaded from the Mote3D style pair of
+ * text files (`num,x,y,z` and `num,r` per line).
+ *
+ * Extra property columns come from files of the same shape,
+ * `num,v1[,v2...]` per line, one line per particle; the number of values
+ * on the first line is the element count of the property.
+ */
+class CPacking
+{
+public:
+    bool read( std::string const& centersFile, std::string const& radiiFile );
+    /** Reads the packing and all property columns of a source */
+    bool read( SPackingSource const& source );
+    /** Adds a property column, fails if the file does not cover every particle */
+    bool readProperty( std::string const& name, std::string const& fileName );
+    /** Writes the centers and radii files, numbered from 1 */
+    bool write( std::string const& centersFile, std::string const& radiiFile ) const;
+    /**
+     * Values after the leading number of a `num,v1[,v2...]` line, parsed
+     * in place so a line costs no allocation. The first maxValues go to
+     * values; returns the value count, or -1 if one is not a number.
+     */
+    static int parseRow( std::string const& line, double *values, unsigned int maxValues );
+    /** Element count of a property file from its first row, 0 if unreadable */
+    static unsigned int propertyElements( std::string const& fileName );
+
+    size_t size() const { return x.size(); }
+    double maxRadius() const;
+    double minRadius() const;
+
+    tLargeVector<double> x, y, z, r;
+    std::vector<SPackingProperty> properties;
+
+private:
+    bool readCenters( std::string const& fileName );
+    bool readRadiuses( std::string const& fileName );
+};
@@ -0,0 +1,117 @@
+#include <filesystem>
+
+#include "packingcache.h"
+
+namespace fs = std::filesystem;
+
+CPackingCache &CPackingCache::instance()
+{
+    static CPackingCache cache;
+    return cache;
+}
+
+bool CPackingCache::statFile( std::string const& path, std::string &name, SFileStamp &stamp )
+{
+    std::error_code error;
+    const fs::path canonical = fs::canonical(path, error);
+    if (error)
+        return false;
+
+    stamp.size = fs::file_size(canonical, error);
+    if (error)
+        return false;
+    stamp.mtime = int64_t(fs::last_write_time(canonical, error).time_since_epoch().count());
+    if (error)
+        return false;
+    name = canonical.string();
+    return true;
+}
+
+bool CPackingCache::fileKey( std::string const& path, std::string &key )
+{
+    std::string name;
+    SFileStamp stamp;
+    if (!statFile(path, name, stamp))
+        return false;
+    key += name + '|' + std::to_string(stamp.size) + '|' + std::to_string(stamp.mtime) + '\n';
+    return true;
+}
+
+bool CPackingCache::fileHash( std::string const& path, uint64_t &hash )
+{
+    std::string name;
+    SFileStamp stamp;
+    if (!statFile(path, name, stamp))
+        return false;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        auto known = stamps.find(name);
+        if (known != stamps.end() && known->second.size == stamp.size && known->second.mtime == stamp.mtime)
+        {
+            hash = known->second.hash;
+            return true;
+        }
+    }
+
+    // read outside the lock, so acquire() never waits for a file to be hashed
+    if (!CPackingSidecar::hashFile(name, stamp.hash))
+        return false;
+    std::lock_guard<std::mutex> lock(mutex);
+    stamps[name] = stamp;
+    hash = stamp.hash;
+    return true;
+}
+
+std::shared_ptr<const CPackingLoader> CPackingCache::acquire( SPackingSource const& source )
+{
+    std::lock_guard<std::mutex> lock(mutex);
+
+    std::string key;
+    if (!fileKey(source.centers, key) || !fileKey(source.radii, key))
+        return nullptr;
+    for (auto const& property : source.properties)
+    {
+        key += property.first + '=';
+        if (!fileKey(property.second, key))
+            return nullptr;
+    }
+
+    auto entry = entries.find(key);
+    if (entry != entries.end())
+    {
+        std::shared_ptr<const CPackingLoader> loader = entry->second.lock();
+        if (loader != nullptr && loader->state() != CPackingLoader::EState::eFailed)
+        {
+            hitCount++;
+            return loader;
+        }
+    }
+
+    missCount++;
+    auto loader = std::make_shared<CPackingLoader>();
+    loader->start(source, [this]( std::string const& path, uint64_t &hash ) { return fileHash(path, hash); });
+
+    // drop entries whose packings are gone
+    for (auto it = entries.begin(); it != entries.end();)
+        it = it->second.expired() ? entries.erase(it) : std::next(it);
+
+    entries[key] = loader;
+    return loader;
+}
+
+bool CPackingCache::sourceHash( SPackingSource const& source, uint64_t &hash )
+{
+    return CPackingSidecar::sourceHash(source, hash, [this]( std::string const& path, uint64_t &file )
+    {
+        return fileHash(path, file);
+    });
+}
+
+size_t CPackingCache::liveEntries()
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    size_t live = 0;
+    for (auto const& entry : entries)
+        live += !entry.second.expired();
+    return live;
+}
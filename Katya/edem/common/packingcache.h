@@ -0,0 +1,66 @@
+#pragma once
+
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+
+#include "packingloader.h"
+
+/**
+ * Process-wide cache of loaded packings.
+ *
+ * Packings are immutable once loaded and shared through shared_ptr to
+ * their CPackingLoader; the cache itself only keeps weak references, so
+ * a packing is freed when its last user lets go of it. An entry is identified by the canonical
+ * path, size and modification time of every file of the source, so
+ * acquire() only stats the files. Misses start a background load and
+ * return at once; the loader thread takes the FNV-1a content hashes it
+ * checks the sidecar with from the cache, which reads a file again only
+ * when its path, size or mtime changed. A failed load is retried by the
+ * next acquire of the same source.
+ *
+ * The cache is a singleton of the shared library it is linked into;
+ * plugins built as separate libraries each have their own.
+ */
+class CPackingCache
+{
+public:
+    static CPackingCache &instance();
+
+    /** Shared loader of the source, started if needed; nullptr if a file is missing */
+    std::shared_ptr<const CPackingLoader> acquire( SPackingSource const& source );
+
+    /**
+     * Hash of the source as CPackingSidecar::sourceHash, from the
+     * remembered file hashes: a few stat calls once the loader hashed
+     * the files, a read of every file before.
+     */
+    bool sourceHash( SPackingSource const& source, uint64_t &hash );
+
+    /** Packings currently alive */
+    size_t liveEntries();
+    size_t hits() const { return hitCount; }
+    size_t misses() const { return missCount; }
+
+private:
+    struct SFileStamp
+    {
+        uint64_t size = 0;
+        int64_t mtime = 0;
+        uint64_t hash = 0;
+    };
+
+    static bool statFile( std::string const& path, std::string &name, SFileStamp &stamp );
+    /** Appends the identity of one file to key: canonical path, size and mtime */
+    bool fileKey( std::string const& path, std::string &key );
+    /** Content hash of one file, read only if it is new or changed; not under the mutex */
+    bool fileHash( std::string const& path, uint64_t &hash );
+
+    std::mutex mutex;
+    std::map<std::string, SFileStamp> stamps;
+    std::map<std::string, std::weak_ptr<const CPackingLoader>> entries;
+    size_t hitCount = 0;
+    size_t missCount = 0;
+};
@@ -0,0 +1,609 @@
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <numeric>
+
+#include "packingcodec.h"
+#include "parallel.h"
+
+namespace
+{
+    const char MAGIC[4] = {'P', 'K', 'Z', '1'};
+
+    /** Unary prefixes this long escape to an explicit bit length */
+    const unsigned ESCAPE = 24;
+
+    struct SBlockHeader
+    {
+        uint32_t count;
+        uint32_t bitBytes;
+        uint8_t rice[4];   /**< parameters of the x, y, z and radius columns */
+        uint32_t reserved;
+    };
+
+    size_t align8( size_t n )
+    {
+        return (n + 7) & ~size_t(7);
+    }
+
+    unsigned bitLength( uint64_t v )
+    {
+        unsigned bits = 0;
+        while (v != 0)
+        {
+            bits++;
+            v >>= 1;
+        }
+        return bits;
+    }
+
+    uint64_t zigzag( int64_t v )
+    {
+        return (uint64_t(v) << 1) ^ uint64_t(v >> 63);
+    }
+
+    int64_t unzigzag( uint64_t v )
+    {
+        return int64_t(v >> 1) ^ -int64_t(v & 1);
+    }
+
+    /** Spreads the low 21 bits of v to every third bit */
+    uint64_t spread3( uint64_t v )
+    {
+        v &= 0x1fffff;
+        v = (v | v << 32) & 0x1f00000000ffffull;
+        v = (v | v << 16) & 0x1f0000ff0000ffull;
+        v = (v | v << 8) & 0x100f00f00f00f00full;
+        v = (v | v << 4) & 0x10c30c30c30c30c3ull;
+        v = (v | v << 2) & 0x1249249249249249ull;
+        return v;
+    }
+
+    /** Inverse of spread3 */
+    uint64_t compact3( uint64_t v )
+    {
+        v &= 0x1249249249249249ull;
+        v = (v | v >> 2) & 0x10c30c30c30c30c3ull;
+        v = (v | v >> 4) & 0x100f00f00f00f00full;
+        v = (v | v >> 8) & 0x1f0000ff0000ffull;
+        v = (v | v >> 16) & 0x1f00000000ffffull;
+        v = (v | v >> 32) & 0x1fffff;
+        return v;
+    }
+
+    /** Little endian bit stream writer */
+    class CBitWriter
+    {
+    public:
+        explicit CBitWriter( std::vector<uint8_t> &bytes ) : out(bytes) {}
+
+        void put( uint64_t v, unsigned bits )
+        {
+            while (bits > 0)
+            {
+                const unsigned take = std::min(bits, 32u);
+                acc |= (v & ((uint64_t(1) << take) - 1)) << fill;
+                fill += take;
+                v = take < 64 ? v >> take : 0;
+                bits -= take;
+                while (fill >= 8)
+                {
+                    out.push_back(uint8_t(acc));
+                    acc >>= 8;
+                    fill -= 8;
+                }
+            }
+        }
+
+        void rice( uint64_t v, unsigned k )
+        {
+            const uint64_t q = v >> k;
+            if (q < ESCAPE)
+            {
+                put((uint64_t(1) << q) - 1, unsigned(q) + 1);
+                put(v, k);
+                return;
+            }
+            const unsigned bits = bitLength(v);
+            put((uint64_t(1) << ESCAPE) - 1, ESCAPE);
+            put(bits - 1, 6);
+            put(v, bits);
+        }
+
+        void flush()
+        {
+            if (fill > 0)
+                out.push_back(uint8_t(acc));
+            acc = 0;
+            fill = 0;
+        }
+
+    private:
+        std::vector<uint8_t> &out;
+        uint64_t acc = 0;
+        unsigned fill = 0;
+    };
+
+    /** Reader of a CBitWriter stream; reading past the end yields zeros and clears ok */
+    class CBitReader
+    {
+    public:
+        CBitReader( const uint8_t *begin, const uint8_t *end )
+            : p(begin), last(end), available(8 * size_t(end - begin)) {}
+
+        uint64_t get( unsigned bits )
+        {
+            uint64_t v = 0;
+            for (unsigned done = 0; done < bits;)
+            {
+                const unsigned take = std::min(bits - done, 32u);
+                refill();
+                v |= (acc & ((uint64_t(1) << take) - 1)) << done;
+                consume(take);
+                done += take;
+            }
+            return v;
+        }
+
+        uint64_t rice( unsigned k )
+        {
+            refill();
+            // the unary prefix: count the ones below the first zero
+            const uint64_t zeros = ~acc;
+            unsigned q = zeros == 0 ? 64 : unsigned(__builtin_ctzll(zeros));
+            if (q < ESCAPE)
+            {
+                consume(q + 1);
+                return (uint64_t(q) << k) | get(k);
+            }
+            consume(ESCAPE);
+            return get(unsigned(get(6)) + 1);
+        }
+
+        bool ok() const { return consumed <= available; }
+
+    private:
+        void refill()
+        {
+            for (; fill <= 56; fill += 8)
+                if (p < last)
+                    acc |= uint64_t(*p++) << fill;
+        }
+
+        void consume( unsigned bits )
+        {
+            acc = bits < 64 ? acc >> bits : 0;
+            fill -= bits;
+            consumed += bits;
+        }
+
+        const uint8_t *p, *last;
+        uint64_t acc = 0;
+        unsigned fill = 0;
+        size_t consumed = 0;
+        const size_t available;
+    };
+
+    /** Rice parameter near the best for the values, from their mean */
+    unsigned riceParameter( const uint64_t *values, size_t n )
+    {
+        if (n == 0)
+            return 0;
+        double mean = 0;
+        for (size_t i = 0; i < n; i++)
+            mean += double(values[i]);
+        mean /= n;
+        const unsigned guess = mean < 1 ? 0 : unsigned(std::floor(std::log2(mean)));
+
+        auto cost = [&]( unsigned k )
+        {
+            size_t bits = 0;
+            for (size_t i = 0; i < n; i++)
+            {
+                const uint64_t q = values[i] >> k;
+                bits += q < ESCAPE ? q + 1 + k : ESCAPE + 6 + bitLength(values[i]);
+            }
+            return bits;
+        };
+        unsigned best = guess;
+        size_t bestCost = cost(guess);
+        for (unsigned k : {guess - 1, guess + 1})
+            if (k < 58)
+            {
+                const size_t c = cost(k);
+                if (c < bestCost)
+                {
+                    best = k;
+                    bestCost = c;
+                }
+            }
+        return best;
+    }
+}
+
+bool CPackingCodec::encode( const CPacking &packing, const SParams &params, std::vector<uint8_t> &bytes )
+{
+    const size_t n = packing.size();
+    if (params.tolerance <= 0 || params.blockSize == 0 || n > UINT32_MAX)
+        return false;
+
+    SHeader header = {};
+    memcpy(header.magic, MAGIC, sizeof(MAGIC));
+    header.version = VERSION;
+    header.count = n;
+    header.blockSize = uint32_t(params.blockSize);
+    header.blockCount = uint32_t((n + params.blockSize - 1) / params.blockSize);
+    header.propertyCount = uint32_t(packing.properties.size());
+    header.step = 2 * params.tolerance;
+    header.indexBits = params.keepOrder ? std::max(1u, bitLength(n - 1)) : 0;
+
+    // quantised centres
+    const tLargeVector<double> *columns[3] = {&packing.x, &packing.y, &packing.z};
+    std::vector<uint32_t> q[3];
+    unsigned levelBits = 0;
+    for (int a = 0; a < 3; a++)
+    {
+        const tLargeVector<double> &c = *columns[a];
+        header.origin[a] = n == 0 ? 0 : *std::min_element(c.begin(), c.end());
+        q[a].resize(n);
+        for (size_t i = 0; i < n; i++)
+        {
+            const double level = std::round((c[i] - header.origin[a]) / header.step);
+            if (!(level >= 0 && level <= UINT32_MAX))
+                return false;
+            q[a][i] = uint32_t(level);
+            levelBits = std::max(levelBits, bitLength(q[a][i]));
+        }
+    }
+
+    // radii: exact codebook if there are few distinct ones, quantised otherwise
+    std::vector<double> codebook(packing.r.begin(), packing.r.end());
+    std::sort(codebook.begin(), codebook.end());
+    codebook.erase(std::unique(codebook.begin(), codebook.end()), codebook.end());
+    std::vector<uint32_t> radius(n);
+    if (n > 0 && codebook.size() <= params.codebookLimit)
+    {
+        header.codebookSize = uint32_t(codebook.size());
+        header.radiusBits = bitLength(codebook.size() - 1);
+        for (size_t i = 0; i < n; i++)
+            radius[i] = uint32_t(std::lower_bound(codebook.begin(), codebook.end(), packing.r[i]) - codebook.begin());
+    }
+    else
+    {
+        codebook.clear();
+        header.radiusBase = n == 0 ? 0 : *std::min_element(packing.r.begin(), packing.r.end());
+        header.radiusStep = 2 * (params.radiusTolerance > 0 ? params.radiusTolerance : params.tolerance);
+        for (size_t i = 0; i < n; i++)
+        {
+            const double level = std::round((packing.r[i] - header.radiusBase) / header.radiusStep);
+            if (!(level >= 0 && level <= UINT32_MAX))
+                return false;
+            radius[i] = uint32_t(level);
+        }
+    }
+
+    // Morton order of the top 21 bits of every coordinate
+    const unsigned shift = levelBits > 21 ? levelBits - 21 : 0;
+    std::vector<std::pair<uint64_t, uint32_t>> keys(n);
+    for (size_t i = 0; i < n; i++)
+        keys[i] = {spread3(q[0][i] >> shift) | spread3(q[1][i] >> shift) << 1 | spread3(q[2][i] >> shift) << 2,
+                   uint32_t(i)};
+    std::sort(keys.begin(), keys.end());
+    // keys of whole coordinates are coded as one ascending column
+    header.keyDeltas = shift == 0;
+
+    std::vector<std::vector<uint8_t>> blockBytes(header.blockCount);
+    parallelFor(0, header.blockCount, params.threads, [&]( size_t b0, size_t b1 )
+    {
+        std::vector<uint64_t> residuals[4];
+        for (size_t b = b0; b < b1; b++)
+        {
+            const size_t first = b * params.blockSize, last = std::min(n, first + params.blockSize);
+            for (int c = 0; c < 4; c++)
+                residuals[c].clear();
+            for (size_t s = first + 1; s < last; s++)
+            {
+                const uint32_t i = keys[s].second, prev = keys[s - 1].second;
+                if (header.keyDeltas)
+                    residuals[0].push_back(keys[s].first - keys[s - 1].first);
+                else
+                    for (int a = 0; a < 3; a++)
+                        residuals[a].push_back(zigzag(int64_t(q[a][i]) - int64_t(q[a][prev])));
+            }
+            for (size_t s = first; s < last; s++)
+                residuals[3].push_back(radius[keys[s].second]);
+
+            SBlockHeader block = {};
+            block.count = uint32_t(last - first);
+            for (int c = 0; c < 4; c++)
+                block.rice[c] = uint8_t(riceParameter(residuals[c].data(), residuals[c].size()));
+
+            std::vector<uint8_t> &out = blockBytes[b];
+            out.resize(sizeof(block));
+            CBitWriter bits(out);
+            if (header.keyDeltas)
+            {
+                bits.put(keys[first].first, 63);
+                for (size_t s = 0; s + 1 < block.count; s++)
+                    bits.rice(residuals[0][s], block.rice[0]);
+            }
+            else
+            {
+                for (int a = 0; a < 3; a++)
+                    bits.put(q[a][keys[first].second], 32);
+                for (size_t s = 0; s + 1 < block.count; s++)
+                    for (int a = 0; a < 3; a++)
+                        bits.rice(residuals[a][s], block.rice[a]);
+            }
+            for (size_t s = 0; s < block.count; s++)
+            {
+                if (header.codebookSize > 0)
+                    bits.put(residuals[3][s], header.radiusBits);
+                else
+                    bits.rice(residuals[3][s], block.rice[3]);
+            }
+            for (size_t s = first; header.indexBits > 0 && s < last; s++)
+                bits.put(keys[s].second, header.indexBits);
+            bits.flush();
+
+            block.bitBytes = uint32_t(out.size() - sizeof(block));
+            memcpy(out.data(), &block, sizeof(block));
+            out.resize(align8(out.size()), 0);
+            for (const SPackingProperty &property : packing.properties)
+                for (size_t s = first; s < last; s++)
+                {
+                    const double *row = property.row(keys[s].second);
+                    const uint8_t *raw = reinterpret_cast<const uint8_t *>(row);
+                    out.insert(out.end(), raw, raw + property.elements * sizeof(double));
+                }
+        }
+    }, 1);
+
+    std::vector<SPropertyEntry> table(packing.properties.size());
+    for (size_t k = 0; k < table.size(); k++)
+    {
+        const SPackingProperty &property = packing.properties[k];
+        if (property.name.size() >= CPackingSidecar::NAME_LENGTH)
+            return false;
+        memset(table[k].name, 0, sizeof(table[k].name));
+        memcpy(table[k].name, property.name.c_str(), property.name.size());
+        table[k].elements = property.elements;
+    }
+    std::vector<uint64_t> blockOffsets(size_t(header.blockCount) + 1, 0);
+    for (size_t b = 0; b < header.blockCount; b++)
+        blockOffsets[b + 1] = blockOffsets[b] + blockBytes[b].size();
+
+    bytes.clear();
+    auto append = [&bytes]( const void *data, size_t size )
+    {
+        const uint8_t *raw = static_cast<const uint8_t *>(data);
+        bytes.insert(bytes.end(), raw, raw + size);
+    };
+    bytes.reserve(sizeof(header) + codebook.size() * sizeof(double) + table.size() * sizeof(SPropertyEntry) +
+                  blockOffsets.size() * sizeof(uint64_t) + blockOffsets.back());
+    append(&header, sizeof(header));
+    append(codebook.data(), codebook.size() * sizeof(double));
+    append(table.data(), table.size() * sizeof(SPropertyEntry));
+    append(blockOffsets.data(), blockOffsets.size() * sizeof(uint64_t));
+    for (const std::vector<uint8_t> &block : blockBytes)
+        append(block.data(), block.size());
+    return true;
+}
+
+bool CPackingCodec::write( const std::string &path, const CPacking &packing, const SParams &params )
+{
+    std::vector<uint8_t> bytes;
+    if (!encode(packing, params, bytes))
+        return false;
+
+    FILE *out = fopen(path.c_str(), "wb");
+    if (out == nullptr)
+        return false;
+    const bool ok = fwrite(bytes.data(), 1, bytes.size(), out) == bytes.size();
+    return fclose(out) == 0 && ok;
+}
+
+bool CPackingCodec::open( const std::string &path )
+{
+    close();
+    if (!file.open(path))
+        return false;
+    if (!open(file.data(), file.size()))
+    {
+        file.close();
+        return false;
+    }
+    return true;
+}
+
+bool CPackingCodec::open( const uint8_t *bytes, size_t size )
+{
+    data = nullptr;
+    count = blocks = 0;
+    if (size < sizeof(SHeader))
+        return false;
+    memcpy(&header, bytes, sizeof(header));
+    if (memcmp(header.magic, MAGIC, sizeof(MAGIC)) != 0 || header.version != VERSION || header.blockSize == 0 ||
+        header.blockCount != (header.count + header.blockSize - 1) / header.blockSize ||
+        header.radiusBits > 32 || header.indexBits > 32)
+        return false;
+
+    size_t at = sizeof(SHeader);
+    const size_t tables = header.codebookSize * sizeof(double) + header.propertyCount * sizeof(SPropertyEntry) +
+                          (size_t(header.blockCount) + 1) * sizeof(uint64_t);
+    if (size - at < tables)
+        return false;
+    codebook = reinterpret_cast<const double *>(bytes + at);
+    at += header.codebookSize * sizeof(double);
+    propertyTable = reinterpret_cast<const SPropertyEntry *>(bytes + at);
+    at += header.propertyCount * sizeof(SPropertyEntry);
+    offsets = reinterpret_cast<const uint64_t *>(bytes + at);
+    at += (size_t(header.blockCount) + 1) * sizeof(uint64_t);
+    blockData = bytes + at;
+    if (offsets[header.blockCount] > size - at)
+        return false;
+
+    data = bytes;
+    length = size;
+    count = header.count;
+    blocks = header.blockCount;
+    blockSize = header.blockSize;
+    originalOrder = header.indexBits > 0;
+    return true;
+}
+
+void CPackingCodec::close()
+{
+    file.close();
+    data = nullptr;
+    length = 0;
+    count = blocks = 0;
+}
+
+void CPackingCodec::prepareColumns( CPacking &packing, size_t rows ) const
+{
+    for (tLargeVector<double> *c : {&packing.x, &packing.y, &packing.z, &packing.r})
+        c->assign(rows, 0.0);
+    packing.properties.resize(header.propertyCount);
+    for (size_t k = 0; k < header.propertyCount; k++)
+    {
+        SPackingProperty &property = packing.properties[k];
+        property.name.assign(propertyTable[k].name, strnlen(propertyTable[k].name, sizeof(propertyTable[k].name)));
+        property.elements = unsigned(propertyTable[k].elements);
+        property.values.assign(rows * property.elements, 0.0);
+    }
+}
+
+bool CPackingCodec::decodeBlock( size_t b, CPacking &packing, size_t at, uint32_t *indices ) const
+{
+    const uint64_t begin = offsets[b], end = offsets[b + 1];
+    if (begin > end || end - begin < sizeof(SBlockHeader))
+        return false;
+    SBlockHeader block;
+    memcpy(&block, blockData + begin, sizeof(block));
+    const size_t expected = b + 1 < blocks ? blockSize : count - b * blockSize;
+    if (block.count != expected || sizeof(block) + block.bitBytes > end - begin)
+        return false;
+
+    const uint8_t *stream = blockData + begin + sizeof(block);
+    CBitReader bits(stream, stream + block.bitBytes);
+    const size_t n = block.count;
+
+    double *x = packing.x.data(), *y = packing.y.data(), *z = packing.z.data(), *r = packing.r.data();
+    int64_t q[3];
+    uint64_t key = 0;
+    if (header.keyDeltas)
+        key = bits.get(63);
+    else
+        for (int a = 0; a < 3; a++)
+            q[a] = int64_t(bits.get(32));
+    for (size_t s = 0; s < n; s++)
+    {
+        if (header.keyDeltas)
+        {
+            if (s > 0)
+                key += bits.rice(block.rice[0]);
+            for (int a = 0; a < 3; a++)
+                q[a] = int64_t(compact3(key >> a));
+        }
+        else if (s > 0)
+            for (int a = 0; a < 3; a++)
+                q[a] += unzigzag(bits.rice(block.rice[a]));
+        x[at + s] = header.origin[0] + double(q[0]) * header.step;
+        y[at + s] = header.origin[1] + double(q[1]) * header.step;
+        z[at + s] = header.origin[2] + double(q[2]) * header.step;
+    }
+    for (size_t s = 0; s < n; s++)
+    {
+        if (header.codebookSize > 0)
+        {
+            const uint64_t index = bits.get(header.radiusBits);
+            if (index >= header.codebookSize)
+                return false;
+            r[at + s] = codebook[index];
+        }
+        else
+            r[at + s] = header.radiusBase + double(bits.rice(block.rice[3])) * header.radiusStep;
+    }
+    for (size_t s = 0; header.indexBits > 0 && s < n; s++)
+    {
+        const uint64_t index = bits.get(header.indexBits);
+        if (index >= count)
+            return false;
+        if (indices != nullptr)
+            indices[s] = uint32_t(index);
+    }
+    if (!bits.ok())
+        return false;
+
+    const uint8_t *values = blockData + begin + align8(sizeof(block) + block.bitBytes);
+    size_t valueBytes = 0;
+    for (size_t k = 0; k < header.propertyCount; k++)
+        valueBytes += n * propertyTable[k].elements * sizeof(double);
+    if (values + valueBytes > blockData + end)
+        return false;
+    for (size_t k = 0; k < header.propertyCount; k++)
+    {
+        SPackingProperty &property = packing.properties[k];
+        const size_t rowBytes = property.elements * sizeof(double);
+        for (size_t s = 0; s < n; s++)
+            memcpy(property.values.data() + (at + s) * property.elements,
+                   values + s * rowBytes, rowBytes);
+        values += n * rowBytes;
+    }
+    return true;
+}
+
+bool CPackingCodec::decode( CPacking &packing, size_t threads ) const
+{
+    if (data == nullptr)
+        return false;
+    if (!originalOrder)
+        return decodeBlocks(0, blocks, packing, nullptr, threads);
+
+    // decode in stored order, then move every particle to its source row
+    CPacking stored;
+    std::vector<uint32_t> indices;
+    if (!decodeBlocks(0, blocks, stored, &indices, threads))
+        return false;
+    prepareColumns(packing, count);
+    parallelFor(0, count, threads, [&]( size_t i0, size_t i1 )
+    {
+        for (size_t i = i0; i < i1; i++)
+        {
+            const size_t j = indices[i];
+            packing.x[j] = stored.x[i];
+            packing.y[j] = stored.y[i];
+            packing.z[j] = stored.z[i];
+            packing.r[j] = stored.r[i];
+            for (size_t k = 0; k < packing.properties.size(); k++)
+            {
+                const unsigned elements = packing.properties[k].elements;
+                std::copy_n(stored.properties[k].row(i), elements, packing.properties[k].values.data() + j * elements);
+            }
+        }
+    });
+    return true;
+}
+
+bool CPackingCodec::decodeBlocks( size_t first, size_t last, CPacking &packing,
+                                  std::vector<uint32_t> *indices, size_t threads ) const
+{
+    if (data == nullptr || first > last || last > blocks)
+        return false;
+
+    const size_t base = blockBegin(first);
+    prepareColumns(packing, blockBegin(last) - base);
+    if (indices != nullptr)
+        indices->assign(blockBegin(last) - base, 0);
+    std::vector<char> blockOk(last - first, 0);
+    parallelFor(first, last, threads, [&]( size_t b0, size_t b1 )
+    {
+        for (size_t b = b0; b < b1; b++)
+        {
+            const size_t at = blockBegin(b) - base;
+            blockOk[b - first] = decodeBlock(b, packing, at, indices != nullptr ? indices->data() + at : nullptr);
+        }
+    }, 1);
+    return std::all_of(blockOk.begin(), blockOk.end(), []( char ok ) { return ok != 0; });
+}
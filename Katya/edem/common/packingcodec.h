@@ -0,0 +1,133 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "packing.h"
+#include "packingsidecar.h"
+
+/**
+ * Compressed packing file (`.pkz`), written by encode() and read
+ * through a memory map.
+ *
+ * Centres are quantised against the packing's box to a step of twice
+ * `tolerance`, so no coordinate moves by more than the tolerance. The
+ * particles are sorted in Morton order of the quantised centres and cut
+ * into blocks. Inside a block the centres are stored as differences to
+ * the previous particle, Rice coded with a parameter chosen per block
+ * and column: the differences of the Morton keys when every coordinate
+ * fits the key's 21 bits, else the zigzag differences of each coordinate.
+ * Radii go through a codebook when the packing has few distinct radii
+ * (a fixed number of index bits), and are
+ * quantised to `radiusTolerance` and Rice coded from the smallest radius
+ * otherwise. Property columns follow their particles and are stored as
+ * plain doubles.
+ *
+ * Every block starts from absolute values and the file begins with a
+ * table of block offsets, so any block decodes on its own: decode()
+ * spreads the blocks over a parallelFor, decodeBlocks() reads a shard.
+ *
+ * Layout (native byte order):
+ *
+ *     header    "PKZ1", version, counts, box origin, steps, radius coding
+ *     codebook  radii, if the codebook is used
+ *     table     per property: name (64 bytes), element count
+ *     offsets   blockCount + 1 offsets of the blocks, from the first block
+ *     blocks    particle count, Rice parameters, the bit stream, then
+ *               the original indices (keepOrder) and property values
+ *
+ * Particles come back in Morton order unless the file was written with
+ * keepOrder, which stores each particle's index in the source (a fixed
+ * number of bits per particle) so decode() restores the original order.
+ */
+class CPackingCodec
+{
+public:
+    struct SParams
+    {
+        /** Largest change of a coordinate */
+        double tolerance = 1e-6;
+        /** Largest change of a radius, 0 for the same as tolerance */
+        double radiusTolerance = 0;
+        /** Up to this many distinct radii are kept exactly in a codebook */
+        size_t codebookLimit = 256;
+        size_t blockSize = 4096;
+        bool keepOrder = false;
+        size_t threads = 0;
+    };
+
+    static constexpr uint32_t VERSION = 1;
+
+    /** Compressed image of the packing, false if it cannot be quantised to the tolerance */
+    static bool encode( const CPacking &packing, const SParams &params, std::vector<uint8_t> &bytes );
+    /** Encodes into a file */
+    static bool write( const std::string &path, const CPacking &packing, const SParams &params );
+
+    /** Maps a compressed file, fails if it is not one or is truncated */
+    bool open( const std::string &path );
+    /** Reads an image in memory; the bytes must outlive the codec */
+    bool open( const uint8_t *data, size_t size );
+    void close();
+
+    size_t size() const { return count; }
+    size_t blockCount() const { return blocks; }
+    /** First particle of block b in the stored (Morton) order */
+    size_t blockBegin( size_t b ) const { return std::min(b * blockSize, count); }
+    bool keepsOrder() const { return originalOrder; }
+
+    /** Decodes the whole packing, in the original order if it was kept */
+    bool decode( CPacking &packing, size_t threads = 0 ) const;
+    /**
+     * Decodes blocks [first, last) in stored order.
+     * @param indices (optional) Source index of each particle, when the order was kept
+     */
+    bool decodeBlocks( size_t first, size_t last, CPacking &packing,
+                       std::vector<uint32_t> *indices = nullptr, size_t threads = 0 ) const;
+
+private:
+    struct SHeader
+    {
+        char magic[4];
+        uint32_t version;
+        uint64_t count;
+        uint32_t blockSize;
+        uint32_t blockCount;
+        uint32_t propertyCount;
+        uint32_t radiusBits;     /**< bits of a codebook index */
+        uint32_t codebookSize;   /**< 0 when radii are quantised instead */
+        uint32_t indexBits;      /**< bits of a source index, 0 unless keepOrder */
+        uint32_t keyDeltas;      /**< centres coded as Morton key differences */
+        uint32_t reserved;
+        double origin[3];
+        double step;
+        double radiusBase;
+        double radiusStep;
+    };
+
+    struct SPropertyEntry
+    {
+        char name[CPackingSidecar::NAME_LENGTH];
+        uint64_t elements;
+    };
+
+    /** Decodes block b into the columns of packing from row `at` */
+    bool decodeBlock( size_t b, CPacking &packing, size_t at, uint32_t *indices ) const;
+    void prepareColumns( CPacking &packing, size_t rows ) const;
+
+    CMappedFile file;
+    const uint8_t *data = nullptr;
+    size_t length = 0;
+
+    SHeader header = {};
+    size_t count = 0;
+    size_t blocks = 0;
+    size_t blockSize = 0;
+    bool originalOrder = false;
+    const double *codebook = nullptr;
+    const SPropertyEntry *propertyTable = nullptr;
+    const uint64_t *offsets = nullptr;
+    const uint8_t *blockData = nullptr;
+};
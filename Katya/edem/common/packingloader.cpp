@@ -0,0 +1,199 @@
+#include <exception>
+#include <fstream>
+#include <memory>
+#include <vector>
+
+#include "packingloader.h"
+
+namespace
+{
+    /** Rows parsed between two notifications of the waiting consumers */
+    const size_t PUBLISH_ROWS = 1024;
+
+    /** Next non-empty line, false at the end of the file */
+    bool nextRow( std::ifstream &ifs, std::string &line )
+    {
+        while (std::getline(ifs, line, '\n'))
+            if (line.find_first_not_of(" \t\r") != std::string::npos)
+                return true;
+        return false;
+    }
+}
+
+CPackingLoader::~CPackingLoader()
+{
+    cancelled = true;
+    if (worker.joinable())
+        worker.join();
+}
+
+void CPackingLoader::start( const SPackingSource &source, CPackingSidecar::tFileHasher hasher )
+{
+    worker = std::thread(&CPackingLoader::run, this, source, std::move(hasher));
+}
+
+void CPackingLoader::start( tLoad load )
+{
+    worker = std::thread([this, load = std::move(load)]()
+    {
+        const bool ok = load(data, error);
+        publish(ok ? data.size() : 0, ok ? EState::eDone : EState::eFailed);
+    });
+}
+
+bool CPackingLoader::waitFor( size_t count ) const
+{
+    if (ready() >= count)
+        return true;
+
+    std::unique_lock<std::mutex> lock(mutex);
+    progress.wait(lock, [&]() { return ready() >= count || state() != EState::eLoading; });
+    return ready() >= count;
+}
+
+CPackingLoader::EState CPackingLoader::wait() const
+{
+    std::unique_lock<std::mutex> lock(mutex);
+    progress.wait(lock, [&]() { return state() != EState::eLoading; });
+    return state();
+}
+
+void CPackingLoader::publish( size_t count, EState newState )
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        readyCount.store(count, std::memory_order_release);
+        loadState.store(int(newState), std::memory_order_release);
+    }
+    progress.notify_all();
+}
+
+void CPackingLoader::run( SPackingSource source, CPackingSidecar::tFileHasher hasher )
+{
+    // the hash only checks and stamps the sidecar
+    uint64_t hash = 0;
+    const bool hashed = source.sidecar && CPackingSidecar::sourceHash(source, hash, hasher);
+
+    CPackingSidecar sidecar;
+    if (source.sidecar && hashed && sidecar.open(CPackingSidecar::pathOf(source), hash))
+    {
+        sidecar.copyTo(data);
+        publish(data.size(), EState::eDone);
+        return;
+    }
+
+    bool ok;
+    try
+    {
+        ok = parse(source);
+    }
+    catch (const std::exception &e)
+    {
+        error = std::string("cannot parse packing: ") + e.what();
+        ok = false;
+    }
+    if (!ok)
+    {
+        publish(ready(), EState::eFailed);
+        return;
+    }
+
+    if (source.sidecar && hashed)
+        CPackingSidecar::write(CPackingSidecar::pathOf(source), data, hash);
+    publish(data.size(), EState::eDone);
+}
+
+bool CPackingLoader::parse( const SPackingSource &source )
+{
+    std::ifstream centers(source.centers), radii(source.radii);
+    if (!centers || !radii)
+    {
+        error = "cannot open " + (centers ? source.radii : source.centers);
+        return false;
+    }
+
+    // size every column from the centers file so rows never move
+    std::string line;
+    size_t n = 0;
+    while (nextRow(centers, line))
+        n++;
+    centers.clear();
+    centers.seekg(0);
+
+    data.x.resize(n);
+    data.y.resize(n);
+    data.z.resize(n);
+    data.r.resize(n);
+
+    std::vector<std::unique_ptr<std::ifstream>> files;
+    data.properties.resize(source.properties.size());
+    for (size_t k = 0; k < source.properties.size(); k++)
+    {
+        files.push_back(std::make_unique<std::ifstream>(source.properties[k].second));
+        SPackingProperty &property = data.properties[k];
+        property.name = source.properties[k].first;
+        property.elements = CPacking::propertyElements(source.properties[k].second);
+        if (!*files.back() || property.elements == 0)
+        {
+            error = "cannot read property file " + source.properties[k].second;
+            return false;
+        }
+        property.values.resize(n * property.elements);
+    }
+
+    double row[3];
+    for (size_t i = 0; i < n; i++)
+    {
+        if (cancelled.load(std::memory_order_relaxed))
+        {
+            error = "cancelled";
+            return false;
+        }
+
+        nextRow(centers, line);
+        if (CPacking::parseRow(line, row, 3) < 3)
+        {
+            error = source.centers + ": bad row " + std::to_string(i + 1);
+            return false;
+        }
+        data.x[i] = row[0];
+        data.y[i] = row[1];
+        data.z[i] = row[2];
+
+        if (!nextRow(radii, line) || CPacking::parseRow(line, row, 1) < 1)
+        {
+            error = source.radii + ": bad or missing row " + std::to_string(i + 1);
+            return false;
+        }
+        data.r[i] = row[0];
+
+        for (size_t k = 0; k < files.size(); k++)
+        {
+            SPackingProperty &property = data.properties[k];
+            double *values = property.values.data() + i * property.elements;
+            if (!nextRow(*files[k], line) ||
+                CPacking::parseRow(line, values, property.elements) != int(property.elements))
+            {
+                error = source.properties[k].second + ": bad or missing row " + std::to_string(i + 1);
+                return false;
+            }
+        }
+
+        if ((i + 1) % PUBLISH_ROWS == 0)
+            publish(i + 1, EState::eLoading);
+    }
+
+    // every file must end with the packing
+    if (nextRow(radii, line))
+    {
+        error = source.radii + ": more rows than " + source.centers;
+        return false;
+    }
+    for (size_t k = 0; k < files.size(); k++)
+        if (nextRow(*files[k], line))
+        {
+            error = source.properties[k].second + ": more rows than " + source.centers;
+            return false;
+        }
+    return true;
+}
@@ -0,0 +1,77 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+
+#include "packingsidecar.h"
+
+/**
+ * Loads a packing on a background thread and publishes the particles as
+ * they are parsed, so consumers can start on the front of the packing
+ * while the rest is still being read.
+ *
+ * A valid sidecar is mapped and published at once. Otherwise the
+ * centers, radii and property files are parsed in lockstep, row i of
+ * every column is complete before ready() passes i, and the sidecar is
+ * written when the parse is done. The columns are sized up front, so
+ * rows below ready() never move and may be read without locking;
+ * packing().size() is only meaningful once the load is done.
+ */
+class CPackingLoader
+{
+public:
+    enum class EState { eLoading, eDone, eFailed };
+
+    CPackingLoader() = default;
+    CPackingLoader( const CPackingLoader & ) = delete;
+    CPackingLoader &operator=( const CPackingLoader & ) = delete;
+    /** Cancels a running load */
+    ~CPackingLoader();
+
+    /** Starts loading on a new thread; hasher as in CPackingSidecar::load */
+    void start( const SPackingSource &source,
+                CPackingSidecar::tFileHasher hasher = CPackingSidecar::hashFile );
+
+    /** Fills the packing, or returns false with the reason */
+    using tLoad = std::function<bool( CPacking &, std::string & )>;
+    /** Runs a load of another kind on a new thread, the packing is published whole when it returns */
+    void start( tLoad load );
+
+    /** Particles that can be read now */
+    size_t ready() const { return readyCount.load(std::memory_order_acquire); }
+    EState state() const { return EState(loadState.load(std::memory_order_acquire)); }
+
+    /**
+     * Blocks until at least count particles are loaded or the load
+     * ended; false if there will never be that many (end of the packing
+     * or a failed load).
+     */
+    bool waitFor( size_t count ) const;
+    /** Blocks until the load ended */
+    EState wait() const;
+
+    /** Rows below ready() are final */
+    const CPacking &packing() const { return data; }
+    /** Why the load failed */
+    const std::string &getError() const { return error; }
+
+private:
+    void run( SPackingSource source, CPackingSidecar::tFileHasher hasher );
+    bool parse( const SPackingSource &source );
+    void publish( size_t count, EState state );
+
+    CPacking data;
+    std::string error;
+
+    std::atomic<size_t> readyCount{0};
+    std::atomic<int> loadState{int(EState::eLoading)};
+    std::atomic<bool> cancelled{false};
+
+    mutable std::mutex mutex;
+    mutable std::condition_variable progress;
+    std::thread worker;
+};
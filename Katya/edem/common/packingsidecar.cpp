@@ -0,0 +1,324 @@
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <functional>
+#include <thread>
+#include <vector>
+
+#ifdef _WIN32
+#include <windows.h>
+#include <process.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include "packingsidecar.h"
+
+namespace
+{
+    const char MAGIC[4] = {'P', 'K', 'C', '1'};
+    const uint32_t ORDER_MARK = 0x01020304;
+
+    const uint64_t FNV_BASIS = 14695981039346656037ull;
+
+    uint64_t fnv( uint64_t hash, const void *data, size_t size )
+    {
+        const uint8_t *bytes = static_cast<const uint8_t *>(data);
+        for (size_t i = 0; i < size; i++)
+        {
+            hash ^= bytes[i];
+            hash *= 1099511628211ull;
+        }
+        return hash;
+    }
+}
+
+std::string CPackingSidecar::temporaryPath( const std::string &path )
+{
+#ifdef _WIN32
+    const unsigned long pid = static_cast<unsigned long>(_getpid());
+#else
+    const unsigned long pid = static_cast<unsigned long>(getpid());
+#endif
+    const size_t thread = std::hash<std::thread::id>()(std::this_thread::get_id());
+    return path + "." + std::to_string(pid) + "." + std::to_string(thread) + ".tmp";
+}
+
+bool CPackingSidecar::replaceFile( const std::string &from, const std::string &to )
+{
+#ifdef _WIN32
+    return MoveFileExA(from.c_str(), to.c_str(), MOVEFILE_REPLACE_EXISTING) != 0;
+#else
+    return rename(from.c_str(), to.c_str()) == 0;
+#endif
+}
+
+CMappedFile::~CMappedFile()
+{
+    close();
+}
+
+bool CMappedFile::open( const std::string &path )
+{
+    close();
+#ifdef _WIN32
+    HANDLE handle = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_DELETE, nullptr,
+                                OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (handle == INVALID_HANDLE_VALUE)
+        return false;
+    LARGE_INTEGER fileSize;
+    if (!GetFileSizeEx(handle, &fileSize) || fileSize.QuadPart == 0)
+    {
+        CloseHandle(handle);
+        return false;
+    }
+    HANDLE mapping = CreateFileMappingA(handle, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    const void *view = mapping != nullptr ? MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0) : nullptr;
+    if (view == nullptr)
+    {
+        if (mapping != nullptr)
+            CloseHandle(mapping);
+        CloseHandle(handle);
+        return false;
+    }
+    fileHandle = handle;
+    mappingHandle = mapping;
+    bytes = static_cast<const uint8_t *>(view);
+    length = size_t(fileSize.QuadPart);
+#else
+    const int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0)
+        return false;
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size == 0)
+    {
+        ::close(fd);
+        return false;
+    }
+    void *view = mmap(nullptr, size_t(st.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+    // the mapping keeps the file alive, even if a writer replaces it
+    ::close(fd);
+    if (view == MAP_FAILED)
+        return false;
+    bytes = static_cast<const uint8_t *>(view);
+    length = size_t(st.st_size);
+#endif
+    return true;
+}
+
+void CMappedFile::close()
+{
+    if (bytes == nullptr)
+        return;
+#ifdef _WIN32
+    UnmapViewOfFile(bytes);
+    CloseHandle(mappingHandle);
+    CloseHandle(fileHandle);
+    fileHandle = mappingHandle = nullptr;
+#else
+    munmap(const_cast<uint8_t *>(bytes), length);
+#endif
+    bytes = nullptr;
+    length = 0;
+}
+
+bool CPackingSidecar::hashFile( const std::string &path, uint64_t &hash )
+{
+    std::ifstream ifs(path, std::ios::binary);
+    if (!ifs)
+        return false;
+
+    // FNV-1a over 64-bit words: one multiply per 8 bytes instead of per byte
+    hash = FNV_BASIS;
+    std::vector<uint64_t> buffer(1 << 13);
+    while (ifs)
+    {
+        ifs.read(reinterpret_cast<char *>(buffer.data()), std::streamsize(buffer.size() * sizeof(uint64_t)));
+        const size_t bytes = size_t(ifs.gcount());
+        const size_t words = bytes / sizeof(uint64_t);
+        for (size_t i = 0; i < words; i++)
+        {
+            hash ^= buffer[i];
+            hash *= 1099511628211ull;
+        }
+        hash = fnv(hash, reinterpret_cast<const char *>(buffer.data()) + words * sizeof(uint64_t),
+                   bytes - words * sizeof(uint64_t));
+    }
+    return true;
+}
+
+bool CPackingSidecar::sourceHash( const SPackingSource &source, uint64_t &hash, const tFileHasher &hasher )
+{
+    uint64_t file;
+    hash = FNV_BASIS;
+    if (!hasher(source.centers, file))
+        return false;
+    hash = fnv(hash, &file, sizeof(file));
+    if (!hasher(source.radii, file))
+        return false;
+    hash = fnv(hash, &file, sizeof(file));
+
+    for (auto const& property : source.properties)
+    {
+        hash = fnv(hash, property.first.c_str(), property.first.size() + 1);
+        if (!hasher(property.second, file))
+            return false;
+        hash = fnv(hash, &file, sizeof(file));
+    }
+    return true;
+}
+
+bool CPackingSidecar::write( const std::string &path, const CPacking &packing, uint64_t hash )
+{
+    SHeader header;
+    memcpy(header.magic, MAGIC, sizeof(MAGIC));
+    header.version = VERSION;
+    header.byteOrder = ORDER_MARK;
+    header.propertyCount = uint32_t(packing.properties.size());
+    header.hash = hash;
+    header.count = packing.size();
+
+    std::vector<SPropertyEntry> table(packing.properties.size());
+    uint64_t offset = 4 * header.count;
+    for (size_t k = 0; k < table.size(); k++)
+    {
+        const SPackingProperty &property = packing.properties[k];
+        if (property.name.size() >= NAME_LENGTH)
+            return false;
+        memset(table[k].name, 0, NAME_LENGTH);
+        memcpy(table[k].name, property.name.c_str(), property.name.size());
+        table[k].elements = property.elements;
+        table[k].offset = offset;
+        offset += property.values.size();
+    }
+
+    const std::string temporary = temporaryPath(path);
+    FILE *file = fopen(temporary.c_str(), "wb");
+    if (file == nullptr)
+        return false;
+
+    bool ok = fwrite(&header, sizeof(header), 1, file) == 1;
+    ok = ok && (table.empty() || fwrite(table.data(), sizeof(SPropertyEntry), table.size(), file) == table.size());
+    for (const tLargeVector<double> *c : {&packing.x, &packing.y, &packing.z, &packing.r})
+        ok = ok && fwrite(c->data(), sizeof(double), c->size(), file) == c->size();
+    for (const SPackingProperty &property : packing.properties)
+        ok = ok && fwrite(property.values.data(), sizeof(double), property.values.size(), file) ==
+                   property.values.size();
+    ok = fclose(file) == 0 && ok;
+
+    if (!ok || !replaceFile(temporary, path))
+    {
+        remove(temporary.c_str());
+        return false;
+    }
+    return true;
+}
+
+bool CPackingSidecar::map( const std::string &path, const uint64_t *expectedHash )
+{
+    close();
+    if (!file.open(path) || file.size() < sizeof(SHeader))
+        return false;
+
+    SHeader header;
+    memcpy(&header, file.data(), sizeof(header));
+    if (memcmp(header.magic, MAGIC, sizeof(MAGIC)) != 0 || header.version != VERSION ||
+        header.byteOrder != ORDER_MARK || (expectedHash != nullptr && header.hash != *expectedHash))
+    {
+        close();
+        return false;
+    }
+
+    count = size_t(header.count);
+    propertyCount = header.propertyCount;
+    builtFrom = header.hash;
+    const size_t columnsStart = sizeof(SHeader) + propertyCount * sizeof(SPropertyEntry);
+    if (file.size() < columnsStart)
+    {
+        close();
+        return false;
+    }
+    columns = reinterpret_cast<const double *>(file.data() + columnsStart);
+
+    // every property block has to lie inside the file
+    size_t doubles = 4 * count;
+    for (size_t k = 0; k < propertyCount; k++)
+    {
+        const SPropertyEntry &e = entry(k);
+        if (e.offset != doubles || e.elements == 0 || e.name[NAME_LENGTH - 1] != 0)
+        {
+            close();
+            return false;
+        }
+        doubles += e.elements * count;
+    }
+    if (file.size() != columnsStart + doubles * sizeof(double))
+    {
+        close();
+        return false;
+    }
+    return true;
+}
+
+const CPackingSidecar::SPropertyEntry &CPackingSidecar::entry( size_t k ) const
+{
+    return reinterpret_cast<const SPropertyEntry *>(file.data() + sizeof(SHeader))[k];
+}
+
+std::string CPackingSidecar::propertyName( size_t k ) const
+{
+    return entry(k).name;
+}
+
+unsigned int CPackingSidecar::propertyElements( size_t k ) const
+{
+    return unsigned(entry(k).elements);
+}
+
+const double *CPackingSidecar::propertyValues( size_t k ) const
+{
+    return columns + entry(k).offset;
+}
+
+void CPackingSidecar::copyTo( CPacking &packing ) const
+{
+    packing.x.assign(x(), x() + count);
+    packing.y.assign(y(), y() + count);
+    packing.z.assign(z(), z() + count);
+    packing.r.assign(r(), r() + count);
+
+    packing.properties.resize(propertyCount);
+    for (size_t k = 0; k < propertyCount; k++)
+    {
+        SPackingProperty &property = packing.properties[k];
+        property.name = propertyName(k);
+        property.elements = propertyElements(k);
+        property.values.assign(propertyValues(k), propertyValues(k) + property.elements * count);
+    }
+}
+
+CPackingSidecar::EStatus CPackingSidecar::load( CPacking &packing, const SPackingSource &source,
+                                                const tFileHasher &hasher )
+{
+    uint64_t hash;
+    if (!sourceHash(source, hash, hasher))
+        return EStatus::eFailed;
+
+    const std::string path = pathOf(source);
+    CPackingSidecar sidecar;
+    if (source.sidecar && sidecar.open(path, hash))
+    {
+        sidecar.copyTo(packing);
+        return EStatus::eMapped;
+    }
+
+    // missing or stale
+    if (!packing.read(source))
+        return EStatus::eFailed;
+    if (source.sidecar)
+        write(path, packing, hash);
+    return EStatus::eParsed;
+}
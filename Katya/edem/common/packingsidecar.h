@@ -0,0 +1,135 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <string>
+
+#include "packing.h"
+
+/** Read-only memory map of a whole file */
+class CMappedFile
+{
+public:
+    CMappedFile() = default;
+    CMappedFile( const CMappedFile & ) = delete;
+    CMappedFile &operator=( const CMappedFile & ) = delete;
+    ~CMappedFile();
+
+    bool open( const std::string &path );
+    void close();
+
+    const uint8_t *data() const { return bytes; }
+    size_t size() const { return length; }
+
+private:
+    const uint8_t *bytes = nullptr;
+    size_t length = 0;
+#ifdef _WIN32
+    void *fileHandle = nullptr;
+    void *mappingHandle = nullptr;
+#endif
+};
+
+/**
+ * Binary sidecar of a parsed packing, stored next to the centers file
+ * as `<centers>.pkc`.
+ *
+ * Layout (native byte order, every block 8 byte aligned):
+ *
+ *     header    "PKC1", version, byte order mark, source hash,
+ *               particle count, property count
+ *     table     per property: name (64 bytes), element count
+ *     columns   x, y, z, r, then the values of every property
+ *
+ * The source hash covers the contents of every file of the
+ * SPackingSource and the property names, so a sidecar whose inputs were
+ * edited is recognised as stale and rebuilt. Writers create a private
+ * temporary file and rename it over the sidecar, so sweep jobs that
+ * start together may all write it but a reader only ever maps a
+ * complete file.
+ */
+class CPackingSidecar
+{
+public:
+    enum class EStatus { eMapped, eParsed, eFailed };
+
+    using tFileHasher = std::function<bool( const std::string &, uint64_t & )>;
+
+    static constexpr uint32_t VERSION = 1;
+    static constexpr size_t NAME_LENGTH = 64;
+
+    /**
+     * Fills the packing from the sidecar of the source if it is valid,
+     * otherwise parses the text files and (re)writes the sidecar. A
+     * failure to write only costs the next run another parse.
+     * @param hasher Content hash of one file, hashFile by default
+     */
+    static EStatus load( CPacking &packing, const SPackingSource &source,
+                         const tFileHasher &hasher = hashFile );
+
+    static std::string pathOf( const SPackingSource &source ) { return source.centers + ".pkc"; }
+
+    /** 64-bit FNV-1a (over words) of a file's contents, false if it cannot be read */
+    static bool hashFile( const std::string &path, uint64_t &hash );
+    /** Hash of all files of the source and the property names */
+    static bool sourceHash( const SPackingSource &source, uint64_t &hash,
+                            const tFileHasher &hasher = hashFile );
+
+    /** Writes the sidecar through a temporary file and an atomic rename */
+    static bool write( const std::string &path, const CPacking &packing, uint64_t hash );
+    /** Name of a temporary file next to path that no other process or thread writes */
+    static std::string temporaryPath( const std::string &path );
+    /** Renames a file over another, atomically where the platform allows */
+    static bool replaceFile( const std::string &from, const std::string &to );
+
+    /** Maps a sidecar, fails if it is truncated or built from other inputs */
+    bool open( const std::string &path, uint64_t expectedHash ) { return map(path, &expectedHash); }
+    /** Maps a sidecar whatever inputs it was built from, for readers without the text files */
+    bool open( const std::string &path ) { return map(path, nullptr); }
+    void close() { file.close(); count = 0; propertyCount = 0; builtFrom = 0; }
+
+    /** Copies the columns into the packing */
+    void copyTo( CPacking &packing ) const;
+
+    size_t size() const { return count; }
+    /** Source hash the sidecar was built from */
+    uint64_t inputsHash() const { return builtFrom; }
+    const double *x() const { return column(0); }
+    const double *y() const { return column(1); }
+    const double *z() const { return column(2); }
+    const double *r() const { return column(3); }
+
+    size_t properties() const { return propertyCount; }
+    std::string propertyName( size_t k ) const;
+    unsigned int propertyElements( size_t k ) const;
+    const double *propertyValues( size_t k ) const;
+
+private:
+    struct SHeader
+    {
+        char magic[4];
+        uint32_t version;
+        uint32_t byteOrder;
+        uint32_t propertyCount;
+        uint64_t hash;
+        uint64_t count;
+    };
+
+    struct SPropertyEntry
+    {
+        char name[NAME_LENGTH];
+        uint64_t elements;
+        uint64_t offset; /**< of the values, in doubles from the first column */
+    };
+
+    bool map( const std::string &path, const uint64_t *expectedHash );
+    const double *column( size_t c ) const { return columns + c * count; }
+    const SPropertyEntry &entry( size_t k ) const;
+
+    CMappedFile file;
+    size_t count = 0;
+    size_t propertyCount = 0;
+    uint64_t builtFrom = 0;
+    const double *columns = nullptr;
+};
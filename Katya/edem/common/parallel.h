@@ -0,0 +1,36 @@
+#pragma once
+
+#include <algorithm>
+#include <thread>
+#include <vector>
+
+/**
+ * Splits [begin, end) into one contiguous chunk per thread and calls
+ * f(chunkBegin, chunkEnd) for each, the last chunk on the calling
+ * thread. threads == 0 means one per hardware thread; ranges shorter
+ * than minChunk per thread use fewer threads. The workers are not
+ * pinned to CPUs.
+ */
+template <class F>
+void parallelFor( size_t begin, size_t end, size_t threads, F &&f, size_t minChunk = 1024 )
+{
+    if (end <= begin)
+        return;
+
+    if (threads == 0)
+        threads = std::max(1u, std::thread::hardware_concurrency());
+    threads = std::min(threads, std::max<size_t>(1, (end - begin) / std::max<size_t>(minChunk, 1)));
+
+    const size_t chunk = (end - begin + threads - 1) / threads;
+    std::vector<std::thread> workers;
+    workers.reserve(threads - 1);
+    for (size_t t = 0; t + 1 < threads; t++)
+    {
+        const size_t lo = begin + t * chunk;
+        workers.emplace_back([&f, lo, hi = std::min(end, lo + chunk)]() { f(lo, hi); });
+    }
+    f(std::min(end, begin + (threads - 1) * chunk), end);
+
+    for (std::thread &worker : workers)
+        worker.join();
+}
@@ -0,0 +1,246 @@
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <numeric>
+
+#include "arena.h"
+#include "parallel.h"
+#include "particlesnapshot.h"
+
+void CParticleSnapshot::setCustomProperties( const std::vector<unsigned int> &indices,
+                                             const std::vector<unsigned int> &elements )
+{
+    propertyIndex = indices;
+    propertyElements = elements;
+    propertyElements.resize(propertyIndex.size(), 1);
+    properties.resize(propertyIndex.size());
+}
+
+std::vector<int> CParticleSnapshot::allIds( const NApiCore::IParticleManagerApi_1_3 &host, int firstId )
+{
+    std::vector<int> ids(std::max(host.getTotalNumberParticles(), 0));
+    std::iota(ids.begin(), ids.end(), firstId);
+    return ids;
+}
+
+void CParticleSnapshot::resizeLanes( size_t n )
+{
+    id.resize(n);
+    type.resize(n);
+    typeOf.resize(n);
+    for (auto *column : {&mass, &volume, &density, &px, &py, &pz, &vx, &vy, &vz, &wx, &wy, &wz})
+        column->resize(n);
+    orientation.resize(withOrientation ? 9 * n : 0);
+    for (size_t k = 0; k < properties.size(); k++)
+        properties[k].resize(propertyElements[k] * n);
+}
+
+void CParticleSnapshot::fetch( const NApiCore::IParticleManagerApi_1_3 &host, const int *ids, const size_t *laneOfId,
+                               size_t begin, size_t end, uint8_t *keep )
+{
+    for (size_t k = begin; k < end; k++)
+    {
+        const NExternalForceTypesV3_0_0::SParticle p = host.getParticleData(ids[k]);
+        const size_t i = laneOfId[k];
+        keep[k] = filter == nullptr || filter(p, filterContext);
+
+        id[i] = ids[k];
+        typeOf[i] = p.type;
+        mass[i] = p.mass;
+        volume[i] = p.volume;
+        density[i] = p.density;
+        px[i] = p.position.getX();
+        py[i] = p.position.getY();
+        pz[i] = p.position.getZ();
+        vx[i] = p.velocity.getX();
+        vy[i] = p.velocity.getY();
+        vz[i] = p.velocity.getZ();
+        wx[i] = p.angVel.getX();
+        wy[i] = p.angVel.getY();
+        wz[i] = p.angVel.getZ();
+
+        if (withOrientation)
+        {
+            double *o = &orientation[9 * i];
+            o[0] = p.orientation.getXX(); o[1] = p.orientation.getXY(); o[2] = p.orientation.getXZ();
+            o[3] = p.orientation.getYX(); o[4] = p.orientation.getYY(); o[5] = p.orientation.getYZ();
+            o[6] = p.orientation.getZX(); o[7] = p.orientation.getZY(); o[8] = p.orientation.getZZ();
+        }
+
+        for (size_t c = 0; c < propertyIndex.size(); c++)
+        {
+            const unsigned int n = propertyElements[c];
+            const double *value = host.getCustomPropertyValue(ids[k], propertyIndex[c]);
+            double *out = &properties[c][n * i];
+            for (unsigned int e = 0; e < n; e++)
+                out[e] = value != nullptr ? value[e] : 0;
+        }
+    }
+}
+
+void CParticleSnapshot::resolveTypes( const size_t *laneOfId, size_t begin, size_t end )
+{
+    const char *lastName = nullptr;
+    uint16_t lastIndex = 0;
+    for (size_t k = begin; k < end; k++)
+    {
+        const size_t i = laneOfId[k];
+        const char *name = typeOf[i] != nullptr ? typeOf[i] : "";
+        if (lastName == nullptr || (name != lastName && strcmp(name, lastName) != 0))
+        {
+            auto found = std::find(typeNames.begin(), typeNames.end(), name);
+            lastIndex = uint16_t(found - typeNames.begin());
+            if (found == typeNames.end())
+                typeNames.emplace_back(name);
+            lastName = name;
+        }
+        type[i] = lastIndex;
+    }
+}
+
+void CParticleSnapshot::compact( const uint8_t *keep, size_t count )
+{
+    size_t out = 0;
+    for (size_t i = 0; i < count; i++)
+    {
+        if (!keep[i])
+            continue;
+        if (out != i)
+        {
+            id[out] = id[i];
+            type[out] = type[i];
+            for (auto *column : {&mass, &volume, &density, &px, &py, &pz, &vx, &vy, &vz, &wx, &wy, &wz})
+                (*column)[out] = (*column)[i];
+            if (withOrientation)
+                std::copy_n(&orientation[9 * i], 9, &orientation[9 * out]);
+            for (size_t c = 0; c < properties.size(); c++)
+            {
+                const unsigned int n = propertyElements[c];
+                std::copy_n(&properties[c][n * i], n, &properties[c][n * out]);
+            }
+        }
+        out++;
+    }
+    if (out != count)
+        resizeLanes(out);
+}
+
+void CParticleSnapshot::rebuildLaneTable()
+{
+    lanes.clear();
+    if (id.empty())
+        return;
+
+    const auto range = std::minmax_element(id.begin(), id.end());
+    minId = *range.first;
+    lanes.assign(size_t(int64_t(*range.second) - minId + 1), -1);
+    for (size_t i = 0; i < id.size(); i++)
+        lanes[id[i] - minId] = int64_t(i);
+}
+
+void CParticleSnapshot::clear()
+{
+    resizeLanes(0);
+    lanes.clear();
+}
+
+int64_t CParticleSnapshot::laneOf( int particleId ) const
+{
+    const int64_t k = int64_t(particleId) - minId;
+    return k >= 0 && size_t(k) < lanes.size() ? lanes[k] : -1;
+}
+
+void CParticleSnapshot::finish( double seconds )
+{
+    stats.lanes = size();
+    stats.seconds = seconds;
+    total.requested += stats.requested;
+    total.fetched += stats.fetched;
+    total.lanes = stats.lanes;
+    total.threads = std::max(total.threads, stats.threads);
+    total.seconds += seconds;
+}
+
+size_t CParticleSnapshot::effectiveThreads( size_t count ) const
+{
+    // mirrors the split parallelFor makes with its default chunk
+    const size_t hardware = std::max(1u, std::thread::hardware_concurrency());
+    return std::max<size_t>(1, std::min(threads == 0 ? hardware : threads, count / 1024));
+}
+
+void CParticleSnapshot::gather( const NApiCore::IParticleManagerApi_1_3 &host, const int *ids, size_t count )
+{
+    auto start = std::chrono::steady_clock::now();
+    CArenaScope scratch(CArena::scratch());
+
+    std::pmr::vector<int> sorted(ids, ids + count, &scratch.resource());
+    std::sort(sorted.begin(), sorted.end());
+    sorted.erase(std::unique(sorted.begin(), sorted.end()), sorted.end());
+
+    const size_t n = sorted.size();
+    resizeLanes(n);
+    std::pmr::vector<size_t> identity(n, &scratch.resource());
+    std::iota(identity.begin(), identity.end(), size_t(0));
+    std::pmr::vector<uint8_t> keep(n, &scratch.resource());
+
+    parallelFor(0, n, threads, [&]( size_t lo, size_t hi )
+    {
+        fetch(host, sorted.data(), identity.data(), lo, hi, keep.data());
+    });
+    resolveTypes(identity.data(), 0, n);
+
+    compact(keep.data(), n);
+    rebuildLaneTable();
+
+    stats = SSnapshotStats();
+    stats.requested = count;
+    stats.fetched = n;
+    stats.threads = effectiveThreads(n);
+    finish(std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count());
+}
+
+void CParticleSnapshot::update( const NApiCore::IParticleManagerApi_1_3 &host, const int *ids, size_t count )
+{
+    auto start = std::chrono::steady_clock::now();
+    CArenaScope scratch(CArena::scratch());
+
+    std::pmr::vector<int> unique(ids, ids + count, &scratch.resource());
+    std::sort(unique.begin(), unique.end());
+    unique.erase(std::unique(unique.begin(), unique.end()), unique.end());
+
+    // changed particles go back into their lanes, new ones are appended
+    const size_t before = size();
+    size_t n = before;
+    std::pmr::vector<size_t> fetchLanes(unique.size(), &scratch.resource());
+    for (size_t k = 0; k < unique.size(); k++)
+    {
+        const int64_t lane = laneOf(unique[k]);
+        fetchLanes[k] = lane >= 0 ? size_t(lane) : n++;
+    }
+
+    resizeLanes(n);
+    const size_t m = unique.size();
+    std::pmr::vector<uint8_t> fetchedKeep(m, &scratch.resource());
+    parallelFor(0, m, threads, [&]( size_t lo, size_t hi )
+    {
+        fetch(host, unique.data(), fetchLanes.data(), lo, hi, fetchedKeep.data());
+    });
+    resolveTypes(fetchLanes.data(), 0, m);
+
+    // only a new or filtered out particle touches the other lanes
+    if (n != before || std::find(fetchedKeep.begin(), fetchedKeep.end(), 0) != fetchedKeep.end())
+    {
+        std::pmr::vector<uint8_t> keep(n, 1, &scratch.resource());
+        for (size_t k = 0; k < m; k++)
+            keep[fetchLanes[k]] = fetchedKeep[k];
+        compact(keep.data(), n);
+        rebuildLaneTable();
+    }
+
+    stats = SSnapshotStats();
+    stats.requested = count;
+    stats.fetched = m;
+    stats.threads = effectiveThreads(m);
+    stats.incremental = true;
+    finish(std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count());
+}
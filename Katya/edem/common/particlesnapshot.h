@@ -0,0 +1,104 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include <Api/Core/IParticleManagerApi_1_3.h>
+
+/** What a particle snapshot gathered and what it cost */
+struct SSnapshotStats
+{
+    size_t requested = 0;   /**< ids asked for */
+    size_t fetched = 0;     /**< getParticleData calls made */
+    size_t lanes = 0;       /**< particles in the snapshot afterwards */
+    size_t threads = 1;     /**< threads that gathered */
+    bool incremental = false;
+    double seconds = 0;
+};
+
+/**
+ * Particle states gathered from IParticleManagerApi_1_3 into reusable
+ * structure of arrays columns.
+ *
+ * gather() fetches a list of ids, optionally keeping only the particles
+ * a filter accepts; update() re-fetches just the given ids and keeps the
+ * rest, so a plugin that knows which few particles changed pays only for
+ * those. Lanes are in id order after gather(), update() appends ids that
+ * were not in the snapshot yet.
+ *
+ * With threads != 1 the fetches are split over a parallelFor, which is
+ * only valid if the host's particle manager may be queried concurrently.
+ * Columns keep their capacity between snapshots; the temporaries of a
+ * call come from the calling thread's CArena::scratch().
+ *
+ * Particle ids of a host without id gaps run from firstId to
+ * firstId + getTotalNumberParticles() - 1, see allIds().
+ */
+class CParticleSnapshot
+{
+public:
+    /** Accepts or rejects a fetched particle */
+    using TFilter = bool (*)( const NExternalForceTypesV3_0_0::SParticle &particle, void *context );
+
+    void setThreads( size_t count ) { threads = count; }
+    void setFilter( TFilter accept, void *context = nullptr ) { filter = accept; filterContext = context; }
+    /** Also gathers the given particle custom properties, elements interleaved per property */
+    void setCustomProperties( const std::vector<unsigned int> &indices, const std::vector<unsigned int> &elements );
+    void setOrientation( bool on ) { withOrientation = on; }
+
+    static std::vector<int> allIds( const NApiCore::IParticleManagerApi_1_3 &host, int firstId = 1 );
+
+    void gather( const NApiCore::IParticleManagerApi_1_3 &host, const int *ids, size_t count );
+    void update( const NApiCore::IParticleManagerApi_1_3 &host, const int *ids, size_t count );
+    void gather( const NApiCore::IParticleManagerApi_1_3 &host, const std::vector<int> &ids )
+    {
+        gather(host, ids.data(), ids.size());
+    }
+    void update( const NApiCore::IParticleManagerApi_1_3 &host, const std::vector<int> &ids )
+    {
+        update(host, ids.data(), ids.size());
+    }
+    void clear();
+
+    size_t size() const { return id.size(); }
+    /** Lane of a particle or -1 */
+    int64_t laneOf( int particleId ) const;
+
+    const SSnapshotStats &lastStats() const { return stats; }
+    const SSnapshotStats &totalStats() const { return total; }
+
+    std::vector<int> id;
+    std::vector<uint16_t> type;        /**< index into typeNames */
+    std::vector<std::string> typeNames;
+    std::vector<double> mass, volume, density;
+    std::vector<double> px, py, pz;
+    std::vector<double> vx, vy, vz;
+    std::vector<double> wx, wy, wz;
+    std::vector<double> orientation;  /**< 9 per lane if enabled */
+    std::vector<std::vector<double>> properties;
+
+private:
+    void resizeLanes( size_t n );
+    /** Fetches ids[begin, end) into their lanes, keep[k] tells if the filter accepted ids[k] */
+    void fetch( const NApiCore::IParticleManagerApi_1_3 &host, const int *ids, const size_t *lanes,
+                size_t begin, size_t end, uint8_t *keep );
+    /** Maps the fetched type names of lanes[begin, end) to indices, serially */
+    void resolveTypes( const size_t *lanes, size_t begin, size_t end );
+    void compact( const uint8_t *keep, size_t count );
+    void rebuildLaneTable();
+    void finish( double seconds );
+    size_t effectiveThreads( size_t count ) const;
+
+    size_t threads = 1;
+    TFilter filter = nullptr;
+    void *filterContext = nullptr;
+    bool withOrientation = false;
+    std::vector<unsigned int> propertyIndex, propertyElements;
+
+    std::vector<const char *> typeOf; /**< type name pointers of the last fetch */
+    std::vector<int64_t> lanes;       /**< lane by id - minId */
+    int minId = 0;
+
+    SSnapshotStats stats, total;
+};
@@ -0,0 +1,130 @@
+#include <cstdio>
+#include <cstring>
+
+#include <Api/Core/ICustomPropertyManagerApi_1_0.h>
+
+#include "propertyhandles.h"
+
+static NApiCore::EApiId managerOf( NApi::EPluginPropertyCategory category )
+{
+    switch (category)
+    {
+    case NApi::eContact:
+        return NApiCore::eContactCustomPropertyManager;
+    case NApi::eGeometry:
+        return NApiCore::eGeometryCustomPropertyManager;
+    case NApi::eSimulation:
+        return NApiCore::eSimulationCustomPropertyManager;
+    default:
+        return NApiCore::eParticleCustomPropertyManager;
+    }
+}
+
+const CPropertyHandle &CPropertyRegistry::declare( const char *name, NApi::EPluginPropertyCategory category,
+                                                   unsigned int elements, NApi::EPluginPropertyUnitTypes unit,
+                                                   double initialValue )
+{
+    handles.emplace_back();
+    CPropertyHandle &handle = handles.back();
+    handle.name = name;
+    handle.category = category;
+    handle.elements = elements > 0 ? elements : 1;
+    handle.unit = unit;
+    handle.initialValue = initialValue;
+    if (strlen(name) >= NApi::CUSTOM_PROP_MAX_NAME_LENGTH)
+    {
+        handle.rejected = true;
+        error = "Custom property name " + handle.name.substr(0, 32) + "... is too long";
+    }
+    return handle;
+}
+
+unsigned int CPropertyRegistry::count( NApi::EPluginPropertyCategory category ) const
+{
+    unsigned int n = 0;
+    for (const CPropertyHandle &handle : handles)
+        n += handle.category == category && !handle.rejected;
+    return n;
+}
+
+bool CPropertyRegistry::describe( unsigned int propertyIndex,
+                                  NApi::EPluginPropertyCategory category,
+                                  char name[],
+                                  NApi::EPluginPropertyDataTypes &dataType,
+                                  unsigned int &numberOfElements,
+                                  NApi::EPluginPropertyUnitTypes &unitType,
+                                  char initValBuff[] ) const
+{
+    for (const CPropertyHandle &handle : handles)
+    {
+        if (handle.category != category || handle.rejected || propertyIndex-- != 0)
+            continue;
+
+        strncpy(name, handle.name.c_str(), NApi::CUSTOM_PROP_MAX_NAME_LENGTH - 1);
+        name[NApi::CUSTOM_PROP_MAX_NAME_LENGTH - 1] = '\0';
+        dataType = NApi::eDouble;
+        numberOfElements = handle.elements;
+        unitType = handle.unit;
+
+        // one value per element, separated by the host delimiter
+        int used = 0;
+        initValBuff[0] = '\0';
+        for (unsigned int e = 0; e < handle.elements && used < int(NApi::BUFF_SIZE); e++)
+            used += snprintf(initValBuff + used, NApi::BUFF_SIZE - used, "%s%g",
+                             e > 0 ? NApi::delim() : "", handle.initialValue);
+        return true;
+    }
+    return false;
+}
+
+bool CPropertyRegistry::resolve( NApiCore::IApiManager_1_0 &apiManager )
+{
+    reset();
+    for (CPropertyHandle &handle : handles)
+    {
+        if (handle.rejected)
+        {
+            error = "Custom property name " + handle.name.substr(0, 32) + "... is too long";
+            return false;
+        }
+
+        auto manager = dynamic_cast<NApiCore::ICustomPropertyManagerApi_1_0 *>(
+                    apiManager.getApi(managerOf(handle.category), 1, 0));
+        if (manager == nullptr)
+        {
+            error = "No custom property manager for " + handle.name;
+            return false;
+        }
+
+        NApiCore::ICustomPropertyManagerApi_1_0::SPropertyData meta;
+        const unsigned int index = manager->getPropertyIndex(handle.name.c_str());
+        const bool found = index != NApi::NO_ID && manager->getPropertyMetaData(index, meta);
+        apiManager.release(manager);
+
+        if (!found)
+        {
+            error = "Custom property " + handle.name + " is not registered";
+            return false;
+        }
+        if (meta.m_numberOfElements < handle.elements)
+        {
+            error = "Custom property " + handle.name + " has fewer elements than declared";
+            return false;
+        }
+        handle.index = index;
+    }
+    return true;
+}
+
+void CPropertyRegistry::reset()
+{
+    error.clear();
+    for (CPropertyHandle &handle : handles)
+        handle.index = NApi::NO_ID;
+}
+
+void CPropertyRegistry::clear()
+{
+    error.clear();
+    handles.clear();
+}
@@ -0,0 +1,141 @@
+#pragma once
+
+#include <cassert>
+#include <deque>
+#include <string>
+
+#include <Api/Core/ApiTypes.h>
+#include <Api/Core/IApiManager_1_0.h>
+#include <Api/Core/ICustomPropertyDataApi_1_0.h>
+
+/**
+ * Elements of one custom property of one particle/contact/geometry.
+ * Empty (false) if the host has no data for it.
+ *
+ * operator[] checks the index only with assert, so release builds read
+ * past the end unchecked; at() checks in every build and returns nullptr
+ * past the end.
+ */
+template <class T>
+class CPropertyView
+{
+public:
+    CPropertyView() = default;
+    CPropertyView( T *elements, unsigned int count ) : data(elements), count(elements != nullptr ? count : 0) {}
+
+    explicit operator bool() const { return data != nullptr; }
+    unsigned int size() const { return count; }
+
+    T &operator[]( unsigned int i ) const
+    {
+        assert(i < count);
+        return data[i];
+    }
+
+    T *at( unsigned int i ) const { return i < count ? data + i : nullptr; }
+
+    T *begin() const { return data; }
+    T *end() const { return data + count; }
+
+private:
+    T *data = nullptr;
+    unsigned int count = 0;
+};
+
+/**
+ * A declared custom property. The index is resolved once in
+ * CPropertyRegistry::resolve(); value() and delta() then go straight to
+ * the index based ICustomPropertyDataApi_1_0 calls.
+ */
+class CPropertyHandle
+{
+public:
+    const char *getName() const { return name.c_str(); }
+    NApi::EPluginPropertyCategory getCategory() const { return category; }
+    unsigned int getElements() const { return elements; }
+    NApi::EPluginPropertyUnitTypes getUnit() const { return unit; }
+    double getInitialValue() const { return initialValue; }
+
+    unsigned int getIndex() const { return index; }
+    bool isResolved() const { return index != NApi::NO_ID; }
+
+    CPropertyView<const double> value( NApiCore::ICustomPropertyDataApi_1_0 *data ) const
+    {
+        if (data == nullptr || index == NApi::NO_ID)
+            return {};
+        return {data->getValue(index), elements};
+    }
+
+    CPropertyView<double> delta( NApiCore::ICustomPropertyDataApi_1_0 *data ) const
+    {
+        if (data == nullptr || index == NApi::NO_ID)
+            return {};
+        return {data->getDelta(index), elements};
+    }
+
+private:
+    friend class CPropertyRegistry;
+
+    std::string name;
+    NApi::EPluginPropertyCategory category = NApi::eParticle;
+    unsigned int elements = 1;
+    NApi::EPluginPropertyUnitTypes unit = NApi::eNone;
+    double initialValue = 0;
+    unsigned int index = NApi::NO_ID;
+    bool rejected = false;
+};
+
+/**
+ * Custom properties of a plugin.
+ *
+ * The plugin declares its properties once, typically as members:
+ *
+ *     CPropertyRegistry properties;
+ *     const CPropertyHandle &charge = properties.declare("Charge", NApi::eParticle, 1, NApi::eCharge);
+ *
+ * count() and describe() answer getNumberOfRequiredProperties() and
+ * getDetailsForProperty(), resolve() looks every property up by name in
+ * starting() and checks the host's element count against the declaration,
+ * so the views returned by the handles are never longer than the data.
+ * Handles keep their address for the lifetime of the registry.
+ *
+ * A name that does not fit CUSTOM_PROP_MAX_NAME_LENGTH with its
+ * terminator is rejected: the handle is never described to the host and
+ * resolve() fails on it.
+ */
+class CPropertyRegistry
+{
+public:
+    const CPropertyHandle &declare( const char *name, NApi::EPluginPropertyCategory category,
+                                    unsigned int elements, NApi::EPluginPropertyUnitTypes unit,
+                                    double initialValue = 0 );
+
+    /** Number of properties declared in a category */
+    unsigned int count( NApi::EPluginPropertyCategory category ) const;
+
+    /** Details of the propertyIndex-th property of a category, as getDetailsForProperty wants them */
+    bool describe( unsigned int propertyIndex,
+                   NApi::EPluginPropertyCategory category,
+                   char name[NApi::CUSTOM_PROP_MAX_NAME_LENGTH],
+                   NApi::EPluginPropertyDataTypes& dataType,
+                   unsigned int& numberOfElements,
+                   NApi::EPluginPropertyUnitTypes& unitType,
+                   char initValBuff[NApi::BUFF_SIZE] ) const;
+
+    /**
+     * Resolves the indices of all declared properties. Returns false and
+     * leaves a message in getError() if one is missing or has fewer
+     * elements than declared.
+     */
+    bool resolve( NApiCore::IApiManager_1_0 &apiManager );
+    /** Forgets the resolved indices */
+    void reset();
+    /** Forgets the declarations too; handles returned so far are dangling */
+    void clear();
+
+    const std::string &getError() const { return error; }
+
+private:
+    std::deque<CPropertyHandle> handles;
+    std::string error;
+};
@@ -0,0 +1,509 @@
+#include <algorithm>
+#include <cmath>
+#include <sstream>
+
+#include <Api/Core/ApiIds.h>
+#include <Api/Core/IGeometryManagerApi_1_2.h>
+
+#include "arena.h"
+#include "region.h"
+
+namespace
+{
+    bool disjoint( const double alo[3], const double ahi[3], const double blo[3], const double bhi[3] )
+    {
+        for (int a = 0; a < 3; a++)
+            if (ahi[a] < blo[a] || bhi[a] < alo[a])
+                return true;
+        return false;
+    }
+
+    /** Calls f(corner) for the 8 corners of a box */
+    template <class F>
+    bool allCorners( const double lo[3], const double hi[3], F &&f )
+    {
+        for (int c = 0; c < 8; c++)
+        {
+            const double p[3] = {c & 1 ? hi[0] : lo[0], c & 2 ? hi[1] : lo[1], c & 4 ? hi[2] : lo[2]};
+            if (!f(p))
+                return false;
+        }
+        return true;
+    }
+}
+
+std::unique_ptr<CRegion> CRegion::parse( const std::string &text )
+{
+    std::istringstream iss(text);
+    std::string shape;
+    iss >> shape;
+
+    double v[8];
+    auto read = [&]( int count )
+    {
+        for (int k = 0; k < count; k++)
+            if (!(iss >> v[k]))
+                return false;
+        return true;
+    };
+
+    if (shape == "box" && read(6) && v[0] <= v[3] && v[1] <= v[4] && v[2] <= v[5])
+        return std::make_unique<CBoxRegion>(v, v + 3);
+    if (shape == "sphere" && read(4) && v[3] > 0)
+        return std::make_unique<CSphereRegion>(v, v[3]);
+    if (shape == "cylinder" && read(8) && v[6] > 0 && v[7] > 0 && v[3] * v[3] + v[4] * v[4] + v[5] * v[5] > 0)
+        return std::make_unique<CCylinderRegion>(v, v + 3, v[6], v[7]);
+    if (shape == "mesh")
+    {
+        std::string name;
+        std::getline(iss >> std::ws, name);
+        if (!name.empty())
+            return std::make_unique<CMeshRegion>(name);
+    }
+    return nullptr;
+}
+
+bool CRegion::combine( std::unique_ptr<CRegion> &region, const std::string &text )
+{
+    std::istringstream iss(text);
+    std::string word;
+    iss >> word;
+
+    CCombinedRegion::EOperation operation;
+    if (word == "or")
+        operation = CCombinedRegion::EOperation::eUnion;
+    else if (word == "and")
+        operation = CCombinedRegion::EOperation::eIntersection;
+    else if (word == "not")
+        operation = CCombinedRegion::EOperation::eDifference;
+    else
+    {
+        region = parse(text);
+        return region != nullptr;
+    }
+
+    std::string rest;
+    std::getline(iss >> std::ws, rest);
+    std::unique_ptr<CRegion> term = parse(rest);
+    if (term == nullptr || region == nullptr)
+        return false;
+    region = std::make_unique<CCombinedRegion>(operation, std::move(region), std::move(term));
+    return true;
+}
+
+void selectInRegion( const CRegion &region, const CSpatialGrid &grid,
+                     const double *x, const double *y, const double *z,
+                     std::vector<uint32_t> &selected, size_t *tested )
+{
+    selected.clear();
+    size_t tests = 0;
+    if (grid.cellCount() > 0)
+    {
+        double lo[3], hi[3];
+        region.bounds(lo, hi);
+        int from[3], to[3];
+        for (int a = 0; a < 3; a++)
+        {
+            from[a] = grid.cellCoord(lo[a], a);
+            to[a] = grid.cellCoord(hi[a], a);
+        }
+
+        for (int iz = from[2]; iz <= to[2]; iz++)
+            for (int iy = from[1]; iy <= to[1]; iy++)
+                for (int ix = from[0]; ix <= to[0]; ix++)
+                {
+                    const size_t c = grid.cellIndex(ix, iy, iz);
+                    if (grid.cellBegin(c) == grid.cellEnd(c))
+                        continue;
+
+                    double cellLo[3], cellHi[3];
+                    grid.cellBox(c, cellLo, cellHi);
+                    const ECellClass cls = region.classify(cellLo, cellHi);
+                    if (cls == ECellClass::eInside)
+                        selected.insert(selected.end(), grid.cellBegin(c), grid.cellEnd(c));
+                    else if (cls == ECellClass::eBoundary)
+                        for (const uint32_t *i = grid.cellBegin(c); i != grid.cellEnd(c); i++)
+                        {
+                            const double p[3] = {x[*i], y[*i], z[*i]};
+                            tests++;
+                            if (region.contains(p))
+                                selected.push_back(*i);
+                        }
+                }
+    }
+    std::sort(selected.begin(), selected.end());
+    if (tested != nullptr)
+        *tested = tests;
+}
+
+CBoxRegion::CBoxRegion( const double l[3], const double h[3] )
+    : lo{l[0], l[1], l[2]}, hi{h[0], h[1], h[2]}
+{
+}
+
+bool CBoxRegion::contains( const double p[3] ) const
+{
+    return lo[0] <= p[0] && p[0] <= hi[0] && lo[1] <= p[1] && p[1] <= hi[1] && lo[2] <= p[2] && p[2] <= hi[2];
+}
+
+ECellClass CBoxRegion::classify( const double l[3], const double h[3] ) const
+{
+    if (disjoint(lo, hi, l, h))
+        return ECellClass::eOutside;
+    for (int a = 0; a < 3; a++)
+        if (l[a] < lo[a] || h[a] > hi[a])
+            return ECellClass::eBoundary;
+    return ECellClass::eInside;
+}
+
+void CBoxRegion::bounds( double l[3], double h[3] ) const
+{
+    for (int a = 0; a < 3; a++)
+    {
+        l[a] = lo[a];
+        h[a] = hi[a];
+    }
+}
+
+CSphereRegion::CSphereRegion( const double c[3], double r )
+    : centre{c[0], c[1], c[2]}, radius(r)
+{
+}
+
+bool CSphereRegion::contains( const double p[3] ) const
+{
+    const double dx = p[0] - centre[0], dy = p[1] - centre[1], dz = p[2] - centre[2];
+    return dx * dx + dy * dy + dz * dz <= radius * radius;
+}
+
+ECellClass CSphereRegion::classify( const double lo[3], const double hi[3] ) const
+{
+    // nearest and farthest points of the box from the centre
+    double nearest = 0, farthest = 0;
+    for (int a = 0; a < 3; a++)
+    {
+        const double dn = std::max({lo[a] - centre[a], 0.0, centre[a] - hi[a]});
+        const double df = std::max(std::fabs(lo[a] - centre[a]), std::fabs(hi[a] - centre[a]));
+        nearest += dn * dn;
+        farthest += df * df;
+    }
+    if (nearest > radius * radius)
+        return ECellClass::eOutside;
+    return farthest <= radius * radius ? ECellClass::eInside : ECellClass::eBoundary;
+}
+
+void CSphereRegion::bounds( double lo[3], double hi[3] ) const
+{
+    for (int a = 0; a < 3; a++)
+    {
+        lo[a] = centre[a] - radius;
+        hi[a] = centre[a] + radius;
+    }
+}
+
+CCylinderRegion::CCylinderRegion( const double c[3], const double a[3], double r, double h )
+    : centre{c[0], c[1], c[2]}, radius(r), halfHeight(h)
+{
+    const double length = std::sqrt(a[0] * a[0] + a[1] * a[1] + a[2] * a[2]);
+    for (int k = 0; k < 3; k++)
+        axis[k] = a[k] / length;
+}
+
+bool CCylinderRegion::contains( const double p[3] ) const
+{
+    const double d[3] = {p[0] - centre[0], p[1] - centre[1], p[2] - centre[2]};
+    const double h = d[0] * axis[0] + d[1] * axis[1] + d[2] * axis[2];
+    return std::fabs(h) <= halfHeight && d[0] * d[0] + d[1] * d[1] + d[2] * d[2] - h * h <= radius * radius;
+}
+
+ECellClass CCylinderRegion::classify( const double lo[3], const double hi[3] ) const
+{
+    double blo[3], bhi[3];
+    bounds(blo, bhi);
+    if (disjoint(blo, bhi, lo, hi))
+        return ECellClass::eOutside;
+
+    // the cylinder is convex: all corners inside means the box is
+    if (allCorners(lo, hi, [&]( const double p[3] ) { return contains(p); }))
+        return ECellClass::eInside;
+
+    // the box's bounding sphere clear of the cylinder means outside
+    const double m[3] = {(lo[0] + hi[0]) / 2, (lo[1] + hi[1]) / 2, (lo[2] + hi[2]) / 2};
+    const double rho = std::sqrt((hi[0] - lo[0]) * (hi[0] - lo[0]) + (hi[1] - lo[1]) * (hi[1] - lo[1]) +
+                                 (hi[2] - lo[2]) * (hi[2] - lo[2])) / 2;
+    const double d[3] = {m[0] - centre[0], m[1] - centre[1], m[2] - centre[2]};
+    const double h = d[0] * axis[0] + d[1] * axis[1] + d[2] * axis[2];
+    const double radial = std::sqrt(std::max(d[0] * d[0] + d[1] * d[1] + d[2] * d[2] - h * h, 0.0));
+    if (std::fabs(h) > halfHeight + rho || radial > radius + rho)
+        return ECellClass::eOutside;
+    return ECellClass::eBoundary;
+}
+
+void CCylinderRegion::bounds( double lo[3], double hi[3] ) const
+{
+    for (int a = 0; a < 3; a++)
+    {
+        const double extent = halfHeight * std::fabs(axis[a]) + radius * std::sqrt(std::max(1 - axis[a] * axis[a], 0.0));
+        lo[a] = centre[a] - extent;
+        hi[a] = centre[a] + extent;
+    }
+}
+
+bool CMeshRegion::resolve( NApiCore::IApiManager_1_0 &apiManager )
+{
+    auto geometry = dynamic_cast<NApiCore::IGeometryManagerApi_1_2 *>(
+        apiManager.getApi(NApiCore::eGeometryManager, 1, 2));
+    if (geometry == nullptr)
+        return false;
+
+    const std::vector<NApiHelpersV3_0_0::CSimple3DVector> mesh =
+        geometry->getGeometryMesh(geometry, name.c_str(), NCalcForceTypesV3_0_0::ETransformSpace::GLOBAL);
+    const std::vector<NApiHelpersV3_0_0::SGeomTriangleNode> triangles =
+        geometry->getGeometryTriangleNodes(geometry, name.c_str());
+    apiManager.release(geometry);
+
+    CArenaScope scratch(CArena::scratch());
+    std::pmr::vector<double> v(&scratch.resource());
+    v.reserve(3 * mesh.size());
+    for (const auto &vertex : mesh)
+    {
+        v.push_back(vertex.getX());
+        v.push_back(vertex.getY());
+        v.push_back(vertex.getZ());
+    }
+    std::pmr::vector<unsigned int> n(&scratch.resource());
+    n.reserve(3 * triangles.size());
+    for (const auto &triangle : triangles)
+    {
+        n.push_back(triangle.vertId0);
+        n.push_back(triangle.vertId1);
+        n.push_back(triangle.vertId2);
+    }
+    setMesh(v.data(), v.size(), n.data(), n.size());
+    return !nodes.empty();
+}
+
+void CMeshRegion::setMesh( const double *v, size_t vertexValues, const unsigned int *n, size_t nodeValues )
+{
+    vertices.assign(v, v + vertexValues);
+    nodes.clear();
+    for (size_t t = 0; t + 2 < nodeValues; t += 3)
+        if (3 * size_t(std::max({n[t], n[t + 1], n[t + 2]})) + 2 < vertices.size())
+            nodes.insert(nodes.end(), n + t, n + t + 3);
+
+    const size_t triangles = nodes.size() / 3;
+    for (int a = 0; a < 3; a++)
+    {
+        lo[a] = vertices.empty() ? 0 : vertices[a];
+        hi[a] = lo[a];
+        for (size_t k = a; k < vertices.size(); k += 3)
+        {
+            lo[a] = std::min(lo[a], vertices[k]);
+            hi[a] = std::max(hi[a], vertices[k]);
+        }
+    }
+
+    // about one bucket per triangle over the (y, z) plane
+    const int side = std::max(1, int(std::sqrt(double(triangles))));
+    for (int b = 0; b < 2; b++)
+    {
+        buckets[b] = side;
+        bucketSize[b] = std::max(hi[b + 1] - lo[b + 1], 1e-300) / side;
+    }
+
+    auto forEachBucket = [&]( size_t t, auto &&f )
+    {
+        double v3[3][3];
+        triangle(t, v3);
+        const int y0 = bucketCoord(std::min({v3[0][1], v3[1][1], v3[2][1]}), 0);
+        const int y1 = bucketCoord(std::max({v3[0][1], v3[1][1], v3[2][1]}), 0);
+        const int z0 = bucketCoord(std::min({v3[0][2], v3[1][2], v3[2][2]}), 1);
+        const int z1 = bucketCoord(std::max({v3[0][2], v3[1][2], v3[2][2]}), 1);
+        for (int bz = z0; bz <= z1; bz++)
+            for (int by = y0; by <= y1; by++)
+                f(size_t(bz) * buckets[0] + by);
+    };
+
+    bucketStart.assign(size_t(buckets[0]) * buckets[1] + 1, 0);
+    for (size_t t = 0; t < triangles; t++)
+        forEachBucket(t, [&]( size_t b ) { bucketStart[b + 1]++; });
+    for (size_t b = 1; b < bucketStart.size(); b++)
+        bucketStart[b] += bucketStart[b - 1];
+    bucketItems.resize(bucketStart.back());
+    CArenaScope scratch(CArena::scratch());
+    std::pmr::vector<uint32_t> fill(bucketStart.begin(), bucketStart.end() - 1, &scratch.resource());
+    for (size_t t = 0; t < triangles; t++)
+        forEachBucket(t, [&]( size_t b ) { bucketItems[fill[b]++] = uint32_t(t); });
+}
+
+int CMeshRegion::bucketCoord( double v, int b ) const
+{
+    const int c = int(std::floor((v - lo[b + 1]) / bucketSize[b]));
+    return c < 0 ? 0 : (c >= buckets[b] ? buckets[b] - 1 : c);
+}
+
+void CMeshRegion::triangle( size_t t, double v[3][3] ) const
+{
+    for (int k = 0; k < 3; k++)
+        for (int a = 0; a < 3; a++)
+            v[k][a] = vertices[3 * size_t(nodes[3 * t + k]) + a];
+}
+
+bool CMeshRegion::contains( const double p[3] ) const
+{
+    if (nodes.empty() || p[0] < lo[0] || p[0] > hi[0] || p[1] < lo[1] || p[1] > hi[1] || p[2] < lo[2] || p[2] > hi[2])
+        return false;
+
+    const size_t b = size_t(bucketCoord(p[2], 1)) * buckets[0] + bucketCoord(p[1], 0);
+    bool inside = false;
+    for (uint32_t k = bucketStart[b]; k < bucketStart[b + 1]; k++)
+    {
+        double v[3][3];
+        triangle(bucketItems[k], v);
+
+        // projection on (y, z), counter-clockwise
+        double a[2] = {v[0][1], v[0][2]}, c1[2] = {v[1][1], v[1][2]}, c2[2] = {v[2][1], v[2][2]};
+        const double area = (c1[0] - a[0]) * (c2[1] - a[1]) - (c1[1] - a[1]) * (c2[0] - a[0]);
+        if (area == 0)
+            continue;
+        if (area < 0)
+        {
+            std::swap(c1[0], c2[0]);
+            std::swap(c1[1], c2[1]);
+        }
+
+        const double *corner[3] = {a, c1, c2};
+        bool hit = true;
+        for (int e = 0; e < 3 && hit; e++)
+        {
+            const double *s = corner[e], *t = corner[(e + 1) % 3];
+            const double dy = t[0] - s[0], dz = t[1] - s[1];
+            const double f = dy * (p[2] - s[1]) - dz * (p[1] - s[0]);
+            // points on an edge belong to the triangle on its top-left side only
+            const bool topLeft = dz < 0 || (dz == 0 && dy < 0);
+            hit = f > 0 || (f == 0 && topLeft);
+        }
+        if (!hit)
+            continue;
+
+        // x of the triangle's plane above the point
+        const double e1y = v[1][1] - v[0][1], e1z = v[1][2] - v[0][2];
+        const double e2y = v[2][1] - v[0][1], e2z = v[2][2] - v[0][2];
+        const double det = e1y * e2z - e1z * e2y;
+        const double u = ((p[1] - v[0][1]) * e2z - (p[2] - v[0][2]) * e2y) / det;
+        const double w = (e1y * (p[2] - v[0][2]) - e1z * (p[1] - v[0][1])) / det;
+        const double px = v[0][0] + u * (v[1][0] - v[0][0]) + w * (v[2][0] - v[0][0]);
+        if (px > p[0])
+            inside = !inside;
+    }
+    return inside;
+}
+
+ECellClass CMeshRegion::classify( const double l[3], const double h[3] ) const
+{
+    if (nodes.empty() || disjoint(lo, hi, l, h))
+        return ECellClass::eOutside;
+
+    const int y0 = bucketCoord(l[1], 0), y1 = bucketCoord(h[1], 0);
+    const int z0 = bucketCoord(l[2], 1), z1 = bucketCoord(h[2], 1);
+    for (int bz = z0; bz <= z1; bz++)
+        for (int by = y0; by <= y1; by++)
+        {
+            const size_t b = size_t(bz) * buckets[0] + by;
+            for (uint32_t k = bucketStart[b]; k < bucketStart[b + 1]; k++)
+            {
+                double v[3][3];
+                triangle(bucketItems[k], v);
+                const double tlo[3] = {std::min({v[0][0], v[1][0], v[2][0]}), std::min({v[0][1], v[1][1], v[2][1]}),
+                                       std::min({v[0][2], v[1][2], v[2][2]})};
+                const double thi[3] = {std::max({v[0][0], v[1][0], v[2][0]}), std::max({v[0][1], v[1][1], v[2][1]}),
+                                       std::max({v[0][2], v[1][2], v[2][2]})};
+                if (!disjoint(tlo, thi, l, h))
+                    return ECellClass::eBoundary;
+            }
+        }
+
+    // no surface in the box: it is all on one side
+    const double m[3] = {(l[0] + h[0]) / 2, (l[1] + h[1]) / 2, (l[2] + h[2]) / 2};
+    return contains(m) ? ECellClass::eInside : ECellClass::eOutside;
+}
+
+void CMeshRegion::bounds( double l[3], double h[3] ) const
+{
+    for (int a = 0; a < 3; a++)
+    {
+        l[a] = lo[a];
+        h[a] = hi[a];
+    }
+}
+
+CCombinedRegion::CCombinedRegion( EOperation op, std::unique_ptr<CRegion> a, std::unique_ptr<CRegion> b )
+    : operation(op), left(std::move(a)), right(std::move(b))
+{
+}
+
+bool CCombinedRegion::contains( const double p[3] ) const
+{
+    switch (operation)
+    {
+    case EOperation::eUnion:
+        return left->contains(p) || right->contains(p);
+    case EOperation::eIntersection:
+        return left->contains(p) && right->contains(p);
+    default:
+        return left->contains(p) && !right->contains(p);
+    }
+}
+
+ECellClass CCombinedRegion::classify( const double lo[3], const double hi[3] ) const
+{
+    const ECellClass a = left->classify(lo, hi);
+    // the right side is only needed when the left does not decide
+    switch (operation)
+    {
+    case EOperation::eUnion:
+    {
+        if (a == ECellClass::eInside)
+            return a;
+        const ECellClass b = right->classify(lo, hi);
+        return b == ECellClass::eInside || a == b ? b : ECellClass::eBoundary;
+    }
+    case EOperation::eIntersection:
+    {
+        if (a == ECellClass::eOutside)
+            return a;
+        const ECellClass b = right->classify(lo, hi);
+        return b == ECellClass::eOutside || a == b ? b : ECellClass::eBoundary;
+    }
+    default:
+    {
+        if (a == ECellClass::eOutside)
+            return a;
+        const ECellClass b = right->classify(lo, hi);
+        if (b == ECellClass::eInside)
+            return ECellClass::eOutside;
+        return a == ECellClass::eInside && b == ECellClass::eOutside ? ECellClass::eInside : ECellClass::eBoundary;
+    }
+    }
+}
+
+void CCombinedRegion::bounds( double lo[3], double hi[3] ) const
+{
+    left->bounds(lo, hi);
+    if (operation == EOperation::eDifference)
+        return;
+
+    double rlo[3], rhi[3];
+    right->bounds(rlo, rhi);
+    for (int a = 0; a < 3; a++)
+    {
+        const bool unite = operation == EOperation::eUnion;
+        lo[a] = unite ? std::min(lo[a], rlo[a]) : std::max(lo[a], rlo[a]);
+        hi[a] = unite ? std::max(hi[a], rhi[a]) : std::min(hi[a], rhi[a]);
+    }
+}
+
+bool CCombinedRegion::resolve( NApiCore::IApiManager_1_0 &apiManager )
+{
+    return left->resolve(apiManager) && right->resolve(apiManager);
+}
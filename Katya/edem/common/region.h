@@ -0,0 +1,167 @@
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <Api/Core/IApiManager_1_0.h>
+
+#include "spatialgrid.h"
+
+/** Where an axis aligned box lies relative to a region */
+enum class ECellClass { eOutside, eInside, eBoundary };
+
+/**
+ * Region of space that selects particles by their centre.
+ *
+ * Besides the point test every region classifies whole boxes, so a
+ * selection over a CSpatialGrid takes or skips entire cells and only
+ * tests the particles of cells on the region's boundary. classify() may
+ * answer eBoundary for a box that is in fact inside or outside; it must
+ * never claim inside or outside wrongly.
+ */
+class CRegion
+{
+public:
+    virtual ~CRegion() = default;
+
+    virtual bool contains( const double p[3] ) const = 0;
+    virtual ECellClass classify( const double lo[3], const double hi[3] ) const = 0;
+    /** Box around the region, nothing outside it is contained */
+    virtual void bounds( double lo[3], double hi[3] ) const = 0;
+    /** Fetches data from the host (mesh regions), true for everything else */
+    virtual bool resolve( NApiCore::IApiManager_1_0 &apiManager ) { return true; }
+
+    /**
+     * Region from its config text:
+     *
+     *     box <x0> <y0> <z0> <x1> <y1> <z1>
+     *     sphere <cx> <cy> <cz> <r>
+     *     cylinder <cx> <cy> <cz> <ax> <ay> <az> <r> <half height>
+     *     mesh <geometry name>
+     *
+     * nullptr if the text is malformed.
+     */
+    static std::unique_ptr<CRegion> parse( const std::string &text );
+    /**
+     * Adds a term of a boolean combination to a region: the text of one
+     * region prefixed by `or`, `and` or `not` (difference). Without a
+     * prefix the term replaces the region.
+     */
+    static bool combine( std::unique_ptr<CRegion> &region, const std::string &text );
+};
+
+/**
+ * Indices of the grid's points inside the region, ascending. Visits
+ * only the cells within the region's bounds; inside cells are taken
+ * whole and only boundary cells test their points.
+ * @param tested (optional) Number of per-point tests done
+ */
+void selectInRegion( const CRegion &region, const CSpatialGrid &grid,
+                     const double *x, const double *y, const double *z,
+                     std::vector<uint32_t> &selected, size_t *tested = nullptr );
+
+class CBoxRegion : public CRegion
+{
+public:
+    CBoxRegion( const double lo[3], const double hi[3] );
+
+    bool contains( const double p[3] ) const override;
+    ECellClass classify( const double lo[3], const double hi[3] ) const override;
+    void bounds( double lo[3], double hi[3] ) const override;
+
+private:
+    double lo[3], hi[3];
+};
+
+class CSphereRegion : public CRegion
+{
+public:
+    CSphereRegion( const double centre[3], double radius );
+
+    bool contains( const double p[3] ) const override;
+    ECellClass classify( const double lo[3], const double hi[3] ) const override;
+    void bounds( double lo[3], double hi[3] ) const override;
+
+private:
+    double centre[3];
+    double radius;
+};
+
+/** Finite cylinder around an axis through its centre, as the cores of defect_processor.py */
+class CCylinderRegion : public CRegion
+{
+public:
+    CCylinderRegion( const double centre[3], const double axis[3], double radius, double halfHeight );
+
+    bool contains( const double p[3] ) const override;
+    ECellClass classify( const double lo[3], const double hi[3] ) const override;
+    void bounds( double lo[3], double hi[3] ) const override;
+
+private:
+    double centre[3];
+    double axis[3];
+    double radius;
+    double halfHeight;
+};
+
+/**
+ * Interior of a closed triangle mesh of a host geometry, fetched in
+ * global coordinates by resolve() through IGeometryManagerApi_1_2.
+ *
+ * Points are tested by the parity of crossings of a ray along +x; the
+ * triangles are bucketed over the (y, z) plane so a ray only meets the
+ * triangles of its bucket. Edges shared by two triangles are counted
+ * once (top-left rule), so rays through a mesh edge are not miscounted.
+ */
+class CMeshRegion : public CRegion
+{
+public:
+    explicit CMeshRegion( const std::string &geometryName ) : name(geometryName) {}
+
+    bool contains( const double p[3] ) const override;
+    ECellClass classify( const double lo[3], const double hi[3] ) const override;
+    void bounds( double lo[3], double hi[3] ) const override;
+    bool resolve( NApiCore::IApiManager_1_0 &apiManager ) override;
+
+    /** Uses the given mesh instead of the host's: vertices as x, y, z triples, 3 nodes per triangle */
+    void setMesh( const double *vertices, size_t vertexValues, const unsigned int *nodes, size_t nodeValues );
+    void setMesh( const std::vector<double> &vertices, const std::vector<unsigned int> &nodes )
+    {
+        setMesh(vertices.data(), vertices.size(), nodes.data(), nodes.size());
+    }
+
+private:
+    int bucketCoord( double v, int axis ) const;
+    void triangle( size_t t, double v[3][3] ) const;
+
+    std::string name;
+    std::vector<double> vertices;
+    std::vector<unsigned int> nodes;
+    double lo[3] = {0, 0, 0}, hi[3] = {0, 0, 0};
+
+    // triangles by (y, z) bucket, CSR
+    int buckets[2] = {0, 0};
+    double bucketSize[2] = {1, 1};
+    std::vector<uint32_t> bucketStart;
+    std::vector<uint32_t> bucketItems;
+};
+
+/** Boolean combination of two regions */
+class CCombinedRegion : public CRegion
+{
+public:
+    enum class EOperation { eUnion, eIntersection, eDifference };
+
+    CCombinedRegion( EOperation operation, std::unique_ptr<CRegion> left, std::unique_ptr<CRegion> right );
+
+    bool contains( const double p[3] ) const override;
+    ECellClass classify( const double lo[3], const double hi[3] ) const override;
+    void bounds( double lo[3], double hi[3] ) const override;
+    bool resolve( NApiCore::IApiManager_1_0 &apiManager ) override;
+
+private:
+    EOperation operation;
+    std::unique_ptr<CRegion> left, right;
+};
@@ -0,0 +1,64 @@
+#include <algorithm>
+
+#include "spatialgrid.h"
+
+void CSpatialGrid::build( const double *x, const double *y, const double *z, size_t n, double size )
+{
+    cellStart.clear();
+    items.clear();
+    if (n == 0)
+        return;
+
+    double lo[3] = {x[0], y[0], z[0]}, hi[3] = {x[0], y[0], z[0]};
+    for (size_t i = 1; i < n; i++)
+    {
+        lo[0] = std::min(lo[0], x[i]); hi[0] = std::max(hi[0], x[i]);
+        lo[1] = std::min(lo[1], y[i]); hi[1] = std::max(hi[1], y[i]);
+        lo[2] = std::min(lo[2], z[i]); hi[2] = std::max(hi[2], z[i]);
+    }
+
+    // keep the cell count within a small multiple of the point count
+    const double maxCells = 4.0 * n + 64;
+    cellSize = size > 0 ? size : 1;
+    auto cellsFor = [&]( double s )
+    {
+        double c = 1;
+        for (int a = 0; a < 3; a++)
+            c *= std::floor((hi[a] - lo[a]) / s) + 1;
+        return c;
+    };
+    while (cellsFor(cellSize) > maxCells)
+        cellSize *= 1.25;
+
+    for (int a = 0; a < 3; a++)
+    {
+        origin[a] = lo[a];
+        dims[a] = int(std::floor((hi[a] - lo[a]) / cellSize)) + 1;
+    }
+
+    std::vector<uint32_t> cellOf(n);
+    cellStart.assign(size_t(dims[0]) * dims[1] * dims[2] + 1, 0);
+    for (size_t i = 0; i < n; i++)
+    {
+        cellOf[i] = uint32_t(cellIndex(cellCoord(x[i], 0), cellCoord(y[i], 1), cellCoord(z[i], 2)));
+        cellStart[cellOf[i] + 1]++;
+    }
+    for (size_t c = 1; c < cellStart.size(); c++)
+        cellStart[c] += cellStart[c - 1];
+
+    items.resize(n);
+    std::vector<uint32_t> fill(cellStart.begin(), cellStart.end() - 1);
+    for (size_t i = 0; i < n; i++)
+        items[fill[cellOf[i]]++] = uint32_t(i);
+}
+
+void CSpatialGrid::cellBox( size_t c, double lo[3], double hi[3] ) const
+{
+    size_t ix = c % dims[0], iy = (c / dims[0]) % dims[1], iz = c / (size_t(dims[0]) * dims[1]);
+    size_t idx[3] = {ix, iy, iz};
+    for (int a = 0; a < 3; a++)
+    {
+        lo[a] = origin[a] + idx[a] * cellSize;
+        hi[a] = lo[a] + cellSize;
+    }
+}
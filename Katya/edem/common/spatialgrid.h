@@ -0,0 +1,79 @@
+#pragma once
+
+#include <cmath>
+#include <cstdint>
+#include <vector>
+
+#include "largepages.h"
+
+/**
+ * Uniform cell grid over a point set.
+ *
+ * Points are bucketed with a counting sort into compressed rows: the
+ * indices of the points in cell c are items[cellStart[c] .. cellStart[c + 1]).
+ * Building is O(N), a neighbourhood query touches only the cells that
+ * overlap the query sphere.
+ */
+class CSpatialGrid
+{
+public:
+    /**
+     * Builds the grid. The cell size is enlarged if needed so the grid
+     * has no more than a few cells per point.
+     */
+    void build( const double *x, const double *y, const double *z, size_t n, double cellSize );
+
+    size_t cellCount() const { return cellStart.empty() ? 0 : cellStart.size() - 1; }
+    double getCellSize() const { return cellSize; }
+    const int *getDims() const { return dims; }
+
+    /** Indices of the points stored in cell c */
+    const uint32_t *cellBegin( size_t c ) const { return items.data() + cellStart[c]; }
+    const uint32_t *cellEnd( size_t c ) const { return items.data() + cellStart[c + 1]; }
+
+    /** Axis aligned bounds of cell c */
+    void cellBox( size_t c, double lo[3], double hi[3] ) const;
+
+    size_t cellIndex( int ix, int iy, int iz ) const { return (size_t(iz) * dims[1] + iy) * dims[0] + ix; }
+    int cellCoord( double v, int axis ) const;
+
+    /**
+     * Calls f(index) for every point whose cell overlaps the sphere
+     * (px, py, pz, radius). The caller does the exact distance test.
+     */
+    template <class F>
+    void forEachCandidate( double px, double py, double pz, double radius, F &&f ) const;
+
+private:
+    double origin[3] = {0, 0, 0};
+    double cellSize = 1;
+    int dims[3] = {0, 0, 0};
+
+    tLargeVector<uint32_t> cellStart;
+    tLargeVector<uint32_t> items;
+};
+
+inline int CSpatialGrid::cellCoord( double v, int axis ) const
+{
+    int c = int(std::floor((v - origin[axis]) / cellSize));
+    return c < 0 ? 0 : (c >= dims[axis] ? dims[axis] - 1 : c);
+}
+
+template <class F>
+void CSpatialGrid::forEachCandidate( double px, double py, double pz, double radius, F &&f ) const
+{
+    if (cellStart.empty())
+        return;
+
+    const int x0 = cellCoord(px - radius, 0), x1 = cellCoord(px + radius, 0);
+    const int y0 = cellCoord(py - radius, 1), y1 = cellCoord(py + radius, 1);
+    const int z0 = cellCoord(pz - radius, 2), z1 = cellCoord(pz + radius, 2);
+
+    for (int iz = z0; iz <= z1; iz++)
+        for (int iy = y0; iy <= y1; iy++)
+        {
+            const size_t row = cellIndex(0, iy, iz);
+            for (uint32_t k = cellStart[row + x0]; k < cellStart[row + x1 + 1]; k++)
+                f(items[k]);
+        }
+}
@@ -0,0 +1,235 @@
+#include <algorithm>
+#include <cmath>
+
+#include "tiledsource.h"
+
+namespace
+{
+    uint64_t splitMix( uint64_t v )
+    {
+        v += 0x9e3779b97f4a7c15ull;
+        v = (v ^ (v >> 30)) * 0xbf58476d1ce4e5b9ull;
+        v = (v ^ (v >> 27)) * 0x94d049bb133111ebull;
+        return v ^ (v >> 31);
+    }
+}
+
+bool CTiledSource::build( const CPacking &packing, const SParams &parameters )
+{
+    base = nullptr;
+    params = parameters;
+    const size_t n = packing.size();
+    if (n == 0 || params.tiles[0] < 1 || params.tiles[1] < 1 || params.tiles[2] < 1)
+        return false;
+
+    const tLargeVector<double> *columns[3] = {&packing.x, &packing.y, &packing.z};
+    for (int a = 0; a < 3; a++)
+    {
+        double lo = (*columns[a])[0] - packing.r[0], hi = (*columns[a])[0] + packing.r[0];
+        for (size_t i = 1; i < n; i++)
+        {
+            lo = std::min(lo, (*columns[a])[i] - packing.r[i]);
+            hi = std::max(hi, (*columns[a])[i] + packing.r[i]);
+        }
+        centre[a] = (lo + hi) / 2;
+        period[a] = params.period[a] > 0 ? params.period[a] : hi - lo;
+    }
+    maxRadius = packing.maxRadius();
+    halfSpan = 0;
+    for (int a = 0; a < 3; a++)
+        for (size_t i = 0; i < n; i++)
+            halfSpan = std::max(halfSpan, std::fabs((*columns[a])[i] - centre[a]));
+
+    // symmetries of the box: axis permutations among equal periods, any signs
+    transforms.clear();
+    const int permutations[6][3] = {{0, 1, 2}, {1, 2, 0}, {2, 0, 1}, {0, 2, 1}, {2, 1, 0}, {1, 0, 2}};
+    for (int p = 0; p < 6; p++)
+        for (int s = 0; s < 8; s++)
+        {
+            STransform t;
+            bool fits = true;
+            int flips = 0;
+            for (int a = 0; a < 3; a++)
+            {
+                t.axis[a] = permutations[p][a];
+                t.sign[a] = (s >> a) & 1 ? -1 : 1;
+                flips += (s >> a) & 1;
+                fits = fits && std::fabs(period[t.axis[a]] - period[a]) <= 1e-9 * period[a];
+            }
+            // odd permutations (p >= 3) and odd flips each reverse handedness
+            const bool proper = (p >= 3) == (flips % 2 == 1);
+            const bool identity = p == 0 && s == 0;
+            const bool wanted = identity || params.variation == EVariation::eAny ||
+                                (params.variation == EVariation::eRotate && proper) ||
+                                (params.variation == EVariation::eMirror && p == 0 && flips == 1);
+            if (fits && wanted)
+                transforms.push_back(t);
+        }
+
+    // a particle can only touch a neighbour tile if it reaches the
+    // nearest centre that tile may have along some axis
+    nearFace.assign(n, 0);
+    boundary = 0;
+    for (size_t i = 0; i < n; i++)
+    {
+        bool near = false;
+        for (int a = 0; a < 3; a++)
+            near = near || std::fabs((*columns[a])[i] - centre[a]) + packing.r[i] + maxRadius > period[a] - halfSpan;
+        nearFace[i] = near;
+        boundary += near;
+    }
+
+    grid.build(packing.x.data(), packing.y.data(), packing.z.data(), n, 2 * maxRadius);
+    base = &packing;
+    return true;
+}
+
+const CTiledSource::STransform &CTiledSource::transformOf( size_t tile ) const
+{
+    if (transforms.size() == 1)
+        return transforms[0];
+    return transforms[splitMix(params.seed ^ splitMix(tile)) % transforms.size()];
+}
+
+void CTiledSource::place( size_t i, const int t[3], double pos[3] ) const
+{
+    const STransform &transform = transformOf((size_t(t[2]) * params.tiles[1] + t[1]) * params.tiles[0] + t[0]);
+    const double d[3] = {base->x[i] - centre[0], base->y[i] - centre[1], base->z[i] - centre[2]};
+    for (int a = 0; a < 3; a++)
+        pos[a] = centre[a] + t[a] * period[a] + transform.sign[a] * d[transform.axis[a]];
+}
+
+bool CTiledSource::overlapsLowerTile( size_t i, const int t[3], size_t tile ) const
+{
+    double pos[3];
+    place(i, t, pos);
+    const double r = base->r[i];
+
+    for (int dz = -1; dz <= 1; dz++)
+        for (int dy = -1; dy <= 1; dy++)
+            for (int dx = -1; dx <= 1; dx++)
+            {
+                const int u[3] = {t[0] + dx, t[1] + dy, t[2] + dz};
+                const size_t other = (size_t(u[2]) * params.tiles[1] + u[1]) * params.tiles[0] + u[0];
+                // only lower tiles decide against this particle
+                if (u[0] < 0 || u[1] < 0 || u[2] < 0 || other >= tile ||
+                    u[0] >= params.tiles[0] || u[1] >= params.tiles[1])
+                    continue;
+
+                // the sphere must reach the centres of that tile at all
+                bool reaches = true;
+                for (int a = 0; a < 3 && reaches; a++)
+                    reaches = std::fabs(pos[a] - centre[a] - u[a] * period[a]) < halfSpan + r + maxRadius;
+                if (!reaches)
+                    continue;
+
+                // query point in the neighbour's frame: invert its transform
+                const STransform &transform = transformOf(other);
+                double q[3];
+                for (int a = 0; a < 3; a++)
+                    q[transform.axis[a]] = transform.sign[a] * (pos[a] - centre[a] - u[a] * period[a]);
+                for (int a = 0; a < 3; a++)
+                    q[a] += centre[a];
+
+                bool overlap = false;
+                grid.forEachCandidate(q[0], q[1], q[2], r + maxRadius, [&]( uint32_t j )
+                {
+                    const double ex = base->x[j] - q[0], ey = base->y[j] - q[1], ez = base->z[j] - q[2];
+                    const double touch = (r + base->r[j]) * (1 - params.overlapTolerance);
+                    overlap = overlap || ex * ex + ey * ey + ez * ez < touch * touch;
+                });
+                if (overlap)
+                    return true;
+            }
+    return false;
+}
+
+bool CTiledSource::particle( size_t g, double pos[3], double &radius, size_t &baseIndex ) const
+{
+    const size_t n = tileSize();
+    const size_t tile = g / n;
+    baseIndex = g % n;
+    const int t[3] = {int(tile % params.tiles[0]), int(tile / params.tiles[0] % params.tiles[1]),
+                      int(tile / (size_t(params.tiles[0]) * params.tiles[1]))};
+    radius = base->r[baseIndex];
+
+    place(baseIndex, t, pos);
+    return !nearFace[baseIndex] || !overlapsLowerTile(baseIndex, t, tile);
+}
+
+void CTiledSource::select( const CRegion &region, std::vector<uint64_t> &slots, size_t *tested ) const
+{
+    slots.clear();
+    size_t tests = 0;
+    const size_t n = tileSize();
+
+    // tiles whose centres can reach into the region's bounds
+    double lo[3], hi[3];
+    region.bounds(lo, hi);
+    int from[3], to[3];
+    for (int a = 0; a < 3; a++)
+    {
+        from[a] = std::max(0, int(std::ceil((lo[a] - centre[a] - halfSpan) / period[a])));
+        to[a] = std::min(params.tiles[a] - 1, int(std::floor((hi[a] - centre[a] + halfSpan) / period[a])));
+    }
+
+    for (int tz = from[2]; tz <= to[2]; tz++)
+        for (int ty = from[1]; ty <= to[1]; ty++)
+            for (int tx = from[0]; tx <= to[0]; tx++)
+            {
+                const int t[3] = {tx, ty, tz};
+                const uint64_t tile = (uint64_t(tz) * params.tiles[1] + ty) * params.tiles[0] + tx;
+                double tileLo[3], tileHi[3];
+                for (int a = 0; a < 3; a++)
+                {
+                    tileLo[a] = centre[a] + t[a] * period[a] - halfSpan;
+                    tileHi[a] = centre[a] + t[a] * period[a] + halfSpan;
+                }
+
+                const ECellClass tileClass = region.classify(tileLo, tileHi);
+                if (tileClass == ECellClass::eOutside)
+                    continue;
+                const size_t first = slots.size();
+                if (tileClass == ECellClass::eInside)
+                {
+                    for (size_t i = 0; i < n; i++)
+                        slots.push_back(tile * n + i);
+                    continue;
+                }
+
+                // a signed axis permutation maps the cell boxes to boxes
+                const STransform &transform = transformOf(size_t(tile));
+                for (size_t c = 0; c < grid.cellCount(); c++)
+                {
+                    if (grid.cellBegin(c) == grid.cellEnd(c))
+                        continue;
+                    double cellLo[3], cellHi[3], worldLo[3], worldHi[3];
+                    grid.cellBox(c, cellLo, cellHi);
+                    for (int a = 0; a < 3; a++)
+                    {
+                        const int source = transform.axis[a];
+                        const double e0 = transform.sign[a] * (cellLo[source] - centre[source]);
+                        const double e1 = transform.sign[a] * (cellHi[source] - centre[source]);
+                        worldLo[a] = centre[a] + t[a] * period[a] + std::min(e0, e1);
+                        worldHi[a] = centre[a] + t[a] * period[a] + std::max(e0, e1);
+                    }
+
+                    const ECellClass cellClass = region.classify(worldLo, worldHi);
+                    if (cellClass == ECellClass::eInside)
+                        for (const uint32_t *i = grid.cellBegin(c); i != grid.cellEnd(c); i++)
+                            slots.push_back(tile * n + *i);
+                    else if (cellClass == ECellClass::eBoundary)
+                        for (const uint32_t *i = grid.cellBegin(c); i != grid.cellEnd(c); i++)
+                        {
+                            double pos[3];
+                            place(*i, t, pos);
+                            tests++;
+                            if (region.contains(pos))
+                                slots.push_back(tile * n + *i);
+                        }
+                }
+                std::sort(slots.begin() + first, slots.end());
+            }
+    if (tested != nullptr)
+        *tested = tests;
+}
@@ -0,0 +1,98 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "packing.h"
+#include "region.h"
+#include "spatialgrid.h"
+
+/**
+ * Replicates a packing over an N x M x K lattice of tiles without
+ * storing the copies.
+ *
+ * Slot g stands for particle g % n of tile g / n (n particles per tile,
+ * tiles numbered x fastest); its position is computed from the tile
+ * index on request, so memory stays O(n) whatever the lattice size.
+ * Each tile may get a seeded random symmetry of the tile box: a
+ * rotation by quarter turns, a mirror, or both. Axes are only swapped
+ * when the period is the same along them, so every variant fills the
+ * same box.
+ *
+ * With a period shorter than the spheres' bounding box (a periodic
+ * specimen whose boundary particles stick out), neighbouring tiles
+ * overlap. A particle within reach of a tile face is checked against
+ * the adjacent tiles through a CSpatialGrid of the base packing, queried
+ * in the neighbour's own frame; of an overlapping pair the particle of
+ * the higher tile is dropped, so both sides agree without shared state.
+ */
+class CTiledSource
+{
+public:
+    enum class EVariation { eNone, eRotate, eMirror, eAny };
+
+    struct SParams
+    {
+        int tiles[3] = {1, 1, 1};
+        /** Lattice spacing, 0 for the extent of the spheres along the axis */
+        double period[3] = {0, 0, 0};
+        EVariation variation = EVariation::eNone;
+        uint64_t seed = 0;
+        /** Pairs overlapping by less than this fraction of r1 + r2 are kept */
+        double overlapTolerance = 1e-3;
+    };
+
+    /** The packing must outlive the source */
+    bool build( const CPacking &packing, const SParams &params );
+
+    size_t tileSize() const { return base == nullptr ? 0 : base->size(); }
+    size_t tileCount() const { return size_t(params.tiles[0]) * params.tiles[1] * params.tiles[2]; }
+    /** Slots, dropped particles included */
+    size_t slots() const { return tileCount() * tileSize(); }
+    /** Base particles within reach of a tile face */
+    size_t boundaryCount() const { return boundary; }
+    const double *getPeriod() const { return period; }
+
+    /**
+     * Particle of slot g: position, radius and index in the base packing.
+     * False if it was dropped to resolve an overlap across a tile face.
+     */
+    bool particle( size_t g, double pos[3], double &radius, size_t &baseIndex ) const;
+
+    /**
+     * Slots whose centre lies in the region, ascending, dropped ones
+     * included. Tiles are classified as a whole first, then the cells
+     * of the base grid mapped into each boundary tile, so only particles
+     * of cells on the region's boundary are tested one by one.
+     * @param tested (optional) Number of per-particle tests done
+     */
+    void select( const CRegion &region, std::vector<uint64_t> &slots, size_t *tested = nullptr ) const;
+
+private:
+    /** Signed axis permutation about the tile centre: out[a] = sign[a] * in[axis[a]] */
+    struct STransform
+    {
+        int axis[3];
+        double sign[3];
+    };
+
+    const STransform &transformOf( size_t tile ) const;
+    /** Position of base particle i in tile (tx, ty, tz) */
+    void place( size_t i, const int t[3], double pos[3] ) const;
+    bool overlapsLowerTile( size_t i, const int t[3], size_t tile ) const;
+
+    const CPacking *base = nullptr;
+    SParams params;
+    double period[3] = {0, 0, 0};
+    double centre[3] = {0, 0, 0};
+    /** Largest distance of a base centre from the tile centre along any axis */
+    double halfSpan = 0;
+    double maxRadius = 0;
+    size_t boundary = 0;
+
+    std::vector<STransform> transforms;
+    /** 1 for base particles within reach of a face of the tile box */
+    std::vector<uint8_t> nearFace;
+    CSpatialGrid grid;
+};
@@ -0,0 +1,512 @@
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+
+#include "parallel.h"
+#include "voxelizer.h"
+
+namespace
+{
+    struct SHeader
+    {
+        char magic[4];
+        uint32_t mode;
+        int32_t dims[3];
+        uint32_t reserved;
+        double origin[3];
+        double voxel;
+    };
+
+    void putVarint( std::vector<uint8_t> &out, uint64_t v )
+    {
+        while (v >= 0x80)
+        {
+            out.push_back(uint8_t(v | 0x80));
+            v >>= 7;
+        }
+        out.push_back(uint8_t(v));
+    }
+
+    bool getVarint( const uint8_t *&p, const uint8_t *end, uint64_t &v )
+    {
+        v = 0;
+        for (int shift = 0; p < end && shift < 64; shift += 7)
+        {
+            const uint8_t byte = *p++;
+            v |= uint64_t(byte & 0x7f) << shift;
+            if (!(byte & 0x80))
+                return true;
+        }
+        return false;
+    }
+}
+
+bool CVoxelizer::voxelize( const CPacking &packing, const SParams &params )
+{
+    const size_t n = packing.size();
+    mode = params.mode;
+    double lo[3], hi[3];
+    std::copy(params.lo, params.lo + 3, lo);
+    std::copy(params.hi, params.hi + 3, hi);
+    if (!(lo[0] < hi[0] && lo[1] < hi[1] && lo[2] < hi[2]))
+    {
+        if (n == 0)
+            return false;
+        const tLargeVector<double> *columns[3] = {&packing.x, &packing.y, &packing.z};
+        for (int a = 0; a < 3; a++)
+        {
+            lo[a] = hi[a] = (*columns[a])[0];
+            for (size_t i = 0; i < n; i++)
+            {
+                lo[a] = std::min(lo[a], (*columns[a])[i] - packing.r[i]);
+                hi[a] = std::max(hi[a], (*columns[a])[i] + packing.r[i]);
+            }
+        }
+    }
+
+    if (mode == EMode::eFraction && params.samples <= 0)
+        return false;
+    voxel = params.voxel;
+    if (voxel <= 0)
+    {
+        if (params.resolution <= 0)
+            return false;
+        voxel = std::max({hi[0] - lo[0], hi[1] - lo[1], hi[2] - lo[2]}) / params.resolution;
+    }
+    for (int a = 0; a < 3; a++)
+    {
+        origin[a] = lo[a];
+        dims[a] = std::max(1, int(std::ceil((hi[a] - lo[a]) / voxel - 1e-9)));
+    }
+
+    // spheres by the z slices they cut, CSR; fractions take them in x
+    // order, so the chords of a line come nearly sorted
+    const int nz = dims[2];
+    std::vector<uint32_t> order(n);
+    for (size_t i = 0; i < n; i++)
+        order[i] = uint32_t(i);
+    if (mode == EMode::eFraction)
+        std::sort(order.begin(), order.end(), [&packing]( uint32_t a, uint32_t b ) { return packing.x[a] < packing.x[b]; });
+    std::vector<uint32_t> sliceStart(size_t(nz) + 1, 0);
+    auto sliceRange = [&]( size_t i, int &k0, int &k1 )
+    {
+        k0 = std::max(0, int(std::floor((packing.z[i] - packing.r[i] - origin[2]) / voxel)));
+        k1 = std::min(nz - 1, int(std::floor((packing.z[i] + packing.r[i] - origin[2]) / voxel)));
+    };
+    for (size_t i = 0; i < n; i++)
+    {
+        int k0, k1;
+        sliceRange(i, k0, k1);
+        for (int k = k0; k <= k1; k++)
+            sliceStart[k + 1]++;
+    }
+    for (int k = 0; k < nz; k++)
+        sliceStart[k + 1] += sliceStart[k];
+    std::vector<uint32_t> sliceItems(sliceStart[nz]);
+    {
+        std::vector<uint32_t> fill(sliceStart.begin(), sliceStart.end() - 1);
+        for (uint32_t i : order)
+        {
+            int k0, k1;
+            sliceRange(i, k0, k1);
+            for (int k = k0; k <= k1; k++)
+                sliceItems[fill[k]++] = i;
+        }
+    }
+
+    const size_t sliceVoxels = size_t(dims[0]) * dims[1];
+    bits.clear();
+    fraction.clear();
+    if (mode == EMode::eOccupancy)
+        bits.assign(rowWords() * dims[1] * nz, 0);
+    else
+        fraction.assign(sliceVoxels * nz, 0);
+
+    const size_t regionCount = params.regions.size();
+    perSlice.assign(nz, SPorosity());
+    std::vector<SPorosity> regionSlices(regionCount * nz);
+    parallelFor(0, size_t(nz), params.threads, [&]( size_t k0, size_t k1 )
+    {
+        // fractions add up in a slice of doubles, occupancy goes straight to the bits
+        std::vector<double> slice(mode == EMode::eFraction ? sliceVoxels : 0);
+        std::vector<SPorosity> sums(regionCount);
+        for (size_t k = k0; k < k1; k++)
+        {
+            std::fill(slice.begin(), slice.end(), 0.0);
+            rasteriseSlice(packing, sliceItems.data() + sliceStart[k], sliceItems.data() + sliceStart[k + 1],
+                           int(k), params.samples, slice.empty() ? nullptr : slice.data());
+            countSlice(int(k), slice.empty() ? nullptr : slice.data(), params.regions, sums.data());
+            for (size_t r = 0; r < regionCount; r++)
+                regionSlices[r * nz + k] = sums[r];
+        }
+    }, 1);
+
+    overall = SPorosity();
+    for (const SPorosity &s : perSlice)
+    {
+        overall.voxels += s.voxels;
+        overall.solid += s.solid;
+    }
+    perRegion.assign(regionCount, SPorosity());
+    for (size_t r = 0; r < regionCount; r++)
+        for (int k = 0; k < nz; k++)
+        {
+            perRegion[r].voxels += regionSlices[r * nz + k].voxels;
+            perRegion[r].solid += regionSlices[r * nz + k].solid;
+        }
+    return true;
+}
+
+void CVoxelizer::rasteriseSlice( const CPacking &packing, const uint32_t *first, const uint32_t *last,
+                                 int k, int samples, double *slice )
+{
+    if (mode == EMode::eFraction)
+    {
+        rasteriseFractions(packing, first, last, k, samples, slice);
+        return;
+    }
+
+    const int nx = dims[0], ny = dims[1];
+    const double h = voxel;
+    const double zMid = origin[2] + (k + 0.5) * h;
+    auto clampRange = [&]( double from, double to, int count, int &i0, int &i1 )
+    {
+        i0 = std::max(0, int(std::floor(from)));
+        i1 = std::min(count - 1, int(std::floor(to)));
+    };
+
+    for (const uint32_t *s = first; s != last; s++)
+    {
+        const double cx = packing.x[*s], cy = packing.y[*s], cz = packing.z[*s], r = packing.r[*s];
+        const double dz = zMid - cz;
+        if (std::fabs(dz) >= r)
+            continue;
+        const double rc = std::sqrt(r * r - dz * dz);
+        int j0, j1;
+        clampRange(std::ceil((cy - rc - origin[1]) / h - 0.5), (cy + rc - origin[1]) / h - 0.5, ny, j0, j1);
+        for (int j = j0; j <= j1; j++)
+        {
+            const double dy = origin[1] + (j + 0.5) * h - cy;
+            const double w2 = rc * rc - dy * dy;
+            if (w2 <= 0)
+                continue;
+            const double w = std::sqrt(w2);
+            int i0, i1;
+            clampRange(std::ceil((cx - w - origin[0]) / h - 0.5), (cx + w - origin[0]) / h - 0.5, nx, i0, i1);
+            if (i0 > i1)
+                continue;
+            uint64_t *row = bits.data() + rowWords() * (size_t(k) * ny + j);
+            const int w0 = i0 / 64, w1 = i1 / 64;
+            const uint64_t first = ~uint64_t(0) << (i0 % 64), last = ~uint64_t(0) >> (63 - i1 % 64);
+            if (w0 == w1)
+                row[w0] |= first & last;
+            else
+            {
+                row[w0] |= first;
+                std::fill(row + w0 + 1, row + w1, ~uint64_t(0));
+                row[w1] |= last;
+            }
+        }
+    }
+}
+
+void CVoxelizer::rasteriseFractions( const CPacking &packing, const uint32_t *first, const uint32_t *last,
+                                     int k, int samples, double *slice )
+{
+    const int nx = dims[0], ny = dims[1];
+    const double h = voxel, spacing = h / samples;
+    const int lines = ny * samples;
+    // chords of every line of a plane, and per row the voxels a merged
+    // chord covers whole as a difference array
+    thread_local std::vector<std::vector<std::pair<double, double>>> chords;
+    thread_local std::vector<double> whole;
+    if (chords.size() < size_t(lines))
+        chords.resize(size_t(lines));
+    whole.assign(size_t(nx + 1) * ny, 0.0);
+
+    for (int c = 0; c < samples; c++)
+    {
+        const double z = origin[2] + k * h + (c + 0.5) * spacing;
+        for (const uint32_t *s = first; s != last; s++)
+        {
+            const double cx = packing.x[*s], cy = packing.y[*s], r = packing.r[*s];
+            const double dz = z - packing.z[*s];
+            const double rc2 = r * r - dz * dz;
+            if (rc2 <= 0)
+                continue;
+            const double rc = std::sqrt(rc2);
+            const int l0 = std::max(0, int(std::ceil((cy - rc - origin[1]) / spacing - 0.5)));
+            const int l1 = std::min(lines - 1, int(std::floor((cy + rc - origin[1]) / spacing - 0.5)));
+            for (int l = l0; l <= l1; l++)
+            {
+                const double dy = origin[1] + (l + 0.5) * spacing - cy;
+                const double w2 = rc2 - dy * dy;
+                if (w2 <= 0)
+                    continue;
+                const double w = std::sqrt(w2);
+                const double a = std::max(0.0, (cx - w - origin[0]) / h);
+                const double b = std::min(double(nx), (cx + w - origin[0]) / h);
+                if (a < b)
+                    chords[l].emplace_back(a, b);
+            }
+        }
+
+        // the union of the chords of each line, in voxels along x
+        for (int l = 0; l < lines; l++)
+        {
+            std::vector<std::pair<double, double>> &line = chords[l];
+            if (line.empty())
+                continue;
+            // insertion sort: a chord starts at most a radius before its centre
+            for (size_t m = 1; m < line.size(); m++)
+                for (size_t q = m; q > 0 && line[q].first < line[q - 1].first; q--)
+                    std::swap(line[q], line[q - 1]);
+            const int j = l / samples;
+            double *row = slice + size_t(j) * nx;
+            double *steps = whole.data() + size_t(j) * (nx + 1);
+            for (size_t m = 0; m < line.size();)
+            {
+                const double a = line[m].first;
+                double b = line[m].second;
+                for (m++; m < line.size() && line[m].first <= b; m++)
+                    b = std::max(b, line[m].second);
+                const int ia = std::min(int(a), nx - 1), ib = int(b);
+                if (ia == ib)
+                {
+                    row[ia] += b - a;
+                    continue;
+                }
+                row[ia] += ia + 1 - a;
+                steps[ia + 1] += 1;
+                steps[ib] -= 1;
+                if (ib < nx)
+                    row[ib] += b - ib;
+            }
+            line.clear();
+        }
+    }
+
+    // every line is 1 / samples^2 of its voxels' cross-section
+    const double weight = 1.0 / (double(samples) * samples);
+    const size_t sliceVoxels = size_t(nx) * ny;
+    uint8_t *out = fraction.data() + sliceVoxels * k;
+    for (int j = 0; j < ny; j++)
+    {
+        double *row = slice + size_t(j) * nx;
+        const double *steps = whole.data() + size_t(j) * (nx + 1);
+        double covered = 0;
+        for (int i = 0; i < nx; i++)
+        {
+            covered += steps[i];
+            row[i] = std::min((row[i] + covered) * weight, 1.0);
+            out[size_t(j) * nx + i] = uint8_t(std::lround(row[i] * 255));
+        }
+    }
+}
+
+double CVoxelizer::rowSolid( const double *slice, int j, int k, int i0, int i1 ) const
+{
+    double solid = 0;
+    if (slice != nullptr)
+    {
+        const double *row = slice + size_t(j) * dims[0];
+        for (int i = i0; i <= i1; i++)
+            solid += row[i];
+        return solid;
+    }
+
+    const uint64_t *row = bits.data() + rowWords() * (size_t(k) * dims[1] + j);
+    const int w0 = i0 / 64, w1 = i1 / 64;
+    const uint64_t first = ~uint64_t(0) << (i0 % 64), last = ~uint64_t(0) >> (63 - i1 % 64);
+    if (w0 == w1)
+        return double(__builtin_popcountll(row[w0] & first & last));
+    size_t count = __builtin_popcountll(row[w0] & first) + __builtin_popcountll(row[w1] & last);
+    for (int w = w0 + 1; w < w1; w++)
+        count += __builtin_popcountll(row[w]);
+    return double(count);
+}
+
+void CVoxelizer::countSlice( int k, const double *slice, const std::vector<const CRegion *> &regionList,
+                             SPorosity *regionSums )
+{
+    const int nx = dims[0], ny = dims[1];
+    const double h = voxel;
+    SPorosity &sum = perSlice[k];
+    sum.voxels = double(nx) * ny;
+    sum.solid = 0;
+    for (int j = 0; j < ny; j++)
+        sum.solid += rowSolid(slice, j, k, 0, nx - 1);
+
+    const double z = origin[2] + (k + 0.5) * h;
+    for (size_t r = 0; r < regionList.size(); r++)
+    {
+        SPorosity &part = regionSums[r];
+        part = SPorosity();
+        double lo[3], hi[3];
+        regionList[r]->bounds(lo, hi);
+        if (z < lo[2] || z > hi[2])
+            continue;
+
+        // voxel centres within the bounds, each row classified whole first
+        const int i0 = std::max(0, int(std::ceil((lo[0] - origin[0]) / h - 0.5)));
+        const int i1 = std::min(nx - 1, int(std::floor((hi[0] - origin[0]) / h - 0.5)));
+        const int j0 = std::max(0, int(std::ceil((lo[1] - origin[1]) / h - 0.5)));
+        const int j1 = std::min(ny - 1, int(std::floor((hi[1] - origin[1]) / h - 0.5)));
+        for (int j = j0; j <= j1 && i0 <= i1; j++)
+        {
+            const double y = origin[1] + (j + 0.5) * h;
+            const double rowLo[3] = {origin[0] + (i0 + 0.5) * h, y, z};
+            const double rowHi[3] = {origin[0] + (i1 + 0.5) * h, y, z};
+            const ECellClass cls = regionList[r]->classify(rowLo, rowHi);
+            if (cls == ECellClass::eOutside)
+                continue;
+
+            if (cls == ECellClass::eInside)
+            {
+                part.voxels += i1 - i0 + 1;
+                part.solid += rowSolid(slice, j, k, i0, i1);
+                continue;
+            }
+            for (int i = i0; i <= i1; i++)
+            {
+                const double p[3] = {origin[0] + (i + 0.5) * h, y, z};
+                if (regionList[r]->contains(p))
+                {
+                    part.voxels += 1;
+                    part.solid += slice != nullptr ? slice[size_t(j) * nx + i] : value(i, j, k);
+                }
+            }
+        }
+    }
+}
+
+double CVoxelizer::value( int i, int j, int k ) const
+{
+    if (mode == EMode::eOccupancy)
+        return double((bits[rowWords() * (size_t(k) * dims[1] + j) + i / 64] >> (i % 64)) & 1);
+    return fraction[(size_t(k) * dims[1] + j) * dims[0] + i] / 255.0;
+}
+
+bool CVoxelizer::write( const std::string &path ) const
+{
+    FILE *file = fopen(path.c_str(), "wb");
+    if (file == nullptr)
+        return false;
+
+    SHeader header = {};
+    memcpy(header.magic, "VOX1", 4);
+    header.mode = uint32_t(mode);
+    std::copy(dims, dims + 3, header.dims);
+    std::copy(origin, origin + 3, header.origin);
+    header.voxel = voxel;
+    bool ok = fwrite(&header, sizeof(header), 1, file) == 1;
+
+    if (mode == EMode::eOccupancy)
+        ok = ok && fwrite(bits.data(), sizeof(uint64_t), bits.size(), file) == bits.size();
+    else
+    {
+        // slices are encoded independently, so they can be decoded in parallel
+        const size_t sliceVoxels = size_t(dims[0]) * dims[1];
+        std::vector<std::vector<uint8_t>> runs(dims[2]);
+        parallelFor(0, size_t(dims[2]), 0, [&]( size_t k0, size_t k1 )
+        {
+            for (size_t k = k0; k < k1; k++)
+            {
+                const uint8_t *v = fraction.data() + sliceVoxels * k;
+                for (size_t start = 0; start < sliceVoxels;)
+                {
+                    size_t end = start + 1;
+                    while (end < sliceVoxels && v[end] == v[start])
+                        end++;
+                    putVarint(runs[k], end - start);
+                    runs[k].push_back(v[start]);
+                    start = end;
+                }
+            }
+        }, 1);
+
+        std::vector<uint64_t> offsets(size_t(dims[2]) + 1, 0);
+        for (int k = 0; k < dims[2]; k++)
+            offsets[k + 1] = offsets[k] + runs[k].size();
+        ok = ok && fwrite(offsets.data(), sizeof(uint64_t), offsets.size(), file) == offsets.size();
+        for (const std::vector<uint8_t> &slice : runs)
+            ok = ok && fwrite(slice.data(), 1, slice.size(), file) == slice.size();
+    }
+    return fclose(file) == 0 && ok;
+}
+
+bool CVoxelizer::read( const std::string &path )
+{
+    FILE *file = fopen(path.c_str(), "rb");
+    if (file == nullptr)
+        return false;
+
+    SHeader header;
+    bool ok = fread(&header, sizeof(header), 1, file) == 1 && memcmp(header.magic, "VOX1", 4) == 0 &&
+              header.mode <= uint32_t(EMode::eFraction) &&
+              header.dims[0] > 0 && header.dims[1] > 0 && header.dims[2] > 0;
+    if (ok)
+    {
+        mode = EMode(header.mode);
+        std::copy(header.dims, header.dims + 3, dims);
+        std::copy(header.origin, header.origin + 3, origin);
+        voxel = header.voxel;
+    }
+
+    const size_t sliceVoxels = ok ? size_t(dims[0]) * dims[1] : 0;
+    bits.clear();
+    fraction.clear();
+    if (ok && mode == EMode::eOccupancy)
+    {
+        bits.resize(rowWords() * dims[1] * dims[2]);
+        ok = fread(bits.data(), sizeof(uint64_t), bits.size(), file) == bits.size();
+    }
+    else if (ok)
+    {
+        std::vector<uint64_t> offsets(size_t(dims[2]) + 1);
+        ok = fread(offsets.data(), sizeof(uint64_t), offsets.size(), file) == offsets.size();
+        std::vector<uint8_t> runs(ok ? offsets.back() : 0);
+        ok = ok && fread(runs.data(), 1, runs.size(), file) == runs.size();
+        fraction.assign(ok ? sliceVoxels * dims[2] : 0, 0);
+
+        std::vector<char> sliceOk(dims[2], 0);
+        parallelFor(0, ok ? size_t(dims[2]) : 0, 0, [&]( size_t k0, size_t k1 )
+        {
+            for (size_t k = k0; k < k1; k++)
+            {
+                if (offsets[k] > offsets[k + 1] || offsets[k + 1] > runs.size())
+                    continue;
+                const uint8_t *p = runs.data() + offsets[k], *end = runs.data() + offsets[k + 1];
+                uint8_t *out = fraction.data() + sliceVoxels * k;
+                size_t filled = 0;
+                uint64_t length;
+                while (p < end && getVarint(p, end, length) && p < end && length <= sliceVoxels - filled)
+                {
+                    std::fill(out + filled, out + filled + length, *p++);
+                    filled += length;
+                }
+                sliceOk[k] = p == end && filled == sliceVoxels;
+            }
+        }, 1);
+        ok = ok && std::all_of(sliceOk.begin(), sliceOk.end(), []( char c ) { return c != 0; });
+    }
+    fclose(file);
+    if (!ok)
+        return false;
+
+    // porosity of the stored, quantised volume; regions are not kept in the file
+    perSlice.assign(dims[2], SPorosity());
+    perRegion.clear();
+    overall = SPorosity();
+    std::vector<double> slice(mode == EMode::eFraction ? sliceVoxels : 0);
+    for (int k = 0; k < dims[2]; k++)
+    {
+        for (size_t v = 0; v < slice.size(); v++)
+            slice[v] = fraction[sliceVoxels * k + v] / 255.0;
+        countSlice(k, slice.empty() ? nullptr : slice.data(), {}, nullptr);
+        overall.voxels += perSlice[k].voxels;
+        overall.solid += perSlice[k].solid;
+    }
+    return true;
+}
@@ -0,0 +1,110 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "packing.h"
+#include "region.h"
+
+/** Solid volume of one part of a voxel grid */
+struct SPorosity
+{
+    double voxels = 0;  /**< voxels in the part */
+    double solid = 0;   /**< solid volume, in voxels */
+
+    double solidFraction() const { return voxels > 0 ? solid / voxels : 0; }
+    double porosity() const { return voxels > 0 ? 1 - solid / voxels : 0; }
+};
+
+/**
+ * Rasterises the spheres of a packing onto a regular voxel grid.
+ *
+ *  - eOccupancy marks a voxel solid when its centre is inside a sphere;
+ *    the volume is kept as one bit per voxel, rows padded to 64 bits;
+ *  - eFraction  computes the fraction of every voxel covered by the
+ *    union of the spheres: `samples` x `samples` lines along x cross
+ *    each voxel, and on every line the chords of the spheres are merged
+ *    and their exact lengths summed into the voxels. Overlaps count once;
+ *    the error is that of the midpoint rule over y and z, largest where
+ *    a surface runs along a line. The volume is kept quantised to
+ *    1/255, the porosities come from the unquantised values.
+ *
+ * The work goes by z slices: spheres are bucketed with a counting sort
+ * into the slices they cut, and a parallelFor over the slices
+ * rasterises each slice from its own list, one row span per sphere
+ * section, so threads never write the same voxel.
+ *
+ * Porosity is reported for the whole grid, per z slice and per region
+ * (voxels whose centre is in the region, rows classified whole where
+ * the region allows).
+ *
+ * Files (native byte order):
+ *
+ *     header    "VOX1", mode, dims, origin, voxel edge
+ *     occupancy the bit rows as stored
+ *     fraction  a table of per-slice offsets, then every slice run
+ *               length encoded as (varint run length, value) pairs
+ */
+class CVoxelizer
+{
+public:
+    enum class EMode : uint32_t { eOccupancy, eFraction };
+
+    struct SParams
+    {
+        EMode mode = EMode::eOccupancy;
+        /** Grid bounds; the packing's bounding box (radii included) unless lo < hi */
+        double lo[3] = {0, 0, 0}, hi[3] = {0, 0, 0};
+        /** Voxel edge, or 0 to have `resolution` voxels along the longest edge */
+        double voxel = 0;
+        int resolution = 256;
+        /** Lines per voxel edge across y and z in eFraction */
+        int samples = 4;
+        size_t threads = 0;
+        /** Regions to report the porosity of, not owned */
+        std::vector<const CRegion *> regions;
+    };
+
+    bool voxelize( const CPacking &packing, const SParams &params );
+
+    const int *getDims() const { return dims; }
+    const double *getOrigin() const { return origin; }
+    double getVoxel() const { return voxel; }
+    EMode getMode() const { return mode; }
+
+    /** Solid fraction of voxel (i, j, k), 0 or 1 in eOccupancy */
+    double value( int i, int j, int k ) const;
+
+    const SPorosity &total() const { return overall; }
+    const std::vector<SPorosity> &slices() const { return perSlice; }
+    const std::vector<SPorosity> &regions() const { return perRegion; }
+
+    bool write( const std::string &path ) const;
+    bool read( const std::string &path );
+
+private:
+    size_t rowWords() const { return (size_t(dims[0]) + 63) / 64; }
+    /** Rasterises slice k, fractions through the slice of doubles (nullptr in eOccupancy) */
+    void rasteriseSlice( const CPacking &packing, const uint32_t *first, const uint32_t *last,
+                         int k, int samples, double *slice );
+    void rasteriseFractions( const CPacking &packing, const uint32_t *first, const uint32_t *last,
+                             int k, int samples, double *slice );
+    /** Solid of voxels i0..i1 of row j, from the slice or else the bits */
+    double rowSolid( const double *slice, int j, int k, int i0, int i1 ) const;
+    void countSlice( int k, const double *slice, const std::vector<const CRegion *> &regionList,
+                     SPorosity *regionSums );
+
+    EMode mode = EMode::eOccupancy;
+    int dims[3] = {0, 0, 0};
+    double origin[3] = {0, 0, 0};
+    double voxel = 1;
+
+    std::vector<uint64_t> bits;
+    std::vector<uint8_t> fraction;
+
+    SPorosity overall;
+    std::vector<SPorosity> perSlice;
+    std::vector<SPorosity> perRegion;
+};
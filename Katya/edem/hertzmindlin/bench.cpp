@@ -0,0 +1,259 @@
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <random>
+#include <vector>
+
+#include <Api/Core/ICustomPropertyManagerApi_1_0.h>
+
+#include "hertzmindlin.h"
+
+using NApiHelpersV3_0_0::CSimple3DVector;
+using namespace NCalcForceTypesV3_0_0;
+
+struct SHostContact
+{
+    SDiscreteElement element1, element2;
+    SInteraction interaction;
+    SContact contact;
+    CSimple3DVector tangentialOverlap;
+};
+
+/**
+ * Straightforward scalar Hertz-Mindlin written directly against the
+ * host structs; the baseline the batched kernel is measured against.
+ */
+static void scalarForce( SHostContact &c, double dt, SContactResult &res )
+{
+    const double pi = 3.14159265358979323846;
+    const SDiscreteElement &e1 = c.element1, &e2 = c.element2;
+
+    CSimple3DVector n = e1.position - c.contact.contactPoint;
+    n.normalise();
+    double radius = 1.0 / (1.0 / e1.contactRadius + 1.0 / e2.contactRadius);
+    double mass = 1.0 / (1.0 / e1.mass + 1.0 / e2.mass);
+    double young1 = 2 * e1.shearModulus * (1 + e1.poisson), young2 = 2 * e2.shearModulus * (1 + e2.poisson);
+    double eStar = 1.0 / ((1 - e1.poisson * e1.poisson) / young1 + (1 - e2.poisson * e2.poisson) / young2);
+    double gStar = 1.0 / ((2 - e1.poisson) / e1.shearModulus + (2 - e2.poisson) / e2.shearModulus);
+    double lnE = log(c.interaction.coeffRest);
+    double beta = lnE / sqrt(lnE * lnE + pi * pi);
+
+    double d = c.contact.normalContactOverlap;
+    double sn = 2 * eStar * sqrt(radius * d);
+    double st = 8 * gStar * sqrt(radius * d);
+
+    CSimple3DVector v = e1.velocityAtContactPoint - e2.velocityAtContactPoint;
+    double vn = v.dot(n);
+    double fnDamp = 2 * sqrt(5.0 / 6.0) * beta * sqrt(sn * mass) * vn;
+    double fn = 4.0 / 3.0 * eStar * sqrt(radius) * pow(d, 1.5) + fnDamp;
+
+    CSimple3DVector vt = v - n * vn;
+    CSimple3DVector overlap = c.tangentialOverlap + vt * dt;
+    overlap -= n * overlap.dot(n);
+    CSimple3DVector ftDamp = vt * (2 * sqrt(5.0 / 6.0) * beta * sqrt(st * mass));
+    CSimple3DVector ft = overlap * -st + ftDamp;
+    if (ft.length() > c.interaction.staticFriction * fabs(fn))
+    {
+        double scale = c.interaction.staticFriction * fabs(fn) / ft.length();
+        ft *= scale;
+        ftDamp *= scale;
+        overlap *= scale;
+    }
+    c.tangentialOverlap = overlap;
+
+    res.normalForce = n * fn;
+    res.usNormalForce = n * fnDamp;
+    res.tangentialForce = ft;
+    res.usTangentialForce = ftDamp;
+}
+
+static std::vector<SHostContact> makeContacts( size_t n )
+{
+    std::mt19937 gen(42);
+    std::uniform_real_distribution<double> unit(-1, 1);
+    std::uniform_real_distribution<double> rad(0.005, 0.03);
+
+    std::vector<SHostContact> contacts(n);
+    for (auto &c : contacts)
+    {
+        for (SDiscreteElement *e : {&c.element1, &c.element2})
+        {
+            e->isSphere = true;
+            e->shearModulus = 1e8;
+            e->poisson = 0.25;
+            e->contactRadius = e->physicalRadius = rad(gen);
+            e->density = 2500;
+            e->mass = e->density * 4.0 / 3.0 * 3.14159265 * pow(e->contactRadius, 3);
+            e->velocityAtContactPoint = CSimple3DVector(unit(gen), unit(gen), unit(gen));
+        }
+        CSimple3DVector dir(unit(gen), unit(gen), unit(gen));
+        dir.normalise();
+        double overlap = 1e-4 * (1 + unit(gen));
+        double dist = c.element1.contactRadius + c.element2.contactRadius - overlap;
+        c.element2.position = c.element1.position - dir * dist;
+        c.contact.contactPoint = c.element1.position - dir * (c.element1.contactRadius - overlap / 2);
+        c.contact.normalContactOverlap = overlap;
+        c.interaction.coeffRest = 0.5;
+        c.interaction.staticFriction = 0.5;
+    }
+    return contacts;
+}
+
+/** Host side of the contact custom properties: one 3-element property */
+class CContactProperties : public NApiCore::ICustomPropertyManagerApi_1_0,
+                           public NApiCore::ICustomPropertyDataApi_1_0
+{
+public:
+    double value[3] = {0, 0, 0};
+    double delta[3] = {0, 0, 0};
+
+    unsigned int getNumProperties() override { return 1; }
+    unsigned int getPropertyIndex( const char *name ) override
+    {
+        return strcmp(name, CHertzMindlin::TANGENTIAL_OVERLAP) == 0 ? 0 : NApi::NO_ID;
+    }
+    bool getPropertyMetaData( unsigned int index, SPropertyData &data ) override
+    {
+        if (index != 0)
+            return false;
+        strncpy(data.m_name, CHertzMindlin::TANGENTIAL_OVERLAP, NApi::CUSTOM_PROP_MAX_NAME_LENGTH - 1);
+        data.m_name[NApi::CUSTOM_PROP_MAX_NAME_LENGTH - 1] = 0;
+        data.m_index = 0;
+        data.m_category = NApi::eContact;
+        data.m_dataType = NApi::eDouble;
+        data.m_numberOfElements = 3;
+        data.m_unitType = NApi::eLength;
+        data.m_finalised = true;
+        return true;
+    }
+    bool getPropertyMetaData( const char *name, SPropertyData &data ) override
+    {
+        return getPropertyMetaData(getPropertyIndex(name), data);
+    }
+
+    IApi *getManager( NApi::tApiMajorVersion, NApi::tApiMinorVersion ) override
+    {
+        return static_cast<NApiCore::ICustomPropertyManagerApi_1_0 *>(this);
+    }
+    const double *getValue( unsigned int index ) override { return index == 0 ? value : nullptr; }
+    const double *getValue( const char *name ) override { return getValue(getPropertyIndex(name)); }
+    double *getDelta( unsigned int index ) override { return index == 0 ? delta : nullptr; }
+    double *getDelta( const char *name ) override { return getDelta(getPropertyIndex(name)); }
+    bool hasData( unsigned int index ) override { return index == 0; }
+    bool hasData( const char *name ) override { return hasData(getPropertyIndex(name)); }
+
+    void getApiVersion( NApi::tApiMajorVersion &major, NApi::tApiMinorVersion &minor ) override
+    {
+        major = 1;
+        minor = 0;
+    }
+    NApiCore::EApiId getApiId() const override { return NApiCore::eContactCustomPropertyManager; }
+    bool readOnly() const override { return false; }
+};
+
+class ApiMgr : public NApiCore::IApiManager_1_0
+{
+public:
+    CContactProperties contactProperties;
+
+    IApi *getApi( NApiCore::EApiId apiId, NApi::tApiMajorVersion, NApi::tApiMinorVersion ) override
+    {
+        if (apiId == NApiCore::eContactCustomPropertyManager)
+            return static_cast<NApiCore::ICustomPropertyManagerApi_1_0 *>(&contactProperties);
+        return nullptr;
+    }
+    void release( IApi * ) override {}
+    void getApiVersion( NApi::tApiMajorVersion &major, NApi::tApiMinorVersion &minor ) override
+    {
+        major = minor = 0;
+    }
+    NApiCore::EApiId getApiId() const override { return NApiCore::eApiManager; }
+    bool readOnly() const override { return false; }
+};
+
+template <class F>
+static double measure( F &&f, int repeats )
+{
+    auto begin = std::chrono::steady_clock::now();
+    for (int r = 0; r < repeats; r++)
+        f();
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+}
+
+int main( int argc, char *argv[] )
+{
+    size_t n = argc > 1 ? std::stoul(argv[1]) : 1 << 20;
+    int repeats = argc > 2 ? std::stoi(argv[2]) : 10;
+    const double dt = 1e-6;
+
+    auto contacts = makeContacts(n);
+    std::vector<SContactResult> results(n);
+
+    SContactBatch batch;
+    batch.resize(n);
+    for (size_t i = 0; i < n; i++)
+        CHertzMindlin::fillLane(batch, i, contacts[i].element1, contacts[i].element2,
+                                contacts[i].interaction, contacts[i].contact);
+
+    CHertzMindlin model;
+    STimeStepData step{0, dt};
+
+    ApiMgr mgr;
+    if (!model.starting(mgr, 1))
+    {
+        printf("cannot resolve %s\n", CHertzMindlin::TANGENTIAL_OVERLAP);
+        return 1;
+    }
+    NApiCore::ICustomPropertyDataApi_1_0 *history = &mgr.contactProperties;
+
+    double scalarTime = measure([&]()
+    {
+        for (size_t i = 0; i < n; i++)
+            scalarForce(contacts[i], dt, results[i]);
+    }, repeats);
+
+    double adapterTime = measure([&]()
+    {
+        for (size_t i = 0; i < n; i++)
+            model.calculateForce(step, contacts[i].element1, nullptr, contacts[i].element2, nullptr,
+                                 contacts[i].interaction, contacts[i].contact, nullptr, nullptr, results[i]);
+    }, repeats);
+
+    // the history goes through the resolved property handle
+    double historyTime = measure([&]()
+    {
+        for (size_t i = 0; i < n; i++)
+            model.calculateForce(step, contacts[i].element1, nullptr, contacts[i].element2, nullptr,
+                                 contacts[i].interaction, contacts[i].contact, history, nullptr, results[i]);
+    }, repeats);
+    model.stopping(mgr);
+
+    // same history on both sides before comparing
+    for (auto &c : contacts)
+        c.tangentialOverlap = CSimple3DVector();
+    for (auto col : {&batch.tx, &batch.ty, &batch.tz})
+        std::fill(col->begin(), col->end(), 0.0);
+
+    double batchTime = measure([&]() { model.calculateForces(batch, dt); }, repeats);
+
+    double maxDiff = 0;
+    for (size_t i = 0; i < n; i++)
+    {
+        for (int r = 0; r < repeats; r++)
+            scalarForce(contacts[i], dt, results[i]);
+        CSimple3DVector diff = results[i].normalForce + results[i].tangentialForce -
+                CSimple3DVector(batch.fnx[i] + batch.ftx[i], batch.fny[i] + batch.fty[i], batch.fnz[i] + batch.ftz[i]);
+        CSimple3DVector ref = results[i].normalForce + results[i].tangentialForce;
+        maxDiff = std::max(maxDiff, diff.length() / std::max(ref.length(), 1e-30));
+    }
+
+    double total = double(n) * repeats;
+    printf("contacts: %zu x %d\n", n, repeats);
+    printf("scalar   %12.3e contacts/s\n", total / scalarTime);
+    printf("adapter  %12.3e contacts/s\n", total / adapterTime);
+    printf("+history %12.3e contacts/s\n", total / historyTime);
+    printf("batched  %12.3e contacts/s (x%.2f vs scalar)\n", total / batchTime, scalarTime / batchTime);
+    printf("max relative difference %.3e\n", maxDiff);
+
+    return maxDiff < 1e-9 ? 0 : 1;
+}
@@ -0,0 +1,138 @@
+#include "hertzmindlin.h"
+
+using NApiHelpersV3_0_0::CSimple3DVector;
+
+const char *CHertzMindlin::TANGENTIAL_OVERLAP = "HM Tangential Overlap";
+
+void CHertzMindlin::getPreferenceFileName( char prefFileName[] )
+{
+    prefFileName[0] = '\0';
+}
+
+bool CHertzMindlin::isThreadSafe()
+{
+    return true;
+}
+
+bool CHertzMindlin::usesCustomProperties()
+{
+    return true;
+}
+
+bool CHertzMindlin::setup( NApiCore::IApiManager_1_0 &apiManager, const char prefFile[], char customMsg[] )
+{
+    return true;
+}
+
+bool CHertzMindlin::starting( NApiCore::IApiManager_1_0 &apiManager, int numThreads )
+{
+    return properties.resolve(apiManager);
+}
+
+void CHertzMindlin::stopping( NApiCore::IApiManager_1_0 &apiManager )
+{
+    properties.reset();
+}
+
+NApi::EPluginModelType CHertzMindlin::getModelType()
+{
+    return NApi::EPluginModelType::eBase;
+}
+
+NApi::EPluginExecutionChainPosition CHertzMindlin::getExecutionChainPosition()
+{
+    return NApi::EPluginExecutionChainPosition::eBasePos;
+}
+
+void CHertzMindlin::fillLane( SContactBatch &batch, size_t i,
+                              const NCalcForceTypesV3_0_0::SDiscreteElement &element1,
+                              const NCalcForceTypesV3_0_0::SDiscreteElement &element2,
+                              const NCalcForceTypesV3_0_0::SInteraction &interaction,
+                              const NCalcForceTypesV3_0_0::SContact &contact )
+{
+    CSimple3DVector normal = element1.position - contact.contactPoint;
+    normal.normalise();
+    batch.nx[i] = normal.getX();
+    batch.ny[i] = normal.getY();
+    batch.nz[i] = normal.getZ();
+    batch.overlap[i] = contact.normalContactOverlap;
+
+    CSimple3DVector relVel = element1.velocityAtContactPoint - element2.velocityAtContactPoint;
+    batch.vx[i] = relVel.getX();
+    batch.vy[i] = relVel.getY();
+    batch.vz[i] = relVel.getZ();
+
+    // geometry is an infinitely large and heavy element 2
+    batch.invRadius[i] = 1.0 / element1.contactRadius + (element2.isSphere ? 1.0 / element2.contactRadius : 0.0);
+    batch.invMass[i] = 1.0 / element1.mass + (element2.isSphere ? 1.0 / element2.mass : 0.0);
+
+    batch.eStar[i] = NHertzMindlin::equivalentYoung(element1.shearModulus, element1.poisson,
+                                                    element2.shearModulus, element2.poisson);
+    batch.gStar[i] = NHertzMindlin::equivalentShear(element1.shearModulus, element1.poisson,
+                                                    element2.shearModulus, element2.poisson);
+    batch.beta[i] = NHertzMindlin::dampingRatio(interaction.coeffRest);
+    batch.friction[i] = interaction.staticFriction;
+}
+
+NApi::ECalculateResult CHertzMindlin::calculateForce(
+        const NCalcForceTypesV3_0_0::STimeStepData &timeStepData,
+        const NCalcForceTypesV3_0_0::SDiscreteElement &element1,
+        NApiCore::ICustomPropertyDataApi_1_0 *element1CustomProperties,
+        const NCalcForceTypesV3_0_0::SDiscreteElement &element2,
+        NApiCore::ICustomPropertyDataApi_1_0 *element2CustomProperties,
+        const NCalcForceTypesV3_0_0::SInteraction &interaction,
+        const NCalcForceTypesV3_0_0::SContact &contact,
+        NApiCore::ICustomPropertyDataApi_1_0 *contactCustomProperties,
+        NApiCore::ICustomPropertyDataApi_1_0 *simulationCustomProperties,
+        NCalcForceTypesV3_0_0::SContactResult &contactResults )
+{
+    // one lane per host thread, allocated once
+    thread_local SContactBatch lane;
+    if (lane.size() != 1)
+        lane.resize(1);
+
+    fillLane(lane, 0, element1, element2, interaction, contact);
+
+    const CPropertyView<const double> overlap = tangentialOverlap.value(contactCustomProperties);
+    const CPropertyView<double> overlapDelta = tangentialOverlap.delta(contactCustomProperties);
+    lane.tx[0] = overlap ? overlap[0] : 0;
+    lane.ty[0] = overlap ? overlap[1] : 0;
+    lane.tz[0] = overlap ? overlap[2] : 0;
+
+    NHertzMindlin::computeForces(lane, 0, 1, timeStepData.timeStep);
+
+    if (overlap && overlapDelta)
+    {
+        overlapDelta[0] += lane.tx[0] - overlap[0];
+        overlapDelta[1] += lane.ty[0] - overlap[1];
+        overlapDelta[2] += lane.tz[0] - overlap[2];
+    }
+
+    contactResults.normalForce += CSimple3DVector(lane.fnx[0], lane.fny[0], lane.fnz[0]);
+    contactResults.usNormalForce += CSimple3DVector(lane.fndx[0], lane.fndy[0], lane.fndz[0]);
+    contactResults.tangentialForce += CSimple3DVector(lane.ftx[0], lane.fty[0], lane.ftz[0]);
+    contactResults.usTangentialForce += CSimple3DVector(lane.ftdx[0], lane.ftdy[0], lane.ftdz[0]);
+
+    return NApi::eSuccess;
+}
+
+void CHertzMindlin::calculateForces( SContactBatch &batch, double timeStep )
+{
+    NHertzMindlin::computeForces(batch, 0, batch.size(), timeStep);
+}
+
+unsigned int CHertzMindlin::getNumberOfRequiredProperties( const NApi::EPluginPropertyCategory category )
+{
+    return properties.count(category);
+}
+
+bool CHertzMindlin::getDetailsForProperty( unsigned int propertyIndex,
+                                           NApi::EPluginPropertyCategory category,
+                                           char name[],
+                                           NApi::EPluginPropertyDataTypes &dataType,
+                                           unsigned int &numberOfElements,
+                                           NApi::EPluginPropertyUnitTypes &unitType,
+                                           char initValBuff[] )
+{
+    return properties.describe(propertyIndex, category, name, dataType, numberOfElements, unitType, initValBuff);
+}
@@ -0,0 +1,79 @@
+#pragma once
+
+#include <Api/Core/ApiTypes.h>
+#include <Api/Core/IApiManager_1_0.h>
+#include <Api/Core/ICustomPropertyDataApi_1_0.h>
+#include <Api/Core/NCalcForceTypesV3_0_0.h>
+
+#include "kernel.h"
+#include "propertyhandles.h"
+
+/**
+ * Hertz-Mindlin (no slip) base contact model.
+ *
+ * The physics lives in NHertzMindlin::computeForces, which works on a
+ * SContactBatch. calculateForce() is the thin per-contact adapter for the
+ * host: it copies the AoS element/contact structs into a one-lane batch,
+ * runs the kernel and copies the result back. Callers that already hold
+ * their contacts in columns use calculateForces() directly.
+ *
+ * The tangential overlap history is kept in a 3-element contact custom
+ * property registered by the model and resolved once in starting().
+ *
+ * The contact model plugin interface header is not part of the vendored
+ * API, so the class mirrors the V3.0.0 method set rather than deriving
+ * from it.
+ */
+class CHertzMindlin
+{
+public:
+    static const char *TANGENTIAL_OVERLAP;
+
+    void getPreferenceFileName( char prefFileName[NApi::FILE_PATH_MAX_LENGTH] );
+    bool isThreadSafe();
+    bool usesCustomProperties();
+    bool setup( NApiCore::IApiManager_1_0& apiManager,
+                const char prefFile[],
+                char customMsg[NApi::ERROR_MSG_MAX_LENGTH] );
+    bool starting( NApiCore::IApiManager_1_0& apiManager, int numThreads );
+    void stopping( NApiCore::IApiManager_1_0& apiManager );
+
+    NApi::EPluginModelType getModelType();
+    NApi::EPluginExecutionChainPosition getExecutionChainPosition();
+
+    NApi::ECalculateResult calculateForce(
+            const NCalcForceTypesV3_0_0::STimeStepData& timeStepData,
+            const NCalcForceTypesV3_0_0::SDiscreteElement& element1,
+            NApiCore::ICustomPropertyDataApi_1_0* element1CustomProperties,
+            const NCalcForceTypesV3_0_0::SDiscreteElement& element2,
+            NApiCore::ICustomPropertyDataApi_1_0* element2CustomProperties,
+            const NCalcForceTypesV3_0_0::SInteraction& interaction,
+            const NCalcForceTypesV3_0_0::SContact& contact,
+            NApiCore::ICustomPropertyDataApi_1_0* contactCustomProperties,
+            NApiCore::ICustomPropertyDataApi_1_0* simulationCustomProperties,
+            NCalcForceTypesV3_0_0::SContactResult& contactResults );
+
+    /** Evaluates every contact of an already filled batch */
+    void calculateForces( SContactBatch &batch, double timeStep );
+
+    unsigned int getNumberOfRequiredProperties( const NApi::EPluginPropertyCategory category );
+    bool getDetailsForProperty( unsigned int propertyIndex,
+                                NApi::EPluginPropertyCategory category,
+                                char name[NApi::CUSTOM_PROP_MAX_NAME_LENGTH],
+                                NApi::EPluginPropertyDataTypes& dataType,
+                                unsigned int& numberOfElements,
+                                NApi::EPluginPropertyUnitTypes& unitType,
+                                char initValBuff[NApi::BUFF_SIZE] );
+
+    /** Copies one host contact into lane i of a batch */
+    static void fillLane( SContactBatch &batch, size_t i,
+                          const NCalcForceTypesV3_0_0::SDiscreteElement& element1,
+                          const NCalcForceTypesV3_0_0::SDiscreteElement& element2,
+                          const NCalcForceTypesV3_0_0::SInteraction& interaction,
+                          const NCalcForceTypesV3_0_0::SContact& contact );
+
+private:
+    CPropertyRegistry properties;
+    const CPropertyHandle &tangentialOverlap =
+            properties.declare(TANGENTIAL_OVERLAP, NApi::eContact, 3, NApi::eLength);
+};
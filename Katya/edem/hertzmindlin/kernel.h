@@ -0,0 +1,176 @@
+#pragma once
+
+#include <cmath>
+#include <cstddef>
+#include <vector>
+
+/**
+ * Structure-of-arrays storage for a batch of contacts.
+ *
+ * Every field is a separate contiguous column so the force loop reads
+ * and writes unit-stride streams of doubles and can be vectorised by the
+ * compiler. Element 2 of a contact with geometry is described by zero
+ * inverse radius and zero inverse mass.
+ */
+struct SContactBatch
+{
+    void resize( size_t n );
+    size_t size() const { return overlap.size(); }
+
+    // contact normal, unit vector pointing from element 2 to element 1
+    std::vector<double> nx, ny, nz;
+    // normal overlap
+    std::vector<double> overlap;
+    // relative velocity at the contact point, v1 - v2
+    std::vector<double> vx, vy, vz;
+    // 1/R1 + 1/R2 and 1/m1 + 1/m2
+    std::vector<double> invRadius, invMass;
+    // equivalent Young's and shear modulus
+    std::vector<double> eStar, gStar;
+    // damping ratio computed from the coefficient of restitution
+    std::vector<double> beta;
+    // coefficient of static friction
+    std::vector<double> friction;
+
+    // tangential overlap history, updated in place
+    std::vector<double> tx, ty, tz;
+
+    // results: total and damping (unsymmetrical) parts of forces on element 1
+    std::vector<double> fnx, fny, fnz;
+    std::vector<double> fndx, fndy, fndz;
+    std::vector<double> ftx, fty, ftz;
+    std::vector<double> ftdx, ftdy, ftdz;
+};
+
+inline void SContactBatch::resize( size_t n )
+{
+    for (auto col : {&nx, &ny, &nz, &overlap, &vx, &vy, &vz, &invRadius, &invMass,
+                     &eStar, &gStar, &beta, &friction, &tx, &ty, &tz,
+                     &fnx, &fny, &fnz, &fndx, &fndy, &fndz,
+                     &ftx, &fty, &ftz, &ftdx, &ftdy, &ftdz})
+        col->resize(n);
+}
+
+namespace NHertzMindlin
+{
+    /** Damping ratio of the Hertz-Mindlin model for a restitution coefficient */
+    inline double dampingRatio( double coeffRest )
+    {
+        const double pi = 3.14159265358979323846;
+        const double lnE = std::log(coeffRest);
+        return lnE / std::sqrt(lnE * lnE + pi * pi);
+    }
+
+    /** Equivalent Young's modulus of two elements given by shear modulus and Poisson's ratio */
+    inline double equivalentYoung( double g1, double nu1, double g2, double nu2 )
+    {
+        const double e1 = 2 * g1 * (1 + nu1), e2 = 2 * g2 * (1 + nu2);
+        return 1.0 / ((1 - nu1 * nu1) / e1 + (1 - nu2 * nu2) / e2);
+    }
+
+    /** Equivalent shear modulus of two elements */
+    inline double equivalentShear( double g1, double nu1, double g2, double nu2 )
+    {
+        return 1.0 / ((2 - nu1) / g1 + (2 - nu2) / g2);
+    }
+
+    /**
+     * Hertz-Mindlin (no slip) force for contacts [begin, end) given as
+     * separate columns.
+     *
+     * The loop body is branch free: the Coulomb limit is applied as a
+     * multiplicative factor so the whole batch goes through the same
+     * instruction stream. The columns are taken as restrict parameters
+     * rather than struct members so the compiler can prove they do not
+     * alias and vectorise the loop.
+     */
+    inline void computeForces( const double *__restrict nx, const double *__restrict ny, const double *__restrict nz,
+                               const double *__restrict ov,
+                               const double *__restrict vx, const double *__restrict vy, const double *__restrict vz,
+                               const double *__restrict invR, const double *__restrict invM,
+                               const double *__restrict eS, const double *__restrict gS,
+                               const double *__restrict beta, const double *__restrict mu,
+                               double *__restrict tx, double *__restrict ty, double *__restrict tz,
+                               double *__restrict fnx, double *__restrict fny, double *__restrict fnz,
+                               double *__restrict fndx, double *__restrict fndy, double *__restrict fndz,
+                               double *__restrict ftx, double *__restrict fty, double *__restrict ftz,
+                               double *__restrict ftdx, double *__restrict ftdy, double *__restrict ftdz,
+                               size_t begin, size_t end, double timeStep )
+    {
+        const double dampCoef = 2.0 * std::sqrt(5.0 / 6.0);
+
+        for (size_t i = begin; i < end; i++)
+        {
+            const double d = ov[i] > 0 ? ov[i] : 0;
+            const double radius = 1.0 / invR[i];
+            const double mass = 1.0 / invM[i];
+            const double sqrtRd = std::sqrt(radius * d);
+
+            // normal direction: elastic Hertz force plus viscous damping
+            const double sn = 2 * eS[i] * sqrtRd;
+            const double fnElastic = 4.0 / 3.0 * eS[i] * sqrtRd * d;
+            const double vn = vx[i] * nx[i] + vy[i] * ny[i] + vz[i] * nz[i];
+            const double fnDamp = dampCoef * beta[i] * std::sqrt(sn * mass) * vn;
+            const double fn = fnElastic + fnDamp;
+
+            fnx[i] = fn * nx[i];
+            fny[i] = fn * ny[i];
+            fnz[i] = fn * nz[i];
+            fndx[i] = fnDamp * nx[i];
+            fndy[i] = fnDamp * ny[i];
+            fndz[i] = fnDamp * nz[i];
+
+            // tangential direction: Mindlin no-slip spring on the accumulated overlap
+            const double st = 8 * gS[i] * sqrtRd;
+            const double vtx = vx[i] - vn * nx[i];
+            const double vty = vy[i] - vn * ny[i];
+            const double vtz = vz[i] - vn * nz[i];
+
+            double ox = tx[i] + vtx * timeStep;
+            double oy = ty[i] + vty * timeStep;
+            double oz = tz[i] + vtz * timeStep;
+            // keep the history in the current tangent plane
+            const double on = ox * nx[i] + oy * ny[i] + oz * nz[i];
+            ox -= on * nx[i];
+            oy -= on * ny[i];
+            oz -= on * nz[i];
+
+            const double tDampCoef = dampCoef * beta[i] * std::sqrt(st * mass);
+            double fx = -st * ox + tDampCoef * vtx;
+            double fy = -st * oy + tDampCoef * vty;
+            double fz = -st * oz + tDampCoef * vtz;
+
+            // Coulomb limit as a scale factor in [0, 1]
+            const double ftMag = std::sqrt(fx * fx + fy * fy + fz * fz);
+            const double ftMax = mu[i] * std::fabs(fn);
+            const double ratio = ftMax / (ftMag + 1e-300);
+            const double scale = ratio < 1.0 ? ratio : 1.0;
+
+            tx[i] = ox * scale;
+            ty[i] = oy * scale;
+            tz[i] = oz * scale;
+            ftx[i] = fx * scale;
+            fty[i] = fy * scale;
+            ftz[i] = fz * scale;
+            ftdx[i] = tDampCoef * vtx * scale;
+            ftdy[i] = tDampCoef * vty * scale;
+            ftdz[i] = tDampCoef * vtz * scale;
+        }
+    }
+
+    /**
+     * Hertz-Mindlin force for contacts [begin, end) of the batch. Calling
+     * it with a one element range is the per-contact path used by the
+     * host adapter.
+     */
+    inline void computeForces( SContactBatch &b, size_t begin, size_t end, double timeStep )
+    {
+        computeForces(b.nx.data(), b.ny.data(), b.nz.data(), b.overlap.data(),
+                      b.vx.data(), b.vy.data(), b.vz.data(), b.invRadius.data(), b.invMass.data(),
+                      b.eStar.data(), b.gStar.data(), b.beta.data(), b.friction.data(),
+                      b.tx.data(), b.ty.data(), b.tz.data(),
+                      b.fnx.data(), b.fny.data(), b.fnz.data(), b.fndx.data(), b.fndy.data(), b.fndz.data(),
+                      b.ftx.data(), b.fty.data(), b.ftz.data(), b.ftdx.data(), b.ftdy.data(), b.ftdz.data(),
+                      begin, end, timeStep);
+    }
+}
@@ -1,121 +1,469 @@
+#include <algorithm>
+#include <cstdio>
 #include <cstring>
 #include <fstream>
 #include <sstream>
 
-#include "factory.h"
+#include "particlefactory.h"
 
-void PTIIoffeFactory::getPreferenceFileName(char prefFileName[])
+void CFactoryCore::getPreferenceFileName(char prefFileName[])
 {
     strncpy(prefFileName, configFileName, NApi::FILE_PATH_MAX_LENGTH);
 }
 
-bool PTIIoffeFactory::setup( NApiCore::IApiManager_1_0 &apiManager, const char prefFile[] )
+bool CFactoryCore::setup( NApiCore::IApiManager_1_0 &apiManager, const char prefFile[], char customMsg[] )
 {
-    if (strlen(prefFile) > NApi::FILE_PATH_MAX_LENGTH)
+    auto fail = [customMsg]( std::string const& message )
+    {
+        strncpy(customMsg, message.c_str(), NApi::ERROR_MSG_MAX_LENGTH - 1);
+        customMsg[NApi::ERROR_MSG_MAX_LENGTH - 1] = 0;
         return false;
+    };
+
+    if (strlen(prefFile) >= NApi::FILE_PATH_MAX_LENGTH)
+        return fail("Factory config path is too long");
 
     strncpy(configFileName, prefFile, NApi::FILE_PATH_MAX_LENGTH);
 
     std::ifstream config(configFileName);
 
     if (!config)
-        return false;
+        return fail(std::string("Cannot read factory config ") + configFileName);
+
+    SPackingSource source;
+    tiled = false;
+    tiling = CTiledSource::SParams();
+    culling = SCullParams();
+    cullReport = SCullReport();
+    clump.reset();
+    statePath.clear();
+    stateInterval = 0;
+    largePages = CLargePages::instance().config();
+    pageLines = false;
+    clumpFile.clear();
+    clumpTolerance = 1e-4;
+    clumpRandom = false;
+    clumpSeed = 0;
+    region.reset();
+    selection.clear();
+    prepared = false;
+    resetPolicies();
+    if (!readSource(config, source))
+        return fail(std::string("No packing in factory config ") + configFileName);
+
+    auto trim = []( std::string const& str )
+    {
+        const size_t first = str.find_first_not_of(" \t\r");
+        const size_t last = str.find_last_not_of(" \t\r");
+        return first == std::string::npos ? std::string() : str.substr(first, last - first + 1);
+    };
+
+    std::string line;
+    while (std::getline(config, line))
+    {
+        line = trim(line);
+        if (line.empty() || line[0] == '#')
+            continue;
+
+        const size_t eq = line.find('=');
+        if (eq == std::string::npos || !readOption(trim(line.substr(0, eq)), trim(line.substr(eq + 1)), source))
+            return fail("Bad factory config line: " + line);
+    }
+    if (culling.mode != ECullMode::eNone && culling.cutoff <= 0)
+        return fail("Culling needs a positive cull_radius");
+    if (stateInterval > 0 && statePath.empty())
+        return fail("state_interval needs a state file");
+    wholePacking = !orderStreams() || tiled || region != nullptr || culling.mode != ECullMode::eNone;
+
+    if (!clumpFile.empty())
+    {
+        clump = CClumpLibrary::instance().acquire(clumpFile, clumpTolerance);
+        if (clump == nullptr)
+            return fail("Cannot read clump template " + clumpFile);
+        const SClumpMass &mass = clump->mass();
+        printf("%s: clump %s of %zu spheres, volume %.6g, principal moments %.6g %.6g %.6g "
+               "(error %.2g on %d x %d rows)\n",
+               configFileName, clump->type().c_str(), clump->getSpheres().size(), mass.volume,
+               mass.moments[0], mass.moments[1], mass.moments[2], mass.error, mass.resolution, mass.resolution);
+    }
 
-    std::string centerConfig, radConfig;
-    std::getline(config, centerConfig);
-    std::getline(config, radConfig);
+    // the element counts are needed to resolve the handles before any row is loaded
+    // a repeated setup declares anew, so dropped or renamed properties are not resolved
+    propertyHandles.clear();
+    properties.clear();
+    for (auto const& property : source.properties)
+    {
+        const unsigned int elements = CPacking::propertyElements(property.second);
+        if (elements == 0)
+            return fail("Cannot read property file " + property.second);
+        propertyHandles.push_back(&properties.declare(property.first.c_str(), NApi::eParticle,
+                                                      elements, NApi::eNone));
+    }
+    if (!propertyHandles.empty() && !properties.resolve(apiManager))
+        return fail("Cannot resolve the factory custom properties");
 
-    readCenters(centerConfig);
-    readRadiuses(radConfig);
+    if (pageLines)
+        CLargePages::instance().configure(largePages);
 
-    return radiuses.size() == centers.size();
+    cursor.reset();
+    resumePending = false;
+    stateTime = 0;
+    std::string error;
+    packing = acquireSource(source, error);
+    if (packing == nullptr)
+        return fail(error);
+    stateSource = source;
+    return true;
 }
 
-NApi::ECalculateResult PTIIoffeFactory::createParticle(
-        double time, bool &particleCreated, bool &additionalParticleRequired,
-        char type[], double &scale, double &posX, double &posY, double &posZ,
-        double &velX, double &velY, double &velZ,
-        double &angVelX, double &angVelY, double &angVelZ,
-        double orientation[], NApiCore::ICustomPropertyDataApi_1_0 *propData )
+bool CFactoryCore::starting( NApiCore::IApiManager_1_0 &apiManager )
 {
-    particleCreated = curno < centers.size();
-    if (!particleCreated)
-        return NApi::ECalculateResult::eSuccess;
+    struct SRelease
+    {
+        CArena &arena;
+        ~SRelease() { arena.release(); }
+    } releaseSetup{setupArena};
 
-    additionalParticleRequired = true;
-    strcpy(type, "Katya");
-    scale = radiuses[curno];
-    Point &pt = centers[curno];
-    posX = pt.x;
-    posY = pt.y;
-    posZ = pt.z;
-    velX = velY = velZ = 0;
-    angVelX = angVelY = angVelZ = 0;
+    // geometry is only final once the simulation starts
+    if (region != nullptr && !region->resolve(apiManager))
+    {
+        fprintf(stderr, "%s: cannot resolve the emission region\n", configFileName);
+        return false;
+    }
 
-    for (unsigned int i = 0; i < 9; i++)     {         orientation[i] = 0.0;     }
+    // the host starts every processing run, the cursor and the prepared
+    // slots carry over from the previous run; setup() starts over
+    if (wholePacking && !prepare())
+    {
+        fprintf(stderr, "%s: %s\n", configFileName,
+                packing->state() == CPackingLoader::EState::eFailed ? packing->getError().c_str()
+                                                                    : "cannot prepare the emission");
+        return false;
+    }
+    // the inputs are read for their hashes only now, setup() returns at once
+    if (!statePath.empty() && (!hashSource(stateSource, sourceHash) ||
+                               !CPackingSidecar::hashFile(configFileName, configHash)))
+    {
+        fprintf(stderr, "%s: cannot identify the inputs for the emission state\n", configFileName);
+        return false;
+    }
+    if (!statePath.empty())
+        restoreState();
+    timeSteps = 0;
+    return true;
+}
 
-    curno = std::min(curno + 1, centers.size());
+void CFactoryCore::stopping( NApiCore::IApiManager_1_0 & )
+{
+    if (!statePath.empty())
+        saveState();
+}
 
-    return NApi::ECalculateResult::eSuccess;
+void CFactoryCore::configForTimeStep( NApiCore::ICustomPropertyDataApi_1_0 * )
+{
+    // no particle is being created at the start of a time step, so the
+    // cursor holds exactly the particles of the steps before
+    if (stateInterval > 0 && ++timeSteps % stateInterval == 0)
+        saveState();
 }
 
-bool PTIIoffeFactory::readCenters(const std::string &fileName)
+void CFactoryCore::saveState()
 {
-    std::ifstream ifs(fileName);
+    // a state not resumed yet is kept as read: nothing was created since
+    SEmissionState state = restored;
+    if (!resumePending.load(std::memory_order_acquire))
+    {
+        state.sourceHash = sourceHash;
+        state.configHash = configHash;
+        state.slots = slotCount();
+        state.claimed = cursor.claimed();
+        state.time = stateTime.load(std::memory_order_relaxed);
+        state.pending = cursor.pending();
+    }
+    if (!state.write(statePath))
+        fprintf(stderr, "%s: cannot write the emission state %s\n", configFileName, statePath.c_str());
+}
 
-    if (!ifs)
-        return false;
+void CFactoryCore::restoreState()
+{
+    SEmissionState state;
+    if (!state.read(statePath))
+        return;
+    if (state.sourceHash != sourceHash || state.configHash != configHash || state.slots != slotCount())
+    {
+        printf("%s: emission state %s is of other inputs, starting over\n", configFileName, statePath.c_str());
+        return;
+    }
+    // starting() does not know the time the host starts from, the first particle does
+    restored = std::move(state);
+    resumePending.store(true, std::memory_order_release);
+}
 
-    std::string line;
+void CFactoryCore::resumeState( double time, double timestep )
+{
+    std::lock_guard<std::mutex> lock(resumeMutex);
+    if (!resumePending.load(std::memory_order_relaxed))
+        return;
 
-    while (std::getline(ifs, line, '\n'))
+    // half a step absorbs the rounding of the time the host restarts at
+    if (time + 0.5 * timestep < restored.time)
+        printf("%s: the simulation starts at %g s, before the emission state %s of %g s, starting over\n",
+               configFileName, time, statePath.c_str(), restored.time);
+    else
     {
-        std::istringstream iss(line);
-        std::string num, x, y, z;
-        std::getline(iss, num, ',');
-        std::getline(iss, x, ',');
-        std::getline(iss, y, ',');
-        std::getline(iss, z, ','); // or \n?
-        auto pt = Point(std::stod(x), std::stod(y), std::stod(z));
-        centers.push_back(pt);
+        cursor.resume(restored.claimed, restored.pending);
+        stateTime.store(restored.time, std::memory_order_relaxed);
+        printf("%s: resumed after %zu emission slots\n", configFileName, restored.emitted());
+        if (restored.slots > 0 && restored.emitted() >= restored.slots)
+            printf("%s: every slot of the emission state %s was emitted, nothing is left; "
+                   "delete it to start over\n", configFileName, statePath.c_str());
     }
-    return true;
+    resumePending.store(false, std::memory_order_release);
 }
 
-bool PTIIoffeFactory::readRadiuses(const std::string &fileName)
+bool CFactoryCore::readOption( std::string const& key, std::string const& value, SPackingSource &source )
 {
-    std::ifstream ifs(fileName);
+    const std::string propertyKey = "property ";
+    if (key.compare(0, propertyKey.size(), propertyKey) == 0)
+    {
+        const size_t name = key.find_first_not_of(' ', propertyKey.size());
+        if (name == std::string::npos)
+            return false;
+        source.properties.emplace_back(key.substr(name), value);
+        return true;
+    }
+    if (key == "sidecar" && (value == "on" || value == "off"))
+    {
+        source.sidecar = value == "on";
+        return true;
+    }
+
+    if (key == "region")
+        return CRegion::combine(region, value);
+    if (key == "state")
+    {
+        statePath = value;
+        return !value.empty();
+    }
+    if (key == "clump")
+    {
+        clumpFile = value;
+        return !value.empty();
+    }
+    if (key == "clump_rotation" && (value == "none" || value == "random"))
+    {
+        clumpRandom = value == "random";
+        return true;
+    }
 
-    if (!ifs)
+    std::istringstream values(value);
+    if (key == "tiles")
+    {
+        tiled = true;
+        return bool(values >> tiling.tiles[0] >> tiling.tiles[1] >> tiling.tiles[2]) &&
+               tiling.tiles[0] > 0 && tiling.tiles[1] > 0 && tiling.tiles[2] > 0;
+    }
+    if (key == "tile_period")
+        return bool(values >> tiling.period[0] >> tiling.period[1] >> tiling.period[2]);
+    if (key == "tile_seed")
+        return bool(values >> tiling.seed);
+    if (key == "tile_overlap_tolerance")
+        return bool(values >> tiling.overlapTolerance);
+    if (key == "cull")
+    {
+        const char *names[] = {"none", "drop", "merge", "parcel"};
+        for (int m = 0; m < 4; m++)
+            if (value == names[m])
+            {
+                culling.mode = ECullMode(m);
+                return true;
+            }
+        return false;
+    }
+    if (key == "clump_tolerance")
+        return bool(values >> clumpTolerance) && clumpTolerance > 0;
+    if (key == "clump_seed")
+        return bool(values >> clumpSeed);
+    if (key == "state_interval")
+        return bool(values >> stateInterval);
+    if (key == "cull_radius")
+        return bool(values >> culling.cutoff);
+    if (key == "parcel_size")
+        return bool(values >> culling.parcelSize) && culling.parcelSize >= 0;
+    if (key == "cull_density")
+        return bool(values >> culling.density) && culling.density > 0;
+    if (key == "cull_shear_modulus")
+        return bool(values >> culling.shearModulus) && culling.shearModulus > 0;
+    if (key == "cull_poisson")
+        return bool(values >> culling.poisson);
+    if (key == "tile_variation")
+    {
+        const char *names[] = {"none", "rotate", "mirror", "any"};
+        for (int v = 0; v < 4; v++)
+            if (value == names[v])
+            {
+                tiling.variation = CTiledSource::EVariation(v);
+                return true;
+            }
         return false;
+    }
 
-    std::string line;
+    if (largePages.readOption(key, value))
+    {
+        pageLines = true;
+        return true;
+    }
+
+    return readPolicyOption(key, value);
+}
+
+bool CFactoryCore::prepare()
+{
+    std::lock_guard<std::mutex> lock(prepareMutex);
+    if (prepared)
+        return true;
+    if (packing->wait() != CPackingLoader::EState::eDone)
+        return false;
 
-    while (std::getline(ifs, line, '\n'))
+    source = &packing->packing();
+    if (culling.mode != ECullMode::eNone)
     {
-        std::istringstream iss(line);
-        std::string num, r;
-        std::getline(iss, num, ',');
-        std::getline(iss, r, ',');
-        radiuses.push_back(std::stod(r));
+        if (!cullFineParticles(*source, culling, culled, cullReport, &setupArena))
+            return false;
+        source = &culled;
+        printf("%s: culled %zu of %zu particles below %g (%zu dropped, %zu merged, %zu into %zu parcels), "
+               "volume lost %.3g%%, timestep x%.3g\n",
+               configFileName, cullReport.dropped + cullReport.merged + cullReport.parcelled, cullReport.before,
+               culling.cutoff, cullReport.dropped, cullReport.merged, cullReport.parcelled, cullReport.parcels,
+               cullReport.volumeBefore > 0 ? 100 * cullReport.volumeLost / cullReport.volumeBefore : 0.0,
+               cullReport.timestepGain());
     }
 
+    const CPacking &data = *source;
+    if (tiled && !tiledSource.build(data, tiling))
+        return false;
+
+    if (region != nullptr && tiled)
+        tiledSource.select(*region, selection);
+    else if (region != nullptr)
+    {
+        CSpatialGrid grid;
+        grid.build(data.x.data(), data.y.data(), data.z.data(), data.size(), 2 * data.maxRadius());
+        std::vector<uint32_t> selected;
+        selectInRegion(*region, grid, data.x.data(), data.y.data(), data.z.data(), selected);
+        selection.assign(selected.begin(), selected.end());
+    }
+
+    preparePolicies();
+    if (CLargePages::instance().config().pages != EPageMode::eDefault)
+        printf("%s: %s\n", configFileName, CLargePages::instance().report().c_str());
+    prepared = true;
     return true;
 }
 
+NApi::ECalculateResult CFactoryCore::emissionEnded() const
+{
+    if (packing == nullptr || packing->state() != CPackingLoader::EState::eFailed)
+        return NApi::ECalculateResult::eSuccess;
+    fprintf(stderr, "%s: %s\n", configFileName, packing->getError().c_str());
+    return NApi::ECalculateResult::eFatalError;
+}
+
+void CFactoryCore::finishParticle( size_t index, const double pos[3], char type[], double &scale,
+                                   double &posX, double &posY, double &posZ, double orientation[],
+                                   NApiCore::ICustomPropertyDataApi_1_0 *propData ) const
+{
+    const CPacking &data = prepared.load(std::memory_order_acquire) ? *source : packing->packing();
+
+    if (clump != nullptr)
+    {
+        double rotation[9] = {1, 0, 0, 0, 1, 0, 0, 0, 1};
+        if (clumpRandom)
+        {
+            // keyed by the position, so a clump keeps its rotation whichever thread emits it
+            uint64_t key = clumpSeed;
+            for (int a = 0; a < 3; a++)
+            {
+                uint64_t bits;
+                memcpy(&bits, &pos[a], sizeof(bits));
+                key = (key ^ bits) * 0x100000001b3ull;
+            }
+            randomRotation(key, rotation);
+        }
+        scale /= clump->boundingRadius();
+        double centre[3];
+        clump->placement(pos, rotation, scale, centre, orientation);
+        snprintf(type, NApi::API_BASIC_STRING_LENGTH, "%s", clump->type().c_str());
+        posX = centre[0];
+        posY = centre[1];
+        posZ = centre[2];
+    }
+    else
+    {
+        strcpy(type, "Katya");
+        posX = pos[0];
+        posY = pos[1];
+        posZ = pos[2];
+        for (unsigned int i = 0; i < 9; i++)     {         orientation[i] = 0.0;     }
+    }
+
+    for (size_t k = 0; k < propertyHandles.size(); k++)
+    {
+        const CPropertyView<const double> value = propertyHandles[k]->value(propData);
+        const CPropertyView<double> delta = propertyHandles[k]->delta(propData);
+        if (!value || !delta)
+            continue;
+
+        const double *target = data.properties[k].row(index);
+        for (unsigned int e = 0; e < delta.size(); e++)
+            delta[e] += target[e] - value[e];
+    }
+}
+
+void CFactoryCore::getSmallestScale( double &scale, char type[] ) const
+{
+    strcpy(type, "Katya");
+    scale = 0;
+    if (prepared.load(std::memory_order_acquire))
+        scale = source->minRadius();
+    else if (packing != nullptr && packing->wait() == CPackingLoader::EState::eDone)
+    {
+        // before starting() only a lower bound is known: culling removes everything below the cutoff
+        scale = packing->packing().minRadius();
+        if (culling.mode != ECullMode::eNone)
+            scale = std::max(scale, culling.cutoff);
+    }
+    if (clump != nullptr)
+    {
+        snprintf(type, NApi::API_BASIC_STRING_LENGTH, "%s", clump->type().c_str());
+        scale /= clump->boundingRadius();
+    }
+}
+
+// each plugin library of the project builds this file with its own FACTORY_INSTANCE
+#ifndef FACTORY_INSTANCE
+#define FACTORY_INSTANCE PTIIoffeFactory
+#endif
+
 EXPORT_MACRO NApiFactory::IPluginParticleFactory *GETFACTORYINSTANCE()
 {
-    return new PTIIoffeFactory;
+    return new FACTORY_INSTANCE;
 }
 
 EXPORT_MACRO void RELEASEFACTORYINSTANCE(NApiFactory::IPluginParticleFactory *instance)
 {
-    auto factory = dynamic_cast<PTIIoffeFactory *>(instance);
+    auto factory = dynamic_cast<CFactoryCore *>(instance);
     if (factory != nullptr)
         delete factory;
 }
 
 EXPORT_MACRO int GETFACTINTERFACEVERSION()
 {
-    return 1;
+    static const int INTERFACE_VERSION_MAJOR = 0x02;
+    static const int INTERFACE_VERSION_MINOR = 0x01;
+    static const int INTERFACE_VERSION_PATCH = 0x00;
+
+    return (INTERFACE_VERSION_MAJOR << 16 |
+            INTERFACE_VERSION_MINOR << 8 |
+            INTERFACE_VERSION_PATCH);
 }
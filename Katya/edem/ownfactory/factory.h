@@ -1,55 +1,283 @@
 #pragma once
 
+#include <atomic>
+#include <istream>
+#include <memory>
+#include <mutex>
 #include <string>
 #include <vector>
 #include <Api/Core/ApiTypes.h>
 #include <Api/Core/IApiManager_1_0.h>
 #include <Api/Core/ICustomPropertyDataApi_1_0.h>
-#include <Api/Factories/IPluginParticleFactoryV2_0_0.h>
+#include <Api/Factories/IPluginParticleFactoryV2_1_0.h>
 #include <Api/Factories/PluginParticleFactoryCore.h>
 
-struct Point
-{
-    Point( double x, double y, double z ) : x(x), y(y), z(z)
-    {}
-
-    double x, y, z;
-};
+#include "arena.h"
+#include "clump.h"
+#include "culling.h"
+#include "emissioncursor.h"
+#include "emissionstate.h"
+#include "largepages.h"
+#include "packingcache.h"
+#include "propertyhandles.h"
+#include "tiledsource.h"
 
-class PTIIoffeFactory : public NApiFactory::IPluginParticleFactoryV2_0_0
+/**
+ * Everything of a packing factory but the emission loop, which
+ * ParticleFactory compiles for its policies.
+ *
+ * Config: the packing as the Source policy reads it (the centers file
+ * on the first line, the radii file on the second for CCsvSource), then
+ * optional `key = value` lines:
+ *
+ *     property <custom property name> = <file>
+ *     sidecar = on | off
+ *     tiles = <N> <M> <K>
+ *     tile_period = <x> <y> <z>
+ *     tile_variation = none | rotate | mirror | any
+ *     tile_seed = <integer>
+ *     tile_overlap_tolerance = <fraction>
+ *     region = [or | and | not] <box | sphere | cylinder | mesh ...>
+ *     cull = none | drop | merge | parcel
+ *     cull_radius = <radius>
+ *     parcel_size = <edge>
+ *     cull_density = <kg/m3>
+ *     cull_shear_modulus = <Pa>
+ *     cull_poisson = <ratio>
+ *     clump = <template file>
+ *     clump_tolerance = <relative error>
+ *     clump_rotation = none | random
+ *     clump_seed = <integer>
+ *     state = <file>
+ *     state_interval = <time steps>
+ *     pages = default | transparent | explicit
+ *     first_touch = on | off
+ *     first_touch_threads = <n>
+ *     large_threshold = <bytes>
+ *
+ * and the lines of the policies (see factorypolicies.h). `property`
+ * loads a per-particle column (see CPacking::readProperty) that is
+ * written into the particle custom property of that name as the
+ * particle is created. The property indices are resolved once in
+ * setup(), emission only adds the difference to the template's initial
+ * value to the delta.
+ *
+ * With CCsvSource the packing comes from CPackingCache, so factories of the
+ * same files (several factories in a deck, or setup() of every
+ * simulation of a batch) share one read-only copy; each instance only
+ * owns its emission cursor. Unless `sidecar = off`, the first process
+ * to load a packing writes its binary sidecar (see CPackingSidecar) and
+ * later processes map that instead of parsing the text files.
+ *
+ * setup() only checks the config and that the files exist, then
+ * returns while the packing loads in the background. createParticle()
+ * blocks only when it reaches a particle that is not loaded yet, and
+ * reports a failed load as eFatalError (details on stderr).
+ *
+ * createParticle() may be called from several threads at once: the
+ * particles are handed out by a CEmissionCursor, each exactly once.
+ *
+ * With `tiles` the packing is replicated over a lattice by a
+ * CTiledSource, built once the whole packing is loaded; particles it
+ * drops at tile faces are skipped and properties follow the base
+ * particle.
+ *
+ * `region` lines (see CRegion::parse) restrict emission to the
+ * particles whose centres lie in the region, the lines folding left
+ * into a boolean combination. The selection is made once over a
+ * CSpatialGrid of the packing, or over the tiles and their cells, at a
+ * cost that follows the size of the region rather than the packing.
+ *
+ * `cull` removes the particles below `cull_radius` before anything else
+ * (see cullFineParticles), which is what bounds the critical timestep;
+ * the material lines only feed the printed report. getSmallestScale()
+ * then gives the smallest radius actually emitted.
+ *
+ * `clump` emits a clump of the template (see CClumpTemplate) for every
+ * packing particle instead of a sphere: the packing centre is the
+ * template origin and the packing radius that of the template's
+ * bounding sphere. The mass properties are integrated once per template
+ * in setup() (shared through CClumpLibrary), and each clump is placed at
+ * its centre of mass with its principal axes as `orientation`, so the
+ * EDEM particle type must be defined from principalSpheres(). With
+ * `clump_rotation = random` every clump is turned by a rotation drawn
+ * from the seed and its position, the same whatever the thread.
+ *
+ * With `state`, stopping() saves the emission state (see
+ * SEmissionState) and starting() reads it back when it was saved for
+ * the same packing and config. The first createParticle() then resumes
+ * from it if the simulation starts at or after the time the state was
+ * saved at, so a run restarted from a host checkpoint goes on with the
+ * particles not emitted yet; a simulation that starts earlier, e.g. the
+ * deck run again from the beginning, starts over. A state of other
+ * inputs is ignored, and a resumed state with nothing left to emit is
+ * reported; delete the file to start over on purpose.
+ * With `state_interval = n` the state is also saved at the start of
+ * every n-th time step (configForTimeStep()), so a run that dies
+ * without stopping() resumes too. The file then belongs to the start of
+ * the last such step: it holds the particles created in the steps
+ * before it. Resume from the host checkpoint of that step, i.e. keep
+ * the interval a multiple of the host's save interval (in steps); a
+ * later checkpoint would see its newer particles emitted again, an
+ * earlier one would miss some.
+ *
+ * The page lines (see SLargePageConfig) choose how the packing columns
+ * and the grids are backed; they are process wide, so the factory whose
+ * setup() loads a packing first decides for it, and the outcome is
+ * printed once the packing is prepared. Without them the EDEM_PAGES
+ * environment applies.
+ *
+ * Culling, tiles and regions are prepared in the first starting(), which
+ * also resolves mesh regions since geometry is only final by then. The
+ * host calls starting() at the start of every processing run, so the
+ * cursor and the prepared slots carry over from one run to the next;
+ * only setup() starts the emission over.
+ */
+class CFactoryCore : public NApiFactory::IPluginParticleFactoryV2_1_0
 {
 public:
     void getPreferenceFileName( char prefFileName[NApi::FILE_PATH_MAX_LENGTH] ) override;
     bool setup( NApiCore::IApiManager_1_0& apiManager,
-               const char prefFile[] ) override;
-
-    NApi::ECalculateResult createParticle(
-                                   double  time,
-                                   bool&   particleCreated,
-                                   bool&   additionalParticleRequired,
-                                   char    type[NApi::API_BASIC_STRING_LENGTH],
-                                   double& scale,
-                                   double& posX,
-                                   double& posY,
-                                   double& posZ,
-                                   double& velX,
-                                   double& velY,
-                                   double& velZ,
-                                   double& angVelX,
-                                   double& angVelY,
-                                   double& angVelZ,
-                                   double  orientation[9],
-                                   NApiCore::ICustomPropertyDataApi_1_0* propData) override;
-private:
-    bool readCenters( std::string const& fileName );
-    bool readRadiuses( std::string const& fileName );
+               const char prefFile[],
+               char customMsg[NApi::ERROR_MSG_MAX_LENGTH] ) override;
+    bool starting( NApiCore::IApiManager_1_0& apiManager ) override;
+    /** Saves the emission state when configured */
+    void stopping( NApiCore::IApiManager_1_0& apiManager ) override;
+    /** Saves the emission state every state_interval time steps */
+    void configForTimeStep( NApiCore::ICustomPropertyDataApi_1_0* simData ) override;
+    /** Whether createParticle needs the property data, i.e. the config has `property` lines */
+    bool usesCustomProperties() override { return !propertyHandles.empty(); }
+
+    /** Smallest radius the factory emits, waits for the packing */
+    void getSmallestScale( double& scale, char type[NApi::API_BASIC_STRING_LENGTH] ) const override;
+
+    /** Loader of the packing, shared with other factories of the same files */
+    const std::shared_ptr<const CPackingLoader> &getPacking() const { return packing; }
+    /** Outcome of the fine particle culling, valid after starting() */
+    const SCullReport &getCullReport() const { return cullReport; }
+    /** Template of the emitted clumps, nullptr when emitting spheres */
+    const std::shared_ptr<const CClumpTemplate> &getClump() const { return clump; }
 
+protected:
+    // policy hooks, called from setup(), starting() and prepare() only
+    /** Reads the packing lines at the top of the config */
+    virtual bool readSource( std::istream &config, SPackingSource &source ) = 0;
+    /** Loader of the packing, nullptr with the reason in error */
+    virtual std::shared_ptr<const CPackingLoader> acquireSource( const SPackingSource &source,
+                                                                 std::string &error ) = 0;
+    virtual bool hashSource( const SPackingSource &source, uint64_t &hash ) = 0;
+    /** Config lines the core does not know */
+    virtual bool readPolicyOption( std::string const& key, std::string const& value ) = 0;
+    virtual void resetPolicies() = 0;
+    /** Whether the order emits slot k as the k-th particle, which lets emission stream */
+    virtual bool orderStreams() const = 0;
+    /** Called once the slots are known, see slotParticle() */
+    virtual void preparePolicies() = 0;
+
+    /** Culls, builds the tiles and the region selection once the packing is loaded */
+    bool prepare();
+    /** Slots emission goes over once prepared, 0 when streaming */
+    size_t slotCount() const { return prepared.load(std::memory_order_acquire) ? preparedSlots() : 0; }
+    /** Slots of the culled packing, its tiles or region, from within prepare() on */
+    size_t preparedSlots() const
+    {
+        return region != nullptr ? selection.size() : tiled ? tiledSource.slots() : source->size();
+    }
+    /** Packing index, position and radius of prepared slot k, false if a tile dropped it */
+    bool slotParticle( size_t k, size_t &index, double pos[3], double &radius ) const
+    {
+        const size_t slot = region != nullptr ? size_t(selection[k]) : k;
+        if (tiled)
+            return tiledSource.particle(slot, pos, radius, index);
+        const CPacking &data = *source;
+        index = slot;
+        pos[0] = data.x[index];
+        pos[1] = data.y[index];
+        pos[2] = data.z[index];
+        radius = data.r[index];
+        return true;
+    }
+    /** Type, clump placement, orientation and property deltas of the particle at pos */
+    void finishParticle( size_t index, const double pos[3], char type[NApi::API_BASIC_STRING_LENGTH],
+                         double &scale, double &posX, double &posY, double &posZ, double orientation[9],
+                         NApiCore::ICustomPropertyDataApi_1_0 *propData ) const;
+    /** Resumes a state read by starting() on the first particle, and keeps the time the state belongs to */
+    void reachTime( double time, double timestep )
+    {
+        if (resumePending.load(std::memory_order_acquire))
+            resumeState(time, timestep);
+        if (statePath.empty())
+            return;
+        const double end = time + timestep;
+        double reached = stateTime.load(std::memory_order_relaxed);
+        while (end > reached && !stateTime.compare_exchange_weak(reached, end, std::memory_order_relaxed))
+            ;
+    }
+    /** Result of a call that created nothing: fatal if the packing failed to load */
+    NApi::ECalculateResult emissionEnded() const;
+
+    std::shared_ptr<const CPackingLoader> packing;
+    CEmissionCursor cursor;
+    /** Culling, tiles, regions or the order need the whole packing before the first particle */
+    bool wholePacking = false;
+    std::atomic<bool> prepared{false};
+
+private:
     char configFileName[NApi::FILE_PATH_MAX_LENGTH];
 
-    std::vector<double> radiuses;
-    std::vector<Point> centers;
+    bool readOption( std::string const& key, std::string const& value, SPackingSource &source );
+    /** Reads the state file and leaves it to resumeState() if it matches the inputs */
+    void restoreState();
+    /** Resumes the cursor from the state read unless the simulation starts before it */
+    void resumeState( double time, double timestep );
+    void saveState();
+
+    CPropertyRegistry properties;
+    /** Handle of each packing property column, same order */
+    std::vector<const CPropertyHandle *> propertyHandles;
+
+    SLargePageConfig largePages;
+    bool pageLines = false;
+
+    std::string statePath;
+    /** Source the state is identified by, hashed in starting() */
+    SPackingSource stateSource;
+    /** Time steps between saves, 0 to save in stopping() only */
+    size_t stateInterval = 0;
+    size_t timeSteps = 0;
+    uint64_t sourceHash = 0;
+    uint64_t configHash = 0;
+    /** State read by starting(), resumed or dropped by the first createParticle() */
+    SEmissionState restored;
+    std::atomic<bool> resumePending{false};
+    std::mutex resumeMutex;
+    /** End of the last time step a particle was created in */
+    std::atomic<double> stateTime{0};
+
+    /** Temporaries of setup() and starting(), released when starting() returns */
+    CArena setupArena;
+
+    SCullParams culling;
+    SCullReport cullReport;
+    CPacking culled;
+    /** Packing particles are taken from once prepared: the loaded or the culled one */
+    const CPacking *source = nullptr;
+
+    std::shared_ptr<const CClumpTemplate> clump;
+    std::string clumpFile;
+    double clumpTolerance = 1e-4;
+    bool clumpRandom = false;
+    uint64_t clumpSeed = 0;
+
+    bool tiled = false;
+    CTiledSource::SParams tiling;
+    CTiledSource tiledSource;
+
+    std::unique_ptr<CRegion> region;
+    /** Packing indices (or tile slots) inside the region, in emission order */
+    std::vector<uint64_t> selection;
 
-    size_t curno = 0;
+    std::mutex prepareMutex;
 };
 
 EXPORT_MACRO NApiFactory::IPluginParticleFactory* GETFACTORYINSTANCE();
@@ -0,0 +1,82 @@
+#include <sstream>
+
+#include "factorypolicies.h"
+#include "packingcache.h"
+#include "packingcodec.h"
+
+bool CCsvSource::read( std::istream &config, SPackingSource &source )
+{
+    return bool(std::getline(config, source.centers)) && bool(std::getline(config, source.radii));
+}
+
+std::shared_ptr<const CPackingLoader> CCsvSource::acquire( const SPackingSource &source, std::string &error )
+{
+    std::shared_ptr<const CPackingLoader> loader = CPackingCache::instance().acquire(source);
+    if (loader == nullptr)
+        error = "Cannot read packing " + source.centers + ", " + source.radii;
+    return loader;
+}
+
+bool CCsvSource::hash( const SPackingSource &source, uint64_t &hash )
+{
+    // the cache remembers the hashes the loader thread took, so this is
+    // mostly a few stat calls
+    return CPackingCache::instance().sourceHash(source, hash);
+}
+
+bool CPkzSource::read( std::istream &config, SPackingSource &source )
+{
+    source.sidecar = false;
+    return bool(std::getline(config, source.centers));
+}
+
+std::shared_ptr<const CPackingLoader> CPkzSource::acquire( const SPackingSource &source, std::string &error )
+{
+    if (!source.properties.empty())
+    {
+        error = "Property lines are not supported with a compressed packing";
+        return nullptr;
+    }
+    auto codec = std::make_shared<CPackingCodec>();
+    if (!codec->open(source.centers))
+    {
+        error = "Cannot open compressed packing " + source.centers;
+        return nullptr;
+    }
+    auto loader = std::make_shared<CPackingLoader>();
+    loader->start([codec]( CPacking &packing, std::string &reason )
+    {
+        if (codec->decode(packing))
+            return true;
+        reason = "compressed packing is damaged";
+        return false;
+    });
+    return loader;
+}
+
+bool CPkzSource::hash( const SPackingSource &source, uint64_t &hash )
+{
+    return CPackingSidecar::hashFile(source.centers, hash);
+}
+
+bool CShuffledOrder::readOption( std::string const& key, std::string const& value )
+{
+    std::istringstream values(value);
+    return key == "order_seed" && bool(values >> seed);
+}
+
+bool CUniformKinematics::readOption( std::string const& key, std::string const& value )
+{
+    std::istringstream values(value);
+    if (key == "velocity")
+        return bool(values >> velocity[0] >> velocity[1] >> velocity[2]);
+    if (key == "angular_velocity")
+        return bool(values >> angular[0] >> angular[1] >> angular[2]);
+    return false;
+}
+
+bool CRadiusFilter::readOption( std::string const& key, std::string const& value )
+{
+    std::istringstream values(value);
+    return key == "radius_range" && bool(values >> lo >> hi) && lo < hi;
+}
@@ -0,0 +1,200 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <istream>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "packingloader.h"
+
+/*
+ * Policies of ParticleFactory. Each is a plain type the factory holds
+ * by value and calls without virtual dispatch:
+ *
+ *  - Source      static read(config, source), acquire(source, error),
+ *                hash(source, hash): where the packing comes from;
+ *  - Order       STREAMS, readOption(), prepare(count, slotParticle),
+ *                slot(k): which slot is emitted k-th;
+ *  - Kinematics  readOption(), apply(pos, radius, vel, angVel): the
+ *                initial velocities;
+ *  - Filter      readOption(), accept(pos, radius): which particles are
+ *                emitted at all.
+ *
+ * readOption() takes the config lines the core does not know and
+ * returns false for the ones it does not know either.
+ */
+
+/** Centers and radii text files, shared through CPackingCache */
+struct CCsvSource
+{
+    /** The centers file on the first line, the radii file on the second */
+    static bool read( std::istream &config, SPackingSource &source );
+    static std::shared_ptr<const CPackingLoader> acquire( const SPackingSource &source, std::string &error );
+    static bool hash( const SPackingSource &source, uint64_t &hash );
+};
+
+/**
+ * Compressed packing (see CPackingCodec), decoded on the loader thread
+ * in the original order when the file kept it. Properties are not
+ * written: `property` lines are refused and the file's columns unused.
+ */
+struct CPkzSource
+{
+    /** The .pkz file on the first line */
+    static bool read( std::istream &config, SPackingSource &source );
+    static std::shared_ptr<const CPackingLoader> acquire( const SPackingSource &source, std::string &error );
+    static bool hash( const SPackingSource &source, uint64_t &hash );
+};
+
+/** Slots in packing order; the only order that streams */
+struct CFileOrder
+{
+    static constexpr bool STREAMS = true;
+
+    bool readOption( std::string const&, std::string const& ) { return false; }
+    template <class F>
+    void prepare( size_t, F && ) {}
+    size_t slot( size_t k ) const { return k; }
+};
+
+/**
+ * A seeded random permutation of the slots without a table: a 4-round
+ * Feistel network over the next power of 4, cycle walked into range
+ * (fewer than 4 steps on average).
+ *
+ *     order_seed = <integer>
+ */
+struct CShuffledOrder
+{
+    static constexpr bool STREAMS = false;
+
+    bool readOption( std::string const& key, std::string const& value );
+    template <class F>
+    void prepare( size_t slots, F && )
+    {
+        count = slots;
+        halfBits = 1;
+        while ((uint64_t(1) << (2 * halfBits)) < count)
+            halfBits++;
+    }
+    size_t slot( size_t k ) const
+    {
+        uint64_t v = k;
+        do
+            v = permute(v);
+        while (v >= count);
+        return size_t(v);
+    }
+
+    uint64_t seed = 0;
+
+private:
+    uint64_t permute( uint64_t v ) const
+    {
+        const uint64_t mask = (uint64_t(1) << halfBits) - 1;
+        uint64_t left = v >> halfBits, right = v & mask;
+        for (uint64_t round = 1; round <= 4; round++)
+        {
+            uint64_t f = (right ^ seed) * 0x9e3779b97f4a7c15ull + round * 0xbf58476d1ce4e5b9ull;
+            f ^= f >> 29;
+            const uint64_t next = left ^ (f & mask);
+            left = right;
+            right = next;
+        }
+        return left << halfBits | right;
+    }
+
+    uint64_t count = 0;
+    int halfBits = 1;
+};
+
+/**
+ * Slots by the height of their lowest point, bottom first, so a
+ * deposit is built from the floor up; keeps a table of the slots.
+ */
+struct CBottomUpOrder
+{
+    static constexpr bool STREAMS = false;
+
+    bool readOption( std::string const&, std::string const& ) { return false; }
+    /** slotParticle(k, index, pos, radius) as CFactoryCore::slotParticle */
+    template <class F>
+    void prepare( size_t slots, F &&slotParticle )
+    {
+        std::vector<std::pair<double, uint64_t>> keyed(slots);
+        for (size_t k = 0; k < slots; k++)
+        {
+            size_t index;
+            double pos[3], radius;
+            // slots a tile dropped go last, the factory skips them anyway
+            keyed[k] = {slotParticle(k, index, pos, radius) ? pos[2] - radius : HUGE_VAL, k};
+        }
+        std::sort(keyed.begin(), keyed.end());
+        order.resize(slots);
+        for (size_t k = 0; k < slots; k++)
+            order[k] = keyed[k].second;
+    }
+    size_t slot( size_t k ) const { return size_t(order[k]); }
+
+private:
+    std::vector<uint64_t> order;
+};
+
+/** Particles at rest */
+struct CZeroKinematics
+{
+    bool readOption( std::string const&, std::string const& ) { return false; }
+    void apply( const double *, double, double vel[3], double angVel[3] ) const
+    {
+        vel[0] = vel[1] = vel[2] = 0;
+        angVel[0] = angVel[1] = angVel[2] = 0;
+    }
+};
+
+/**
+ * The same velocity for every particle.
+ *
+ *     velocity = <vx> <vy> <vz>
+ *     angular_velocity = <wx> <wy> <wz>
+ */
+struct CUniformKinematics
+{
+    bool readOption( std::string const& key, std::string const& value );
+    void apply( const double *, double, double vel[3], double angVel[3] ) const
+    {
+        for (int a = 0; a < 3; a++)
+        {
+            vel[a] = velocity[a];
+            angVel[a] = angular[a];
+        }
+    }
+
+    double velocity[3] = {0, 0, 0};
+    double angular[3] = {0, 0, 0};
+};
+
+/** Every particle */
+struct CNoFilter
+{
+    bool readOption( std::string const&, std::string const& ) { return false; }
+    bool accept( const double *, double ) const { return true; }
+};
+
+/**
+ * Particles with a radius in [min, max).
+ *
+ *     radius_range = <min> <max>
+ */
+struct CRadiusFilter
+{
+    bool readOption( std::string const& key, std::string const& value );
+    bool accept( const double *, double radius ) const { return radius >= lo && radius < hi; }
+
+    double lo = 0;
+    double hi = HUGE_VAL;
+};
@@ -0,0 +1,150 @@
+#pragma once
+
+#include "factory.h"
+#include "factorypolicies.h"
+
+/**
+ * Packing factory whose source, order, kinematics and filter are fixed
+ * at compile time (see factorypolicies.h).
+ *
+ * The policies are held by value and called directly, so
+ * createParticle() compiles to one loop for each combination, with no
+ * branches for the features it does not have. A streaming order with no
+ * whole-packing feature configured emits straight from the loader;
+ * otherwise slot k of the prepared slots (see CFactoryCore) is emitted
+ * at position order.slot(k). The filter is tested last, so a rejected
+ * particle costs one cursor step.
+ *
+ * Each combination a deck needs is a plugin library of its own, built
+ * from the same sources with FACTORY_INSTANCE naming one of the aliases
+ * below; the plain library is PTIIoffeFactory.
+ */
+template <class Source, class Order, class Kinematics, class Filter>
+class ParticleFactory : public CFactoryCore
+{
+public:
+    NApi::ECalculateResult createParticle(
+                                   double  time,
+                                   double  timestep,
+                                   bool&   particleCreated,
+                                   bool&   additionalParticleRequired,
+                                   char    type[NApi::API_BASIC_STRING_LENGTH],
+                                   double& scale,
+                                   double& posX,
+                                   double& posY,
+                                   double& posZ,
+                                   double& velX,
+                                   double& velY,
+                                   double& velZ,
+                                   double& angVelX,
+                                   double& angVelY,
+                                   double& angVelZ,
+                                   double  orientation[9],
+                                   NApiCore::ICustomPropertyDataApi_1_0* propData,
+                                   NApiCore::ICustomPropertyDataApi_1_0* simData) override
+    {
+        reachTime(time, timestep);
+        size_t index;
+        double pos[3];
+        particleCreated = nextParticle(index, pos, scale);
+        if (!particleCreated)
+            return emissionEnded();
+
+        additionalParticleRequired = true;
+        double vel[3], angVel[3];
+        kinematics.apply(pos, scale, vel, angVel);
+        velX = vel[0];
+        velY = vel[1];
+        velZ = vel[2];
+        angVelX = angVel[0];
+        angVelY = angVel[1];
+        angVelZ = angVel[2];
+        finishParticle(index, pos, type, scale, posX, posY, posZ, orientation, propData);
+        return NApi::ECalculateResult::eSuccess;
+    }
+
+    const Order &getOrder() const { return order; }
+    const Kinematics &getKinematics() const { return kinematics; }
+    const Filter &getFilter() const { return filter; }
+
+protected:
+    bool readSource( std::istream &config, SPackingSource &source ) override
+    {
+        return Source::read(config, source);
+    }
+    std::shared_ptr<const CPackingLoader> acquireSource( const SPackingSource &source, std::string &error ) override
+    {
+        return Source::acquire(source, error);
+    }
+    bool hashSource( const SPackingSource &source, uint64_t &hash ) override
+    {
+        return Source::hash(source, hash);
+    }
+    bool readPolicyOption( std::string const& key, std::string const& value ) override
+    {
+        return order.readOption(key, value) || kinematics.readOption(key, value) || filter.readOption(key, value);
+    }
+    void resetPolicies() override
+    {
+        order = Order();
+        kinematics = Kinematics();
+        filter = Filter();
+    }
+    bool orderStreams() const override { return Order::STREAMS; }
+    void preparePolicies() override
+    {
+        order.prepare(preparedSlots(), [this]( size_t k, size_t &index, double pos[3], double &radius )
+        {
+            return slotParticle(k, index, pos, radius);
+        });
+    }
+
+private:
+    /** Index in the packing and placement of the next particle, false when there is none */
+    bool nextParticle( size_t &index, double pos[3], double &radius )
+    {
+        if (packing == nullptr)
+            return false;
+
+        if constexpr (Order::STREAMS)
+            if (!wholePacking)
+            {
+                const CPacking &data = packing->packing();
+                for (;;)
+                {
+                    index = cursor.next();
+                    // waits only if the loader has not reached this particle yet
+                    if (!packing->waitFor(index + 1))
+                        return false;
+                    pos[0] = data.x[index];
+                    pos[1] = data.y[index];
+                    pos[2] = data.z[index];
+                    radius = data.r[index];
+                    if (filter.accept(pos, radius))
+                        return true;
+                }
+            }
+
+        // culling, tiles, regions and orders need the whole packing
+        if (!prepared.load(std::memory_order_acquire) && !prepare())
+            return false;
+        const size_t count = slotCount();
+        for (size_t k = cursor.next(); k < count; k = cursor.next())
+            if (slotParticle(order.slot(k), index, pos, radius) && filter.accept(pos, radius))
+                return true;
+        return false;
+    }
+
+    Order order;
+    Kinematics kinematics;
+    Filter filter;
+};
+
+/** CSV packing in file order, particles at rest: the default plugin */
+using PTIIoffeFactory = ParticleFactory<CCsvSource, CFileOrder, CZeroKinematics, CNoFilter>;
+/** CSV packing in a seeded random order */
+using CShuffledFactory = ParticleFactory<CCsvSource, CShuffledOrder, CZeroKinematics, CNoFilter>;
+/** CSV packing from the floor up, a radius range only, all at one velocity */
+using CDepositFactory = ParticleFactory<CCsvSource, CBottomUpOrder, CUniformKinematics, CRadiusFilter>;
+/** Compressed packing in file order, particles at rest */
+using CPkzFactory = ParticleFactory<CPkzSource, CFileOrder, CZeroKinematics, CNoFilter>;
@@ -1,18 +1,91 @@
-#include "factory.h"
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iomanip>
+#include <map>
+#include <memory_resource>
+#include <sstream>
+#include <thread>
+#include <vector>
+
+#include <Api/Core/ICustomPropertyManagerApi_1_0.h>
+
+#include "packingcodec.h"
+#include "particlefactory.h"
+
+/** Host side of one single-element particle property */
+class CParticleProperties : public NApiCore::ICustomPropertyManagerApi_1_0,
+                            public NApiCore::ICustomPropertyDataApi_1_0
+{
+public:
+    static constexpr const char *NAME = "Grain ID";
+    double value = -1;
+    double delta = 0;
+
+    unsigned int getNumProperties() override { return 1; }
+    unsigned int getPropertyIndex( const char *name ) override
+    {
+        return strcmp(name, NAME) == 0 ? 0 : NApi::NO_ID;
+    }
+    bool getPropertyMetaData( unsigned int index, SPropertyData &data ) override
+    {
+        if (index != 0)
+            return false;
+        strncpy(data.m_name, NAME, NApi::CUSTOM_PROP_MAX_NAME_LENGTH - 1);
+        data.m_name[NApi::CUSTOM_PROP_MAX_NAME_LENGTH - 1] = '\0';
+        data.m_index = 0;
+        data.m_category = NApi::eParticle;
+        data.m_dataType = NApi::eDouble;
+        data.m_numberOfElements = 1;
+        data.m_unitType = NApi::eNone;
+        data.m_finalised = true;
+        return true;
+    }
+    bool getPropertyMetaData( const char *name, SPropertyData &data ) override
+    {
+        return getPropertyMetaData(getPropertyIndex(name), data);
+    }
+
+    IApi *getManager( NApi::tApiMajorVersion, NApi::tApiMinorVersion ) override
+    {
+        return static_cast<NApiCore::ICustomPropertyManagerApi_1_0 *>(this);
+    }
+    const double *getValue( unsigned int index ) override { return index == 0 ? &value : nullptr; }
+    const double *getValue( const char *name ) override { return getValue(getPropertyIndex(name)); }
+    double *getDelta( unsigned int index ) override { return index == 0 ? &delta : nullptr; }
+    double *getDelta( const char *name ) override { return getDelta(getPropertyIndex(name)); }
+    bool hasData( unsigned int index ) override { return index == 0; }
+    bool hasData( const char *name ) override { return hasData(getPropertyIndex(name)); }
+
+    void getApiVersion( NApi::tApiMajorVersion &major, NApi::tApiMinorVersion &minor ) override
+    {
+        major = 1;
+        minor = 0;
+    }
+    NApiCore::EApiId getApiId() const override { return NApiCore::eParticleCustomPropertyManager; }
+    bool readOnly() const override { return false; }
+};
 
 class ApiMgr : public NApiCore::IApiManager_1_0
 {
 public:
+    CParticleProperties particleProperties;
+
     IApi* getApi(NApiCore::EApiId apiId,
                  NApi::tApiMajorVersion major,
                  NApi::tApiMinorVersion minor ) override
     {
-        return new ApiMgr;
+        if (apiId == NApiCore::eParticleCustomPropertyManager)
+            return static_cast<NApiCore::ICustomPropertyManagerApi_1_0 *>(&particleProperties);
+        return nullptr;
     }
 
     void release( IApi* apiInstance ) override
     {
-        delete apiInstance;
     }
 
     void getApiVersion(NApi::tApiMajorVersion& major,
@@ -32,11 +105,10 @@ public:
     }
 };
 
-int main()
+/** Emits every particle of the factory, returns how many or -1 on an error */
+static int emitAll( PTIIoffeFactory *factory, NApiCore::ICustomPropertyDataApi_1_0 *propData,
+                    bool (*check)( int, NApiCore::ICustomPropertyDataApi_1_0 * ) = nullptr )
 {
-    PTIIoffeFactory *factory = dynamic_cast<PTIIoffeFactory *>(GETFACTORYINSTANCE());
-    ApiMgr mgr;
-    factory->setup(mgr, "config.txt");
     bool success = true;
     bool additionalParticleRequired;
     char type[100];
@@ -45,18 +117,882 @@ int main()
     double velX, velY, velZ;
     double angVelX, angVelY, angVelZ;
     double orientation[9];
-    NApiCore::ICustomPropertyDataApi_1_0 *propData = nullptr;
     int cnt = 0;
     while (success)
     {
-        factory->createParticle(0, success, additionalParticleRequired,
+        const NApi::ECalculateResult result = factory->createParticle(0, 1e-6, success, additionalParticleRequired,
                                 type, scale,
                                 posX, posY, posZ,
                                 velX, velY, velZ,
                                 angVelX, angVelY, angVelZ,
-                                orientation, propData);
+                                orientation, propData, nullptr);
+        if (result == NApi::ECalculateResult::eFatalError)
+            return -1;
+        if (success && check != nullptr && !check(cnt, propData))
+            return -1;
         cnt += success;
     }
+    return cnt;
+}
+
+/** Position, radius and z velocity of every particle a factory emits, in order */
+static std::vector<std::array<double, 5>> emitted( CFactoryCore &factory )
+{
+    std::vector<std::array<double, 5>> out;
+    bool more = true, additional;
+    char type[NApi::API_BASIC_STRING_LENGTH];
+    double scale, pos[3], vel[3], angVel[3], orientation[9];
+    while (more)
+    {
+        factory.createParticle(0, 1e-6, more, additional, type, scale, pos[0], pos[1], pos[2],
+                               vel[0], vel[1], vel[2], angVel[0], angVel[1], angVel[2], orientation, nullptr, nullptr);
+        if (more)
+            out.push_back({pos[0], pos[1], pos[2], scale, vel[2]});
+    }
+    return out;
+}
+
+int main()
+{
+    PTIIoffeFactory *factory = dynamic_cast<PTIIoffeFactory *>(GETFACTORYINSTANCE());
+    ApiMgr mgr;
+    char msg[NApi::ERROR_MSG_MAX_LENGTH] = "";
+    if (!factory->setup(mgr, "config.txt", msg))
+        return 1;
+    const int cnt = emitAll(factory, nullptr);
+    RELEASEFACTORYINSTANCE(factory);
+    printf("emitted %d particles\n", cnt);
+
+    // a property column: grain id 2 * i + 1 for particle i
+    {
+        std::ofstream grains("grains_test.txt"), config("config_test.txt");
+        for (int i = 0; i < cnt; i++)
+            grains << i + 1 << "," << 2 * i + 1 << "\n";
+        config << "Positions.txt\nRadii.txt\nproperty " << CParticleProperties::NAME << " = grains_test.txt\n";
+    }
+
+    // two factories of the same files share one packing but not the cursor
+    PTIIoffeFactory *first = dynamic_cast<PTIIoffeFactory *>(GETFACTORYINSTANCE());
+    PTIIoffeFactory *second = dynamic_cast<PTIIoffeFactory *>(GETFACTORYINSTANCE());
+    bool shared = first->setup(mgr, "config.txt", msg) && second->setup(mgr, "config.txt", msg) &&
+                  first->getPacking() == second->getPacking();
+    shared = shared && emitAll(first, nullptr) == cnt && emitAll(second, nullptr) == cnt;
+    RELEASEFACTORYINSTANCE(first);
+    shared = shared && CPackingCache::instance().liveEntries() == 1;
+    RELEASEFACTORYINSTANCE(second);
+    shared = shared && CPackingCache::instance().liveEntries() == 0;
+    printf("shared packing: %s (%zu hits, %zu misses)\n", shared ? "ok" : "FAILED",
+           CPackingCache::instance().hits(), CPackingCache::instance().misses());
+
+    // the sidecar: parsed and written once, then mapped, rebuilt when stale
+    bool sidecarOk;
+    {
+        SPackingSource source;
+        source.centers = "Positions.txt";
+        source.radii = "Radii.txt";
+        source.properties.emplace_back(CParticleProperties::NAME, "grains_test.txt");
+        remove(CPackingSidecar::pathOf(source).c_str());
+
+        auto timed = [&]( CPacking &packing, CPackingSidecar::EStatus &status )
+        {
+            const auto start = std::chrono::steady_clock::now();
+            status = CPackingSidecar::load(packing, source);
+            return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        };
+        CPacking parsed, mapped, rebuilt;
+        CPackingSidecar::EStatus first, second, third;
+        const double parseTime = timed(parsed, first);
+        const double mapTime = timed(mapped, second);
+        sidecarOk = first == CPackingSidecar::EStatus::eParsed && second == CPackingSidecar::EStatus::eMapped &&
+                    mapped.x == parsed.x && mapped.r == parsed.r && mapped.properties.size() == 1 &&
+                    mapped.properties[0].name == CParticleProperties::NAME &&
+                    mapped.properties[0].values == parsed.properties[0].values;
+
+        // same values, different bytes: the sidecar is stale
+        {
+            std::ofstream grains("grains_test.txt");
+            for (int i = 0; i < cnt; i++)
+                grains << i + 1 << "," << 2 * i + 1 << "\n";
+            grains << "\n";
+        }
+        timed(rebuilt, third);
+        sidecarOk = sidecarOk && third == CPackingSidecar::EStatus::eParsed;
+        remove(CPackingSidecar::pathOf(source).c_str());
+        printf("sidecar: %s (parse %.1f ms, mapped %.1f ms)\n", sidecarOk ? "ok" : "FAILED",
+               parseTime * 1e3, mapTime * 1e3);
+    }
+
+    // background loading: setup returns at once, emission follows the loader
+    bool asyncOk;
+    {
+        const int n = 200000;
+        {
+            std::ofstream centers("centers_test.txt"), radii("radii_test.txt"), shortRadii("short_test.txt");
+            std::ofstream config("async_test.txt"), broken("broken_test.txt");
+            for (int i = 0; i < n; i++)
+            {
+                centers << i + 1 << "," << 1e-3 * i << "," << 2e-3 * i << "," << 3e-3 * i << "\n";
+                radii << i + 1 << "," << 1e-4 * (1 + i % 7) << "\n";
+                if (i + 1 < n)
+                    shortRadii << i + 1 << "," << 1e-4 << "\n";
+            }
+            config << "centers_test.txt\nradii_test.txt\nsidecar = off\n";
+            broken << "centers_test.txt\nshort_test.txt\nsidecar = off\n";
+        }
+
+        factory = dynamic_cast<PTIIoffeFactory *>(GETFACTORYINSTANCE());
+        const auto start = std::chrono::steady_clock::now();
+        asyncOk = factory->setup(mgr, "async_test.txt", msg);
+        const double setupTime = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        const int emitted = asyncOk ? emitAll(factory, nullptr) : -1;
+        const double loadTime = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        const CPacking &data = factory->getPacking()->packing();
+        asyncOk = emitted == n && fabs(data.r[n - 1] - 1e-4 * (1 + (n - 1) % 7)) < 1e-12 &&
+                  fabs(data.z[n - 1] - 3e-3 * (n - 1)) < 1e-9;
+        RELEASEFACTORYINSTANCE(factory);
+
+        // several emitting threads: every particle exactly once
+        factory = dynamic_cast<PTIIoffeFactory *>(GETFACTORYINSTANCE());
+        asyncOk = asyncOk && factory->setup(mgr, "async_test.txt", msg);
+        std::vector<std::vector<int>> taken(4);
+        std::vector<std::thread> workers;
+        for (auto &indices : taken)
+            workers.emplace_back([&]()
+            {
+                bool created = true, additional;
+                char type[100];
+                double scale, p[3], v[3], w[3], orientation[9];
+                while (created)
+                {
+                    factory->createParticle(0, 1e-6, created, additional, type, scale, p[0], p[1], p[2],
+                                            v[0], v[1], v[2], w[0], w[1], w[2], orientation, nullptr, nullptr);
+                    if (created)
+                        indices.push_back(int(lround(p[0] * 1e3)));
+                }
+            });
+        for (auto &worker : workers)
+            worker.join();
+        RELEASEFACTORYINSTANCE(factory);
+        std::vector<int> times(n, 0);
+        for (auto &indices : taken)
+            for (int i : indices)
+                times[i]++;
+        const bool once = std::count(times.begin(), times.end(), 1) == n;
+        printf("%zu threads emitted %zu, %zu, %zu, %zu particles: %s\n", taken.size(), taken[0].size(),
+               taken[1].size(), taken[2].size(), taken[3].size(), once ? "each exactly once" : "FAILED");
+        asyncOk = asyncOk && once;
+
+        // a load error surfaces from createParticle after the good rows
+        factory = dynamic_cast<PTIIoffeFactory *>(GETFACTORYINSTANCE());
+        asyncOk = asyncOk && factory->setup(mgr, "broken_test.txt", msg) && emitAll(factory, nullptr) == -1;
+        RELEASEFACTORYINSTANCE(factory);
+
+        for (const char *name : {"centers_test.txt", "radii_test.txt", "short_test.txt", "async_test.txt",
+                                 "broken_test.txt"})
+            remove(name);
+        printf("async load: %s (setup %.2f ms, %d particles emitted after %.1f ms)\n",
+               asyncOk ? "ok" : "FAILED", setupTime * 1e3, emitted, loadTime * 1e3);
+    }
+
+    // tiling with a period well inside the packing, so neighbouring tiles
+    // overlap: some particles must go and no overlap may cross a tile face
+    bool tilingOk;
+    {
+        CPacking base;
+        base.read("Positions.txt", "Radii.txt");
+        const double maxR = base.maxRadius();
+        const double lo = *std::min_element(base.x.begin(), base.x.end()) - maxR;
+        const double hi = *std::max_element(base.x.begin(), base.x.end()) + maxR;
+
+        CTiledSource::SParams params;
+        params.tiles[0] = params.tiles[1] = params.tiles[2] = 3;
+        params.variation = CTiledSource::EVariation::eAny;
+        params.seed = 7;
+        for (double &period : params.period)
+            period = hi - lo - 8 * maxR;
+        CTiledSource tiles;
+        tilingOk = tiles.build(base, params);
+
+        const auto start = std::chrono::steady_clock::now();
+        std::vector<double> px, py, pz, pr;
+        std::vector<size_t> tileOf;
+        for (size_t g = 0; g < tiles.slots(); g++)
+        {
+            double pos[3], r;
+            size_t i;
+            if (!tiles.particle(g, pos, r, i))
+                continue;
+            px.push_back(pos[0]);
+            py.push_back(pos[1]);
+            pz.push_back(pos[2]);
+            pr.push_back(r);
+            tileOf.push_back(g / tiles.tileSize());
+        }
+        const double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+        CSpatialGrid grid;
+        grid.build(px.data(), py.data(), pz.data(), px.size(), 2 * maxR);
+        size_t crossing = 0;
+        for (size_t a = 0; a < px.size(); a++)
+            grid.forEachCandidate(px[a], py[a], pz[a], pr[a] + maxR, [&]( uint32_t b )
+            {
+                const double dx = px[a] - px[b], dy = py[a] - py[b], dz = pz[a] - pz[b];
+                const double touch = (pr[a] + pr[b]) * (1 - params.overlapTolerance);
+                crossing += tileOf[a] != tileOf[b] && dx * dx + dy * dy + dz * dz < touch * touch;
+            });
+
+        // the factory emits the same particles
+        {
+            std::ofstream config("tiles_test.txt");
+            config << "Positions.txt\nRadii.txt\nsidecar = off\ntiles = 3 3 3\ntile_variation = any\n"
+                   << "tile_seed = 7\ntile_period = " << params.period[0] << " " << params.period[1] << " "
+                   << params.period[2] << "\n";
+        }
+        factory = dynamic_cast<PTIIoffeFactory *>(GETFACTORYINSTANCE());
+        const int emitted = factory->setup(mgr, "tiles_test.txt", msg) ? emitAll(factory, nullptr) : -1;
+        RELEASEFACTORYINSTANCE(factory);
+        remove("tiles_test.txt");
+
+        tilingOk = tilingOk && crossing == 0 && px.size() < tiles.slots() && size_t(emitted) == px.size();
+
+        // a core through the lattice: tiles and cells decide, the rest is tested
+        const double *period = tiles.getPeriod();
+        const double core[3] = {(lo + hi) / 2 + period[0], (lo + hi) / 2 + period[1], (lo + hi) / 2 + period[2]};
+        const double axis[3] = {0, 0, 1};
+        CCylinderRegion cylinder(core, axis, 0.8 * period[0], 1.2 * period[2]);
+        std::vector<uint64_t> slots, brute;
+        size_t tested;
+        tiles.select(cylinder, slots, &tested);
+        for (size_t g = 0; g < tiles.slots(); g++)
+        {
+            double pos[3], r;
+            size_t i;
+            tiles.particle(g, pos, r, i);
+            if (cylinder.contains(pos))
+                brute.push_back(g);
+        }
+        tilingOk = tilingOk && slots == brute && !slots.empty();
+        printf("tiled core: %zu of %zu slots, %zu tested one by one\n", slots.size(), tiles.slots(), tested);
+        printf("tiling: %s (%zu of %zu slots kept, %zu boundary particles per tile, %.0f ns per slot)\n",
+               tilingOk ? "ok" : "FAILED", px.size(), tiles.slots(), tiles.boundaryCount(),
+               seconds * 1e9 / tiles.slots());
+    }
+
+    // regions: selecting through the grid must match testing every particle
+    bool regionOk = true;
+    {
+        CPacking base;
+        base.read("Positions.txt", "Radii.txt");
+        CSpatialGrid grid;
+        grid.build(base.x.data(), base.y.data(), base.z.data(), base.size(), 2 * base.maxRadius());
+        const double lo = *std::min_element(base.z.begin(), base.z.end());
+        const double hi = *std::max_element(base.z.begin(), base.z.end());
+        const double c = (lo + hi) / 2, h = (hi - lo) / 2;
+
+        auto check = [&]( const CRegion &region, const char *name )
+        {
+            std::vector<uint32_t> selected, brute;
+            size_t tested;
+            selectInRegion(region, grid, base.x.data(), base.y.data(), base.z.data(), selected, &tested);
+            for (uint32_t i = 0; i < base.size(); i++)
+            {
+                const double p[3] = {base.x[i], base.y[i], base.z[i]};
+                if (region.contains(p))
+                    brute.push_back(i);
+            }
+            const bool same = selected == brute && !selected.empty();
+            printf("region %s: %zu selected, %zu of %zu tested one by one: %s\n", name, selected.size(), tested,
+                   base.size(), same ? "ok" : "FAILED");
+            regionOk = regionOk && same;
+            return selected;
+        };
+
+        std::ostringstream core;
+        core << "cylinder " << c << " " << c << " " << c << " 0 0 1 " << 0.5 * h << " " << 0.8 * h;
+        std::unique_ptr<CRegion> region;
+        regionOk = CRegion::combine(region, core.str());
+        const std::vector<uint32_t> coreSelection = check(*region, "cylinder");
+
+        std::ostringstream hollow;
+        hollow << "not sphere " << c << " " << c << " " << c << " " << 0.3 * h;
+        regionOk = regionOk && CRegion::combine(region, hollow.str());
+        check(*region, "cylinder not sphere");
+
+        // a cube mesh selects what the same box does
+        const double a = c - 0.6 * h, b = c + 0.6 * h;
+        std::vector<double> vertices;
+        for (int k = 0; k < 8; k++)
+            vertices.insert(vertices.end(), {k & 1 ? b : a, k & 2 ? b : a, k & 4 ? b : a});
+        const std::vector<unsigned int> faces = {0, 1, 3, 0, 3, 2, 4, 6, 7, 4, 7, 5, 0, 4, 5, 0, 5, 1,
+                                                 2, 3, 7, 2, 7, 6, 0, 2, 6, 0, 6, 4, 1, 5, 7, 1, 7, 3};
+        CMeshRegion mesh("cube");
+        mesh.setMesh(vertices, faces);
+        const double boxLo[3] = {a, a, a}, boxHi[3] = {b, b, b};
+        regionOk = regionOk && check(mesh, "mesh") == check(CBoxRegion(boxLo, boxHi), "box");
+
+        // the factory emits the core
+        {
+            std::ofstream config("region_test.txt");
+            config << "Positions.txt\nRadii.txt\nsidecar = off\nregion = " << core.str() << "\n";
+        }
+        factory = dynamic_cast<PTIIoffeFactory *>(GETFACTORYINSTANCE());
+        const int emitted = factory->setup(mgr, "region_test.txt", msg) ? emitAll(factory, nullptr) : -1;
+        RELEASEFACTORYINSTANCE(factory);
+        remove("region_test.txt");
+        regionOk = regionOk && size_t(emitted) == coreSelection.size();
+    }
+
+    // culling the finest third: nothing below the cutoff is left, merges
+    // and parcels keep the volume and the factory reports the new scale
+    bool cullOk = true;
+    {
+        CPacking base;
+        base.read("Positions.txt", "Radii.txt");
+        std::vector<double> sorted(base.r.begin(), base.r.end());
+        std::sort(sorted.begin(), sorted.end());
+        const double cutoff = sorted[sorted.size() / 3];
+
+        const char *modes[] = {"drop", "merge", "parcel"};
+        for (int m = 0; m < 3; m++)
+        {
+            SCullParams params;
+            params.mode = ECullMode(m + 1);
+            params.cutoff = cutoff;
+            CPacking culled;
+            SCullReport report;
+            bool ok = cullFineParticles(base, params, culled, report);
+
+            double volume = 0;
+            for (double r : culled.r)
+                volume += 4.0 / 3.0 * M_PI * r * r * r;
+            ok = ok && culled.minRadius() >= cutoff && report.after == culled.size() &&
+                 std::fabs(report.volumeBefore - report.volumeLost - volume) < 1e-9 * report.volumeBefore &&
+                 (params.mode != ECullMode::eDrop || report.dropped + report.after == report.before) &&
+                 report.timestepGain() >= 1;
+
+            {
+                std::ofstream config("cull_test.txt");
+                config << "Positions.txt\nRadii.txt\nsidecar = off\ncull = " << modes[m]
+                       << "\ncull_radius = " << std::setprecision(17) << cutoff << "\n";
+            }
+            factory = dynamic_cast<PTIIoffeFactory *>(GETFACTORYINSTANCE());
+            double scale = 0;
+            char type[NApi::API_BASIC_STRING_LENGTH];
+            int emitted = -1;
+            if (factory->setup(mgr, "cull_test.txt", msg) && factory->starting(mgr))
+            {
+                factory->getSmallestScale(scale, type);
+                emitted = emitAll(factory, nullptr);
+            }
+            RELEASEFACTORYINSTANCE(factory);
+            remove("cull_test.txt");
+            ok = ok && scale == culled.minRadius() && size_t(emitted) == culled.size();
+
+            printf("cull %s below %g: %zu -> %zu particles (%zu parcels), volume lost %.3g%%, "
+                   "mass lost %.3g, timestep %.3g -> %.3g s: %s\n",
+                   modes[m], cutoff, report.before, report.after, report.parcels,
+                   100 * report.volumeLost / report.volumeBefore, report.massLost,
+                   report.timestepBefore, report.timestepAfter, ok ? "ok" : "FAILED");
+            cullOk = cullOk && ok;
+        }
+    }
+
+    // clumps: the union of overlapping spheres against closed forms, the
+    // principal frame, and the factory placing every sphere where the
+    // template puts it
+    bool clumpOk = true;
+    {
+        const double lens = M_PI * (4 + 1) * 1 / 12.0;  // two unit spheres one apart: pi (4r + d)(2r - d)^2 / 12
+        CClumpTemplate single, pair;
+        single.assign("one", {SClumpSphere{0.3, -0.2, 0.1, 1}});
+        pair.assign("pair", {SClumpSphere{0, 0, 0, 1}, SClumpSphere{1, 0, 0, 1}});
+        const auto start = std::chrono::steady_clock::now();
+        clumpOk = single.compute(1e-5) && pair.compute(1e-5);
+        const double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        const SClumpMass &one = single.mass(), &two = pair.mass();
+        const double sphere = 4.0 / 3.0 * M_PI;
+        clumpOk = clumpOk && std::fabs(one.volume - sphere) < 1e-4 * sphere &&
+                  std::fabs(one.centre[0] - 0.3) < 1e-5 && std::fabs(one.inertia[0] - 0.4 * sphere) < 1e-4 * sphere &&
+                  std::fabs(one.inertia[1]) < 1e-5 &&
+                  std::fabs(two.volume - (2 * sphere - lens)) < 1e-4 * sphere && std::fabs(two.centre[0] - 0.5) < 1e-5 &&
+                  std::fabs(std::fabs(two.axes[0]) - 1) < 1e-6 && two.moments[0] < two.moments[1];
+
+        // a turned copy has the same moments, its long axis turned along
+        double rotation[9];
+        randomRotation(7, rotation);
+        std::vector<SClumpSphere> turned;
+        for (const SClumpSphere &s : pair.getSpheres())
+            turned.push_back(SClumpSphere{rotation[0] * s.x + rotation[1] * s.y + rotation[2] * s.z,
+                                          rotation[3] * s.x + rotation[4] * s.y + rotation[5] * s.z,
+                                          rotation[6] * s.x + rotation[7] * s.y + rotation[8] * s.z, s.r});
+        CClumpTemplate rotated, principal;
+        rotated.assign("pair", turned);
+        principal.assign("pair", pair.principalSpheres());
+        clumpOk = clumpOk && rotated.compute(1e-5) && principal.compute(1e-5);
+        const double dot = rotated.mass().axes[0] * rotation[0] + rotated.mass().axes[3] * rotation[3] +
+                          rotated.mass().axes[6] * rotation[6];
+        clumpOk = clumpOk && std::fabs(std::fabs(dot) - 1) < 1e-6 &&
+                  std::fabs(principal.mass().inertia[1]) < 1e-5 && std::fabs(principal.mass().centre[0]) < 1e-5;
+        for (int a = 0; a < 3; a++)
+            clumpOk = clumpOk && std::fabs(rotated.mass().moments[a] - two.moments[a]) < 1e-4 * two.moments[2];
+        printf("clump volumes %.6f (exact %.6f), %.6f (exact %.6f), moments %.5f %.5f %.5f, "
+               "%d rows a side, %.1f ms\n", one.volume, sphere, two.volume, 2 * sphere - lens,
+               two.moments[0], two.moments[1], two.moments[2], two.resolution, seconds * 1e3);
+
+        {
+            std::ofstream clump("clump_test.txt");
+            clump << "# a bent trimer\nTrimer\n0 0 0 0.5\n0.6 0 0 0.4\n0.6 0.5 0.2 0.3\n";
+        }
+        CPacking base;
+        base.read("Positions.txt", "Radii.txt");
+        std::vector<double> placed;
+        // held across the factories, so the library hands the same template out again
+        std::shared_ptr<const CClumpTemplate> held;
+        for (const char *rotation : {"none", "random", "random"})
+        {
+            {
+                std::ofstream config("clump_config_test.txt");
+                config << "Positions.txt\nRadii.txt\nsidecar = off\nclump = clump_test.txt\n"
+                       << "clump_rotation = " << rotation << "\nclump_seed = 3\n";
+            }
+            factory = dynamic_cast<PTIIoffeFactory *>(GETFACTORYINSTANCE());
+            const size_t computedBefore = CClumpLibrary::instance().computed();
+            bool ok = factory->setup(mgr, "clump_config_test.txt", msg) && factory->starting(mgr);
+            std::shared_ptr<const CClumpTemplate> clump = factory->getClump();
+            ok = ok && clump != nullptr && clump->type() == "Trimer" && (held == nullptr || clump == held);
+            held = clump;
+            const std::vector<SClumpSphere> local = ok ? clump->principalSpheres() : std::vector<SClumpSphere>();
+            bool more = ok, additional;
+            char type[NApi::API_BASIC_STRING_LENGTH];
+            double scale, pos[3], vel[3], angVel[3], orientation[9];
+            std::vector<double> run;
+            for (size_t i = 0; more; i++)
+            {
+                factory->createParticle(0, 1e-6, more, additional, type, scale, pos[0], pos[1], pos[2],
+                                        vel[0], vel[1], vel[2], angVel[0], angVel[1], angVel[2],
+                                        orientation, nullptr, nullptr);
+                if (!more)
+                    break;
+                ok = ok && i < base.size() && strcmp(type, "Trimer") == 0 &&
+                     std::fabs(scale * clump->boundingRadius() - base.r[i]) < 1e-12 * base.r[i];
+                run.insert(run.end(), orientation, orientation + 9);
+                // the orientation is a proper rotation
+                for (int r = 0; ok && r < 3; r++)
+                    for (int c = 0; c < 3; c++)
+                    {
+                        double product = 0;
+                        for (int k = 0; k < 3; k++)
+                            product += orientation[3 * r + k] * orientation[3 * c + k];
+                        ok = std::fabs(product - (r == c)) < 1e-12;
+                    }
+                // unturned, every sphere lands on origin + scale * template position
+                if (std::string(rotation) == "none")
+                    for (size_t s = 0; ok && s < local.size(); s++)
+                    {
+                        const double p[3] = {local[s].x, local[s].y, local[s].z};
+                        const SClumpSphere &t = clump->getSpheres()[s];
+                        const double expected[3] = {base.x[i] + scale * t.x, base.y[i] + scale * t.y,
+                                                    base.z[i] + scale * t.z};
+                        for (int a = 0; a < 3; a++)
+                            ok = ok && std::fabs(pos[a] + scale * (orientation[3 * a] * p[0] +
+                                                 orientation[3 * a + 1] * p[1] + orientation[3 * a + 2] * p[2]) -
+                                                 expected[a]) < 1e-9;
+                    }
+            }
+            ok = ok && run.size() == 9 * base.size();
+            // random rotations repeat, and the template is integrated once
+            if (std::string(rotation) == "random" && !placed.empty())
+                ok = ok && run == placed && CClumpLibrary::instance().computed() == computedBefore;
+            if (std::string(rotation) == "random")
+                placed = run;
+            RELEASEFACTORYINSTANCE(factory);
+            printf("clumps %s: %zu emitted: %s\n", rotation, run.size() / 9, ok ? "ok" : "FAILED");
+            clumpOk = clumpOk && ok;
+        }
+        remove("clump_config_test.txt");
+        remove("clump_test.txt");
+    }
+
+    // checkpoints: stop part way with blocks of two threads open, then a
+    // new factory resumes with exactly the particles not emitted yet
+    bool stateOk = true;
+    {
+        CPacking base;
+        base.read("Positions.txt", "Radii.txt");
+        std::vector<std::array<double, 3>> all;
+        for (size_t i = 0; i < base.size(); i++)
+            all.push_back({base.x[i], base.y[i], base.z[i]});
+        std::sort(all.begin(), all.end());
+
+        // particles created at the given simulation time, in steps of 1e-6 s
+        auto take = []( PTIIoffeFactory *f, size_t limit, std::vector<std::array<double, 3>> &out, double time = 0 )
+        {
+            bool more = true, additional;
+            char type[NApi::API_BASIC_STRING_LENGTH];
+            double scale, pos[3], vel[3], angVel[3], orientation[9];
+            for (size_t i = 0; i < limit && more; i++)
+            {
+                f->createParticle(time, 1e-6, more, additional, type, scale, pos[0], pos[1], pos[2],
+                                  vel[0], vel[1], vel[2], angVel[0], angVel[1], angVel[2],
+                                  orientation, nullptr, nullptr);
+                if (more)
+                    out.push_back({pos[0], pos[1], pos[2]});
+            }
+        };
+
+        for (const char *extra : {"", "region = box -100 -100 -100 100 100 100\n"})
+        {
+            {
+                std::ofstream config("state_config_test.txt");
+                config << "Positions.txt\nRadii.txt\nstate = state_test.bin\n" << extra;
+            }
+            remove("state_test.bin");
+            std::vector<std::array<double, 3>> emitted;
+            factory = dynamic_cast<PTIIoffeFactory *>(GETFACTORYINSTANCE());
+            bool ok = factory->setup(mgr, "state_config_test.txt", msg) && factory->starting(mgr);
+            take(factory, 1000, emitted);
+            std::vector<std::array<double, 3>> other;
+            std::thread([&]() { take(factory, 5, other); }).join();
+            emitted.insert(emitted.end(), other.begin(), other.end());
+            factory->stopping(mgr);
+            RELEASEFACTORYINSTANCE(factory);
+
+            factory = dynamic_cast<PTIIoffeFactory *>(GETFACTORYINSTANCE());
+            const auto start = std::chrono::steady_clock::now();
+            ok = ok && factory->setup(mgr, "state_config_test.txt", msg) && factory->starting(mgr);
+            const double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+            const size_t before = emitted.size();
+            take(factory, base.size() + 1, emitted, 1e-6);
+            factory->stopping(mgr);
+            RELEASEFACTORYINSTANCE(factory);
+            std::sort(emitted.begin(), emitted.end());
+            ok = ok && before == 1005 && emitted == all;
+
+            // the deck run again from the beginning starts over rather
+            // than resuming a state with nothing left
+            std::vector<std::array<double, 3>> rerun;
+            factory = dynamic_cast<PTIIoffeFactory *>(GETFACTORYINSTANCE());
+            ok = ok && factory->setup(mgr, "state_config_test.txt", msg) && factory->starting(mgr);
+            take(factory, base.size() + 1, rerun);
+            RELEASEFACTORYINSTANCE(factory);
+            ok = ok && rerun.size() == base.size();
+
+            // a changed config starts over
+            {
+                std::ofstream config("state_config_test.txt", std::ios::app);
+                config << "# edited\n";
+            }
+            std::vector<std::array<double, 3>> again;
+            factory = dynamic_cast<PTIIoffeFactory *>(GETFACTORYINSTANCE());
+            ok = ok && factory->setup(mgr, "state_config_test.txt", msg) && factory->starting(mgr);
+            take(factory, base.size() + 1, again);
+            RELEASEFACTORYINSTANCE(factory);
+            ok = ok && again.size() == base.size();
+
+            printf("resume%s: %zu before the stop, %zu after, set up in %.2f ms: %s\n", *extra ? " in a region" : "",
+                   before, emitted.size() - before, seconds * 1e3, ok ? "ok" : "FAILED");
+            stateOk = stateOk && ok;
+        }
+
+        // the host starts every processing run: pausing and going on
+        // emits the rest of the packing, none of it twice
+        for (const char *extra : {"", "region = box -100 -100 -100 100 100 100\n"})
+        {
+            {
+                std::ofstream config("state_config_test.txt");
+                config << "Positions.txt\nRadii.txt\n" << extra;
+            }
+            std::vector<std::array<double, 3>> emitted;
+            factory = dynamic_cast<PTIIoffeFactory *>(GETFACTORYINSTANCE());
+            bool ok = factory->setup(mgr, "state_config_test.txt", msg) && factory->starting(mgr);
+            take(factory, 500, emitted);
+            factory->stopping(mgr);
+            ok = ok && factory->starting(mgr);
+            take(factory, base.size() + 1, emitted);
+            factory->stopping(mgr);
+            RELEASEFACTORYINSTANCE(factory);
+            std::sort(emitted.begin(), emitted.end());
+            ok = ok && emitted == all;
+            printf("pause and go on%s: %zu emitted: %s\n", *extra ? " in a region" : "", emitted.size(),
+                   ok ? "ok" : "FAILED");
+            stateOk = stateOk && ok;
+        }
+
+        // periodic saves: the state of the last n-th time step survives a
+        // run that never stops
+        {
+            std::ofstream config("state_config_test.txt");
+            config << "Positions.txt\nRadii.txt\nstate = state_test.bin\nstate_interval = 2\n";
+        }
+        remove("state_test.bin");
+        std::vector<std::array<double, 3>> saved, lost, resumed;
+        factory = dynamic_cast<PTIIoffeFactory *>(GETFACTORYINSTANCE());
+        bool ok = factory->setup(mgr, "state_config_test.txt", msg) && factory->starting(mgr);
+        factory->configForTimeStep(nullptr);
+        take(factory, 300, saved);
+        ok = ok && !std::ifstream("state_test.bin");
+        take(factory, 400, saved, 1e-6);
+        factory->configForTimeStep(nullptr);
+        take(factory, 200, lost, 2e-6);
+        factory->configForTimeStep(nullptr);
+        RELEASEFACTORYINSTANCE(factory);
+
+        factory = dynamic_cast<PTIIoffeFactory *>(GETFACTORYINSTANCE());
+        ok = ok && factory->setup(mgr, "state_config_test.txt", msg) && factory->starting(mgr);
+        take(factory, base.size() + 1, resumed, 2e-6);
+        RELEASEFACTORYINSTANCE(factory);
+        const size_t again = resumed.size();
+        resumed.insert(resumed.end(), saved.begin(), saved.end());
+        std::sort(resumed.begin(), resumed.end());
+        ok = ok && lost.size() == 200 && again == base.size() - 700 && resumed == all;
+        printf("periodic state: %zu saved, %zu lost and emitted again: %s\n", saved.size(), lost.size(),
+               ok ? "ok" : "FAILED");
+        stateOk = stateOk && ok;
+
+        // without a state file the interval is a config error
+        {
+            std::ofstream config("state_config_test.txt");
+            config << "Positions.txt\nRadii.txt\nstate_interval = 2\n";
+        }
+        factory = dynamic_cast<PTIIoffeFactory *>(GETFACTORYINSTANCE());
+        stateOk = stateOk && !factory->setup(mgr, "state_config_test.txt", msg);
+        RELEASEFACTORYINSTANCE(factory);
+
+        remove("state_test.bin");
+        remove("state_config_test.txt");
+    }
+
+    // the other policy combinations: a permutation, a sorted and filtered
+    // deposit, and the compressed source in file order
+    bool policyOk = true;
+    {
+        CPacking base;
+        base.read("Positions.txt", "Radii.txt");
+        std::vector<std::array<double, 5>> file;
+        for (size_t i = 0; i < base.size(); i++)
+            file.push_back({base.x[i], base.y[i], base.z[i], base.r[i], 0});
+
+        auto run = [&]( CFactoryCore &f, const std::string &lines )
+        {
+            {
+                std::ofstream config("policy_test.txt");
+                config << lines;
+            }
+            std::vector<std::array<double, 5>> out;
+            if (f.setup(mgr, "policy_test.txt", msg) && f.starting(mgr))
+                out = emitted(f);
+            remove("policy_test.txt");
+            return out;
+        };
+
+        const std::string csv = "Positions.txt\nRadii.txt\nsidecar = off\n";
+        CShuffledFactory shuffled;
+        const std::vector<std::array<double, 5>> first = run(shuffled, csv + "order_seed = 1\n");
+        const std::vector<std::array<double, 5>> same = run(shuffled, csv + "order_seed = 1\n");
+        std::vector<std::array<double, 5>> other = run(shuffled, csv + "order_seed = 2\n");
+        std::vector<std::array<double, 5>> sorted = first, all = file;
+        std::sort(sorted.begin(), sorted.end());
+        std::sort(all.begin(), all.end());
+        const bool shuffleOk = first == same && first != other && first != file && sorted == all;
+
+        CDepositFactory deposit;
+        const double lo = base.r[base.size() / 2];
+        std::ostringstream lines;
+        lines << csv << std::setprecision(17) << "radius_range = " << lo << " 1e9\nvelocity = 0 0 -2\n";
+        const std::vector<std::array<double, 5>> layered = run(deposit, lines.str());
+        const size_t inRange = size_t(std::count_if(base.r.begin(), base.r.end(), [lo]( double r ) { return r >= lo; }));
+        bool depositOk = layered.size() == inRange;
+        for (size_t i = 0; depositOk && i < layered.size(); i++)
+            depositOk = layered[i][3] >= lo && layered[i][4] == -2 &&
+                        (i == 0 || layered[i][2] - layered[i][3] >= layered[i - 1][2] - layered[i - 1][3]);
+
+        CPackingCodec::SParams params;
+        params.keepOrder = true;
+        CPkzFactory compressed;
+        bool pkzOk = CPackingCodec::write("policy_test.pkz", base, params);
+        const std::vector<std::array<double, 5>> decoded = run(compressed, "policy_test.pkz\n");
+        pkzOk = pkzOk && decoded.size() == file.size();
+        for (size_t i = 0; pkzOk && i < decoded.size(); i++)
+            for (int a = 0; a < 4; a++)
+                pkzOk = pkzOk && std::fabs(decoded[i][a] - file[i][a]) <= params.tolerance * (1 + 1e-9);
+        remove("policy_test.pkz");
+
+        printf("policies: shuffled %s, deposit of %zu from the floor up %s, compressed source %s\n",
+               shuffleOk ? "ok" : "FAILED", layered.size(), depositOk ? "ok" : "FAILED", pkzOk ? "ok" : "FAILED");
+        policyOk = shuffleOk && depositOk && pkzOk;
+    }
+
+    // arenas: nested scopes give back exactly their part, a reset round
+    // of the same shape asks nothing upstream, and a culled packing made
+    // with the setup arena matches the heap one
+    bool arenaOk = true;
+    {
+        struct CCounting : std::pmr::memory_resource
+        {
+            size_t calls = 0;
+            void *do_allocate( size_t bytes, size_t alignment ) override
+            {
+                calls++;
+                return std::pmr::new_delete_resource()->allocate(bytes, alignment);
+            }
+            void do_deallocate( void *p, size_t bytes, size_t alignment ) override
+            {
+                std::pmr::new_delete_resource()->deallocate(p, bytes, alignment);
+            }
+            bool do_is_equal( const std::pmr::memory_resource &other ) const noexcept override { return this == &other; }
+        } counting;
+
+        CArena arena(4096, &counting);
+        size_t warmCalls = 0;
+        for (int round = 0; round < 4; round++)
+        {
+            arena.reset();
+            std::pmr::map<int, std::pmr::string> names(&arena);
+            for (int k = 0; k < 2000; k++)
+                names.emplace(k, std::pmr::string("a name well past the small string buffer", &arena));
+            {
+                CArenaScope inner(arena);
+                const size_t before = arena.used();
+                std::pmr::vector<double> column(size_t(1) << 16, 1.0, &inner.resource());
+                arenaOk = arenaOk && arena.used() >= before + column.size() * sizeof(double) &&
+                          reinterpret_cast<uintptr_t>(column.data()) % alignof(double) == 0;
+            }
+            arenaOk = arenaOk && names.size() == 2000 && names[1999].size() == 40;
+            if (round == 0)
+                warmCalls = counting.calls;
+        }
+        arenaOk = arenaOk && counting.calls == warmCalls && arena.upstreamAllocations() == warmCalls;
+        arena.release();
+        arenaOk = arenaOk && arena.reserved() == 0;
+
+        CPacking base;
+        base.read("Positions.txt", "Radii.txt");
+        SCullParams params;
+        params.mode = ECullMode::eParcel;
+        params.cutoff = base.r[0] * 1.01;
+        CPacking onHeap, onArena;
+        SCullReport heapReport, arenaReport;
+        CArena setup;
+        arenaOk = arenaOk && cullFineParticles(base, params, onHeap, heapReport) ==
+                                 cullFineParticles(base, params, onArena, arenaReport, &setup) &&
+                  onHeap.x == onArena.x && onHeap.r == onArena.r && heapReport.parcels == arenaReport.parcels;
+
+        printf("arena: %zu upstream chunks for 4 rounds: %s\n", warmCalls, arenaOk ? "ok" : "FAILED");
+    }
+
+    // large arrays: every page mode keeps the data and gives its blocks
+    // back, explicit pages fall back when none are reserved, and a factory
+    // configured for huge pages emits the same particles
+    bool pagesOk = true;
+    {
+        CLargePages &pages = CLargePages::instance();
+        const SLargePageConfig initial = pages.config();
+        const CLargePages::SStats before = pages.stats();
+        const size_t n = size_t(8) << 20;
+        uint64_t misses[3] = {0, 0, 0};
+        double gatherTime[3] = {0, 0, 0};
+        for (int m = 0; m < 3; m++)
+        {
+            SLargePageConfig config;
+            config.pages = EPageMode(m);
+            config.firstTouch = true;
+            pages.configure(config);
+            tLargeVector<double> column(n);
+            for (size_t i = 0; i < n; i++)
+                column[i] = double(i);
+            const CLargePages::SStats during = pages.stats();
+            pagesOk = pagesOk && (m == 0 ? during.mappings == before.mappings
+                                         : during.mappings == before.mappings + 1 &&
+                                           during.mappedBytes >= before.mappedBytes + n * sizeof(double));
+
+            // a random gather, the access pattern of neighbour lists
+            CTlbCounter tlb;
+            const auto start = std::chrono::steady_clock::now();
+            tlb.start();
+            double sum = 0;
+            uint64_t k = 1;
+            for (size_t i = 0; i < n / 4; i++)
+            {
+                k = k * 6364136223846793005ull + 1442695040888963407ull;
+                sum += column[size_t(k >> 33) % n];
+            }
+            misses[m] = tlb.stop();
+            gatherTime[m] = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+            pagesOk = pagesOk && sum > 0 && column[n - 1] == double(n - 1);
+        }
+        const CLargePages::SStats after = pages.stats();
+        pagesOk = pagesOk && after.mappings == before.mappings && after.mappedBytes == before.mappedBytes &&
+                  after.heapBytes == before.heapBytes;
+
+        std::string report;
+        {
+            std::ofstream config("pages_test.txt");
+            config << "Positions.txt\nRadii.txt\nsidecar = off\npages = transparent\nfirst_touch = on\n"
+                      "large_threshold = 4096\n";
+        }
+        PTIIoffeFactory paged;
+        std::vector<std::array<double, 5>> out;
+        if (paged.setup(mgr, "pages_test.txt", msg) && paged.starting(mgr))
+        {
+            out = emitted(paged);
+            report = pages.report();
+        }
+        remove("pages_test.txt");
+        CPacking base;
+        base.read("Positions.txt", "Radii.txt");
+        bool sameOk = out.size() == base.size();
+        for (size_t i = 0; sameOk && i < out.size(); i++)
+            sameOk = out[i][0] == base.x[i] && out[i][3] == base.r[i];
+        pagesOk = pagesOk && sameOk && pages.config().pages == EPageMode::eTransparent &&
+                  report.find("dTLB misses") != std::string::npos;
+        pages.configure(initial);
+
+        printf("large pages: %s, random gather %.1f / %.1f / %.1f ms (default / transparent / explicit)",
+               pagesOk ? "ok" : "FAILED", gatherTime[0] * 1e3, gatherTime[1] * 1e3, gatherTime[2] * 1e3);
+        if (CTlbCounter().available())
+            printf(", dTLB misses %llu / %llu / %llu", (unsigned long long)misses[0], (unsigned long long)misses[1],
+                   (unsigned long long)misses[2]);
+        printf("\n  %s\n", report.c_str());
+    }
+
+    factory = dynamic_cast<PTIIoffeFactory *>(GETFACTORYINSTANCE());
+    // a setup with a property the host lacks fails, and must not leave
+    // it declared for the next setup of the same factory
+    {
+        std::ofstream config("missing_test.txt");
+        config << "Positions.txt\nRadii.txt\nproperty Missing = grains_test.txt\n";
+    }
+    bool redeclareOk = !factory->setup(mgr, "missing_test.txt", msg);
+    remove("missing_test.txt");
+    // a property name too long for the host buffer is never described and does not resolve
+    {
+        CPropertyRegistry registry;
+        registry.declare(std::string(NApi::CUSTOM_PROP_MAX_NAME_LENGTH, 'x').c_str(), NApi::eParticle, 1, NApi::eNone);
+        redeclareOk = redeclareOk && registry.count(NApi::eParticle) == 0 && !registry.getError().empty() &&
+                      !registry.resolve(mgr) && registry.getError().find("too long") != std::string::npos;
+    }
+    {
+        double elements[2] = {1, 2};
+        const CPropertyView<double> view(elements, 2);
+        redeclareOk = redeclareOk && view.at(1) == elements + 1 && view.at(2) == nullptr;
+    }
+    bool ok = factory->setup(mgr, "config.txt", msg) && !factory->usesCustomProperties() &&
+              factory->setup(mgr, "config_test.txt", msg) && redeclareOk;
+    // the host hands property data to createParticle only if the factory asks for it
+    const int withProperty = ok ? emitAll(factory, factory->usesCustomProperties() ? &mgr.particleProperties : nullptr,
+                                          []( int i, NApiCore::ICustomPropertyDataApi_1_0 *data )
+    {
+        auto props = static_cast<CParticleProperties *>(data);
+        if (props == nullptr)
+            return false;
+        const bool written = props->value + props->delta == 2 * i + 1;
+        props->delta = 0;
+        return written;
+    }) : -1;
+    RELEASEFACTORYINSTANCE(factory);
+    remove("grains_test.txt");
+    remove("config_test.txt");
 
-    return 0;
+    printf("emitted %d particles with property\n", withProperty);
+    return shared && sidecarOk && asyncOk && tilingOk && regionOk && cullOk && clumpOk && stateOk && policyOk && arenaOk && pagesOk && withProperty == cnt ? 0 : 1;
 }
@@ -0,0 +1,247 @@
+#include <algorithm>
+#include <charconv>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "defectclusters.h"
+#include "musenstore.h"
+
+namespace fs = std::filesystem;
+
+static void usage()
+{
+    fprintf(stderr,
+            "usage: defects <bonds_preprocessed.txt | bonds.mcs> <out dir> [options]\n"
+            "         --distance <d>           clustering distance, mm (0.2)\n"
+            "         --step <s>               time window, s (0.0005)\n"
+            "         --partial                a window holds only its own defects\n"
+            "         --min-size <n>           smallest cluster written (1)\n"
+            "         --threads <n>            0 for one per hardware thread\n");
+}
+
+struct SDefects
+{
+    std::vector<double> x, y, z, t;
+    std::vector<long long> ids;
+    std::vector<double> timePoints;
+};
+
+static std::string_view nextToken( const char *&p, const char *end )
+{
+    while (p < end && (*p == ' ' || *p == '\t' || *p == '\r'))
+        p++;
+    const char *start = p;
+    while (p < end && *p != ' ' && *p != '\t' && *p != '\r' && *p != '\n')
+        p++;
+    return std::string_view(start, size_t(p - start));
+}
+
+/** The output of defect_processor.py and the time_points.txt next to it */
+static bool readPreprocessed( const std::string &path, SDefects &defects )
+{
+    CMappedFile file;
+    if (!file.open(path))
+        return false;
+    const char *p = reinterpret_cast<const char *>(file.data());
+    const char *end = p + file.size();
+
+    const char *names[] = {"BondId", "BondX,mm", "BondY,mm", "BondZ,mm", "DeathT,s"};
+    int column[5] = {-1, -1, -1, -1, -1};
+    int columns = 0;
+    for (std::string_view name = nextToken(p, end); !name.empty(); name = nextToken(p, end), columns++)
+        for (int c = 0; c < 5; c++)
+            if (name == names[c])
+                column[c] = columns;
+    if (column[1] < 0 || column[2] < 0 || column[3] < 0 || column[4] < 0)
+    {
+        fprintf(stderr, "%s has no BondX,mm, BondY,mm, BondZ,mm or DeathT,s column\n", path.c_str());
+        return false;
+    }
+
+    size_t line = 1;
+    while (p < end)
+    {
+        p++;  // the new line
+        line++;
+        double values[5] = {0, 0, 0, 0, 0};
+        int found = 0;
+        for (int c = 0; c < columns; c++)
+        {
+            const std::string_view token = nextToken(p, end);
+            if (token.empty())
+                break;
+            for (int k = 0; k < 5; k++)
+                if (column[k] == c)
+                {
+                    const auto result = std::from_chars(token.data(), token.data() + token.size(), values[k]);
+                    if (result.ec != std::errc() || result.ptr != token.data() + token.size())
+                    {
+                        fprintf(stderr, "%s:%zu: bad value %.*s\n", path.c_str(), line, int(token.size()),
+                                token.data());
+                        return false;
+                    }
+                    found++;
+                }
+        }
+        while (p < end && *p != '\n')
+            p++;
+        if (found == 0)
+            continue;
+        if (found != (column[0] < 0 ? 4 : 5))
+        {
+            fprintf(stderr, "%s:%zu: too few columns\n", path.c_str(), line);
+            return false;
+        }
+        defects.ids.push_back(column[0] < 0 ? (long long)defects.ids.size() : (long long)values[0]);
+        defects.x.push_back(values[1]);
+        defects.y.push_back(values[2]);
+        defects.z.push_back(values[3]);
+        defects.t.push_back(values[4]);
+    }
+
+    if (FILE *times = fopen((fs::path(path).parent_path() / "time_points.txt").string().c_str(), "r"))
+    {
+        double time;
+        while (fscanf(times, "%lf", &time) == 1)
+            defects.timePoints.push_back(time);
+        fclose(times);
+    }
+    return true;
+}
+
+/**
+ * Broken bonds of a MUSEN store: a bond that died before the last time
+ * point is a defect at its coordinates of the last time point up to its
+ * death, in mm, as defect_processor.py writes them (without its region
+ * of interest).
+ */
+static bool readStore( const CMusenStore &store, SDefects &defects )
+{
+    if (store.kind() != EMusenKind::eBonds || !store.hasCoordinates() || store.timePoints() == 0)
+        return false;
+    defects.timePoints.assign(store.times(), store.times() + store.timePoints());
+    const double last = defects.timePoints.back();
+    for (size_t row = 0; row < store.size(); row++)
+    {
+        const double death = store.death()[row];
+        if (death > last - 1e-5)
+            continue;
+        const size_t at = std::upper_bound(store.times(), store.times() + store.timePoints(), death) - store.times();
+        const size_t frame = at > 0 ? at - 1 : 0;
+        defects.ids.push_back((long long)store.ids()[row]);
+        defects.x.push_back(1e3 * store.frame(frame, 0)[row]);
+        defects.y.push_back(1e3 * store.frame(frame, 1)[row]);
+        defects.z.push_back(1e3 * store.frame(frame, 2)[row]);
+        defects.t.push_back(death);
+    }
+    return true;
+}
+
+int main( int argc, char *argv[] )
+{
+    if (argc < 3)
+    {
+        usage();
+        return 1;
+    }
+
+    CDefectClusters::SParams params;
+    double step = 0.0005;
+    for (int a = 3; a < argc; a++)
+    {
+        const std::string option = argv[a];
+        const bool value = a + 1 < argc;
+        if (option == "--distance" && value)
+            params.distance = atof(argv[++a]);
+        else if (option == "--step" && value)
+            step = atof(argv[++a]);
+        else if (option == "--partial")
+            params.cumulative = false;
+        else if (option == "--min-size" && value)
+            params.minSize = size_t(atol(argv[++a]));
+        else if (option == "--threads" && value)
+            params.threads = size_t(atoi(argv[++a]));
+        else
+        {
+            usage();
+            return 1;
+        }
+    }
+
+    SDefects defects;
+    CMusenStore store;
+    if (store.open(argv[1]) ? !readStore(store, defects) : !readPreprocessed(argv[1], defects))
+    {
+        fprintf(stderr, "cannot read defects from %s\n", argv[1]);
+        return 1;
+    }
+    store.close();
+
+    // windows as defect_cluster.py spaces them over the time points
+    if (defects.timePoints.empty() && !defects.t.empty())
+        defects.timePoints = {*std::min_element(defects.t.begin(), defects.t.end()),
+                              *std::max_element(defects.t.begin(), defects.t.end())};
+    if (!defects.timePoints.empty() && step > 0)
+    {
+        const double first = defects.timePoints.front(), last = defects.timePoints.back();
+        const size_t count = size_t((last - first) / step) + 1;
+        for (size_t k = 0; k < count; k++)
+            params.windowEnds.push_back(count > 1 ? first + (last - first) * double(k) / double(count - 1) : first);
+    }
+
+    std::error_code error;
+    fs::create_directories(argv[2], error);
+    const fs::path out(argv[2]);
+    FILE *statistics = fopen((out / "statistics.txt").string().c_str(), "w");
+    if (statistics == nullptr)
+    {
+        fprintf(stderr, "cannot write to %s\n", argv[2]);
+        return 1;
+    }
+    fprintf(statistics, "Time (end), s\tCluster count\tMax size\n");
+
+    bool written = true;
+    const auto start = std::chrono::steady_clock::now();
+    const bool ok = CDefectClusters().cluster(
+        defects.x.data(), defects.y.data(), defects.z.data(), defects.t.data(), defects.x.size(), params,
+        [&]( const CDefectClusters::SWindowStats &stats, const std::vector<SDefectCluster> &clusters )
+        {
+            fprintf(statistics, "%.17g\t%zu\t%zu\n", stats.end, stats.clusters, stats.largest);
+            char name[64];
+            snprintf(name, sizeof(name), "cluster_%.6f.txt", stats.end);
+            FILE *file = fopen((out / name).string().c_str(), "w");
+            if (file == nullptr)
+            {
+                written = false;
+                return;
+            }
+            fprintf(file, "Id\tX,mm\tY,mm\tZ,mm\tN\tS1,mm\tS2,mm\tS3,mm\t"
+                          "A1x\tA1y\tA1z\tA2x\tA2y\tA2z\tA3x\tA3y\tA3z\n");
+            for (const SDefectCluster &c : clusters)
+            {
+                fprintf(file, "%lld\t%.17g\t%.17g\t%.17g\t%zu\t%.9g\t%.9g\t%.9g", defects.ids[c.first],
+                        c.centroid[0], c.centroid[1], c.centroid[2], c.size, c.extent[0], c.extent[1], c.extent[2]);
+                for (int k = 0; k < 3; k++)
+                    fprintf(file, "\t%.9g\t%.9g\t%.9g", c.axes[k][0], c.axes[k][1], c.axes[k][2]);
+                fprintf(file, "\n");
+            }
+            written = fclose(file) == 0 && written;
+        });
+    const double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    written = fclose(statistics) == 0 && written;
+    if (!ok || !written)
+    {
+        fprintf(stderr, ok ? "cannot write to %s\n" : "cannot cluster the defects of %s\n", ok ? argv[2] : argv[1]);
+        return 1;
+    }
+    printf("%zu defects in %zu windows clustered in %.3f s\n", defects.x.size(),
+           std::max<size_t>(1, params.windowEnds.size()), seconds);
+    return 0;
+}
@@ -0,0 +1,147 @@
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+
+#include "musenstore.h"
+
+static void usage()
+{
+    fprintf(stderr,
+            "usage: musen convert particles|bonds <export.txt> <out.mcs> [options]\n"
+            "         --threads <n>            0 for one per hardware thread\n"
+            "         --batch-mb <n>           frame buffers of a batch (256)\n"
+            "       musen info <store.mcs>\n"
+            "       musen frame <store.mcs> <time> [id...]\n"
+            "       musen trajectory <store.mcs> <id>\n");
+}
+
+static bool openStore( CMusenStore &store, const char *path )
+{
+    if (store.open(path))
+        return true;
+    fprintf(stderr, "%s is not a MUSEN store\n", path);
+    return false;
+}
+
+static void printRow( const CMusenStore &store, size_t t, size_t row )
+{
+    printf("%lld", (long long)store.ids()[row]);
+    if (store.kind() == EMusenKind::eParticles)
+        printf(" %.17g", store.radius()[row]);
+    else
+        printf(" %lld %lld %.17g", (long long)store.begin()[row], (long long)store.end()[row], store.death()[row]);
+    if (store.hasCoordinates())
+        printf(" %.17g %.17g %.17g", store.frame(t, 0)[row], store.frame(t, 1)[row], store.frame(t, 2)[row]);
+    printf("\n");
+}
+
+int main( int argc, char *argv[] )
+{
+    if (argc < 3)
+    {
+        usage();
+        return 1;
+    }
+    const std::string command = argv[1];
+
+    if (command == "convert" && argc >= 5)
+    {
+        const std::string kind = argv[2];
+        if (kind != "particles" && kind != "bonds")
+        {
+            usage();
+            return 1;
+        }
+        CMusenConverter::SParams params;
+        for (int a = 5; a < argc; a++)
+        {
+            const std::string option = argv[a];
+            const bool value = a + 1 < argc;
+            if (option == "--threads" && value)
+                params.threads = size_t(atoi(argv[++a]));
+            else if (option == "--batch-mb" && value)
+                params.batchBytes = size_t(atol(argv[++a])) << 20;
+            else
+            {
+                usage();
+                return 1;
+            }
+        }
+
+        CMusenConverter::SReport report;
+        std::string error;
+        if (!CMusenConverter::convert(argv[3], kind == "particles" ? EMusenKind::eParticles : EMusenKind::eBonds,
+                                      argv[4], params, report, error))
+        {
+            fprintf(stderr, "%s\n", error.c_str());
+            return 1;
+        }
+        printf("%zu %s, %zu time points in %zu batches: %.1f MB of text to %.1f MB in %.3f s (%.0f MB/s)\n",
+               report.entities, kind.c_str(), report.timePoints, report.batches, report.inputBytes / 1048576.0,
+               report.outputBytes / 1048576.0, report.seconds, report.inputBytes / 1048576.0 / report.seconds);
+        return 0;
+    }
+
+    CMusenStore store;
+    if (command == "info")
+    {
+        if (!openStore(store, argv[2]))
+            return 1;
+        printf("%zu %s, %zu time points", store.size(),
+               store.kind() == EMusenKind::eParticles ? "particles" : "bonds", store.timePoints());
+        if (store.timePoints() > 0)
+            printf(" from %g to %g", store.times()[0], store.times()[store.timePoints() - 1]);
+        printf(", %s\n", store.hasCoordinates() ? "with coordinates" : "without coordinates");
+        for (size_t k = 0; k < store.materials(); k++)
+            printf("  material %zu: %s\n", k, store.materialName(k));
+        return 0;
+    }
+    if (command == "frame" && argc >= 4)
+    {
+        if (!openStore(store, argv[2]))
+            return 1;
+        const size_t t = store.timeIndex(atof(argv[3]));
+        if (t == store.timePoints())
+        {
+            fprintf(stderr, "no time point at or after %s\n", argv[3]);
+            return 1;
+        }
+        printf("# time %.17g\n", store.times()[t]);
+        if (argc == 4)
+            for (size_t row = 0; row < store.size(); row++)
+                printRow(store, t, row);
+        for (int a = 4; a < argc; a++)
+        {
+            const int64_t row = store.row(atoll(argv[a]));
+            if (row < 0)
+            {
+                fprintf(stderr, "no entity %s\n", argv[a]);
+                return 1;
+            }
+            printRow(store, t, size_t(row));
+        }
+        return 0;
+    }
+    if (command == "trajectory" && argc == 4)
+    {
+        if (!openStore(store, argv[2]))
+            return 1;
+        const int64_t row = store.row(atoll(argv[3]));
+        if (row < 0)
+        {
+            fprintf(stderr, "no entity %s\n", argv[3]);
+            return 1;
+        }
+        for (size_t t = 0; t < store.timePoints(); t++)
+        {
+            printf("%.17g", store.times()[t]);
+            if (store.hasCoordinates())
+                printf(" %.17g %.17g %.17g", store.frame(t, 0)[row], store.frame(t, 1)[row], store.frame(t, 2)[row]);
+            printf("\n");
+        }
+        return 0;
+    }
+    usage();
+    return 1;
+}
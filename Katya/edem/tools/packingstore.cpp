@@ -0,0 +1,193 @@
+#include <cstdio>
+#include <cstring>
+#include <string>
+
+#include "packingcodec.h"
+#include "packingsidecar.h"
+#include "packingstore.h"
+
+struct SPackingStore
+{
+    /** Columns of the mapped sidecar, or of the decoded packing */
+    CPackingSidecar sidecar;
+    CPacking packing;
+    bool mapped = false;
+    std::string propertyNames;  /**< of the sidecar, NUL separated */
+    std::vector<size_t> nameAt;
+};
+
+namespace
+{
+    thread_local std::string lastError;
+
+    SPackingStore *fail( const std::string &message )
+    {
+        lastError = message;
+        return nullptr;
+    }
+
+    SPackingStore *mapped( SPackingStore *store )
+    {
+        store->mapped = true;
+        for (size_t k = 0; k < store->sidecar.properties(); k++)
+        {
+            store->nameAt.push_back(store->propertyNames.size());
+            store->propertyNames += store->sidecar.propertyName(k);
+            store->propertyNames += '\0';
+        }
+        return store;
+    }
+
+    /** Index of a property column, -1 if none */
+    long propertyIndex( const SPackingStore *store, const char *name )
+    {
+        const uint32_t count = pks_property_count(store);
+        for (uint32_t k = 0; k < count; k++)
+            if (strcmp(pks_property_name(store, k), name) == 0)
+                return long(k);
+        return -1;
+    }
+}
+
+uint32_t pks_abi_version( void )
+{
+    return PKS_ABI_VERSION;
+}
+
+SPackingStore *pks_open( const char *path )
+{
+    if (path == nullptr)
+        return fail("no path");
+
+    char magic[4] = {0, 0, 0, 0};
+    if (FILE *file = fopen(path, "rb"))
+    {
+        if (fread(magic, 1, sizeof(magic), file) != sizeof(magic))
+            magic[0] = 0;
+        fclose(file);
+    }
+    else
+        return fail(std::string("cannot open ") + path);
+
+    SPackingStore *store = new SPackingStore;
+    if (memcmp(magic, "PKC1", 4) == 0)
+    {
+        if (store->sidecar.open(path))
+            return mapped(store);
+        delete store;
+        return fail(std::string("damaged or foreign sidecar ") + path);
+    }
+    if (memcmp(magic, "PKZ1", 4) == 0)
+    {
+        CPackingCodec codec;
+        if (codec.open(path) && codec.decode(store->packing))
+            return store;
+        delete store;
+        return fail(std::string("damaged compressed packing ") + path);
+    }
+    delete store;
+    return fail(std::string("neither a sidecar nor a compressed packing: ") + path);
+}
+
+SPackingStore *pks_open_text( const char *centers, const char *radii )
+{
+    if (centers == nullptr || radii == nullptr)
+        return fail("no path");
+
+    SPackingSource source;
+    source.centers = centers;
+    source.radii = radii;
+    uint64_t hash;
+    if (!CPackingSidecar::sourceHash(source, hash))
+        return fail(std::string("cannot read ") + centers + ", " + radii);
+
+    SPackingStore *store = new SPackingStore;
+    const std::string path = CPackingSidecar::pathOf(source);
+    if (store->sidecar.open(path, hash))
+        return mapped(store);
+
+    if (!store->packing.read(source))
+    {
+        delete store;
+        return fail(std::string("cannot parse ") + centers + ", " + radii);
+    }
+    // map what was just written, so the columns are the file's as on any later open
+    if (CPackingSidecar::write(path, store->packing, hash) && store->sidecar.open(path, hash))
+    {
+        store->packing = CPacking();
+        return mapped(store);
+    }
+    return store;
+}
+
+void pks_close( SPackingStore *store )
+{
+    delete store;
+}
+
+const char *pks_last_error( void )
+{
+    return lastError.c_str();
+}
+
+uint64_t pks_size( const SPackingStore *store )
+{
+    if (store == nullptr)
+        return 0;
+    return store->mapped ? store->sidecar.size() : store->packing.size();
+}
+
+int pks_mapped( const SPackingStore *store )
+{
+    return store != nullptr && store->mapped ? 1 : 0;
+}
+
+const double *pks_column( const SPackingStore *store, const char *name )
+{
+    if (store == nullptr || name == nullptr)
+        return nullptr;
+
+    const char *axes[] = {"x", "y", "z", "r"};
+    for (int a = 0; a < 4; a++)
+        if (strcmp(name, axes[a]) == 0)
+        {
+            if (store->mapped)
+                return a == 0 ? store->sidecar.x() : a == 1 ? store->sidecar.y()
+                                                 : a == 2 ? store->sidecar.z() : store->sidecar.r();
+            const tLargeVector<double> *columns[] = {&store->packing.x, &store->packing.y,
+                                                     &store->packing.z, &store->packing.r};
+            return columns[a]->data();
+        }
+
+    const long k = propertyIndex(store, name);
+    if (k < 0)
+        return nullptr;
+    return store->mapped ? store->sidecar.propertyValues(size_t(k)) : store->packing.properties[size_t(k)].values.data();
+}
+
+uint32_t pks_column_elements( const SPackingStore *store, const char *name )
+{
+    if (store == nullptr || name == nullptr)
+        return 0;
+    if (strcmp(name, "x") == 0 || strcmp(name, "y") == 0 || strcmp(name, "z") == 0 || strcmp(name, "r") == 0)
+        return 1;
+
+    const long k = propertyIndex(store, name);
+    if (k < 0)
+        return 0;
+    return store->mapped ? store->sidecar.propertyElements(size_t(k)) : store->packing.properties[size_t(k)].elements;
+}
+
+uint32_t pks_property_count( const SPackingStore *store )
+{
+    if (store == nullptr)
+        return 0;
+    return uint32_t(store->mapped ? store->sidecar.properties() : store->packing.properties.size());
+}
+
+const char *pks_property_name( const SPackingStore *store, uint32_t k )
+{
+    if (k >= pks_property_count(store))
+        return nullptr;
+    return store->mapped ? store->propertyNames.c_str() + store->nameAt[k] : store->packing.properties[k].name.c_str();
+}
@@ -0,0 +1,63 @@
+#pragma once
+
+/*
+ * C interface to a packing for analysis tools in other languages
+ * (packingstore.py wraps it with ctypes).
+ *
+ * A store is opened from
+ *  - a binary sidecar `.pkc` (see CPackingSidecar): the file is mapped
+ *    and the columns point into the mapping, nothing is copied or
+ *    parsed whatever the size;
+ *  - a compressed `.pkz` (see CPackingCodec): decoded into memory on
+ *    every hardware thread;
+ *  - the text files: read through the sidecar, which is written next to
+ *    the centers file on the first open, so later opens are mapped.
+ *
+ * Columns are arrays of pks_size() doubles, property columns of
+ * pks_size() * elements doubles interleaved per particle. They are
+ * read-only and valid until pks_close(). Functions that fail return
+ * null or 0 and leave a message for pks_last_error() of the thread.
+ */
+
+#include <stdint.h>
+
+#ifdef _WIN32
+#define PKS_API __declspec(dllexport)
+#else
+#define PKS_API __attribute__((visibility("default")))
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define PKS_ABI_VERSION 1
+
+typedef struct SPackingStore SPackingStore;
+
+PKS_API uint32_t pks_abi_version( void );
+
+/** A .pkc sidecar (mapped) or a .pkz file (decoded), told apart by their contents */
+PKS_API SPackingStore *pks_open( const char *path );
+/** The Mote3D centers and radii text files, through their sidecar */
+PKS_API SPackingStore *pks_open_text( const char *centers, const char *radii );
+PKS_API void pks_close( SPackingStore *store );
+
+/** Message of the last failure on the calling thread */
+PKS_API const char *pks_last_error( void );
+
+PKS_API uint64_t pks_size( const SPackingStore *store );
+/** 1 if the columns point into a mapped file, 0 if they were decoded into memory */
+PKS_API int pks_mapped( const SPackingStore *store );
+
+/** "x", "y", "z", "r" or a property name; null if there is no such column */
+PKS_API const double *pks_column( const SPackingStore *store, const char *name );
+/** Doubles per particle of a column, 0 if there is no such column */
+PKS_API uint32_t pks_column_elements( const SPackingStore *store, const char *name );
+
+PKS_API uint32_t pks_property_count( const SPackingStore *store );
+PKS_API const char *pks_property_name( const SPackingStore *store, uint32_t k );
+
+#ifdef __cplusplus
+}
+#endif
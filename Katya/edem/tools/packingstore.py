@@ -0,0 +1,175 @@
+"""Zero-copy access to packings from Python through libpackingstore.
+
+A .pkc sidecar is mapped, not parsed: the columns are memoryviews (or
+NumPy arrays with as_numpy) over the mapping, so opening a packing of
+any size takes as long as mapping a file. Text packings are opened
+through their sidecar, which is written on the first open; .pkz files
+are decoded in C++.
+
+    with PackingStore('Positions.txt.pkc') as packing:
+        x = packing.as_numpy('x')
+        temperature = packing.as_numpy('Temperature')   # (n, elements)
+
+The library is looked up in $PACKINGSTORE_LIB, next to this file and in
+../build, ../_build, build, _build beside it.
+"""
+
+import argparse
+import ctypes
+import os
+from pathlib import Path
+
+ABI_VERSION = 1
+
+
+def _load_library(path=None):
+    candidates = [path, os.environ.get('PACKINGSTORE_LIB')]
+    here = Path(__file__).resolve().parent
+    names = ['libpackingstore.so', 'libpackingstore.dylib', 'packingstore.dll', 'libpackingstore.dll']
+    for folder in [here, here / 'build', here / '_build', here.parent / 'build', here.parent / '_build']:
+        candidates += [str(folder / name) for name in names]
+    for candidate in candidates:
+        if candidate and Path(candidate).exists():
+            lib = ctypes.CDLL(candidate)
+            break
+    else:
+        raise OSError('libpackingstore not found, build tools/ or set PACKINGSTORE_LIB')
+
+    handle = ctypes.c_void_p
+    signatures = {
+        'pks_abi_version': (ctypes.c_uint32, []),
+        'pks_open': (handle, [ctypes.c_char_p]),
+        'pks_open_text': (handle, [ctypes.c_char_p, ctypes.c_char_p]),
+        'pks_close': (None, [handle]),
+        'pks_last_error': (ctypes.c_char_p, []),
+        'pks_size': (ctypes.c_uint64, [handle]),
+        'pks_mapped': (ctypes.c_int, [handle]),
+        'pks_column': (ctypes.c_void_p, [handle, ctypes.c_char_p]),
+        'pks_column_elements': (ctypes.c_uint32, [handle, ctypes.c_char_p]),
+        'pks_property_count': (ctypes.c_uint32, [handle]),
+        'pks_property_name': (ctypes.c_char_p, [handle, ctypes.c_uint32]),
+    }
+    for name, (restype, argtypes) in signatures.items():
+        function = getattr(lib, name)
+        function.restype = restype
+        function.argtypes = argtypes
+    if lib.pks_abi_version() != ABI_VERSION:
+        raise OSError(f'libpackingstore ABI {lib.pks_abi_version()}, expected {ABI_VERSION}')
+    return lib
+
+
+class _Handle:
+    """Owns the C store; every column keeps it alive, so a column never outlives its mapping."""
+
+    def __init__(self, lib, pointer):
+        self.lib = lib
+        self.pointer = pointer
+
+    def __del__(self):
+        if self.pointer:
+            self.lib.pks_close(self.pointer)
+            self.pointer = None
+
+
+class PackingStore:
+    _lib = None
+
+    def __init__(self, path=None, centers=None, radii=None, library=None):
+        """A .pkc or .pkz file as `path`, or the `centers` and `radii` text files."""
+        if PackingStore._lib is None or library is not None:
+            PackingStore._lib = _load_library(library)
+        lib = PackingStore._lib
+        if path is not None:
+            pointer = lib.pks_open(str(path).encode())
+        else:
+            pointer = lib.pks_open_text(str(centers).encode(), str(radii).encode())
+        if not pointer:
+            raise OSError(lib.pks_last_error().decode())
+        self._handle = _Handle(lib, pointer)
+
+    def __enter__(self):
+        return self
+
+    def __exit__(self, *exc):
+        self.close()
+
+    def close(self):
+        """Drops the store; it is unmapped once no column refers to it any more."""
+        self._handle = None
+
+    def __len__(self):
+        return self._lib.pks_size(self._handle.pointer)
+
+    @property
+    def mapped(self):
+        """True if the columns are views of the mapped file, False if they were decoded"""
+        return self._lib.pks_mapped(self._handle.pointer) != 0
+
+    @property
+    def properties(self):
+        count = self._lib.pks_property_count(self._handle.pointer)
+        return [self._lib.pks_property_name(self._handle.pointer, k).decode() for k in range(count)]
+
+    def column(self, name):
+        """Read-only memoryview of doubles: (n,) for x, y, z, r, (n, elements) for a property"""
+        pointer = self._handle.pointer
+        elements = self._lib.pks_column_elements(pointer, name.encode())
+        address = self._lib.pks_column(pointer, name.encode())
+        if elements == 0 or not address:
+            raise KeyError(name)
+        n = len(self)
+        if n == 0:
+            return memoryview(b'').cast('d')
+        array = (ctypes.c_double * (n * elements)).from_address(address)
+        array.handle = self._handle
+        raw = memoryview(array).cast('B')
+        view = raw.cast('d', [n, elements]) if elements > 1 else raw.cast('d')
+        return view.toreadonly()
+
+    def as_numpy(self, name):
+        """The column as a read-only NumPy array sharing the store's memory"""
+        import numpy
+        view = self.column(name)
+        return numpy.frombuffer(view, dtype=numpy.float64).reshape(view.shape)
+
+    @property
+    def x(self):
+        return self.column('x')
+
+    @property
+    def y(self):
+        return self.column('y')
+
+    @property
+    def z(self):
+        return self.column('z')
+
+    @property
+    def r(self):
+        return self.column('r')
+
+
+def main():
+    parser = argparse.ArgumentParser(description='Summary of a packing through libpackingstore')
+    parser.add_argument('path', type=str, help='.pkc or .pkz file, or the centers file with --radii')
+    parser.add_argument('--radii', type=str, default=None, help='Radii file of a text packing')
+    parser.add_argument('--library', type=str, default=None, help='Path of libpackingstore')
+    args = parser.parse_args()
+
+    if args.radii is None:
+        packing = PackingStore(args.path, library=args.library)
+    else:
+        packing = PackingStore(centers=args.path, radii=args.radii, library=args.library)
+    with packing:
+        n = len(packing)
+        print(f'{n} particles, {"mapped" if packing.mapped else "decoded"}')
+        for name in ['x', 'y', 'z', 'r']:
+            column = packing.column(name)
+            if n:
+                print(f'  {name}: {min(column):.6g} .. {max(column):.6g}')
+        for name in packing.properties:
+            print(f'  property {name}: {packing.column(name).shape}')
+
+
+if __name__ == '__main__':
+    main()
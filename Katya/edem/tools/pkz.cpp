@@ -0,0 +1,104 @@
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+
+#include "packingcodec.h"
+
+static void usage()
+{
+    fprintf(stderr,
+            "usage: pkz encode <centers> <radii> <out.pkz> [options]\n"
+            "         --tolerance <e>          largest change of a coordinate (1e-6)\n"
+            "         --radius-tolerance <e>   largest change of a radius (as --tolerance)\n"
+            "         --block <n>              particles per block (4096)\n"
+            "         --keep-order             store the source order\n"
+            "         --threads <n>            0 for one per hardware thread\n"
+            "       pkz decode <in.pkz> <centers> <radii> [--threads <n>]\n");
+}
+
+int main( int argc, char *argv[] )
+{
+    if (argc < 5)
+    {
+        usage();
+        return 1;
+    }
+    const std::string command = argv[1];
+
+    CPackingCodec::SParams params;
+    for (int a = 5; a < argc; a++)
+    {
+        const std::string option = argv[a];
+        const bool value = a + 1 < argc;
+        if (option == "--tolerance" && value)
+            params.tolerance = atof(argv[++a]);
+        else if (option == "--radius-tolerance" && value)
+            params.radiusTolerance = atof(argv[++a]);
+        else if (option == "--block" && value)
+            params.blockSize = size_t(atol(argv[++a]));
+        else if (option == "--keep-order")
+            params.keepOrder = true;
+        else if (option == "--threads" && value)
+            params.threads = size_t(atoi(argv[++a]));
+        else
+        {
+            usage();
+            return 1;
+        }
+    }
+
+    CPacking packing;
+    if (command == "encode")
+    {
+        if (!packing.read(argv[2], argv[3]))
+        {
+            fprintf(stderr, "cannot read packing %s, %s\n", argv[2], argv[3]);
+            return 1;
+        }
+        std::vector<uint8_t> bytes;
+        const auto start = std::chrono::steady_clock::now();
+        if (!CPackingCodec::encode(packing, params, bytes))
+        {
+            fprintf(stderr, "cannot quantise the packing to %g\n", params.tolerance);
+            return 1;
+        }
+        const double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        FILE *out = fopen(argv[4], "wb");
+        if (out == nullptr || fwrite(bytes.data(), 1, bytes.size(), out) != bytes.size() || fclose(out) != 0)
+        {
+            fprintf(stderr, "cannot write %s\n", argv[4]);
+            return 1;
+        }
+        const double binary = 32.0 * packing.size();
+        printf("%zu particles in %zu bytes (%.2f per particle, %.1fx smaller than binary) in %.3f s\n",
+               packing.size(), bytes.size(), double(bytes.size()) / std::max<size_t>(packing.size(), 1),
+               binary / bytes.size(), seconds);
+        return 0;
+    }
+    if (command == "decode")
+    {
+        CPackingCodec codec;
+        if (!codec.open(argv[2]))
+        {
+            fprintf(stderr, "cannot open %s\n", argv[2]);
+            return 1;
+        }
+        const auto start = std::chrono::steady_clock::now();
+        if (!codec.decode(packing, params.threads))
+        {
+            fprintf(stderr, "%s is damaged\n", argv[2]);
+            return 1;
+        }
+        const double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        if (!packing.write(argv[3], argv[4]))
+        {
+            fprintf(stderr, "cannot write %s, %s\n", argv[3], argv[4]);
+            return 1;
+        }
+        printf("%zu particles decoded in %.3f s\n", packing.size(), seconds);
+        return 0;
+    }
+    usage();
+    return 1;
+}
@@ -0,0 +1,512 @@
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <random>
+
+#include "defectclusters.h"
+#include "musenstore.h"
+#include "packingcodec.h"
+#include "packingsidecar.h"
+#include "packingstore.h"
+#include "voxelizer.h"
+
+static bool near( double a, double b, double tolerance )
+{
+    return std::fabs(a - b) <= tolerance;
+}
+
+int main()
+{
+    // two overlapping spheres: the fractions cover their union, the lens
+    // between them once
+    bool unionOk;
+    {
+        CPacking pair;
+        pair.x = {-0.2, 0.25};
+        pair.y = {0.013, -0.007};
+        pair.z = {0.004, 0.011};
+        pair.r = {0.4, 0.35};
+        const double dx = 0.45, dy = -0.02, dz = 0.007, d = std::sqrt(dx * dx + dy * dy + dz * dz);
+        const double r1 = 0.4, r2 = 0.35;
+        const double lens = M_PI * (r1 + r2 - d) * (r1 + r2 - d) *
+                            (d * d + 2 * d * (r1 + r2) - 3 * (r1 - r2) * (r1 - r2)) / (12 * d);
+        const double exact = 4.0 / 3.0 * M_PI * (r1 * r1 * r1 + r2 * r2 * r2) - lens;
+        CVoxelizer::SParams params;
+        params.lo[0] = params.lo[1] = params.lo[2] = -0.7;
+        params.hi[0] = params.hi[1] = params.hi[2] = 0.7;
+        params.resolution = 56;
+        params.mode = CVoxelizer::EMode::eFraction;
+        CVoxelizer voxels;
+        unionOk = voxels.voxelize(pair, params);
+        const double volume = voxels.total().solid * std::pow(voxels.getVoxel(), 3);
+        unionOk = unionOk && near(volume, exact, 1e-3 * exact);
+        printf("union of two spheres %.6f, fractions %.6f: %s\n", exact, volume, unionOk ? "ok" : "FAILED");
+    }
+
+    // one sphere off the grid lines: fractions give its volume, occupancy roughly
+    bool sphereOk;
+    {
+        CPacking one;
+        one.x = {0.013};
+        one.y = {-0.021};
+        one.z = {0.007};
+        one.r = {0.5};
+        CVoxelizer::SParams params;
+        params.lo[0] = params.lo[1] = params.lo[2] = -0.6;
+        params.hi[0] = params.hi[1] = params.hi[2] = 0.6;
+        params.resolution = 48;
+        params.mode = CVoxelizer::EMode::eFraction;
+        params.samples = 16;
+        CVoxelizer voxels;
+        sphereOk = voxels.voxelize(one, params);
+        const double h3 = std::pow(voxels.getVoxel(), 3), exact = 4.0 / 3.0 * M_PI * 0.125;
+        const double fractionVolume = voxels.total().solid * h3;
+        params.mode = CVoxelizer::EMode::eOccupancy;
+        sphereOk = sphereOk && voxels.voxelize(one, params);
+        const double occupancyVolume = voxels.total().solid * h3;
+        sphereOk = sphereOk && near(fractionVolume, exact, 1e-5 * exact) && near(occupancyVolume, exact, 0.01 * exact);
+        printf("sphere volume %.8f, fractions %.8f, occupancy %.8f: %s\n",
+               exact, fractionVolume, occupancyVolume, sphereOk ? "ok" : "FAILED");
+    }
+
+    // the coords packing: both modes agree, overlaps keep the union below
+    // the sum of the spheres, the file keeps the volume and a box around
+    // everything reports the whole grid
+    bool packingOk;
+    {
+        CPacking packing;
+        packingOk = packing.read("../coords/Positions.txt", "../coords/Radii.txt");
+        double sphereVolume = 0;
+        for (double radius : packing.r)
+            sphereVolume += 4.0 / 3.0 * M_PI * radius * radius * radius;
+
+        const double lo[3] = {-10, -10, -10}, hi[3] = {10, 10, 10}, centre[3] = {1.5, 1.5, 1.5};
+        CBoxRegion everything(lo, hi);
+        CSphereRegion core(centre, 0.3);
+        CVoxelizer::SParams params;
+        params.resolution = 192;
+        params.regions = {&everything, &core};
+
+        CVoxelizer occupancy, fraction;
+        auto start = std::chrono::steady_clock::now();
+        packingOk = packingOk && occupancy.voxelize(packing, params);
+        const double occupancySeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        params.mode = CVoxelizer::EMode::eFraction;
+        start = std::chrono::steady_clock::now();
+        packingOk = packingOk && fraction.voxelize(packing, params);
+        const double fractionSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+        const double h3 = std::pow(fraction.getVoxel(), 3);
+        packingOk = packingOk &&
+                    fraction.total().solid * h3 <= sphereVolume &&
+                    near(occupancy.total().porosity(), fraction.total().porosity(), 0.01) &&
+                    fraction.regions()[0].voxels == fraction.total().voxels &&
+                    near(fraction.regions()[0].solid, fraction.total().solid, 1e-6 * fraction.total().solid) &&
+                    fraction.regions()[1].voxels > 0;
+
+        double slicesSolid = 0;
+        for (const SPorosity &slice : fraction.slices())
+            slicesSolid += slice.solid;
+        packingOk = packingOk && near(slicesSolid, fraction.total().solid, 1e-9 * slicesSolid);
+
+        const int *dims = fraction.getDims();
+        if (fraction.regions().size() == 2)
+            printf("coords packing on %d x %d x %d: porosity %.4f (occupancy %.4f), core %.4f, "
+                   "%.2f s fractions, %.2f s occupancy\n",
+                   dims[0], dims[1], dims[2], fraction.total().porosity(), occupancy.total().porosity(),
+                   fraction.regions()[1].porosity(), fractionSeconds, occupancySeconds);
+
+        // round trips: bits exactly, fractions to their quantisation
+        CVoxelizer reread;
+        bool fileOk = occupancy.write("voxels_test.vox") && reread.read("voxels_test.vox") &&
+                      reread.total().solid == occupancy.total().solid;
+        for (int k = 0; fileOk && k < dims[2]; k += 7)
+            for (int j = 0; j < dims[1]; j += 3)
+                for (int i = 0; i < dims[0]; i++)
+                    fileOk = fileOk && reread.value(i, j, k) == occupancy.value(i, j, k);
+        fileOk = fileOk && fraction.write("voxels_test.vox") && reread.read("voxels_test.vox") &&
+                 near(reread.total().solid, fraction.total().solid, 0.5 / 255 * fraction.total().voxels) &&
+                 near(reread.total().porosity(), fraction.total().porosity(), 1e-3);
+        FILE *file = fopen("voxels_test.vox", "rb");
+        long bytes = 0;
+        if (file != nullptr)
+        {
+            fseek(file, 0, SEEK_END);
+            bytes = ftell(file);
+            fclose(file);
+        }
+        remove("voxels_test.vox");
+        printf("fraction file %ld bytes for %.0f voxels: %s\n", bytes, fraction.total().voxels,
+               fileOk ? "ok" : "FAILED");
+        packingOk = packingOk && fileOk;
+    }
+
+    // compressed packings: every coordinate within the tolerance, shards
+    // decode alone, the kept order comes back, and the file is a fraction
+    // of the binary columns
+    bool codecOk = true;
+    {
+        CPacking packing;
+        codecOk = packing.read("../coords/Positions.txt", "../coords/Radii.txt");
+        SPackingProperty grain;
+        grain.name = "Grain ID";
+        for (size_t i = 0; i < packing.size(); i++)
+            grain.values.push_back(double(i % 17));
+        packing.properties.push_back(grain);
+
+        // a jittered lattice of a million particles for the ratio and the speed
+        CPacking large;
+        std::mt19937 rng(5);
+        std::uniform_real_distribution<double> jitter(-0.2, 0.2), radius(0.3, 0.45);
+        for (int k = 0; k < 100; k++)
+            for (int j = 0; j < 100; j++)
+                for (int i = 0; i < 100; i++)
+                {
+                    large.x.push_back(1e-3 * (i + jitter(rng)));
+                    large.y.push_back(1e-3 * (j + jitter(rng)));
+                    large.z.push_back(1e-3 * (k + jitter(rng)));
+                    large.r.push_back(1e-3 * radius(rng));
+                }
+
+        auto within = []( const CPacking &a, const CPacking &b, double tolerance, double radiusTolerance )
+        {
+            bool ok = a.size() == b.size();
+            for (size_t i = 0; ok && i < a.size(); i++)
+                ok = near(a.x[i], b.x[i], tolerance) && near(a.y[i], b.y[i], tolerance) &&
+                     near(a.z[i], b.z[i], tolerance) && near(a.r[i], b.r[i], radiusTolerance);
+            return ok;
+        };
+
+        for (const CPacking *source : {&packing, &large})
+        {
+            CPackingCodec::SParams params;
+            params.tolerance = source == &large ? 1e-7 : 1e-6;
+            params.keepOrder = true;
+            std::vector<uint8_t> bytes;
+            CPackingCodec codec;
+            CPacking decoded;
+            bool ok = CPackingCodec::encode(*source, params, bytes) && codec.open(bytes.data(), bytes.size());
+            auto start = std::chrono::steady_clock::now();
+            ok = ok && codec.decode(decoded);
+            const double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+            const double slack = 1e-12;
+            ok = ok && within(*source, decoded, params.tolerance + slack, params.tolerance + slack) &&
+                 decoded.properties.size() == source->properties.size() &&
+                 (source->properties.empty() || decoded.properties[0].values == source->properties[0].values);
+
+            // a shard in the middle matches its part of the stored order
+            CPacking stored, shard;
+            std::vector<uint32_t> storedIndex, shardIndex;
+            const size_t b0 = codec.blockCount() / 3, b1 = std::min(codec.blockCount(), b0 + 2);
+            ok = ok && codec.decodeBlocks(0, codec.blockCount(), stored, &storedIndex) &&
+                 codec.decodeBlocks(b0, b1, shard, &shardIndex) &&
+                 shard.size() == codec.blockBegin(b1) - codec.blockBegin(b0);
+            for (size_t i = 0; ok && i < shard.size(); i++)
+                ok = shard.x[i] == stored.x[codec.blockBegin(b0) + i] &&
+                     shardIndex[i] == storedIndex[codec.blockBegin(b0) + i];
+
+            // without the order the file is smaller and holds the same particles
+            params.keepOrder = false;
+            std::vector<uint8_t> unordered;
+            ok = ok && CPackingCodec::encode(*source, params, unordered) && unordered.size() < bytes.size();
+
+            // damage is caught, not decoded
+            std::vector<uint8_t> damaged(unordered.begin(), unordered.begin() + unordered.size() / 2);
+            CPackingCodec broken;
+            ok = ok && (!broken.open(damaged.data(), damaged.size()) || !broken.decode(decoded));
+
+            const double binary = 32.0 * source->size();
+            printf("codec %zu particles to %g: %.2f bytes per particle (%.1fx, %.1fx with order), "
+                   "decoded in %.1f ms: %s\n",
+                   source->size(), params.tolerance, double(unordered.size()) / source->size(),
+                   binary / unordered.size(), binary / bytes.size(), seconds * 1e3, ok ? "ok" : "FAILED");
+            codecOk = codecOk && ok;
+        }
+    }
+
+    // the C interface: a text packing opens through its sidecar and is
+    // mapped from then on, a sidecar with properties and a compressed
+    // file open directly, and failures leave a message
+    bool storeOk = true;
+    {
+        CPacking packing;
+        storeOk = packing.read("../coords/Positions.txt", "../coords/Radii.txt") &&
+                  packing.write("store_test_centers.txt", "store_test_radii.txt");
+        remove("store_test_centers.txt.pkc");
+
+        auto sameColumns = [&packing]( SPackingStore *store )
+        {
+            bool same = store != nullptr && pks_size(store) == packing.size();
+            const char *names[] = {"x", "y", "z", "r"};
+            const tLargeVector<double> *columns[] = {&packing.x, &packing.y, &packing.z, &packing.r};
+            for (int a = 0; same && a < 4; a++)
+            {
+                const double *column = pks_column(store, names[a]);
+                same = column != nullptr && pks_column_elements(store, names[a]) == 1;
+                for (size_t i = 0; same && i < packing.size(); i++)
+                    same = std::fabs(column[i] - (*columns[a])[i]) <= 1e-9 * (1 + 1e-9);
+            }
+            return same;
+        };
+
+        auto start = std::chrono::steady_clock::now();
+        SPackingStore *parsed = pks_open_text("store_test_centers.txt", "store_test_radii.txt");
+        const double parseTime = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        start = std::chrono::steady_clock::now();
+        SPackingStore *again = pks_open_text("store_test_centers.txt", "store_test_radii.txt");
+        const double mapTime = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        storeOk = storeOk && sameColumns(parsed) && pks_mapped(parsed) && sameColumns(again) && pks_mapped(again);
+        pks_close(parsed);
+        pks_close(again);
+
+        SPackingProperty grain;
+        grain.name = "Grain ID";
+        grain.elements = 2;
+        for (size_t i = 0; i < packing.size(); i++)
+        {
+            grain.values.push_back(double(i));
+            grain.values.push_back(double(i % 7));
+        }
+        packing.properties.push_back(grain);
+        SPackingStore *withGrain = nullptr;
+        if (CPackingSidecar::write("store_test.pkc", packing, 42) && (withGrain = pks_open("store_test.pkc")) != nullptr)
+        {
+            const double *values = pks_column(withGrain, "Grain ID");
+            storeOk = storeOk && sameColumns(withGrain) && pks_property_count(withGrain) == 1 &&
+                      strcmp(pks_property_name(withGrain, 0), "Grain ID") == 0 &&
+                      pks_column_elements(withGrain, "Grain ID") == 2 && values != nullptr &&
+                      values[2 * 100] == 100 && values[2 * 100 + 1] == 100 % 7;
+        }
+        else
+            storeOk = false;
+        pks_close(withGrain);
+        packing.properties.clear();
+
+        CPackingCodec::SParams params;
+        params.keepOrder = true;
+        params.tolerance = 1e-9;
+        SPackingStore *decoded = nullptr;
+        storeOk = storeOk && CPackingCodec::write("store_test.pkz", packing, params) &&
+                  (decoded = pks_open("store_test.pkz")) != nullptr && sameColumns(decoded) && !pks_mapped(decoded);
+        pks_close(decoded);
+
+        storeOk = storeOk && pks_open("store_test_radii.txt") == nullptr && strlen(pks_last_error()) > 0 &&
+                  pks_open("store_test_missing.pkc") == nullptr && pks_column(nullptr, "x") == nullptr;
+
+        for (const char *file : {"store_test_centers.txt", "store_test_radii.txt", "store_test_centers.txt.pkc",
+                                 "store_test.pkc", "store_test.pkz"})
+            remove(file);
+        printf("store %zu particles: parsed %.1f ms, mapped %.3f ms: %s\n", packing.size(), parseTime * 1e3,
+               mapTime * 1e3, storeOk ? "ok" : "FAILED");
+    }
+
+    // MUSEN exports: a particle export converted in several batches
+    // reads back by row, by id and by frame, bonds without coordinates
+    // get no frames, and a malformed line is reported by number
+    bool musenOk = true;
+    {
+        const size_t count = 3000, timePoints = 7;
+        std::mt19937 random(5);
+        std::vector<int64_t> ids(count);
+        for (size_t i = 0; i < count; i++)
+            ids[i] = int64_t(i * 3 + 11);
+        std::shuffle(ids.begin(), ids.end(), random);
+        auto coordinate = []( int64_t id, size_t t, int a ) { return 1e-3 * double(id) + 0.25 * double(t) - a; };
+
+        FILE *file = fopen("musen_test_particles.txt", "w");
+        FILE *bonds = fopen("musen_test_bonds.txt", "w");
+        musenOk = file != nullptr && bonds != nullptr;
+        for (size_t i = 0; musenOk && i < count; i++)
+        {
+            fprintf(file, "0 %lld 7 1 5 %.17g", (long long)ids[i], 1e-4 * double(i % 13 + 1));
+            fprintf(bonds, "0 %lld 5 %lld %lld 24 0 %.17g 23 %s", (long long)ids[i], (long long)i, (long long)i + 1,
+                    0.5 * double(i), i % 3 == 0 ? "Glass" : "Steel");
+            for (size_t t = 0; t < timePoints; t++)
+            {
+                fprintf(file, " 2 %.17g 12 %.17g %.17g %.17g", 0.25 * double(t), coordinate(ids[i], t, 0),
+                        coordinate(ids[i], t, 1), coordinate(ids[i], t, 2));
+                fprintf(bonds, " 2 %.17g", 0.25 * double(t));
+            }
+            fprintf(file, i % 500 == 0 ? " \n\n" : "\n");
+            fprintf(bonds, "\n");
+        }
+        if (file != nullptr)
+            fclose(file);
+        if (bonds != nullptr)
+            fclose(bonds);
+
+        CMusenConverter::SParams params;
+        params.threads = 3;
+        params.batchBytes = 24 * timePoints * 700;
+        CMusenConverter::SReport report;
+        std::string error;
+        CMusenStore store;
+        musenOk = musenOk &&
+                  CMusenConverter::convert("musen_test_particles.txt", EMusenKind::eParticles, "musen_test.mcs",
+                                           params, report, error) &&
+                  report.batches == 5 && store.open("musen_test.mcs") && store.size() == count &&
+                  store.timePoints() == timePoints && store.hasCoordinates() && store.timeIndex(0.3) == 2;
+        for (size_t k = 0; musenOk && k < count; k += 37)
+        {
+            const int64_t id = ids[(k * 7919) % count];
+            const int64_t row = store.row(id);
+            musenOk = row >= 0 && store.ids()[row] == id && store.radius()[row] == 1e-4 * double(size_t(row) % 13 + 1);
+            for (size_t t = 0; musenOk && t < timePoints; t++)
+                for (int a = 0; a < 3; a++)
+                    musenOk = musenOk && store.frame(t, a)[row] == coordinate(id, t, a);
+        }
+        musenOk = musenOk && store.row(12) < 0 && store.times()[timePoints - 1] == 0.25 * double(timePoints - 1);
+        store.close();
+
+        musenOk = musenOk &&
+                  CMusenConverter::convert("musen_test_bonds.txt", EMusenKind::eBonds, "musen_test.mcs", params,
+                                           report, error) &&
+                  store.open("musen_test.mcs") && store.kind() == EMusenKind::eBonds && !store.hasCoordinates() &&
+                  store.materials() == 2 && strcmp(store.materialName(store.material()[0]), "Glass") == 0 &&
+                  strcmp(store.materialName(store.material()[1]), "Steel") == 0 && store.begin()[5] == 5 &&
+                  store.end()[5] == 6 && store.death()[8] == 4 && store.row(ids[8]) == 8;
+        store.close();
+
+        file = fopen("musen_test_bonds.txt", "a");
+        if (file != nullptr)
+        {
+            fprintf(file, "0 1 5 1 2 24 0 1 2 0 2 0.25\n");
+            fclose(file);
+        }
+        musenOk = musenOk &&
+                  !CMusenConverter::convert("musen_test_bonds.txt", EMusenKind::eBonds, "musen_test.mcs", params,
+                                            report, error) &&
+                  error.find(":3001: fewer time points") != std::string::npos &&
+                  store.open("musen_test.mcs") && store.size() == count;
+        store.close();
+
+        for (const char *name : {"musen_test_particles.txt", "musen_test_bonds.txt", "musen_test.mcs"})
+            remove(name);
+        printf("musen %zu entities x %zu time points: %s\n", count, timePoints, musenOk ? "ok" : "FAILED");
+    }
+
+    // defect clusters: the same clusters as a brute-force single linkage,
+    // cumulative windows that keep a crack's id as it grows, principal
+    // axes along a line of defects, and the time of a million defects
+    bool defectsOk = true;
+    {
+        const size_t count = 3000;
+        const double distance = 0.2;
+        std::mt19937 random(9);
+        std::uniform_real_distribution<double> box(0, 6);
+        std::vector<double> x(count), y(count), z(count), t(count);
+        for (size_t i = 0; i < count; i++)
+        {
+            x[i] = box(random);
+            y[i] = box(random);
+            z[i] = box(random);
+            t[i] = box(random);
+        }
+
+        std::vector<size_t> root(count);
+        for (size_t i = 0; i < count; i++)
+            root[i] = i;
+        auto findRoot = [&root]( size_t i )
+        {
+            while (root[i] != i)
+                i = root[i] = root[root[i]];
+            return i;
+        };
+        for (size_t i = 0; i < count; i++)
+            for (size_t j = 0; j < i; j++)
+                if ((x[i] - x[j]) * (x[i] - x[j]) + (y[i] - y[j]) * (y[i] - y[j]) + (z[i] - z[j]) * (z[i] - z[j]) <
+                    distance * distance)
+                    root[std::max(findRoot(i), findRoot(j))] = std::min(findRoot(i), findRoot(j));
+        std::vector<size_t> sizes(count, 0);
+        for (size_t i = 0; i < count; i++)
+            sizes[findRoot(i)]++;
+        size_t expectedClusters = 0;
+        for (size_t i = 0; i < count; i++)
+            expectedClusters += sizes[i] > 0;
+
+        CDefectClusters engine;
+        CDefectClusters::SParams params;
+        params.distance = distance;
+        params.threads = 3;
+        size_t windows = 0;
+        defectsOk = engine.cluster(x.data(), y.data(), z.data(), nullptr, count, params,
+            [&]( const CDefectClusters::SWindowStats &stats, const std::vector<SDefectCluster> &clusters )
+            {
+                windows++;
+                defectsOk = stats.clusters == expectedClusters && clusters.size() == expectedClusters &&
+                            stats.largest == *std::max_element(sizes.begin(), sizes.end());
+                for (const SDefectCluster &c : clusters)
+                    defectsOk = defectsOk && findRoot(c.first) == c.first && sizes[c.first] == c.size;
+            }) && defectsOk && windows == 1;
+        for (size_t i = 0; defectsOk && i < count; i++)
+            defectsOk = engine.clusterOf(i) == findRoot(i);
+
+        // a crack along (1, 2, 2) / 3 that grows by one defect per window,
+        // with a stray defect joining it in the last window
+        const size_t length = 50;
+        std::vector<double> cx, cy, cz, ct;
+        for (size_t k = 0; k < length; k++)
+        {
+            cx.push_back(10 + 0.1 * k / 3);
+            cy.push_back(10 + 0.2 * k / 3);
+            cz.push_back(10 + 0.2 * k / 3);
+            ct.push_back(double(k));
+        }
+        cx.push_back(10 + 0.1 * length / 3 + 0.15);
+        cy.push_back(cy.back());
+        cz.push_back(cz.back());
+        ct.push_back(double(length - 1));
+        params.windowEnds.clear();
+        for (size_t k = 0; k < length; k++)
+            params.windowEnds.push_back(double(k));
+        windows = 0;
+        defectsOk = defectsOk && engine.cluster(cx.data(), cy.data(), cz.data(), ct.data(), cx.size(), params,
+            [&]( const CDefectClusters::SWindowStats &stats, const std::vector<SDefectCluster> &clusters )
+            {
+                const size_t expected = stats.window + 1 + (stats.window + 1 == length ? 1 : 0);
+                defectsOk = defectsOk && stats.clusters == 1 && clusters.size() == 1 && clusters[0].first == 0 &&
+                            clusters[0].size == expected && stats.defects == expected;
+                windows++;
+            }) && windows == length;
+        params.windowEnds.clear();
+        defectsOk = defectsOk && engine.cluster(cx.data(), cy.data(), cz.data(), ct.data(), length, params,
+            [&]( const CDefectClusters::SWindowStats &, const std::vector<SDefectCluster> &clusters )
+            {
+                const SDefectCluster &c = clusters[0];
+                defectsOk = defectsOk && near(c.axes[0][0], 1.0 / 3, 1e-9) && near(c.axes[0][1], 2.0 / 3, 1e-9) &&
+                            near(c.axes[0][2], 2.0 / 3, 1e-9) && c.extent[1] < 1e-6 &&
+                            near(c.centroid[0], 10 + 0.1 * (length - 1) / 6, 1e-9) &&
+                            near(c.extent[0], 0.1 * std::sqrt((length * length - 1) / 12.0), 1e-9);
+            });
+
+        params.windowEnds = {1.5, 3, 4.5, 6};
+        const size_t many = 1000000;
+        std::uniform_real_distribution<double> wide(0, 100);
+        x.resize(many);
+        y.resize(many);
+        z.resize(many);
+        t.resize(many);
+        for (size_t i = 0; i < many; i++)
+        {
+            x[i] = wide(random);
+            y[i] = wide(random);
+            z[i] = wide(random);
+            t[i] = box(random);
+        }
+        size_t largest = 0, last = 0;
+        const auto start = std::chrono::steady_clock::now();
+        defectsOk = defectsOk && engine.cluster(x.data(), y.data(), z.data(), t.data(), many, params,
+            [&]( const CDefectClusters::SWindowStats &stats, const std::vector<SDefectCluster> & )
+            {
+                largest = stats.largest;
+                last = stats.defects;
+            }) && last == many;
+        const double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        printf("defect clusters %zu brute-force, %zu defects in 4 windows in %.2f s (largest %zu): %s\n",
+               expectedClusters, many, seconds, largest, defectsOk ? "ok" : "FAILED");
+    }
+
+    return unionOk && sphereOk && packingOk && codecOk && storeOk && musenOk && defectsOk ? 0 : 1;
+}
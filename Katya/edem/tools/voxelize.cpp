@@ -0,0 +1,122 @@
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "voxelizer.h"
+
+static void usage()
+{
+    fprintf(stderr,
+            "usage: voxelize <centers> <radii> <out.vox> [options]\n"
+            "  --resolution <n>   voxels along the longest edge (256)\n"
+            "  --voxel <edge>     voxel edge instead of a resolution\n"
+            "  --bounds <x0> <y0> <z0> <x1> <y1> <z1>\n"
+            "  --fraction         partial volume fractions instead of occupancy\n"
+            "  --samples <n>      lines per voxel edge of the fractions (4)\n"
+            "  --threads <n>      0 for one per hardware thread\n"
+            "  --region <text>    porosity of a region, see CRegion::parse; repeatable\n"
+            "  --slices <file>    per slice porosity as TSV\n");
+}
+
+int main( int argc, char *argv[] )
+{
+    if (argc < 4)
+    {
+        usage();
+        return 1;
+    }
+
+    CVoxelizer::SParams params;
+    std::vector<std::unique_ptr<CRegion>> regions;
+    std::vector<std::string> regionTexts;
+    const char *slicesFile = nullptr;
+    for (int a = 4; a < argc; a++)
+    {
+        const std::string option = argv[a];
+        const int left = argc - a - 1;
+        if (option == "--resolution" && left >= 1)
+            params.resolution = atoi(argv[++a]);
+        else if (option == "--voxel" && left >= 1)
+            params.voxel = atof(argv[++a]);
+        else if (option == "--bounds" && left >= 6)
+        {
+            for (int c = 0; c < 3; c++)
+                params.lo[c] = atof(argv[++a]);
+            for (int c = 0; c < 3; c++)
+                params.hi[c] = atof(argv[++a]);
+        }
+        else if (option == "--fraction")
+            params.mode = CVoxelizer::EMode::eFraction;
+        else if (option == "--samples" && left >= 1)
+            params.samples = atoi(argv[++a]);
+        else if (option == "--threads" && left >= 1)
+            params.threads = size_t(atoi(argv[++a]));
+        else if (option == "--region" && left >= 1)
+        {
+            regionTexts.push_back(argv[++a]);
+            regions.push_back(CRegion::parse(regionTexts.back()));
+            if (regions.back() == nullptr)
+            {
+                fprintf(stderr, "bad region: %s\n", argv[a]);
+                return 1;
+            }
+            params.regions.push_back(regions.back().get());
+        }
+        else if (option == "--slices" && left >= 1)
+            slicesFile = argv[++a];
+        else
+        {
+            usage();
+            return 1;
+        }
+    }
+
+    CPacking packing;
+    if (!packing.read(argv[1], argv[2]))
+    {
+        fprintf(stderr, "cannot read packing %s, %s\n", argv[1], argv[2]);
+        return 1;
+    }
+
+    CVoxelizer voxelizer;
+    const auto start = std::chrono::steady_clock::now();
+    if (!voxelizer.voxelize(packing, params))
+    {
+        fprintf(stderr, "cannot voxelize the packing\n");
+        return 1;
+    }
+    const double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    if (!voxelizer.write(argv[3]))
+    {
+        fprintf(stderr, "cannot write %s\n", argv[3]);
+        return 1;
+    }
+
+    const int *dims = voxelizer.getDims();
+    printf("%zu spheres on %d x %d x %d voxels of %g in %.2f s\n",
+           packing.size(), dims[0], dims[1], dims[2], voxelizer.getVoxel(), seconds);
+    printf("porosity %.6f\n", voxelizer.total().porosity());
+    for (size_t r = 0; r < regions.size(); r++)
+        printf("region %s: porosity %.6f over %.0f voxels\n", regionTexts[r].c_str(),
+               voxelizer.regions()[r].porosity(), voxelizer.regions()[r].voxels);
+
+    if (slicesFile != nullptr)
+    {
+        FILE *file = fopen(slicesFile, "w");
+        if (file == nullptr)
+        {
+            fprintf(stderr, "cannot write %s\n", slicesFile);
+            return 1;
+        }
+        fprintf(file, "z\tporosity\n");
+        for (size_t k = 0; k < voxelizer.slices().size(); k++)
+            fprintf(file, "%.9g\t%.6f\n", voxelizer.getOrigin()[2] + (k + 0.5) * voxelizer.getVoxel(),
+                    voxelizer.slices()[k].porosity());
+        fclose(file);
+    }
+    return 0;
+}